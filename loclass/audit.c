@@ -0,0 +1,385 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+/**
+  Audit mode: given a known key, check which authentications in a (large) corpus of
+  captured (CSN, CC, NR, MAC) records were made with that key.
+
+  The corpus is streamed in chunks. While the worker pool verifies one chunk, the next
+  one is read from disk. Each chunk is split into batches (one task each), and every
+  batch owns a byte-aligned slice of the result bitmap, so no locking is needed.
+  Diversified keys go through a shared divkey_cache, since the same cards recur over
+  and over in a reader log.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "audit.h"
+#include "cipherutils.h"
+#include "ikeys.h"
+#include "elite_crack.h"
+#include "optimized_cipher.h"
+#include "fileutils.h"
+#include "threadpool.h"
+#include "divkey_cache.h"
+#include "des.h"
+
+#define AUDIT_DEFAULT_BATCH 8192
+#define AUDIT_CACHE_SIZE (1 << 16)
+
+typedef struct {
+	bool elite;
+	uint8_t keytable[128];	// elite: hash2(K_cus)
+	des_context ctx;		// standard: key schedule of the master key
+	uint64_t keyid;
+	divkey_cache *cache;
+} audit_keys;
+
+typedef struct {
+	const audit_keys *keys;
+	const dumpdata *records;
+	size_t count;
+	uint8_t *bitmap;
+	uint64_t passed;
+} audit_task;
+
+static int audit_prepare(const audit_config *config, audit_keys *keys)
+{
+	memset(keys, 0, sizeof(audit_keys));
+	keys->elite = config->elite;
+	if(config->elite)
+	{
+		uint8_t k_cus[8];
+		memcpy(k_cus, config->key, 8);
+		hash2(k_cus, keys->keytable);
+		keys->keyid = divkey_keyid(keys->keytable, 128);
+	}else
+	{
+		keys->ctx.mode = DES_ENCRYPT;
+		des_setkey_enc(&keys->ctx, config->key);
+		keys->keyid = divkey_keyid(config->key, 8);
+	}
+	keys->cache = divkey_cache_create(AUDIT_CACHE_SIZE);
+	return keys->cache == NULL;
+}
+
+static void audit_worker(void *arg)
+{
+	audit_task *task = (audit_task*) arg;
+	const audit_keys *keys = task->keys;
+	uint8_t csn[8], cc_nr[12], div_key[8], mac[4];
+	des_context ctx = keys->ctx;
+	size_t n;
+
+	memset(task->bitmap, 0, (task->count + 7) / 8);
+	task->passed = 0;
+
+	for(n = 0 ; n < task->count ; n++)
+	{
+		const dumpdata *rec = &task->records[n];
+		memcpy(csn, rec->csn, 8);
+		if(keys->elite)
+			diversifyKeyEliteCached(keys->cache, keys->keyid, keys->keytable, csn, div_key);
+		else
+			diversifyKeyCached(keys->cache, keys->keyid, &ctx, csn, div_key);
+
+		memcpy(cc_nr, rec->cc_nr, 12);
+		opt_doReaderMAC(cc_nr, div_key, mac);
+		if(memcmp(mac, rec->mac, 4) == 0)
+		{
+			task->bitmap[n >> 3] |= 1 << (n & 7);
+			task->passed++;
+		}
+	}
+}
+
+static void audit_cachestats(audit_keys *keys, audit_summary *s)
+{
+	divkey_cache_counters c;
+	divkey_cache_stats(keys->cache, &c);
+	s->cache_hits = c.hits;
+	s->cache_misses = c.misses;
+}
+
+static size_t audit_batchsize(const audit_config *config)
+{
+	size_t batch = config->batch ? config->batch : AUDIT_DEFAULT_BATCH;
+	return (batch + 7) & ~(size_t) 7;
+}
+
+/**
+ * Verifies one chunk using the pool. Only submits, the caller waits.
+ */
+static size_t audit_submit(threadpool *pool, const audit_keys *keys, const dumpdata *records,
+						   size_t count, size_t batch, uint8_t *bitmap, audit_task *tasks)
+{
+	size_t ntasks = 0, offset;
+	for(offset = 0 ; offset < count ; offset += batch)
+	{
+		audit_task *t = &tasks[ntasks++];
+		t->keys = keys;
+		t->records = records + offset;
+		t->count = (count - offset) < batch ? (count - offset) : batch;
+		t->bitmap = bitmap + offset / 8;
+		t->passed = 0;
+		threadpool_submit(pool, audit_worker, t);
+	}
+	return ntasks;
+}
+
+static double audit_seconds(struct timespec *t1, struct timespec *t2)
+{
+	return (t2->tv_sec - t1->tv_sec) + (t2->tv_nsec - t1->tv_nsec) / 1e9;
+}
+
+static void audit_report(const audit_summary *s)
+{
+	double rate = s->seconds > 0 ? s->records / s->seconds : 0;
+	prnlog("[+] Audited %llu records in %f seconds (%.0f records/s, %.1fM records/min)",
+		   (unsigned long long) s->records, s->seconds, rate, rate * 60 / 1e6);
+	prnlog("[+] Passed: %llu  Failed: %llu",
+		   (unsigned long long) s->passed, (unsigned long long) s->failed);
+	uint64_t lookups = s->cache_hits + s->cache_misses;
+	prnlog("[+] Div key cache: %llu hits, %llu misses (%.1f%% hit rate)",
+		   (unsigned long long) s->cache_hits, (unsigned long long) s->cache_misses,
+		   lookups ? 100.0 * s->cache_hits / lookups : 0.0);
+}
+
+int auditRecords(const dumpdata *records, size_t count, const audit_config *config,
+				 uint8_t *bitmap, audit_summary *summary)
+{
+	struct timespec t1, t2;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	audit_keys keys;
+	if(audit_prepare(config, &keys))
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to set up div key cache");
+		return 1;
+	}
+
+	size_t batch = audit_batchsize(config);
+	size_t maxtasks = count / batch + 1;
+	audit_task *tasks = calloc(maxtasks, sizeof(audit_task));
+	uint8_t *bits = bitmap ? bitmap : malloc((count + 7) / 8 + 1);
+	threadpool *pool = threadpool_create(config->threads);
+	if(tasks == NULL || bits == NULL || pool == NULL)
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to set up audit workers");
+		free(tasks);
+		if(bits != bitmap) free(bits);
+		threadpool_destroy(pool);
+		divkey_cache_destroy(keys.cache);
+		return 1;
+	}
+
+	size_t i, ntasks = audit_submit(pool, &keys, records, count, batch, bits, tasks);
+	threadpool_wait(pool);
+
+	audit_summary s = {count, 0, 0, 0, 0, 0};
+	for(i = 0 ; i < ntasks ; i++)
+		s.passed += tasks[i].passed;
+	s.failed = s.records - s.passed;
+	audit_cachestats(&keys, &s);
+
+	threadpool_destroy(pool);
+	divkey_cache_destroy(keys.cache);
+	free(tasks);
+	if(bits != bitmap) free(bits);
+
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	s.seconds = audit_seconds(&t1, &t2);
+	if(summary) *summary = s;
+	return 0;
+}
+
+int auditFile(const char *filename, const audit_config *config, audit_summary *summary)
+{
+	FILE *f = fopen(filename, "rb");
+	if(!f) {
+		logmsg(LOG_LEVEL_ERROR, "Failed to open file '%s'", filename);
+		return 1;
+	}
+	FILE *out = NULL;
+	if(config->bitmap_file)
+	{
+		out = fopen(config->bitmap_file, "wb");
+		if(!out) {
+			logmsg(LOG_LEVEL_ERROR, "Failed to write to file '%s'", config->bitmap_file);
+			fclose(f);
+			return 1;
+		}
+	}
+
+	struct timespec t1, t2;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	audit_keys keys;
+	int prepared = audit_prepare(config, &keys);
+
+	threadpool *pool = threadpool_create(config->threads);
+	size_t batch = audit_batchsize(config);
+	// A few batches per worker per chunk keeps all cores busy despite uneven cache hit rates
+	size_t chunk = batch * 4 * (pool ? threadpool_size(pool) : 1);
+	size_t ntasks_max = chunk / batch;
+
+	dumpdata *buf[2] = { malloc(chunk * sizeof(dumpdata)), malloc(chunk * sizeof(dumpdata)) };
+	uint8_t *bits = malloc(chunk / 8);
+	audit_task *tasks = calloc(ntasks_max, sizeof(audit_task));
+	audit_summary s = {0, 0, 0, 0, 0, 0};
+	int cur = 0, errors = 0;
+
+	if(prepared || pool == NULL || buf[0] == NULL || buf[1] == NULL || bits == NULL || tasks == NULL)
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to set up audit workers");
+		errors = 1;
+		goto done;
+	}
+
+	bool stopped = false;
+	size_t count = fread(buf[cur], sizeof(dumpdata), chunk, f);
+	while(count > 0)
+	{
+		size_t i, ntasks = audit_submit(pool, &keys, buf[cur], count, batch, bits, tasks);
+		// Read the next chunk while this one is being verified
+		size_t next = fread(buf[cur ^ 1], sizeof(dumpdata), chunk, f);
+		threadpool_wait(pool);
+
+		for(i = 0 ; i < ntasks ; i++)
+			s.passed += tasks[i].passed;
+		s.records += count;
+
+		if(out && fwrite(bits, 1, (count + 7) / 8, out) != (count + 7) / 8)
+		{
+			logmsg(LOG_LEVEL_ERROR, "Failed to write to file '%s'", config->bitmap_file);
+			errors = 1;
+			stopped = true;
+			break;
+		}
+		cur ^= 1;
+		count = next;
+	}
+	if(ferror(f))
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to read from file '%s'", filename);
+		errors = 1;
+	}else if(!stopped && (!feof(f) || (ftell(f) % sizeof(dumpdata)) != 0))
+	{
+		logmsg(LOG_LEVEL_WARN, "Warning, trailing bytes in '%s' ignored (not a multiple of %d)", filename, (int) sizeof(dumpdata));
+	}
+	s.failed = s.records - s.passed;
+	audit_cachestats(&keys, &s);
+
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	s.seconds = audit_seconds(&t1, &t2);
+	audit_report(&s);
+	if(summary) *summary = s;
+
+done:
+	threadpool_destroy(pool);
+	divkey_cache_destroy(keys.cache);
+	free(buf[0]);
+	free(buf[1]);
+	free(bits);
+	free(tasks);
+	fclose(f);
+	if(out) fclose(out);
+	return errors;
+}
+
+// ----------------------------------------------------------------------------
+// TEST CODE BELOW
+// ----------------------------------------------------------------------------
+
+int testAudit()
+{
+	int errors = 0;
+	prnlog("[+] Testing audit...");
+
+	// Elite: every record in the example dump was made with this K_cus
+	{
+		uint8_t dump[24 * 126];
+		uint8_t bitmap[16];
+		audit_summary s;
+		audit_config config = {true, {0x5B,0x7C,0x62,0xC4,0x91,0xC1,0x1B,0x39}, 0, 16, NULL};
+
+		if(loadFile("iclass_dump.bin", dump, sizeof(dump)))
+			return 1;
+		// Break the MAC of record 5
+		dump[5 * 24 + 20] ^= 0x01;
+		auditRecords((dumpdata*) dump, 126, &config, bitmap, &s);
+		if(s.passed != 125 || (bitmap[0] & 0x20) || bitmap[0] != 0xDF || bitmap[15] != 0x3F)
+		{
+			logmsg(LOG_LEVEL_ERROR, "[+] FAILED: elite audit, passed %d of 126", (int) s.passed);
+			errors++;
+		}
+	}
+	// Standard key
+	{
+		uint8_t key[8] = {0x6c,0x8d,0x44,0xf9,0x2a,0x2d,0x01,0xbf};
+		dumpdata recs[20];
+		uint8_t div_key[8];
+		uint8_t bitmap[3];
+		audit_summary s;
+		audit_config config = {false, {0}, 2, 8, NULL};
+		int i;
+		memcpy(config.key, key, 8);
+		for(i = 0 ; i < 20 ; i++)
+		{
+			uint8_t csn[8] = {0x01,0x02,0x03,0x04,0xF7,0xFF,0x12,0xE0};
+			csn[0] = i % 3;	// recurring CSNs
+			memcpy(recs[i].csn, csn, 8);
+			memset(recs[i].cc_nr, 0xFF, 8);
+			recs[i].cc_nr[0] = 0xFE;
+			x_num_to_bytes(i * 0x01010101, 4, recs[i].cc_nr + 8);
+			diversifyKey(csn, key, div_key);
+			opt_doReaderMAC(recs[i].cc_nr, div_key, recs[i].mac);
+		}
+		recs[19].mac[3] ^= 0x80;
+		auditRecords(recs, 20, &config, bitmap, &s);
+		if(s.passed != 19 || bitmap[0] != 0xFF || bitmap[1] != 0xFF || (bitmap[2] & 0x0F) != 0x07)
+		{
+			logmsg(LOG_LEVEL_ERROR, "[+] FAILED: standard audit, passed %d of 20", (int) s.passed);
+			errors++;
+		}
+	}
+	if(!errors)
+		prnlog("[+] Audit OK!");
+	return errors;
+}
@@ -0,0 +1,99 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#ifndef AUDIT_H
+#define AUDIT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "elite_crack.h"
+
+/**
+ * Configuration for verifying a corpus of captured authentications against a known key.
+ * The corpus uses the same record layout as the dumpfiles (see dumpdata):
+ *		<8 byte CSN><8 byte CC><4 byte NR><4 byte MAC>
+ *		.. N times...
+ */
+typedef struct {
+	bool elite;					// key is K_cus (iclass format), div keys go via hash2/hash1
+	uint8_t key[8];				// standard: master key on NIST format. elite: K_cus on iclass format
+	int threads;				// worker threads, 0 = one per core
+	size_t batch;				// records per task, 0 = default. Rounded up to a multiple of 8
+	const char *bitmap_file;	// optional, one bit per record (LSB first), 1 = MAC verified
+} audit_config;
+
+typedef struct {
+	uint64_t records;
+	uint64_t passed;
+	uint64_t failed;
+	double seconds;
+	uint64_t cache_hits;		// div key cache
+	uint64_t cache_misses;
+} audit_summary;
+
+/**
+ * @brief Streams a corpus file, verifies each reader MAC and optionally writes a pass/fail bitmap.
+ * @param filename the corpus
+ * @param config
+ * @param summary where to put the totals, may be NULL
+ * @return 0 for ok, 1 for failz (I/O). Records that fail verification are not errors.
+ */
+int auditFile(const char *filename, const audit_config *config, audit_summary *summary);
+/**
+ * @brief Same as auditFile, but over records already in memory
+ * @param records
+ * @param count number of records
+ * @param config (bitmap_file is ignored)
+ * @param bitmap (count+7)/8 bytes, bit i is set when record i verified. May be NULL.
+ * @param summary may be NULL
+ * @return 0 for ok, 1 for failz
+ */
+int auditRecords(const dumpdata *records, size_t count, const audit_config *config,
+				 uint8_t *bitmap, audit_summary *summary);
+
+int testAudit();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AUDIT_H
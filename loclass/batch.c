@@ -0,0 +1,721 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cipherutils.h"
+#include "elite_crack.h"
+#include "fileutils.h"
+#include "threadpool.h"
+#include "batch.h"
+
+#define BATCH_PENDING	0
+#define BATCH_CACHED	1
+#define BATCH_REUSED	2
+#define BATCH_SOLVED	3
+#define BATCH_FAILED	4
+
+typedef struct {
+	char *path;
+	dumpdata *records;
+	size_t count;
+	uint64_t hash;
+} batch_dump;
+
+typedef struct {
+	char *name;
+	size_t *members;			// indices into the dumps
+	size_t nmembers;
+	dumpdata *records;			// distinct records of all members, in file order
+	size_t count;
+	uint64_t hash;
+	uint16_t keytable[128];
+	uint8_t kcus[8];
+	int state;
+	size_t same_as;				// for BATCH_REUSED, the earlier group
+	double seconds;
+} batch_group;
+
+typedef struct {
+	batch_dump *dumps;
+	size_t ndumps;
+	batch_group *groups;
+	size_t ngroups;
+} batch_job;
+
+static int compareRecords(const void *a, const void *b)
+{
+	return memcmp(a, b, sizeof(dumpdata));
+}
+
+uint64_t batchContentHash(const dumpdata *records, size_t count)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	dumpdata *sorted = malloc((count ? count : 1) * sizeof(dumpdata));
+	size_t i, j;
+
+	if(!sorted)
+		return 0;
+	memcpy(sorted, records, count * sizeof(dumpdata));
+	qsort(sorted, count, sizeof(dumpdata), compareRecords);
+	for(i = 0 ; i < count ; i++)
+	{
+		if(i > 0 && memcmp(&sorted[i], &sorted[i - 1], sizeof(dumpdata)) == 0)
+			continue;
+		const uint8_t *p = (const uint8_t *) &sorted[i];
+		for(j = 0 ; j < sizeof(dumpdata) ; j++)
+		{
+			h ^= p[j];
+			h *= 0x100000001b3ULL;
+		}
+	}
+	free(sorted);
+	return h;
+}
+
+static void cachePath(const char *dir, uint64_t hash, char *buf, size_t len)
+{
+	snprintf(buf, len, "%s/%016llx.keytable", dir, (unsigned long long) hash);
+}
+
+int batchCacheLoad(const char *dir, uint64_t hash, uint16_t keytable[128], bool *failed)
+{
+	char path[PATH_MAX];
+	unsigned int v;
+	int i, status;
+
+	cachePath(dir, hash, path, sizeof(path));
+	FILE *f = fopen(path, "r");
+	if(!f)
+		return 1;
+	if(fscanf(f, "loclass-keytable %d", &status) != 1)
+	{
+		fclose(f);
+		return 1;
+	}
+	for(i = 0 ; i < 128 ; i++)
+	{
+		if(fscanf(f, "%4x", &v) != 1)
+		{
+			prnlog("Ignoring broken cache entry '%s'", path);
+			fclose(f);
+			return 1;
+		}
+		keytable[i] = v;
+	}
+	fclose(f);
+	if(failed)
+		*failed = status != 0;
+	return 0;
+}
+
+int batchCacheStore(const char *dir, uint64_t hash, const uint16_t keytable[128], bool failed)
+{
+	char path[PATH_MAX], tmp[PATH_MAX + 8];
+	int i;
+
+	if(mkdir(dir, 0777) && errno != EEXIST)
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to create cache directory '%s'", dir);
+		return 1;
+	}
+	cachePath(dir, hash, path, sizeof(path));
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	FILE *f = fopen(tmp, "w");
+	if(!f)
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to write to file '%s'", tmp);
+		return 1;
+	}
+	// The keytable as 16 bit values, the high byte holds the crack markers
+	fprintf(f, "loclass-keytable %d\n", failed ? 1 : 0);
+	for(i = 0 ; i < 128 ; i++)
+		fprintf(f, "%04x%c", keytable[i] & (0xFF | CRACKED), (i & 15) == 15 ? '\n' : ' ');
+	if(fclose(f) || rename(tmp, path))
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to write to file '%s'", path);
+		unlink(tmp);
+		return 1;
+	}
+	return 0;
+}
+
+static int loadDump(batch_dump *d)
+{
+	FILE *f = fopen(d->path, "rb");
+	if(!f) {
+		logmsg(LOG_LEVEL_ERROR, "Failed to open file '%s'", d->path);
+		return 1;
+	}
+	fseek(f, 0, SEEK_END);
+	long fsize = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	d->count = fsize > 0 ? fsize / sizeof(dumpdata) : 0;
+	d->records = malloc((d->count ? d->count : 1) * sizeof(dumpdata));
+	if(d->count == 0 || !d->records || fread(d->records, sizeof(dumpdata), d->count, f) != d->count)
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to read from file '%s'", d->path);
+		fclose(f);
+		return 1;
+	}
+	fclose(f);
+	if(fsize % sizeof(dumpdata))
+		logmsg(LOG_LEVEL_WARN, "Warning: '%s' is %ld bytes, not a multiple of %d, ignoring the tail",
+			   d->path, fsize, (int) sizeof(dumpdata));
+	d->hash = batchContentHash(d->records, d->count);
+	return 0;
+}
+
+/**
+ * Adds a dump to the job, in the named group or (name NULL) a new group of its own.
+ * A path listed twice is loaded once.
+ */
+static int addDump(batch_job *job, const char *path, const char *group)
+{
+	size_t i, d;
+	batch_group *g = NULL;
+
+	for(d = 0 ; d < job->ndumps ; d++)
+		if(strcmp(job->dumps[d].path, path) == 0)
+			break;
+	if(d == job->ndumps)
+	{
+		batch_dump *dumps = realloc(job->dumps, (job->ndumps + 1) * sizeof(batch_dump));
+		if(!dumps)
+			return 1;
+		job->dumps = dumps;
+		memset(&dumps[d], 0, sizeof(batch_dump));
+		dumps[d].path = strdup(path);
+		job->ndumps++;
+		if(!dumps[d].path || loadDump(&dumps[d]))
+			return 1;
+	}
+	if(group == NULL)
+		group = path;
+	for(i = 0 ; i < job->ngroups ; i++)
+		if(strcmp(job->groups[i].name, group) == 0)
+			g = &job->groups[i];
+	if(g == NULL)
+	{
+		batch_group *groups = realloc(job->groups, (job->ngroups + 1) * sizeof(batch_group));
+		if(!groups)
+			return 1;
+		job->groups = groups;
+		g = &groups[job->ngroups++];
+		memset(g, 0, sizeof(batch_group));
+		g->name = strdup(group);
+		if(!g->name)
+			return 1;
+	}
+	for(i = 0 ; i < g->nmembers ; i++)
+		if(g->members[i] == d)
+			return 0;
+	size_t *members = realloc(g->members, (g->nmembers + 1) * sizeof(size_t));
+	if(!members)
+		return 1;
+	g->members = members;
+	g->members[g->nmembers++] = d;
+	return 0;
+}
+
+static int compareNames(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+static int readDirectory(batch_job *job, const char *dirname)
+{
+	DIR *dir = opendir(dirname);
+	struct dirent *e;
+	char **names = NULL;
+	size_t n = 0, i;
+	int errors = 0;
+
+	if(!dir)
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to open directory '%s'", dirname);
+		return 1;
+	}
+	while((e = readdir(dir)) != NULL)
+	{
+		char path[PATH_MAX];
+		struct stat st;
+		// Skip hidden files, this is also where a cache inside the directory lives
+		if(e->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", dirname, e->d_name);
+		if(stat(path, &st) || !S_ISREG(st.st_mode))
+			continue;
+		char **more = realloc(names, (n + 1) * sizeof(char*));
+		if(!more || !(more[n] = strdup(path)))
+		{
+			names = more;
+			errors = 1;
+			break;
+		}
+		names = more;
+		n++;
+	}
+	closedir(dir);
+	// Same order regardless of the file system
+	if(names)
+		qsort(names, n, sizeof(char*), compareNames);
+	for(i = 0 ; i < n ; i++)
+	{
+		if(!errors)
+			errors = addDump(job, names[i], strrchr(names[i], '/') + 1);
+		free(names[i]);
+	}
+	free(names);
+	if(!errors && n == 0)
+	{
+		prnlog("No dumps in '%s'", dirname);
+		errors = 1;
+	}
+	return errors;
+}
+
+static int readManifest(batch_job *job, const char *filename)
+{
+	FILE *f = fopen(filename, "r");
+	char line[PATH_MAX + 256];
+	char base[PATH_MAX];
+	int lineno = 0, errors = 0;
+
+	if(!f)
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to open file '%s'", filename);
+		return 1;
+	}
+	// Paths in the manifest are relative to the manifest itself
+	snprintf(base, sizeof(base), "%s", filename);
+	char *slash = strrchr(base, '/');
+	if(slash)
+		slash[1] = 0;
+	else
+		base[0] = 0;
+
+	while(!errors && fgets(line, sizeof(line), f))
+	{
+		char *hash = strchr(line, '#');
+		char *file, *group, *extra;
+		char path[PATH_MAX];
+
+		lineno++;
+		if(hash)
+			*hash = 0;
+		file = strtok(line, " \t\r\n");
+		if(!file)
+			continue;
+		group = strtok(NULL, " \t\r\n");
+		extra = strtok(NULL, " \t\r\n");
+		if(extra)
+		{
+			logmsg(LOG_LEVEL_ERROR, "%s:%d: expected '<path> [<group>]'", filename, lineno);
+			errors = 1;
+			break;
+		}
+		if(file[0] == '/')
+			snprintf(path, sizeof(path), "%s", file);
+		else
+			snprintf(path, sizeof(path), "%s%s", base, file);
+		errors = addDump(job, path, group);
+	}
+	fclose(f);
+	if(!errors && job->ndumps == 0)
+	{
+		prnlog("No dumps in '%s'", filename);
+		errors = 1;
+	}
+	return errors;
+}
+
+/**
+ * Merges the records of the members, dropping records that were already seen,
+ * so overlapping dumps cost nothing extra.
+ */
+static int mergeGroup(batch_job *job, batch_group *g)
+{
+	size_t i, j, total = 0;
+
+	for(i = 0 ; i < g->nmembers ; i++)
+		total += job->dumps[g->members[i]].count;
+	g->records = malloc(total * sizeof(dumpdata));
+	dumpdata *sorted = malloc(total * sizeof(dumpdata));
+	size_t nsorted = 0;
+	if(!g->records || !sorted)
+	{
+		free(sorted);
+		return 1;
+	}
+	for(i = 0 ; i < g->nmembers ; i++)
+	{
+		batch_dump *d = &job->dumps[g->members[i]];
+		for(j = 0 ; j < d->count ; j++)
+		{
+			if(bsearch(&d->records[j], sorted, nsorted, sizeof(dumpdata), compareRecords))
+				continue;
+			g->records[g->count++] = d->records[j];
+			// Insertion keeps the seen-set sorted; groups are a few hundred records
+			size_t pos = nsorted;
+			while(pos > 0 && compareRecords(&sorted[pos - 1], &d->records[j]) > 0)
+			{
+				sorted[pos] = sorted[pos - 1];
+				pos--;
+			}
+			sorted[pos] = d->records[j];
+			nsorted++;
+		}
+	}
+	free(sorted);
+	g->hash = batchContentHash(g->records, g->count);
+	return 0;
+}
+
+static void groupKey(batch_group *g)
+{
+	uint64_t kcus = 0;
+
+	if(calculateMasterKeyFromKeytable(g->keytable, &kcus))
+		g->state = BATCH_FAILED;
+	memcpy(g->kcus, &kcus, 8);
+}
+
+static void solveGroup(void *arg)
+{
+	batch_group *g = (batch_group *) arg;
+	struct timespec t1, t2;
+	size_t i;
+	int errors = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	for(i = 0 ; i < g->count ; i++)
+		errors += bruteforceItem(g->records[i], g->keytable);
+	g->state = errors ? BATCH_FAILED : BATCH_SOLVED;
+	groupKey(g);
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	g->seconds = (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / 1e9;
+}
+
+static const char *stateName(int state)
+{
+	switch(state)
+	{
+	case BATCH_CACHED: return "cached";
+	case BATCH_REUSED: return "reused";
+	case BATCH_SOLVED: return "solved";
+	case BATCH_FAILED: return "FAILED";
+	default: return "pending";
+	}
+}
+
+static void freeJob(batch_job *job)
+{
+	size_t i;
+	for(i = 0 ; i < job->ndumps ; i++)
+	{
+		free(job->dumps[i].path);
+		free(job->dumps[i].records);
+	}
+	for(i = 0 ; i < job->ngroups ; i++)
+	{
+		free(job->groups[i].name);
+		free(job->groups[i].members);
+		free(job->groups[i].records);
+	}
+	free(job->dumps);
+	free(job->groups);
+}
+
+int batchCrack(const char *path, const batch_config *config, batch_summary *summary)
+{
+	batch_job job = {NULL, 0, NULL, 0};
+	batch_summary s;
+	struct timespec t1, t2;
+	struct stat st;
+	bool cache = config->cache_dir && config->cache_dir[0];
+	threadpool *pool = NULL;
+	size_t i, j;
+	int errors = 0;
+
+	memset(&s, 0, sizeof(s));
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	if(stat(path, &st))
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to open '%s'", path);
+		return 1;
+	}
+	errors = S_ISDIR(st.st_mode) ? readDirectory(&job, path) : readManifest(&job, path);
+	for(i = 0 ; !errors && i < job.ngroups ; i++)
+		errors = mergeGroup(&job, &job.groups[i]);
+	if(!errors && (pool = threadpool_create(config->threads)) == NULL)
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to set up batch workers");
+		errors = 1;
+	}
+	if(errors)
+	{
+		freeJob(&job);
+		return 1;
+	}
+
+	for(i = 0 ; i < job.ngroups ; i++)
+	{
+		batch_group *g = &job.groups[i];
+		bool failed = false;
+
+		s.records += g->count;
+		for(j = 0 ; j < i ; j++)
+		{
+			if(job.groups[j].hash == g->hash && job.groups[j].state != BATCH_REUSED)
+			{
+				g->state = BATCH_REUSED;
+				g->same_as = j;
+				break;
+			}
+		}
+		if(g->state == BATCH_REUSED)
+			continue;
+		if(errors)
+			continue;	// the pool refused work, leave the rest pending
+		if(cache && batchCacheLoad(config->cache_dir, g->hash, g->keytable, &failed) == 0)
+		{
+			g->state = BATCH_CACHED;
+			groupKey(g);
+			if(failed)
+				g->state = BATCH_FAILED;
+			continue;
+		}
+		// Start from whatever is known about the members
+		for(j = 0 ; cache && j < g->nmembers ; j++)
+		{
+			uint16_t known[128];
+			int k;
+			if(batchCacheLoad(config->cache_dir, job.dumps[g->members[j]].hash, known, NULL))
+				continue;
+			for(k = 0 ; k < 128 ; k++)
+				if((known[k] & CRACKED) && !(g->keytable[k] & CRACKED))
+					g->keytable[k] = known[k] & (0xFF | CRACKED);
+		}
+		if(threadpool_submit(pool, solveGroup, g))
+		{
+			logmsg(LOG_LEVEL_ERROR, "Failed to queue group '%s'", g->name);
+			errors = 1;
+		}
+	}
+	threadpool_wait(pool);
+	threadpool_destroy(pool);
+
+	for(i = 0 ; i < job.ngroups ; i++)
+	{
+		batch_group *g = &job.groups[i];
+		if(g->state == BATCH_REUSED)
+		{
+			memcpy(g->keytable, job.groups[g->same_as].keytable, sizeof(g->keytable));
+			memcpy(g->kcus, job.groups[g->same_as].kcus, 8);
+			if(job.groups[g->same_as].state == BATCH_FAILED || job.groups[g->same_as].state == BATCH_PENDING)
+				g->state = job.groups[g->same_as].state;
+		}
+		if(cache && (g->state == BATCH_SOLVED || g->state == BATCH_FAILED))
+		{
+			errors |= batchCacheStore(config->cache_dir, g->hash, g->keytable, g->state == BATCH_FAILED);
+			for(j = 0 ; j < g->nmembers ; j++)
+				errors |= batchCacheStore(config->cache_dir, job.dumps[g->members[j]].hash,
+										  g->keytable, g->state == BATCH_FAILED);
+		}
+		switch(g->state)
+		{
+		case BATCH_CACHED: s.cached++; break;
+		case BATCH_REUSED: s.reused++; break;
+		case BATCH_SOLVED: s.solved++; break;
+		default: s.failed++; break;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	s.dumps = job.ndumps;
+	s.groups = job.ngroups;
+	s.seconds = (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / 1e9;
+
+	prnlog("%s", "");
+	prnlog("group                     dumps  records  status  seconds  K_cus (iclass format)");
+	for(i = 0 ; i < job.ngroups ; i++)
+	{
+		batch_group *g = &job.groups[i];
+		const uint8_t *k = g->kcus;
+		if(g->state == BATCH_FAILED || g->state == BATCH_PENDING)
+			prnlog("%-24.24s  %5d  %7d  %-6s  %7.2f  -", g->name, (int) g->nmembers, (int) g->count,
+				   stateName(g->state), g->seconds);
+		else
+			prnlog("%-24.24s  %5d  %7d  %-6s  %7.2f  %02x%02x%02x%02x%02x%02x%02x%02x", g->name,
+				   (int) g->nmembers, (int) g->count, stateName(g->state), g->seconds,
+				   k[0],k[1],k[2],k[3],k[4],k[5],k[6],k[7]);
+	}
+	prnlog("%d dumps in %d groups: %d solved, %d cached, %d reused, %d failed in %.2f seconds",
+		   (int) s.dumps, (int) s.groups, (int) s.solved, (int) s.cached, (int) s.reused,
+		   (int) s.failed, s.seconds);
+
+	freeJob(&job);
+	if(summary) *summary = s;
+	return errors || s.failed ? 1 : 0;
+}
+
+// ----------------------------------------------------------------------------
+// TEST CODE BELOW
+// ----------------------------------------------------------------------------
+
+static int writeTestFile(const char *dir, const char *name, const void *data, size_t len)
+{
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	FILE *f = fopen(path, "wb");
+	if(!f)
+		return 1;
+	size_t n = fwrite(data, 1, len, f);
+	return fclose(f) || n != len;
+}
+
+static void removeTestDir(const char *dirname)
+{
+	DIR *dir = opendir(dirname);
+	struct dirent *e;
+	char path[PATH_MAX];
+	if(!dir)
+		return;
+	while((e = readdir(dir)) != NULL)
+	{
+		if(strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", dirname, e->d_name);
+		if(unlink(path))
+			removeTestDir(path);
+	}
+	closedir(dir);
+	rmdir(dirname);
+}
+
+int testBatch()
+{
+	int errors = 0;
+	char dir[] = "/tmp/loclass-batch-XXXXXX";
+	char cache[sizeof(dir) + 8], manifest[sizeof(dir) + 16];
+	dumpdata dump[126];
+	uint8_t k_cus[8] = {0x5B,0x7C,0x62,0xC4,0x91,0xC1,0x1B,0x39};
+	uint8_t table[128];
+	uint16_t keytable[128] = {0};
+	batch_config config = {2, cache};
+	batch_summary s;
+	int i, j;
+
+	prnlog("[+] Testing batch crack...");
+	if(loadFile("iclass_dump.bin", dump, sizeof(dump)))
+		return 1;
+	if(mkdtemp(dir) == NULL)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: could not create a temporary directory");
+		return 1;
+	}
+	snprintf(cache, sizeof(cache), "%s/.cache", dir);
+	snprintf(manifest, sizeof(manifest), "%s/manifest", dir);
+
+	// The dump in two halves, plus a copy of the second half. The first half has been
+	// cracked before: put the bytes it recovers in the cache, so only the second half
+	// needs work
+	const char *text =
+			"# two sites with the same K_cus\n"
+			"a.bin site\n"
+			"b.bin site\n"
+			"b-copy.bin site   # overlaps b.bin\n"
+			"a.bin again\n"
+			"b.bin again\n";
+	hash2(k_cus, table);
+	for(i = 0 ; i < 63 ; i++)
+	{
+		uint8_t key_index[8];
+		hash1(dump[i].csn, key_index);
+		for(j = 0 ; j < 8 ; j++)
+			keytable[key_index[j]] = table[key_index[j]] | CRACKED;
+	}
+	if(writeTestFile(dir, "a.bin", dump, 63 * sizeof(dumpdata))
+			|| writeTestFile(dir, "b.bin", dump + 63, 63 * sizeof(dumpdata))
+			|| writeTestFile(dir, "b-copy.bin", dump + 63, 63 * sizeof(dumpdata))
+			|| writeTestFile(dir, "manifest", text, strlen(text))
+			|| batchCacheStore(cache, batchContentHash(dump, 63), keytable, false))
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: could not write test files");
+		removeTestDir(dir);
+		return 1;
+	}
+
+	// 'again' has the same records as 'site', so one solve covers both
+	if(batchCrack(manifest, &config, &s) || s.dumps != 3 || s.groups != 2 || s.records != 252
+			|| s.solved != 1 || s.reused != 1 || s.cached != 0)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: batch over a manifest, %d solved, %d reused", (int) s.solved, (int) s.reused);
+		errors++;
+	}
+	// Second time round everything comes from the cache, also for the single dumps
+	if(batchCrack(manifest, &config, &s) || s.cached != 1 || s.reused != 1 || s.solved != 0)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: batch from the cache, %d cached", (int) s.cached);
+		errors++;
+	}
+	unlink(manifest);
+	if(batchCrack(dir, &config, &s) || s.dumps != 3 || s.groups != 3 || s.cached != 2 || s.reused != 1)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: batch over a directory, %d cached", (int) s.cached);
+		errors++;
+	}
+	if(batchCacheLoad(cache, batchContentHash(dump, 126), keytable, NULL) || keytable[0x45] != (0x7B | CRACKED))
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: merged keytable not in the cache");
+		errors++;
+	}
+	removeTestDir(dir);
+	if(errors == 0)
+		prnlog("[+] Batch crack tests ok");
+	return errors;
+}
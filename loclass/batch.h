@@ -0,0 +1,112 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "elite_crack.h"
+
+/**
+ * Cracks many dumps in one go. The input is either a directory, where every file is a
+ * dump of its own, or a manifest with one dump per line:
+ *		<path> [<group>]
+ * Dumps with the same group are known to share K_cus, their records are merged and
+ * solved as one keytable. Relative paths are relative to the manifest, # starts a comment.
+ *
+ * Each group is one task on a shared thread pool. With a cache directory, the keytable
+ * of every solved group is stored under the content hash of the group and of each of
+ * its dumps, so a resubmitted dump is not cracked again, and a group that overlaps
+ * earlier work starts from the key bytes already known.
+ */
+typedef struct {
+	int threads;				// worker threads, 0 = one per core
+	const char *cache_dir;		// NULL or "" disables the cache
+} batch_config;
+
+typedef struct {
+	size_t dumps;
+	size_t groups;
+	size_t records;				// distinct records over all groups
+	size_t cached;				// groups answered from the cache
+	size_t reused;				// groups identical to an earlier group in the same batch
+	size_t solved;
+	size_t failed;
+	double seconds;
+} batch_summary;
+
+/**
+ * @brief Cracks every group of a directory or manifest, and prints a table with the results
+ * @param path directory or manifest
+ * @param config
+ * @param summary where to put the totals, may be NULL
+ * @return 0 for ok, 1 for failz (I/O, or a group could not be cracked)
+ */
+int batchCrack(const char *path, const batch_config *config, batch_summary *summary);
+/**
+ * @brief Content hash of a set of records, independent of their order and of duplicates
+ * (FNV-1a 64 over the sorted, distinct records)
+ */
+uint64_t batchContentHash(const dumpdata *records, size_t count);
+/**
+ * @brief Reads a cached keytable
+ * @param dir cache directory
+ * @param hash content hash
+ * @param keytable where to put it, with the CRACKED markers as left by bruteforceItem
+ * @param failed set when the cached crack did not recover K_cus, may be NULL
+ * @return 0 for ok, 1 for failz (no such entry)
+ */
+int batchCacheLoad(const char *dir, uint64_t hash, uint16_t keytable[128], bool *failed);
+/**
+ * @brief Stores a keytable in the cache, creating the directory if needed
+ * @return 0 for ok, 1 for failz
+ */
+int batchCacheStore(const char *dir, uint64_t hash, const uint16_t keytable[128], bool failed);
+
+int testBatch();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BATCH_H
@@ -0,0 +1,692 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+/**
+  loclass-bench: micro benchmarks for the cipher primitives.
+
+  Every benchmark is a function running the primitive 'iters' times. The iteration count
+  is calibrated so one repetition takes about BENCH_REP_NS, then after a warmup the
+  repetitions are timed one by one, giving min / median / p99 ns per operation.
+  Results are printed as a table, and optionally written as JSON. With --compare, the
+  medians are checked against a JSON file from an earlier run, and anything slower
+  than the threshold is flagged as a regression (exit code 1).
+
+  On Linux, --perf also reads hardware counters (perf_event_open) over the timed
+  repetitions: cycles, instructions, L1D read misses and branch mispredicts, reported
+  per operation. Counters the kernel or CPU does not offer are left out.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <errno.h>
+#include "cipherutils.h"
+#include "cipher.h"
+#include "ikeys.h"
+#include "des.h"
+#include "elite_crack.h"
+#include "optimized_cipher.h"
+#include "fileutils.h"
+#include "tag_engine.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#define BENCH_REP_NS		5000000ULL		// 5 ms per repetition
+#define BENCH_WARMUP_NS		50000000ULL		// 50 ms warmup
+#define BENCH_DEFAULT_REPS	31
+#define BENCH_MAX_REPS		1000
+#define BENCH_MAX			32
+#define BENCH_DEFAULT_THRESHOLD	10.0		// percent
+
+typedef void (*bench_fn)(uint64_t iters);
+
+typedef struct {
+	const char *name;
+	bench_fn fn;
+} benchmark;
+
+typedef enum {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_L1D_MISSES,
+	PERF_BRANCH_MISSES,
+	PERF_COUNTERS
+} perf_counter;
+
+static const char *perf_names[PERF_COUNTERS] = {"cycles", "instructions", "l1d_misses", "branch_misses"};
+
+typedef struct {
+	const char *name;
+	uint64_t iters;			// per repetition
+	int reps;
+	double min_ns;			// all per operation
+	double median_ns;
+	double p99_ns;
+	double ops_per_sec;		// from the median
+	bool perf_valid[PERF_COUNTERS];
+	double perf_per_op[PERF_COUNTERS];
+} bench_result;
+
+// Results are written here, so the compiler can not drop the work
+static volatile uint8_t sink;
+
+static uint8_t div_key[8] = {0xE0,0x33,0xCA,0x41,0x9A,0xEE,0x43,0xF9};
+static uint8_t cc_nr[12] = {0xFE,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0,0,0,0};
+static uint8_t csn[8] = {0x01,0x02,0x03,0x04,0xF7,0xFF,0x12,0xE0};
+static uint8_t key[8] = {0x5B,0x7C,0x62,0xC4,0x91,0xC1,0x1B,0x39};
+
+static uint64_t now_ns()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static void bench_opt_doReaderMAC(uint64_t iters)
+{
+	uint8_t mac[4];
+	uint64_t n;
+	for(n = 0 ; n < iters ; n++)
+	{
+		cc_nr[11] = n;
+		opt_doReaderMAC(cc_nr, div_key, mac);
+		sink ^= mac[0];
+	}
+}
+
+static void bench_opt_doReaderMAC_spec(uint64_t iters)
+{
+	uint8_t mac[4], k[8];
+	uint64_t n;
+	opt_mac_spec spec;
+	opt_macSpecialize(cc_nr, &spec);
+	memcpy(k, div_key, 8);
+	for(n = 0 ; n < iters ; n++)
+	{
+		k[7] = n;
+		opt_doReaderMAC_spec(&spec, k, mac);
+		sink ^= mac[0];
+	}
+}
+
+static void bench_doReaderMAC(uint64_t iters)
+{
+	uint8_t mac[4];
+	uint64_t n;
+	for(n = 0 ; n < iters ; n++)
+	{
+		cc_nr[11] = n;
+		doReaderMAC(cc_nr, div_key, mac);
+		sink ^= mac[0];
+	}
+}
+
+static void bench_opt_doTagMAC_1(uint64_t iters)
+{
+	uint64_t n;
+	for(n = 0 ; n < iters ; n++)
+	{
+		cc_nr[7] = n;
+		State s = opt_doTagMAC_1(cc_nr, div_key);
+		sink ^= s.l;
+	}
+}
+
+static void bench_opt_doTagMAC_2(uint64_t iters)
+{
+	uint8_t mac[4];
+	uint64_t n;
+	State s = opt_doTagMAC_1(cc_nr, div_key);
+	for(n = 0 ; n < iters ; n++)
+	{
+		cc_nr[11] = n;
+		opt_doTagMAC_2(s, cc_nr + 8, mac, div_key);
+		sink ^= mac[0];
+	}
+}
+
+static void bench_tagRespond(uint64_t iters)
+{
+	uint8_t mac[4];
+	uint64_t n;
+	tag_card card;
+	tagCardInit(&card, div_key);
+	for(n = 0 ; n < iters ; n++)
+	{
+		cc_nr[11] = n;
+		tagRespond(&card, cc_nr, cc_nr + 8, mac);
+		sink ^= mac[0];
+	}
+	tagCardDestroy(&card);
+}
+
+static void bench_diversifyKey(uint64_t iters)
+{
+	uint8_t out[8];
+	uint64_t n;
+	for(n = 0 ; n < iters ; n++)
+	{
+		csn[0] = n;
+		diversifyKey(csn, key, out);
+		sink ^= out[0];
+	}
+}
+
+static void bench_hash0(uint64_t iters)
+{
+	uint8_t out[8];
+	uint64_t n;
+	for(n = 0 ; n < iters ; n++)
+	{
+		hash0(0x0102030405060708ULL ^ n, out);
+		sink ^= out[0];
+	}
+}
+
+static void bench_hash1(uint64_t iters)
+{
+	uint8_t out[8];
+	uint64_t n;
+	for(n = 0 ; n < iters ; n++)
+	{
+		csn[0] = n;
+		hash1(csn, out);
+		sink ^= out[0];
+	}
+}
+
+static void bench_hash2(uint64_t iters)
+{
+	uint8_t keytable[128];
+	uint64_t n;
+	for(n = 0 ; n < iters ; n++)
+	{
+		key[0] = n;
+		hash2(key, keytable);
+		sink ^= keytable[0];
+	}
+}
+
+static void bench_des_setkey_enc(uint64_t iters)
+{
+	des_context ctx;
+	uint64_t n;
+	for(n = 0 ; n < iters ; n++)
+	{
+		key[0] = n;
+		des_setkey_enc(&ctx, key);
+		sink ^= ctx.sk[0];
+	}
+}
+
+static void bench_des_crypt_ecb(uint64_t iters)
+{
+	des_context ctx = {DES_ENCRYPT, {0}};
+	uint8_t block[8] = {0};
+	uint64_t n;
+	des_setkey_enc(&ctx, key);
+	for(n = 0 ; n < iters ; n++)
+		des_crypt_ecb(&ctx, block, block);
+	sink ^= block[0];
+}
+
+static void bench_permutekey_rev(uint64_t iters)
+{
+	uint8_t out[8];
+	uint64_t n;
+	for(n = 0 ; n < iters ; n++)
+	{
+		key[0] = n;
+		permutekey_rev(key, out);
+		sink ^= out[0];
+	}
+}
+
+/*
+ * What bruteforceItem does per candidate, one at a time: piece together key_sel from
+ * the keytable, permute, diversify and compute the reader MAC. bruteforceItem itself
+ * runs these steps as a batched pipeline, see bench_bruteforce_pipeline.
+ */
+static void bench_bruteforce_scalar(uint64_t iters)
+{
+	static const uint8_t key_index[8] = {0x01,0x01,0x00,0x00,0x45,0x01,0x45,0x45};
+	static const uint8_t mac_wanted[4] = {0};
+	uint16_t keytable[128] = {0};
+	uint8_t key_sel[8], key_sel_p[8], divk[8], mac[4];
+	uint64_t n;
+	int i;
+	opt_mac_spec spec;
+	opt_macSpecialize(cc_nr, &spec);
+	for(n = 0 ; n < iters ; n++)
+	{
+		keytable[0x00] = n & 0xFF;
+		keytable[0x01] = (n >> 8) & 0xFF;
+		keytable[0x45] = (n >> 16) & 0xFF;
+		for(i = 0 ; i < 8 ; i++)
+			key_sel[i] = keytable[key_index[i]] & 0xFF;
+		permutekey_rev(key_sel, key_sel_p);
+		diversifyKey(csn, key_sel_p, divk);
+		opt_doReaderMAC_spec(&spec, divk, mac);
+		sink ^= memcmp(mac, mac_wanted, 4) == 0;
+	}
+}
+
+/*
+ * Per candidate cost of the batched pipeline bruteforceItem runs
+ */
+static void bench_bruteforce_pipeline(uint64_t iters)
+{
+	sink ^= crackCandidates(iters);
+}
+
+static const benchmark benchmarks[] = {
+	{"opt_doReaderMAC",				bench_opt_doReaderMAC},
+	{"opt_doReaderMAC_spec",		bench_opt_doReaderMAC_spec},
+	{"doReaderMAC",					bench_doReaderMAC},
+	{"opt_doTagMAC_1",				bench_opt_doTagMAC_1},
+	{"opt_doTagMAC_2",				bench_opt_doTagMAC_2},
+	{"tagRespond (cached CC)",		bench_tagRespond},
+	{"diversifyKey",				bench_diversifyKey},
+	{"hash0",						bench_hash0},
+	{"hash1",						bench_hash1},
+	{"hash2",						bench_hash2},
+	{"des_setkey_enc",				bench_des_setkey_enc},
+	{"des_crypt_ecb",				bench_des_crypt_ecb},
+	{"permutekey_rev",				bench_permutekey_rev},
+	{"bruteforceItem/candidate",	bench_bruteforce_pipeline},
+	{"scalar crack/candidate",		bench_bruteforce_scalar},
+};
+#define NBENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double*) a, y = *(const double*) b;
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Hardware counters. Each counter is opened on its own (not as a group), so that one
+ * the PMU does not have, typically L1D misses in a VM, does not take the others down.
+ */
+static int perf_fd[PERF_COUNTERS] = {-1, -1, -1, -1};
+
+#ifdef __linux__
+static int perf_open()
+{
+	static const struct {
+		uint32_t type;
+		uint64_t config;
+	} events[PERF_COUNTERS] = {
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+		{PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+	};
+	int i, opened = 0;
+	for(i = 0 ; i < PERF_COUNTERS ; i++)
+	{
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = events[i].type;
+		attr.config = events[i].config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		perf_fd[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		if(perf_fd[i] < 0)
+			fprintf(stderr, "[+] perf counter %s not available: %s\n", perf_names[i], strerror(errno));
+		else
+			opened++;
+	}
+	return opened ? 0 : 1;
+}
+
+static void perf_start()
+{
+	int i;
+	for(i = 0 ; i < PERF_COUNTERS ; i++)
+	{
+		if(perf_fd[i] < 0) continue;
+		ioctl(perf_fd[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(perf_fd[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+static void perf_stop(bench_result *r, uint64_t ops)
+{
+	int i;
+	for(i = 0 ; i < PERF_COUNTERS ; i++)
+	{
+		uint64_t value;
+		r->perf_valid[i] = false;
+		if(perf_fd[i] < 0) continue;
+		ioctl(perf_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+		if(read(perf_fd[i], &value, sizeof(value)) != sizeof(value)) continue;
+		r->perf_valid[i] = true;
+		r->perf_per_op[i] = (double) value / ops;
+	}
+}
+#else
+static int perf_open()
+{
+	fprintf(stderr, "[+] perf counters are only supported on Linux\n");
+	return 1;
+}
+static void perf_start() {}
+static void perf_stop(bench_result *r, uint64_t ops) { (void) r; (void) ops; }
+#endif
+
+static bool perf_enabled()
+{
+	int i;
+	for(i = 0 ; i < PERF_COUNTERS ; i++)
+		if(perf_fd[i] >= 0) return true;
+	return false;
+}
+
+static void run_benchmark(const benchmark *b, int reps, bench_result *r)
+{
+	double samples[BENCH_MAX_REPS];
+	uint64_t iters = 1, t, start;
+	int i;
+
+	// Calibrate: double the iteration count until a repetition takes long enough
+	for(;;)
+	{
+		t = now_ns();
+		b->fn(iters);
+		t = now_ns() - t;
+		if(t >= BENCH_REP_NS / 2 || iters >= (1ULL << 40)) break;
+		iters *= 2;
+	}
+	if(t > 0)
+		iters = iters * BENCH_REP_NS / t;
+	if(iters == 0) iters = 1;
+
+	// Warmup
+	start = now_ns();
+	while(now_ns() - start < BENCH_WARMUP_NS)
+		b->fn(iters);
+
+	memset(r, 0, sizeof(bench_result));
+	if(perf_enabled()) perf_start();
+	for(i = 0 ; i < reps ; i++)
+	{
+		t = now_ns();
+		b->fn(iters);
+		samples[i] = (double) (now_ns() - t) / iters;
+	}
+	if(perf_enabled()) perf_stop(r, iters * reps);
+	qsort(samples, reps, sizeof(double), cmp_double);
+
+	r->name = b->name;
+	r->iters = iters;
+	r->reps = reps;
+	r->min_ns = samples[0];
+	r->median_ns = samples[reps / 2];
+	// Nearest rank
+	r->p99_ns = samples[(99 * reps + 99) / 100 - 1];
+	r->ops_per_sec = r->median_ns > 0 ? 1e9 / r->median_ns : 0;
+}
+
+static int write_json(FILE *f, const bench_result *results, int n)
+{
+	int i;
+	fprintf(f, "{\n  \"benchmarks\": [\n");
+	for(i = 0 ; i < n ; i++)
+	{
+		const bench_result *r = &results[i];
+		int p;
+		fprintf(f, "    {\"name\": \"%s\", \"iterations\": %llu, \"reps\": %d, "
+				"\"min_ns\": %.3f, \"median_ns\": %.3f, \"p99_ns\": %.3f, \"ops_per_sec\": %.1f",
+				r->name, (unsigned long long) r->iters, r->reps,
+				r->min_ns, r->median_ns, r->p99_ns, r->ops_per_sec);
+		for(p = 0 ; p < PERF_COUNTERS ; p++)
+			if(r->perf_valid[p])
+				fprintf(f, ", \"%s_per_op\": %.3f", perf_names[p], r->perf_per_op[p]);
+		if(r->perf_valid[PERF_CYCLES] && r->perf_valid[PERF_INSTRUCTIONS] && r->perf_per_op[PERF_CYCLES] > 0)
+			fprintf(f, ", \"ipc\": %.3f", r->perf_per_op[PERF_INSTRUCTIONS] / r->perf_per_op[PERF_CYCLES]);
+		fprintf(f, "}%s\n", i + 1 < n ? "," : "");
+	}
+	fprintf(f, "  ]\n}\n");
+	return ferror(f) ? 1 : 0;
+}
+
+/*
+ * Finds the median of a benchmark in a JSON file written by write_json. This is not a
+ * general JSON parser, it only understands our own output.
+ * Returns 0 for ok, 1 if not found.
+ */
+static int baseline_median(const char *json, const char *name, double *median)
+{
+	char needle[128];
+	snprintf(needle, sizeof(needle), "\"name\": \"%s\"", name);
+	const char *p = strstr(json, needle);
+	if(p == NULL) return 1;
+	const char *end = strchr(p, '}');
+	p = strstr(p, "\"median_ns\":");
+	if(p == NULL || (end && p > end)) return 1;
+	*median = strtod(p + strlen("\"median_ns\":"), NULL);
+	return 0;
+}
+
+static char *read_text(const char *filename)
+{
+	FILE *f = fopen(filename, "rb");
+	if(!f) return NULL;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	char *text = malloc(size + 1);
+	if(text && fread(text, 1, size, f) != (size_t) size)
+	{
+		free(text);
+		text = NULL;
+	}
+	if(text) text[size] = 0;
+	fclose(f);
+	return text;
+}
+
+static int compare(FILE *out, const char *filename, const bench_result *results, int n, double threshold)
+{
+	char *json = read_text(filename);
+	int i, regressions = 0;
+	if(json == NULL)
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to read baseline '%s'", filename);
+		return 1;
+	}
+	fprintf(out, "\n");
+	fprintf(out, "%-26s %12s %12s %9s\n", "benchmark", "base ns/op", "now ns/op", "change");
+	for(i = 0 ; i < n ; i++)
+	{
+		double base;
+		if(baseline_median(json, results[i].name, &base) || base <= 0)
+		{
+			fprintf(out, "%-26s %12s %12.2f %9s\n", results[i].name, "-", results[i].median_ns, "new");
+			continue;
+		}
+		double change = 100.0 * (results[i].median_ns - base) / base;
+		bool regressed = change > threshold;
+		fprintf(out, "%-26s %12.2f %12.2f %+8.1f%%%s\n", results[i].name, base, results[i].median_ns,
+			   change, regressed ? "  REGRESSION" : "");
+		regressions += regressed;
+	}
+	free(json);
+	if(regressions)
+		fprintf(out, "[+] %d benchmark(s) regressed more than %.1f%%\n", regressions, threshold);
+	else
+		fprintf(out, "[+] No regressions (threshold %.1f%%)\n", threshold);
+	return regressions ? 1 : 0;
+}
+
+static void print_perf(FILE *out, const bench_result *results, int n)
+{
+	int i, p;
+	fprintf(out, "\n%-26s %12s %12s %8s %12s %12s\n", "benchmark", "cycles/op", "instr/op", "IPC",
+			"L1D miss/op", "br miss/op");
+	for(i = 0 ; i < n ; i++)
+	{
+		const bench_result *r = &results[i];
+		char col[PERF_COUNTERS][32], ipc[32] = "-";
+		for(p = 0 ; p < PERF_COUNTERS ; p++)
+		{
+			if(r->perf_valid[p]) snprintf(col[p], sizeof(col[p]), "%.2f", r->perf_per_op[p]);
+			else strcpy(col[p], "-");
+		}
+		if(r->perf_valid[PERF_CYCLES] && r->perf_valid[PERF_INSTRUCTIONS] && r->perf_per_op[PERF_CYCLES] > 0)
+			snprintf(ipc, sizeof(ipc), "%.2f", r->perf_per_op[PERF_INSTRUCTIONS] / r->perf_per_op[PERF_CYCLES]);
+		fprintf(out, "%-26s %12s %12s %8s %12s %12s\n", r->name, col[PERF_CYCLES], col[PERF_INSTRUCTIONS],
+				ipc, col[PERF_L1D_MISSES], col[PERF_BRANCH_MISSES]);
+	}
+}
+
+static void showHelp()
+{
+	prnlog("Usage: loclass-bench [options]");
+	prnlog("-j, --json <file>        Write results as JSON (- for stdout)");
+	prnlog("-c, --compare <file>     Compare against a JSON baseline, exit 1 on regressions");
+	prnlog("-T, --threshold <pct>    Slowdown of the median that counts as a regression (default %.0f)", BENCH_DEFAULT_THRESHOLD);
+	prnlog("-r, --reps <n>           Timed repetitions per benchmark (default %d)", BENCH_DEFAULT_REPS);
+	prnlog("-f, --filter <text>      Only run benchmarks whose name contains <text>");
+	prnlog("-p, --perf               Read hardware counters (Linux perf_event_open): cycles, instructions,");
+	prnlog("                         L1D misses and branch mispredicts per op, and IPC");
+	prnlog("-l, --list               List the benchmarks");
+	prnlog("-h, --help               Show this help");
+}
+
+int main(int argc, char **argv)
+{
+	const char *jsonFile = NULL, *baseline = NULL, *filter = NULL;
+	double threshold = BENCH_DEFAULT_THRESHOLD;
+	int reps = BENCH_DEFAULT_REPS;
+	bool perf = false;
+	bench_result results[BENCH_MAX];
+	int c, n = 0;
+	size_t i;
+
+	static struct option long_options[] = {
+		{"json",		required_argument,	0, 'j'},
+		{"compare",		required_argument,	0, 'c'},
+		{"threshold",	required_argument,	0, 'T'},
+		{"reps",		required_argument,	0, 'r'},
+		{"filter",		required_argument,	0, 'f'},
+		{"perf",		no_argument,		0, 'p'},
+		{"list",		no_argument,		0, 'l'},
+		{"help",		no_argument,		0, 'h'},
+		{0, 0, 0, 0}
+	};
+
+	while ((c = getopt_long (argc, argv, "j:c:T:r:f:plh", long_options, NULL)) != -1)
+		switch (c)
+		{
+		case 'j':
+			jsonFile = optarg;
+			break;
+		case 'c':
+			baseline = optarg;
+			break;
+		case 'T':
+			threshold = atof(optarg);
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			if(reps < 1) reps = 1;
+			if(reps > BENCH_MAX_REPS) reps = BENCH_MAX_REPS;
+			break;
+		case 'f':
+			filter = optarg;
+			break;
+		case 'p':
+			perf = true;
+			break;
+		case 'l':
+			for(i = 0 ; i < NBENCHMARKS ; i++)
+				prnlog("%s", benchmarks[i].name);
+			return 0;
+		case 'h':
+			showHelp();
+			return 0;
+		default:
+			return 1;
+		}
+
+	if(perf && perf_open())
+		fprintf(stderr, "[+] No perf counters, running without\n");
+
+	// With JSON on stdout, the table goes to stderr
+	FILE *table = (jsonFile && strcmp(jsonFile, "-") == 0) ? stderr : stdout;
+	fprintf(table, "%-26s %12s %12s %12s %14s %10s\n", "benchmark", "min ns/op", "median ns/op", "p99 ns/op", "ops/s", "iters/rep");
+	for(i = 0 ; i < NBENCHMARKS ; i++)
+	{
+		if(filter && strstr(benchmarks[i].name, filter) == NULL) continue;
+		bench_result *r = &results[n++];
+		run_benchmark(&benchmarks[i], reps, r);
+		fprintf(table, "%-26s %12.2f %12.2f %12.2f %14.0f %10llu\n", r->name, r->min_ns, r->median_ns,
+				r->p99_ns, r->ops_per_sec, (unsigned long long) r->iters);
+		fflush(table);
+	}
+
+	if(perf_enabled())
+		print_perf(table, results, n);
+
+	int errors = 0;
+	if(jsonFile)
+	{
+		FILE *f = strcmp(jsonFile, "-") == 0 ? stdout : fopen(jsonFile, "w");
+		if(f == NULL)
+		{
+			logmsg(LOG_LEVEL_ERROR, "Failed to write to file '%s'", jsonFile);
+			return 1;
+		}
+		errors += write_json(f, results, n);
+		if(f != stdout) fclose(f);
+	}
+	if(baseline)
+		errors += compare(table, baseline, results, n, threshold);
+	return errors ? 1 : 0;
+}
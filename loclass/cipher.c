@@ -46,6 +46,7 @@
 #include <time.h>
 #include "fileutils.h"
 #include "optimized_cipher.h"
+#include "loclass_config.h"
 
 /**
 * Definition 1 (Cipher state). A cipher state of iClass s is an element of F 40/2
@@ -166,16 +167,16 @@ State successor(uint8_t* k, State s, bool y)
 *	We define the successor function suc which takes a key k ∈ (F 82 ) 8 , a state s and
 *	an input y ∈ F 2 and outputs the successor state s ′ . We overload the function suc
 *	to multiple bit input x ∈ F n 2 which we define as
+*	suc(k, s, ǫ) = s
+*	suc(k, s, x 0 . . . x n ) = suc(k, successor(k, s, x 0 ), x 1 . . . x n )
+*	The bits are consumed from the head of the stream, x 0 first.
 * @param k - array containing 8 bytes
 **/
 State suc(uint8_t* k,State s, BitstreamIn *bitstream)
 {
-	if(bitsLeft(bitstream) == 0)
-	{
-		return s;
-	}
-	bool lastbit = tailBit(bitstream);
-	return successor(k,suc(k,s,bitstream), lastbit);
+	while(bitsLeft(bitstream) > 0)
+		s = successor(k, s, headBit(bitstream));
+	return s;
 }
 
 /**
@@ -188,15 +189,11 @@ State suc(uint8_t* k,State s, BitstreamIn *bitstream)
 **/
 void output(uint8_t* k,State s, BitstreamIn* in,  BitstreamOut* out)
 {
-	if(bitsLeft(in) == 0)
+	while(bitsLeft(in) > 0)
 	{
-		return;
+		pushBit(out,(s.r >> 2) & 1);
+		s = successor(k, s, headBit(in));
 	}
-	pushBit(out,(s.r >> 2) & 1);
-	//Remove first bit
-	uint8_t x0 = headBit(in);
-	State ss = successor(k,s,x0);
-	output(k,ss,in, out);
 }
 
 /**
@@ -222,52 +219,59 @@ void MAC(uint8_t* k, BitstreamIn input, BitstreamOut *out)
 	output(k,initState,&input_32_zeroes,out);
 }
 
+/**
+ * The same as MAC, on bytes as they are sent: every byte goes in LSB first, which is
+ * what the bit reversal in doReaderMAC did, and the MAC comes out LSB first as well.
+ */
+void macInit(mac_ctx *ctx, const uint8_t div_key[8])
+{
+	memcpy(ctx->k, div_key, 8);
+	ctx->s = kinit(ctx->k);
+}
+
+void macUpdate(mac_ctx *ctx, const uint8_t *data, size_t len)
+{
+	size_t i;
+	int bit;
+	for(i = 0 ; i < len ; i++)
+		for(bit = 0 ; bit < 8 ; bit++)
+			ctx->s = successor(ctx->k, ctx->s, (data[i] >> bit) & 1);
+}
+
+void macFinal(mac_ctx *ctx, uint8_t mac[4])
+{
+	int i;
+	memset(mac, 0, 4);
+	// output(k, s, 0^32)
+	for(i = 0 ; i < 32 ; i++)
+	{
+		mac[i >> 3] |= ((ctx->s.r >> 2) & 1) << (i & 7);
+		ctx->s = successor(ctx->k, ctx->s, 0);
+	}
+}
+
 void doReaderMAC(uint8_t *cc_nr_p, uint8_t *div_key_p, uint8_t mac[4])
 {
-	int length = 8+4;// CC - NR
-	uint8_t *cc_nr;
-    uint8_t div_key[8];
-	cc_nr=(uint8_t*)malloc(length);
-	memcpy(cc_nr,cc_nr_p,8+4);
-    memcpy(div_key,div_key_p,8);
-
-    reverse_arraybytes(cc_nr,length);
-    BitstreamIn bitstream = {cc_nr,length * 8,0};
-	uint8_t dest []= {0,0,0,0};
-    BitstreamOut out = { dest, sizeof(dest)*8, 0 };
-	MAC(div_key,bitstream, &out);
-    //The output MAC must also be reversed
-    reverse_arraybytes(dest, sizeof(dest));
-    memcpy(mac, dest, 4);
-    //printf("Calculated_MAC\t%02x%02x%02x%02x\n", dest[0],dest[1],dest[2],dest[3]);
-    free(cc_nr);
-    return;
+	mac_ctx ctx;
+	macInit(&ctx, div_key_p);
+	macUpdate(&ctx, cc_nr_p, 8 + 4);// CC - NR
+	macFinal(&ctx, mac);
 }
 void doTagMAC(uint8_t *cc_nr_p, uint8_t *div_key_p, uint8_t mac[4])
 {
-	int length = 8+4+4;// CC - NR - 32 bits zeroes
-	uint8_t *cc_nr_zeroes;
-	uint8_t div_key[8];
-	cc_nr_zeroes=(uint8_t*)malloc(length);
-	memset(cc_nr_zeroes , 0 , length);
-	memcpy(cc_nr_zeroes,cc_nr_p,8+4);
-	memcpy(div_key,div_key_p,8);
-
-	reverse_arraybytes(cc_nr_zeroes,8+4);
-	BitstreamIn bitstream_in = {cc_nr_zeroes,length * 8,0};
-	uint8_t dest []= {0,0,0,0};
-	BitstreamOut out = { dest, sizeof(dest)*8, 0 };
-	MAC(div_key,bitstream_in, &out);
-	//The output MAC must also be reversed
-	reverse_arraybytes(dest, sizeof(dest));
-	//memcpy(mac, dest, 8);
-	// should be 4?
-	memcpy(mac, dest, 4);
-	//printf("Calculated_MAC\t%02x%02x%02x%02x\n", dest[0],dest[1],dest[2],dest[3]);
-	free(cc_nr_zeroes);
-	return;
+	static const uint8_t zeroes_32[4] = {0,0,0,0};
+	mac_ctx ctx;
+	macInit(&ctx, div_key_p);
+	macUpdate(&ctx, cc_nr_p, 8 + 4);// CC - NR - 32 bits zeroes
+	macUpdate(&ctx, zeroes_32, 4);
+	macFinal(&ctx, mac);
 }
 
+// ----------------------------------------------------------------------------
+// TEST CODE BELOW
+// ----------------------------------------------------------------------------
+
+#ifndef LOCLASS_NO_TESTS
 
 int testOptMAC()
 {
@@ -302,12 +306,70 @@ int testOptMAC()
 			prnlog("[+] opt-MAC calculation OK!");
 		else{
 			errors ++;
-			prnlog("[+] opt-MAC CALCULATION FAIL!!");
+			logmsg(LOG_LEVEL_ERROR, "[+] opt-MAC CALCULATION FAIL!!");
+		}
+
+		opt_mac_spec spec;
+		opt_macSpecialize(cc_nr, &spec);
+		clock_t t5 = clock();
+		for(n=0 ; n < 40000; n++)
+		   opt_doReaderMAC_spec(&spec, div_key, calculated_mac);
+		clock_t t6 = clock();
+
+		if(memcmp(calculated_mac, correct_MAC,4) == 0)
+			prnlog("[+] specialized opt-MAC calculation OK!");
+		else{
+			errors ++;
+			logmsg(LOG_LEVEL_ERROR, "[+] specialized opt-MAC CALCULATION FAIL!!");
 		}
 
 		float diff1 = (((float)t2 - (float)t1) / CLOCKS_PER_SEC );
 		float diff2 = (((float)t4 - (float)t3) / CLOCKS_PER_SEC );
-		prnlog("\nStd: %f\nOpt: %f\n----",diff1, diff2);
+		float diff3 = (((float)t6 - (float)t5) / CLOCKS_PER_SEC );
+		prnlog("\nStd: %f\nOpt: %f\nSpec: %f\n----",diff1, diff2, diff3);
+
+		//Other keys and cc_nr, all bits of the input should matter
+		uint8_t key[8], input[12], mac_opt[4], mac_spec[4];
+		int i;
+		for(n = 0 ; n < 1000 ; n++)
+		{
+			for(i = 0 ; i < 8 ; i++) key[i] = rand();
+			for(i = 0 ; i < 12 ; i++) input[i] = rand();
+			opt_doReaderMAC(input, key, mac_opt);
+			opt_macSpecialize(input, &spec);
+			opt_doReaderMAC_spec(&spec, key, mac_spec);
+			if(memcmp(mac_opt, mac_spec, 4) != 0)
+			{
+				logmsg(LOG_LEVEL_ERROR, "[+] specialized opt-MAC differs from opt-MAC FAIL!!");
+				printvar("key", key, 8);
+				printvar("cc_nr", input, 12);
+				errors++;
+				break;
+			}
+		}
+		if(n == 1000)
+			prnlog("[+] specialized opt-MAC equals opt-MAC for random input : OK!");
+
+		//MAC over N bytes against the streaming reference, for lengths up to 300
+		uint8_t data[300];
+		mac_ctx ctx;
+		for(n = 0 ; n <= 300 ; n += 1 + n / 8)
+		{
+			for(i = 0 ; i < 8 ; i++) key[i] = rand();
+			for(i = 0 ; i < (int) n ; i++) data[i] = rand();
+			macInit(&ctx, key);
+			macUpdate(&ctx, data, n);
+			macFinal(&ctx, mac_spec);
+			opt_doMAC_N(data, n, key, mac_opt);
+			if(memcmp(mac_opt, mac_spec, 4) != 0)
+			{
+				logmsg(LOG_LEVEL_ERROR, "[+] opt-MAC over %u bytes CALCULATION FAIL!!", n);
+				errors++;
+				break;
+			}
+		}
+		if(n > 300)
+			prnlog("[+] opt-MAC over N bytes equals reference : OK!");
 
 
 	}
@@ -357,6 +419,41 @@ int testOptMAC()
 }
 
 
+/**
+ * A MAC over more than 255 bits, fed in uneven pieces, must match MAC() on the whole
+ * bitstream (bytes bit-reversed, as doReaderMAC used to do).
+ */
+static int testStreamingMAC()
+{
+	uint8_t div_key[8] = {0xE0,0x33,0xCA,0x41,0x9A,0xEE,0x43,0xF9};
+	uint8_t data[300], reversed[300], mac[4], expected[4] = {0};
+	BitstreamIn in = {reversed, sizeof(reversed) * 8, 0};
+	BitstreamOut out = {expected, sizeof(expected) * 8, 0};
+	mac_ctx ctx;
+	size_t i, n;
+
+	for(i = 0 ; i < sizeof(data) ; i++)
+		data[i] = (i * 37 + 11) & 0xFF;
+	memcpy(reversed, data, sizeof(data));
+	reverse_arraybytes(reversed, sizeof(reversed));
+	MAC(div_key, in, &out);
+	reverse_arraybytes(expected, 4);
+
+	macInit(&ctx, div_key);
+	for(i = 0, n = 1 ; i < sizeof(data) ; i += n, n = n * 2 + 1)
+		macUpdate(&ctx, data + i, i + n > sizeof(data) ? sizeof(data) - i : n);
+	macFinal(&ctx, mac);
+	if(memcmp(mac, expected, 4) != 0)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: streaming MAC over %d bytes", (int) sizeof(data));
+		printarr("    Streaming", mac, 4);
+		printarr("    MAC()    ", expected, 4);
+		return 1;
+	}
+	prnlog("[+] Streaming MAC OK!");
+	return 0;
+}
+
 int testMAC()
 {
 	prnlog("[+] Testing MAC calculation...");
@@ -376,11 +473,12 @@ int testMAC()
 
 	}else
 	{
-		prnlog("[+] FAILED: MAC calculation failed:");
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: MAC calculation failed:");
 		printarr("    Calculated_MAC", calculated_mac, 4);
 		printarr("    Correct_MAC   ", correct_MAC, 4);
 		return 1;
 	}
-
-	return 0;
+	return testStreamingMAC();
 }
+
+#endif // LOCLASS_NO_TESTS
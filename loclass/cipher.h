@@ -44,7 +44,27 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include <stddef.h>
 #include "cipherutils.h"
+#include "optimized_cipher.h"
+
+/**
+ * Streaming reference MAC: MAC(k, x) over any number of bytes, with no heap and no
+ * recursion. Bytes are in protocol order (as in cc_nr), each fed LSB first.
+ *		macInit(&ctx, div_key); macUpdate(&ctx, cc_nr, 12); macFinal(&ctx, mac);
+ * is the reader MAC.
+ */
+typedef struct {
+	uint8_t k[8];
+	State s;
+} mac_ctx;
+
+void macInit(mac_ctx *ctx, const uint8_t div_key[8]);
+void macUpdate(mac_ctx *ctx, const uint8_t *data, size_t len);
+/**
+ * @brief Feeds 32 zero bits while taking the output bits, the context is spent afterwards
+ */
+void macFinal(mac_ctx *ctx, uint8_t mac[4]);
 
 void doReaderMAC(uint8_t *cc_nr_p, uint8_t *div_key_p, uint8_t mac[4]);
 void doTagMAC(uint8_t *cc_nr_p, uint8_t *div_key_p, uint8_t mac[4]);
@@ -40,6 +40,7 @@
 #include <string.h>
 #include "fileutils.h"
 #include "cipherutils.h"
+#include "loclass_config.h"
 /**
  *
  * @brief Return and remove the first bit (x0) in the stream : <x0 x1 x2 x3 ... xn >
@@ -132,6 +133,52 @@ uint64_t x_bytes_to_num(uint8_t* src, size_t len)
 	}
 	return num;
 }
+/**
+ * @brief Parses a hex string, e.g. "5B7C62C491C11B39", into bytes. Spaces and
+ * colons between bytes are skipped.
+ * @param hex
+ * @param dest where to put the bytes
+ * @param len the number of bytes expected
+ * @return 0 for ok, 1 for failz (bad character, too short or too long)
+ */
+int hexToBytes(const char *hex, uint8_t *dest, size_t len)
+{
+	size_t n = 0;
+	int nibbles = 0;
+	uint8_t val = 0;
+	for( ; *hex ; hex++)
+	{
+		char c = *hex;
+		if(c == ' ' || c == ':') continue;
+		if(c >= '0' && c <= '9') val = (val << 4) | (c - '0');
+		else if(c >= 'a' && c <= 'f') val = (val << 4) | (c - 'a' + 10);
+		else if(c >= 'A' && c <= 'F') val = (val << 4) | (c - 'A' + 10);
+		else return 1;
+
+		if(++nibbles == 2)
+		{
+			if(n == len) return 1;
+			dest[n++] = val;
+			nibbles = 0;
+			val = 0;
+		}
+	}
+	return (n != len || nibbles != 0);
+}
+uint64_t splitmix64(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+uint64_t splitmix64At(uint64_t seed, uint64_t n)
+{
+	uint64_t state = seed + n * 0x9E3779B97F4A7C15ULL;
+	return splitmix64(&state);
+}
+
 uint8_t reversebytes(uint8_t b) {
 	b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
 	b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
@@ -140,7 +187,7 @@ uint8_t reversebytes(uint8_t b) {
 }
 void reverse_arraybytes(uint8_t* arr, size_t len)
 {
-	uint8_t i;
+	size_t i;
 	for( i =0; i< len ; i++)
 	{
 		arr[i] = reversebytes(arr[i]);
@@ -148,70 +195,83 @@ void reverse_arraybytes(uint8_t* arr, size_t len)
 }
 void reverse_arraycopy(uint8_t* arr, uint8_t* dest, size_t len)
 {
-	uint8_t i;
+	size_t i;
 	for( i =0; i< len ; i++)
 	{
 		dest[i] = reversebytes(arr[i]);
 	}
 }
 
-void printarr(char * name, uint8_t* arr, int len)
-{
-	int cx;
-	size_t outsize = 40+strlen(name)+len*5;
-	char* output = malloc(outsize);
-	memset(output, 0,outsize);
+/*
+ * The print functions below format into a line buffer on the stack. When a line is full
+ * it is logged, and the output continues on the next line.
+ */
+typedef struct {
+	char line[LOG_LINE_MAX];
+	int len;
+} line_buffer;
 
-	int i ;
-	cx = snprintf(output,outsize, "uint8_t %s[] = {", name);
-	for(i =0 ;  i< len ; i++)
+static void line_append(line_buffer *b, const char *text, int textlen)
+{
+	if(b->len + textlen >= (int) sizeof(b->line))
 	{
-		cx += snprintf(output+cx,outsize-cx,"0x%02x,",*(arr+i));//5 bytes per byte
+		prnlog("%s", b->line);
+		b->len = 0;
+		b->line[0] = 0;
 	}
-	cx += snprintf(output+cx,outsize-cx,"};");
-	prnlog(output);
+	memcpy(b->line + b->len, text, textlen + 1);
+	b->len += textlen;
 }
 
-void printvar(char * name, uint8_t* arr, int len)
+void printarr(char * name, uint8_t* arr, int len)
 {
-	int cx;
-	size_t outsize = 40+strlen(name)+len*2;
-	char* output = malloc(outsize);
-	memset(output, 0,outsize);
-
-	int i ;
-	cx = snprintf(output,outsize,"%s = ", name);
-	for(i =0 ;  i< len ; i++)
-	{
-		cx += snprintf(output+cx,outsize-cx,"%02x",*(arr+i));//2 bytes per byte
-	}
+	line_buffer b = {{0}, 0};
+	char piece[8];
+	int i;
+	b.len = snprintf(b.line, sizeof(b.line) - 8, "uint8_t %s[] = {", name);
+	if(b.len >= (int) sizeof(b.line) - 8) b.len = sizeof(b.line) - 9;
+	for(i = 0 ; i < len ; i++)
+		line_append(&b, piece, snprintf(piece, sizeof(piece), "0x%02x,", arr[i]));
+	line_append(&b, "};", 2);
+	prnlog("%s", b.line);
+}
 
-	prnlog(output);
+void printvar(char * name, uint8_t* arr, int len)
+{
+	line_buffer b = {{0}, 0};
+	char piece[4];
+	int i;
+	b.len = snprintf(b.line, sizeof(b.line) - 4, "%s = ", name);
+	if(b.len >= (int) sizeof(b.line) - 4) b.len = sizeof(b.line) - 5;
+	for(i = 0 ; i < len ; i++)
+		line_append(&b, piece, snprintf(piece, sizeof(piece), "%02x", arr[i]));
+	prnlog("%s", b.line);
 }
 
 void printarr_human_readable(char * title, uint8_t* arr, int len)
 {
-	int cx;
-	size_t outsize = 100+strlen(title)+len*4;
-	char* output = malloc(outsize);
-	memset(output, 0,outsize);
-
-
-	int i;
-	cx = snprintf(output,outsize,  "\n\t%s\n", title);
-	for(i =0 ;  i< len ; i++)
+	char row[16 + 16 * 3];
+	int i, cx = 0;
+	prnlog("%s", "");
+	prnlog("\t%s", title);
+	prnlog("%s", "");
+	for(i = 0 ; i < len ; i++)
 	{
 		if(i % 16 == 0)
-			cx += snprintf(output+cx,outsize-cx,"\n%02x| ", i );
-		cx += snprintf(output+cx,outsize-cx, "%02x ",*(arr+i));
+		{
+			if(i) prnlog("%s", row);
+			cx = snprintf(row, sizeof(row), "%02x| ", i);
+		}
+		cx += snprintf(row + cx, sizeof(row) - cx, "%02x ", arr[i]);
 	}
-	prnlog(output);
+	if(len) prnlog("%s", row);
 }
 
 //-----------------------------
 // Code for testing below
 //-----------------------------
 
+#ifndef LOCLASS_NO_TESTS
 
 int testBitStream()
 {
@@ -231,7 +291,7 @@ int testBitStream()
 		prnlog("    Bitstream test 1 ok");
 	}else
 	{
-		prnlog("    Bitstream test 1 failed");
+		logmsg(LOG_LEVEL_ERROR, "    Bitstream test 1 failed");
 		uint8_t i;
 		for(i = 0 ; i < sizeof(input) ; i++)
 		{
@@ -265,7 +325,7 @@ int testReversedBitstream()
 		prnlog("    Bitstream test 2 ok");
 	}else
 	{
-		prnlog("    Bitstream test 2 failed");
+		logmsg(LOG_LEVEL_ERROR, "    Bitstream test 2 failed");
 		uint8_t i;
 		for(i = 0 ; i < sizeof(input) ; i++)
 		{
@@ -285,3 +345,5 @@ int testCipherUtils(void)
 	retval |= testReversedBitstream();
 	return retval;
 }
+
+#endif // LOCLASS_NO_TESTS
@@ -49,14 +49,14 @@ extern "C" {
 
 typedef struct {
 	uint8_t * buffer;
-	uint8_t numbits;
-	uint8_t position;
+	uint32_t numbits;
+	uint32_t position;
 } BitstreamIn;
 
 typedef struct {
 	uint8_t * buffer;
-	uint8_t numbits;
-	uint8_t position;
+	uint32_t numbits;
+	uint32_t position;
 }BitstreamOut;
 
 bool headBit( BitstreamIn *stream);
@@ -70,6 +70,17 @@ void push6bits( BitstreamOut* stream, uint8_t bits);
 void EncryptDES(bool key[56], bool outBlk[64], bool inBlk[64], int verbose) ;
 void x_num_to_bytes(uint64_t n, size_t len, uint8_t* dest);
 uint64_t x_bytes_to_num(uint8_t* src, size_t len);
+int hexToBytes(const char *hex, uint8_t *dest, size_t len);
+/**
+ * @brief splitmix64, for test data and simulations (not for keys). Advances *state and
+ * returns the next 64 bits.
+ */
+uint64_t splitmix64(uint64_t *state);
+/**
+ * @brief Output n of the splitmix64 stream started at seed, without going through the
+ * ones before it, so that item n of a generated set does not depend on the others
+ */
+uint64_t splitmix64At(uint64_t seed, uint64_t n);
 uint8_t reversebytes(uint8_t b);
 void reverse_arraybytes(uint8_t* arr, size_t len);
 void reverse_arraycopy(uint8_t* arr, uint8_t* dest, size_t len);
@@ -0,0 +1,271 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "elite_crack.h"
+#include "fileutils.h"
+#include "crack_plan.h"
+#include "loclass_config.h"
+
+int crackPlan(const uint8_t *dump, size_t dumpsize, const uint16_t *keytable, crack_plan *plan)
+{
+	uint16_t table[128] = {0};
+	size_t itemsize = sizeof(dumpdata);
+	size_t i;
+	int j;
+
+	memset(plan, 0, sizeof(*plan));
+	plan->nitems = dumpsize / itemsize;
+	if(plan->nitems == 0)
+		return 0;
+	plan->items = calloc(plan->nitems, sizeof(crack_plan_item));
+	if(!plan->items)
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to allocate a plan for %d items", (int) plan->nitems);
+		return 1;
+	}
+	if(keytable)
+		memcpy(table, keytable, sizeof(table));
+
+	for(i = 0 ; i < plan->nitems ; i++)
+	{
+		const dumpdata *rec = (const dumpdata *) (dump + i * itemsize);
+		crack_plan_item *item = &plan->items[i];
+
+		memcpy(item->csn, rec->csn, 8);
+		hash1(item->csn, item->key_index);
+
+		// Same marking as bruteforceItem
+		for(j = 0 ; j < 8 ; j++)
+		{
+			uint8_t k = item->key_index[j];
+			if(table[k] & (CRACKED | BEING_CRACKED)) continue;
+			if(j == 7 && hash1ParityOnly(item->key_index))
+			{
+				item->parity_only = true;
+				plan->parity_only++;
+				break;
+			}
+			item->unknown[item->nunknown++] = k;
+			table[k] |= BEING_CRACKED;
+			if(item->nunknown > 3)
+				break;
+		}
+		if(item->nunknown > 3)
+		{
+			// bruteforceItem clears the marker on the first three only, so the
+			// fourth byte is skipped by later items too. Keep doing the same.
+			item->rejected = true;
+			for(j = 0 ; j < 3 ; j++)
+				table[item->unknown[j]] &= ~BEING_CRACKED;
+			plan->rejected++;
+			continue;
+		}
+		item->candidates = 1ULL << (8 * item->nunknown);
+		plan->candidates += item->candidates;
+		plan->candidates_expected += item->nunknown ? (item->candidates + 1) / 2 : 1;
+		for(j = 0 ; j < item->nunknown ; j++)
+			table[item->unknown[j]] = (table[item->unknown[j]] & 0xFF) | CRACKED;
+	}
+	for(j = 0 ; j < 16 ; j++)
+		if(table[j] & CRACKED)
+			plan->known_after++;
+	return 0;
+}
+
+void crackPlanSetRate(crack_plan *plan, double rate)
+{
+	plan->rate = rate;
+	plan->eta = rate > 0 ? plan->candidates_expected / rate : 0;
+	plan->eta_worst = rate > 0 ? plan->candidates / rate : 0;
+}
+
+static void formatSeconds(double s, char *buf, size_t len)
+{
+	if(s < 120)
+		snprintf(buf, len, "%.1f s", s);
+	else if(s < 7200)
+		snprintf(buf, len, "%.1f min", s / 60);
+	else
+		snprintf(buf, len, "%.1f h", s / 3600);
+}
+
+void printCrackPlan(const crack_plan *plan)
+{
+	size_t i;
+	int hist[5] = {0};
+	char eta[32], worst[32];
+
+	prnlog("item  CSN               hash1             bytes  unknown      candidates");
+	for(i = 0 ; i < plan->nitems ; i++)
+	{
+		const crack_plan_item *it = &plan->items[i];
+		const uint8_t *c = it->csn, *k = it->key_index;
+		char unknown[16] = "-";
+		int j, n = 0;
+
+		for(j = 0 ; j < it->nunknown && j < 3 ; j++)
+			n += snprintf(unknown + n, sizeof(unknown) - n, "%s%02x", j ? "," : "", it->unknown[j]);
+		hist[it->nunknown]++;
+		if(it->rejected)
+		{
+			prnlog("%4d  %02x%02x%02x%02x%02x%02x%02x%02x  %02x%02x%02x%02x%02x%02x%02x%02x  >3     REJECTED", (int) i,
+				   c[0],c[1],c[2],c[3],c[4],c[5],c[6],c[7], k[0],k[1],k[2],k[3],k[4],k[5],k[6],k[7]);
+			continue;
+		}
+		prnlog("%4d  %02x%02x%02x%02x%02x%02x%02x%02x  %02x%02x%02x%02x%02x%02x%02x%02x  %d      %-11s  %10llu", (int) i,
+			   c[0],c[1],c[2],c[3],c[4],c[5],c[6],c[7], k[0],k[1],k[2],k[3],k[4],k[5],k[6],k[7],
+			   it->nunknown, unknown, (unsigned long long) it->candidates);
+	}
+	prnlog("%s", "");
+	prnlog("Items           : %d (%d with 0 bytes, %d with 1, %d with 2, %d with 3)",
+		   (int) plan->nitems, hist[0], hist[1], hist[2], hist[3]);
+	prnlog("Rejected (>3)   : %d", (int) plan->rejected);
+	prnlog("Parity skipped  : %d (unknown k[7] bytes that only hit DES parity bits)", (int) plan->parity_only);
+	prnlog("Candidates      : %llu worst case, %llu expected",
+		   (unsigned long long) plan->candidates, (unsigned long long) plan->candidates_expected);
+	prnlog("Key bytes 0-15  : %d of 16 recovered", plan->known_after);
+	if(plan->rate > 0)
+	{
+		formatSeconds(plan->eta, eta, sizeof(eta));
+		formatSeconds(plan->eta_worst, worst, sizeof(worst));
+		prnlog("Rate            : %.0f candidates/s (this machine, one thread)", plan->rate);
+		prnlog("ETA             : %s expected, %s worst case", eta, worst);
+	}
+	if(plan->known_after < 16)
+		logmsg(LOG_LEVEL_WARN, "Warning: the dump does not cover all of the first 16 key bytes, the master key cannot be calculated");
+}
+
+void freeCrackPlan(crack_plan *plan)
+{
+	free(plan->items);
+	plan->items = NULL;
+	plan->nitems = 0;
+}
+
+int crackPlanFile(const char *filename)
+{
+	crack_plan plan;
+	FILE *f = fopen(filename, "rb");
+	if(!f) {
+		logmsg(LOG_LEVEL_ERROR, "Failed to open file '%s'", filename);
+		return 1;
+	}
+	fseek(f, 0, SEEK_END);
+	long fsize = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	uint8_t *dump = malloc(fsize > 0 ? fsize : 1);
+	if(fsize <= 0 || fread(dump, fsize, 1, f) != 1) {
+		logmsg(LOG_LEVEL_ERROR, "Failed to read from file '%s'", filename);
+		free(dump);
+		fclose(f);
+		return 1;
+	}
+	fclose(f);
+	if(fsize % sizeof(dumpdata))
+		logmsg(LOG_LEVEL_WARN, "Warning: '%s' is %ld bytes, not a multiple of %d, ignoring the tail",
+			   filename, fsize, (int) sizeof(dumpdata));
+
+	int errors = crackPlan(dump, fsize, NULL, &plan);
+	free(dump);
+	if(errors)
+		return 1;
+	crackPlanSetRate(&plan, calibrateCrackRate(0.2));
+	printCrackPlan(&plan);
+	errors = plan.rejected > 0 || plan.known_after < 16;
+	freeCrackPlan(&plan);
+	return errors;
+}
+
+// ----------------------------------------------------------------------------
+// TEST CODE BELOW
+// ----------------------------------------------------------------------------
+
+#ifndef LOCLASS_NO_TESTS
+
+int testCrackPlan()
+{
+	int errors = 0;
+	uint8_t dump[24 * 126];
+	crack_plan plan;
+	prnlog("[+] Testing crack plan...");
+
+	if(loadFile("iclass_dump.bin", dump, sizeof(dump)))
+		return 1;
+	if(crackPlan(dump, sizeof(dump), NULL, &plan))
+		return 1;
+	// The first record (hash1 0101000045014545) needs 01, 00 and 45
+	if(plan.nitems != 126 || plan.rejected != 0 || plan.known_after != 16
+			|| plan.items[0].nunknown != 3 || plan.items[0].unknown[0] != 0x01
+			|| plan.items[0].unknown[1] != 0x00 || plan.items[0].unknown[2] != 0x45)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: plan for iclass_dump.bin, %d items, %d rejected, %d known",
+			   (int) plan.nitems, (int) plan.rejected, plan.known_after);
+		errors++;
+	}
+	freeCrackPlan(&plan);
+
+	// With byte 0x01 already known, the first record needs only 00 and 45, a copy of it
+	// needs nothing, and 0123456789abcdef (hash1 0040286c28517002) needs 40,28,6c,51
+	{
+		uint16_t keytable[128] = {0};
+		uint8_t csn[8] = {0x01,0x23,0x45,0x67,0x89,0xab,0xcd,0xef};
+		keytable[0x01] = CRACKED | 0x12;
+		memcpy(dump + 24, dump, 24);
+		memcpy(dump + 48, csn, 8);
+		if(crackPlan(dump, 3 * 24, keytable, &plan))
+			return 1;
+		if(plan.items[0].nunknown != 2 || plan.items[1].nunknown != 0 || plan.items[1].candidates != 1
+				|| !plan.items[2].rejected || plan.items[2].unknown[3] != 0x51 || plan.rejected != 1
+				|| plan.candidates != 0x10001 || plan.candidates_expected != 0x8001)
+		{
+			logmsg(LOG_LEVEL_ERROR, "[+] FAILED: plan with a seeded keytable");
+			errors++;
+		}
+		freeCrackPlan(&plan);
+	}
+	if(errors == 0)
+		prnlog("[+] Crack plan tests ok");
+	return errors;
+}
+
+#endif // LOCLASS_NO_TESTS
@@ -0,0 +1,108 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#ifndef CRACK_PLAN_H
+#define CRACK_PLAN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * What bruteforceItem will do with one record of a dump, given the
+ * keytable as the earlier records leave it.
+ */
+typedef struct {
+	uint8_t csn[8];
+	uint8_t key_index[8];		// hash1(csn)
+	uint8_t nunknown;			// distinct key bytes not known before this item
+	uint8_t unknown[4];			// those indices, in the order they are bruteforced
+	bool rejected;				// needs > 3 bytes, bruteforceItem refuses it
+	bool parity_only;			// k[7] is unknown but a don't-care, see hash1ParityOnly
+	uint64_t candidates;		// worst case, 256^nunknown (1 when nothing is unknown)
+} crack_plan_item;
+
+typedef struct {
+	crack_plan_item *items;		// one per record, owned by the plan
+	size_t nitems;
+	size_t rejected;
+	size_t parity_only;			// items that skip a don't-care k[7]
+	uint64_t candidates;		// worst case over all items
+	uint64_t candidates_expected;	// (n+1)/2 per item, i.e. average over uniform keys
+	uint8_t known_after;		// of the first 16 key bytes (the ones the master key needs)
+	double rate;				// candidates per second, 0 if not calibrated
+	double eta;					// expected seconds at rate
+	double eta_worst;
+} crack_plan;
+
+/**
+ * @brief Computes hash1 for every record of a dump and simulates how bruteforceDump fills
+ * the keytable, without running any crypto.
+ * @param dump the dump, same layout as for bruteforceDump
+ * @param dumpsize in bytes
+ * @param keytable keytable to start from (as passed to bruteforceDump), NULL for an empty one.
+ * Not modified.
+ * @param plan where to put the plan, free with freeCrackPlan
+ * @return 0 for ok, 1 for failz
+ */
+int crackPlan(const uint8_t *dump, size_t dumpsize, const uint16_t *keytable, crack_plan *plan);
+/**
+ * @brief Fills in rate and the ETAs of a plan
+ * @param plan
+ * @param rate candidates per second, e.g. from calibrateCrackRate
+ */
+void crackPlanSetRate(crack_plan *plan, double rate);
+void printCrackPlan(const crack_plan *plan);
+void freeCrackPlan(crack_plan *plan);
+/**
+ * @brief Loads a dumpfile, calibrates the crack rate and prints the plan.
+ * @param filename
+ * @return 0 for ok, 1 for failz (I/O, or the dump cannot be fully cracked)
+ */
+int crackPlanFile(const char *filename);
+
+int testCrackPlan();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CRACK_PLAN_H
@@ -0,0 +1,138 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "crack_stats.h"
+#include "fileutils.h"
+
+static const char *const stage_names[CRACK_STAGES] = {
+	"keytable gather",
+	"permutekey_rev",
+	"des_setkey_enc",
+	"des_crypt_ecb",
+	"hash0",
+	"reader MAC",
+};
+
+const char *crackStageName(crack_stage stage)
+{
+	return stage < CRACK_STAGES ? stage_names[stage] : "?";
+}
+
+const char *crackTickUnit()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return "cycles";
+#else
+	return "ns";
+#endif
+}
+
+#ifdef LOCLASS_STATS
+
+__thread crack_stats crackStats;
+static __thread struct timespec item_start;
+static __thread uint64_t item_candidates;
+
+void crackStatsItemBegin()
+{
+	clock_gettime(CLOCK_MONOTONIC, &item_start);
+	item_candidates = crackStats.candidates;
+}
+
+void crackStatsItemEnd(int bytes, bool cracked)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	crack_item_stats *item = &crackStats.last_item;
+	item->candidates = crackStats.candidates - item_candidates;
+	item->bytes = bytes;
+	item->cracked = cracked;
+	item->seconds = (t.tv_sec - item_start.tv_sec) + (t.tv_nsec - item_start.tv_nsec) / 1e9;
+	crackStats.seconds += item->seconds;
+	crackStats.items++;
+	if(cracked) crackStats.items_cracked++;
+}
+
+int getCrackStats(crack_stats *stats)
+{
+	*stats = crackStats;
+	return 0;
+}
+
+void resetCrackStats()
+{
+	memset(&crackStats, 0, sizeof(crack_stats));
+}
+
+#else
+
+int getCrackStats(crack_stats *stats)
+{
+	memset(stats, 0, sizeof(crack_stats));
+	return 1;
+}
+
+void resetCrackStats()
+{
+}
+
+#endif // LOCLASS_STATS
+
+void printCrackStats(const crack_stats *stats)
+{
+	uint64_t total = 0;
+	int i;
+	for(i = 0 ; i < CRACK_STAGES ; i++)
+		total += stats->ticks[i];
+
+	prnlog("%s", "");
+	prnlog("%-18s %16s %8s %14s", "stage", crackTickUnit(), "share", "per candidate");
+	for(i = 0 ; i < CRACK_STAGES ; i++)
+	{
+		prnlog("%-18s %16llu %7.1f%% %14.1f", crackStageName(i), (unsigned long long) stats->ticks[i],
+			   total ? 100.0 * stats->ticks[i] / total : 0.0,
+			   stats->candidates ? (double) stats->ticks[i] / stats->candidates : 0.0);
+	}
+	prnlog("%-18s %16llu %7.1f%% %14.1f", "total", (unsigned long long) total, total ? 100.0 : 0.0,
+		   stats->candidates ? (double) total / stats->candidates : 0.0);
+	prnlog("[+] %llu items (%llu cracked), %llu candidates in %f seconds, %.0f candidates/s",
+		   (unsigned long long) stats->items, (unsigned long long) stats->items_cracked,
+		   (unsigned long long) stats->candidates, stats->seconds,
+		   stats->seconds > 0 ? stats->candidates / stats->seconds : 0.0);
+}
@@ -0,0 +1,151 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+#ifndef CRACK_STATS_H
+#define CRACK_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+  Optional instrumentation of the bruteforceItem loop. Build with -DLOCLASS_STATS
+  (e.g. make DEFINES=-DLOCLASS_STATS) to enable it; otherwise the macros below expand
+  to nothing and the crack loop is unchanged.
+
+  Stage times are in TSC cycles on x86, and in nanoseconds elsewhere. Stats are kept
+  per thread, getCrackStats returns those of the calling thread.
+**/
+
+typedef enum {
+	CRACK_STAGE_GATHER,		// key_sel from the keytable
+	CRACK_STAGE_PERMUTE,	// permutekey_rev
+	CRACK_STAGE_SETKEY,		// des_setkey_enc
+	CRACK_STAGE_ENCRYPT,	// des_crypt_ecb of the CSN
+	CRACK_STAGE_HASH0,		// hash0
+	CRACK_STAGE_MAC,		// doReaderMAC and compare
+	CRACK_STAGES
+} crack_stage;
+
+typedef struct {
+	uint64_t candidates;
+	int bytes;				// number of bytes bruteforced
+	bool cracked;
+	double seconds;
+} crack_item_stats;
+
+typedef struct {
+	uint64_t ticks[CRACK_STAGES];
+	uint64_t candidates;
+	uint64_t items;
+	uint64_t items_cracked;
+	double seconds;
+	crack_item_stats last_item;
+} crack_stats;
+
+/**
+ * @brief Copies the stats of the calling thread
+ * @param stats
+ * @return 0 for ok, 1 if built without LOCLASS_STATS (stats are then all zero)
+ */
+int getCrackStats(crack_stats *stats);
+/**
+ * @brief Zeroes the stats of the calling thread
+ */
+void resetCrackStats();
+/**
+ * @brief Prints a per-stage breakdown, candidates per second and per-item totals
+ */
+void printCrackStats(const crack_stats *stats);
+const char *crackStageName(crack_stage stage);
+/**
+ * @brief Unit of the stage ticks, "cycles" or "ns"
+ */
+const char *crackTickUnit();
+
+#ifdef LOCLASS_STATS
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t crack_ticks() { return __rdtsc(); }
+#else
+#include <time.h>
+static inline uint64_t crack_ticks()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+#endif
+
+extern __thread crack_stats crackStats;
+
+void crackStatsItemBegin();
+void crackStatsItemEnd(int bytes, bool cracked);
+
+#define CRACK_STATS_DECLARE			uint64_t _crack_ticks = 0
+#define CRACK_STATS_START()			(_crack_ticks = crack_ticks())
+#define CRACK_STATS_STAGE(stage)										\
+	do {																\
+		uint64_t _now = crack_ticks();									\
+		crackStats.ticks[stage] += _now - _crack_ticks;					\
+		_crack_ticks = _now;											\
+	} while(0)
+#define CRACK_STATS_CANDIDATE()		(crackStats.candidates++)
+#define CRACK_STATS_CANDIDATES(n)	(crackStats.candidates += (n))
+#define CRACK_STATS_ITEM_BEGIN()	crackStatsItemBegin()
+#define CRACK_STATS_ITEM_END(bytes, cracked) crackStatsItemEnd(bytes, cracked)
+
+#else
+
+#define CRACK_STATS_DECLARE			do {} while(0)
+#define CRACK_STATS_START()			do {} while(0)
+#define CRACK_STATS_STAGE(stage)	do {} while(0)
+#define CRACK_STATS_CANDIDATE()		do {} while(0)
+#define CRACK_STATS_CANDIDATES(n)	do {} while(0)
+#define CRACK_STATS_ITEM_BEGIN()	do {} while(0)
+#define CRACK_STATS_ITEM_END(bytes, cracked) do {} while(0)
+
+#endif // LOCLASS_STATS
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CRACK_STATS_H
@@ -297,6 +297,7 @@ static const uint32_t RHs[16] =
 
 #define SWAP(a,b) { uint32_t t = a; a = b; b = t; t = 0; }
 
+#if !defined(LOCLASS_DES_ECB_ONLY)
 static const unsigned char odd_parity_table[128] = { 1,  2,  4,  7,  8,
 		11, 13, 14, 16, 19, 21, 22, 25, 26, 28, 31, 32, 35, 37, 38, 41, 42, 44,
 		47, 49, 50, 52, 55, 56, 59, 61, 62, 64, 67, 69, 70, 73, 74, 76, 79, 81,
@@ -384,6 +385,7 @@ int des_key_check_weak( const unsigned char key[DES_KEY_SIZE] )
 
 	return( 0 );
 }
+#endif /* !LOCLASS_DES_ECB_ONLY */
 
 static void des_setkey( uint32_t SK[32], const unsigned char key[DES_KEY_SIZE] )
 {
@@ -482,6 +484,7 @@ int des_setkey_dec( des_context *ctx, const unsigned char key[DES_KEY_SIZE] )
 	return( 0 );
 }
 
+#if !defined(LOCLASS_DES_ECB_ONLY)
 static void des3_set2key( uint32_t esk[96],
 						  uint32_t dsk[96],
 						  const unsigned char key[DES_KEY_SIZE*2] )
@@ -581,6 +584,7 @@ int des3_set3key_dec( des3_context *ctx, const unsigned char key[DES_KEY_SIZE *
 
 	return( 0 );
 }
+#endif /* !LOCLASS_DES_ECB_ONLY */
 
 /*
  * DES-ECB block encryption/decryption
@@ -599,11 +603,20 @@ int des_crypt_ecb( des_context *ctx,
 
 	DES_IP( X, Y );
 
+#if defined(LOCLASS_SMALL)
+	/* One round per iteration, swapping the halves instead of alternating */
+	for( i = 0; i < 16; i++ )
+	{
+		DES_ROUND( Y, X );
+		T = X; X = Y; Y = T;
+	}
+#else
 	for( i = 0; i < 8; i++ )
 	{
 		DES_ROUND( Y, X );
 		DES_ROUND( X, Y );
 	}
+#endif
 
 	DES_FP( Y, X );
 
@@ -667,6 +680,7 @@ int des_crypt_cbc( des_context *ctx,
 }
 #endif /* POLARSSL_CIPHER_MODE_CBC */
 
+#if !defined(LOCLASS_DES_ECB_ONLY)
 /*
  * 3DES-ECB block encryption/decryption
  */
@@ -763,6 +777,7 @@ int des3_crypt_cbc( des3_context *ctx,
 	return( 0 );
 }
 #endif /* POLARSSL_CIPHER_MODE_CBC */
+#endif /* !LOCLASS_DES_ECB_ONLY */
 
 #endif /* !POLARSSL_DES_ALT */
 
@@ -28,6 +28,7 @@
 #define POLARSSL_DES_H
 
 //#include "config.h"
+#include "loclass_config.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -67,6 +68,7 @@ typedef struct
 }
 des_context;
 
+#if !defined(LOCLASS_DES_ECB_ONLY)
 /**
  * \brief          Triple-DES context structure
  */
@@ -107,6 +109,7 @@ int des_key_check_key_parity( const unsigned char key[DES_KEY_SIZE] );
  * \return         0 if no weak key was found, 1 if a weak key was identified.
  */
 int des_key_check_weak( const unsigned char key[DES_KEY_SIZE] );
+#endif /* !LOCLASS_DES_ECB_ONLY */
 
 /**
  * \brief          DES key schedule (56-bit, encryption)
@@ -128,6 +131,7 @@ int des_setkey_enc( des_context *ctx, const unsigned char key[DES_KEY_SIZE] );
  */
 int des_setkey_dec( des_context *ctx, const unsigned char key[DES_KEY_SIZE] );
 
+#if !defined(LOCLASS_DES_ECB_ONLY)
 /**
  * \brief          Triple-DES key schedule (112-bit, encryption)
  *
@@ -167,6 +171,7 @@ int des3_set3key_enc( des3_context *ctx, const unsigned char key[DES_KEY_SIZE *
  * \return         0
  */
 int des3_set3key_dec( des3_context *ctx, const unsigned char key[DES_KEY_SIZE * 3] );
+#endif /* !LOCLASS_DES_ECB_ONLY */
 
 /**
  * \brief          DES-ECB block encryption/decryption
@@ -200,6 +205,7 @@ int des_crypt_cbc( des_context *ctx,
 					unsigned char *output );
 #endif /* POLARSSL_CIPHER_MODE_CBC */
 
+#if !defined(LOCLASS_DES_ECB_ONLY)
 /**
  * \brief          3DES-ECB block encryption/decryption
  *
@@ -233,6 +239,7 @@ int des3_crypt_cbc( des3_context *ctx,
 					 const unsigned char *input,
 					 unsigned char *output );
 #endif /* POLARSSL_CIPHER_MODE_CBC */
+#endif /* !LOCLASS_DES_ECB_ONLY */
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,322 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "divkey_cache.h"
+#include "cipherutils.h"
+#include "fileutils.h"
+#include "ikeys.h"
+#include "elite_crack.h"
+#include "loclass_config.h"
+
+#define DK_PROBE	4	// entries looked at per lookup, two cache lines
+#define DK_STRIPES	16	// counter stripes, to keep threads off each others lines
+
+/**
+ * One entry is 32 bytes. The seq field is a seqlock: 0 means the slot was never used,
+ * odd means a writer is busy with it. Readers retry-free: if the sequence changed while
+ * reading, it's just a miss.
+ */
+typedef struct {
+	uint32_t seq;
+	uint32_t unused;
+	uint64_t csn;
+	uint64_t keyid;
+	uint64_t div_key;
+} divkey_entry;
+
+/**
+ * Per-thread counters, one cache line each. The cache struct is allocated 64-byte
+ * aligned, so the stripes array starts on a line and no two stripes share one.
+ */
+typedef struct {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t inserts;
+	uint64_t evictions;
+} __attribute__((aligned(64))) divkey_stripe;
+
+struct divkey_cache {
+	divkey_entry *entries;
+	void *mem;
+	size_t mask;
+	divkey_stripe stripes[DK_STRIPES];
+};
+
+static __thread int dk_stripe_id = -1;
+static int dk_stripe_next = 0;
+
+static divkey_stripe* dk_stripe(divkey_cache *cache)
+{
+	if(dk_stripe_id < 0)
+		dk_stripe_id = __atomic_fetch_add(&dk_stripe_next, 1, __ATOMIC_RELAXED) % DK_STRIPES;
+	return &cache->stripes[dk_stripe_id];
+}
+
+static inline uint64_t dk_hash(uint64_t csn, uint64_t keyid)
+{
+	// splitmix64 finalizer
+	uint64_t z = csn ^ (keyid * 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+divkey_cache* divkey_cache_create(size_t capacity)
+{
+	size_t n = DK_PROBE;
+	while(n < capacity) n <<= 1;
+
+	divkey_cache *cache = NULL;
+	if(posix_memalign((void**) &cache, 64, sizeof(divkey_cache)) != 0) return NULL;
+	memset(cache, 0, sizeof(divkey_cache));
+	cache->mem = calloc(n * sizeof(divkey_entry) + 64, 1);
+	if(cache->mem == NULL)
+	{
+		free(cache);
+		return NULL;
+	}
+	cache->entries = (divkey_entry*) (((uintptr_t) cache->mem + 63) & ~(uintptr_t) 63);
+	cache->mask = n - 1;
+	return cache;
+}
+
+void divkey_cache_destroy(divkey_cache *cache)
+{
+	if(cache == NULL) return;
+	free(cache->mem);
+	free(cache);
+}
+
+void divkey_cache_clear(divkey_cache *cache)
+{
+	memset(cache->entries, 0, (cache->mask + 1) * sizeof(divkey_entry));
+	memset(cache->stripes, 0, sizeof(cache->stripes));
+}
+
+bool divkey_cache_get(divkey_cache *cache, uint64_t keyid, const uint8_t csn_p[8], uint8_t div_key[8])
+{
+	uint64_t csn = x_bytes_to_num((uint8_t*) csn_p, 8);
+	size_t start = dk_hash(csn, keyid) & cache->mask & ~(size_t) 1;
+	int i;
+	for(i = 0 ; i < DK_PROBE ; i++)
+	{
+		divkey_entry *e = &cache->entries[(start + i) & cache->mask];
+		uint32_t s1 = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+		if(s1 == 0 || (s1 & 1)) continue;
+		uint64_t e_csn = __atomic_load_n(&e->csn, __ATOMIC_RELAXED);
+		uint64_t e_keyid = __atomic_load_n(&e->keyid, __ATOMIC_RELAXED);
+		uint64_t e_key = __atomic_load_n(&e->div_key, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&e->seq, __ATOMIC_RELAXED) != s1) continue;
+		if(e_csn == csn && e_keyid == keyid)
+		{
+			x_num_to_bytes(e_key, 8, div_key);
+			__atomic_fetch_add(&dk_stripe(cache)->hits, 1, __ATOMIC_RELAXED);
+			return true;
+		}
+	}
+	__atomic_fetch_add(&dk_stripe(cache)->misses, 1, __ATOMIC_RELAXED);
+	return false;
+}
+
+void divkey_cache_put(divkey_cache *cache, uint64_t keyid, const uint8_t csn_p[8], const uint8_t div_key[8])
+{
+	uint64_t csn = x_bytes_to_num((uint8_t*) csn_p, 8);
+	uint64_t h = dk_hash(csn, keyid);
+	size_t start = h & cache->mask & ~(size_t) 1;
+	divkey_entry *victim = NULL;
+	int i;
+	for(i = 0 ; i < DK_PROBE ; i++)
+	{
+		divkey_entry *e = &cache->entries[(start + i) & cache->mask];
+		uint32_t s = __atomic_load_n(&e->seq, __ATOMIC_RELAXED);
+		if(s == 0)
+		{
+			victim = e;
+			break;
+		}
+	}
+	if(victim == NULL)
+	{
+		// Window full, replace a pseudo-random entry in it
+		victim = &cache->entries[(start + ((h >> 40) % DK_PROBE)) & cache->mask];
+	}
+
+	uint32_t s = __atomic_load_n(&victim->seq, __ATOMIC_RELAXED);
+	if((s & 1) || !__atomic_compare_exchange_n(&victim->seq, &s, s + 1, false,
+											  __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+		return; // Someone else is writing this slot, drop the insert
+
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&victim->csn, csn, __ATOMIC_RELAXED);
+	__atomic_store_n(&victim->keyid, keyid, __ATOMIC_RELAXED);
+	__atomic_store_n(&victim->div_key, x_bytes_to_num((uint8_t*) div_key, 8), __ATOMIC_RELAXED);
+	__atomic_store_n(&victim->seq, s + 2, __ATOMIC_RELEASE);
+
+	divkey_stripe *st = dk_stripe(cache);
+	__atomic_fetch_add(&st->inserts, 1, __ATOMIC_RELAXED);
+	if(s != 0) __atomic_fetch_add(&st->evictions, 1, __ATOMIC_RELAXED);
+}
+
+void divkey_cache_stats(divkey_cache *cache, divkey_cache_counters *out)
+{
+	memset(out, 0, sizeof(divkey_cache_counters));
+	int i;
+	for(i = 0 ; i < DK_STRIPES ; i++)
+	{
+		out->hits += cache->stripes[i].hits;
+		out->misses += cache->stripes[i].misses;
+		out->inserts += cache->stripes[i].inserts;
+		out->evictions += cache->stripes[i].evictions;
+	}
+	out->capacity = cache->mask + 1;
+}
+
+uint64_t divkey_keyid(const uint8_t *key, size_t len)
+{
+	// FNV-1a
+	uint64_t h = 0xCBF29CE484222325ULL ^ len;
+	size_t i;
+	for(i = 0 ; i < len ; i++)
+	{
+		h ^= key[i];
+		h *= 0x100000001B3ULL;
+	}
+	return h;
+}
+
+void diversifyKeyCached(divkey_cache *cache, uint64_t keyid, des_context *ctx,
+						uint8_t csn[8], uint8_t div_key[8])
+{
+	if(cache && divkey_cache_get(cache, keyid, csn, div_key))
+		return;
+	diversifyKeyWithContext(ctx, csn, div_key);
+	if(cache)
+		divkey_cache_put(cache, keyid, csn, div_key);
+}
+
+void diversifyKeyEliteCached(divkey_cache *cache, uint64_t keyid, const uint8_t keytable[128],
+							 uint8_t csn[8], uint8_t div_key[8])
+{
+	if(cache && divkey_cache_get(cache, keyid, csn, div_key))
+		return;
+
+	diversifyKeyElite(keytable, csn, div_key);
+	if(cache)
+		divkey_cache_put(cache, keyid, csn, div_key);
+}
+
+// ----------------------------------------------------------------------------
+// TEST CODE BELOW
+// ----------------------------------------------------------------------------
+
+#ifndef LOCLASS_NO_TESTS
+
+int testDivkeyCache()
+{
+	int errors = 0;
+	prnlog("[+] Testing div key cache...");
+
+	uint8_t key[8] = {0x6c,0x8d,0x44,0xf9,0x2a,0x2d,0x01,0xbf};
+	uint8_t csn[8] = {0x01,0x02,0x03,0x04,0xF7,0xFF,0x12,0xE0};
+	uint8_t expected[8], div_key[8];
+	des_context ctx = {DES_ENCRYPT,{0}};
+	des_setkey_enc(&ctx, key);
+	uint64_t keyid = divkey_keyid(key, 8);
+
+	divkey_cache *cache = divkey_cache_create(64);
+	if(cache == NULL) return 1;
+	if(((uintptr_t) cache->stripes & 63) != 0 || sizeof(divkey_stripe) != 64)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: div key cache stripes not on their own cache lines");
+		errors++;
+	}
+
+	diversifyKey(csn, key, expected);
+	diversifyKeyCached(cache, keyid, &ctx, csn, div_key);
+	diversifyKeyCached(cache, keyid, &ctx, csn, div_key);
+	if(memcmp(div_key, expected, 8) != 0)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: cached div key differs");
+		errors++;
+	}
+	// Another key must not see the entry
+	if(divkey_cache_get(cache, keyid ^ 1, csn, div_key))
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: div key cache hit for wrong keyid");
+		errors++;
+	}
+	// Overfill it, whatever is still in there must be correct
+	int i, hits = 0;
+	for(i = 0 ; i < 1000 ; i++)
+	{
+		csn[0] = i & 0xFF; csn[1] = i >> 8;
+		diversifyKeyCached(cache, keyid, &ctx, csn, div_key);
+	}
+	for(i = 0 ; i < 1000 ; i++)
+	{
+		csn[0] = i & 0xFF; csn[1] = i >> 8;
+		if(divkey_cache_get(cache, keyid, csn, div_key))
+		{
+			hits++;
+			diversifyKey(csn, key, expected);
+			if(memcmp(div_key, expected, 8) != 0)
+			{
+				logmsg(LOG_LEVEL_ERROR, "[+] FAILED: stale div key for entry %d", i);
+				errors++;
+				break;
+			}
+		}
+	}
+	divkey_cache_counters c;
+	divkey_cache_stats(cache, &c);
+	if(hits == 0 || hits > 64 || c.hits < 1 || c.capacity != 64)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: div key cache bounds (hits %d, capacity %d)", hits, (int) c.capacity);
+		errors++;
+	}
+	divkey_cache_destroy(cache);
+	if(!errors)
+		prnlog("[+] Div key cache OK!");
+	return errors;
+}
+
+#endif // LOCLASS_NO_TESTS
@@ -0,0 +1,127 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#ifndef DIVKEY_CACHE_H
+#define DIVKEY_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "des.h"
+
+/**
+ * A bounded CSN -> diversified key cache, for workloads where the same cards come back
+ * over and over (audit, simulation, encoding). Entries are keyed on (keyid, CSN), where
+ * keyid identifies the master key or elite keytable the div key was derived from, so one
+ * cache can be shared between keys.
+ *
+ * The table uses open addressing over a fixed array (two 32-byte entries per cache line),
+ * with no allocation after creation. Lookups and inserts are lock-free and may be done
+ * from any number of threads; when a slot is contended or the probe window is full, an
+ * insert simply replaces an older entry or is dropped.
+ */
+typedef struct divkey_cache divkey_cache;
+
+typedef struct {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t inserts;
+	uint64_t evictions;
+	size_t capacity;
+} divkey_cache_counters;
+
+/**
+ * @brief Creates a cache
+ * @param capacity number of entries, rounded up to a power of two
+ * @return the cache, or NULL on failure
+ */
+divkey_cache* divkey_cache_create(size_t capacity);
+void divkey_cache_destroy(divkey_cache *cache);
+/**
+ * @brief Drops all entries and resets the counters. Not safe against concurrent use.
+ */
+void divkey_cache_clear(divkey_cache *cache);
+/**
+ * @brief Looks up a div key
+ * @return true on hit, with the key in div_key
+ */
+bool divkey_cache_get(divkey_cache *cache, uint64_t keyid, const uint8_t csn[8], uint8_t div_key[8]);
+/**
+ * @brief Stores a div key
+ */
+void divkey_cache_put(divkey_cache *cache, uint64_t keyid, const uint8_t csn[8], const uint8_t div_key[8]);
+/**
+ * @brief Reads the hit/miss counters (summed over all threads)
+ */
+void divkey_cache_stats(divkey_cache *cache, divkey_cache_counters *out);
+/**
+ * @brief Fingerprint of a master key or keytable, for use as keyid
+ * @param key the master key (8 bytes) or hash2 keytable (128 bytes)
+ * @param len
+ * @return a 64-bit id
+ */
+uint64_t divkey_keyid(const uint8_t *key, size_t len);
+
+/**
+ * @brief Standard diversification (see diversifyKeyWithContext) through the cache
+ * @param cache may be NULL, then this is just diversifyKeyWithContext
+ * @param keyid divkey_keyid() of the master key
+ * @param ctx DES context set up with the master key
+ */
+void diversifyKeyCached(divkey_cache *cache, uint64_t keyid, des_context *ctx,
+						uint8_t csn[8], uint8_t div_key[8]);
+/**
+ * @brief Elite diversification: hash1 -> keytable gather -> permutekey_rev -> diversifyKey,
+ * through the cache
+ * @param cache may be NULL
+ * @param keyid divkey_keyid() of the keytable
+ * @param keytable hash2(K_cus), 128 bytes
+ */
+void diversifyKeyEliteCached(divkey_cache *cache, uint64_t keyid, const uint8_t keytable[128],
+							 uint8_t csn[8], uint8_t div_key[8]);
+
+int testDivkeyCache();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DIVKEY_CACHE_H
@@ -0,0 +1,244 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "cipher.h"
+#include "cipherutils.h"
+#include "ikeys.h"
+#include "elite_crack.h"
+#include "fileutils.h"
+#include "crack_plan.h"
+#include "audit.h"
+#include "dumpgen.h"
+
+const uint8_t dumpgen_canonical_csns[DUMPGEN_CANONICAL_CSNS][8] = {
+	{0x0b,0x00,0x0f,0xff,0xf7,0xff,0x12,0xe0},
+	{0x0e,0x02,0x0e,0xfc,0xf7,0xff,0x12,0xe0},
+	{0x0f,0x06,0x0d,0xf9,0xf7,0xff,0x12,0xe0},
+	{0x0e,0x0e,0x0a,0xf8,0xf7,0xff,0x12,0xe0},
+	{0x16,0x12,0x06,0xf4,0xf7,0xff,0x12,0xe0},
+	{0x57,0x10,0xd7,0xe3,0xf7,0xff,0x12,0xe0},
+	{0x3f,0x14,0xbb,0x6f,0xf7,0xff,0x12,0xe0},
+	{0x17,0x16,0x05,0xf1,0xf7,0xff,0x12,0xe0},
+};
+
+void dumpgenRecords(const dumpgen_config *config, uint64_t first, dumpdata *records, size_t count)
+{
+	const uint8_t (*csns)[8] = config->csns ? config->csns : dumpgen_canonical_csns;
+	size_t ncsns = config->csns ? config->ncsns : DUMPGEN_CANONICAL_CSNS;
+	uint8_t keytable[128], div_key[8];
+	uint8_t key[8];
+	size_t n;
+	int i;
+
+	memcpy(key, config->key, 8);
+	if(config->elite)
+		hash2(key, keytable);
+
+	for(n = 0 ; n < count ; n++)
+	{
+		dumpdata *rec = &records[n];
+		uint64_t r = splitmix64At(config->seed, first + n);
+
+		if(config->random_csns || ncsns == 0)
+		{
+			uint64_t c = splitmix64At(~config->seed, first + n);
+			for(i = 0 ; i < 8 ; i++)
+				rec->csn[i] = c >> (8 * i);
+		}else
+		{
+			memcpy(rec->csn, csns[(first + n) % ncsns], 8);
+		}
+		memcpy(rec->cc_nr, config->cc, 8);
+		for(i = 0 ; i < 4 ; i++)
+			rec->cc_nr[8 + i] = r >> (8 * i);
+
+		if(config->elite)
+		{
+			diversifyKeyElite(keytable, rec->csn, div_key);
+		}else
+		{
+			diversifyKey(rec->csn, key, div_key);
+		}
+		doReaderMAC(rec->cc_nr, div_key, rec->mac);
+	}
+}
+
+int dumpgenFile(const char *filename, const dumpgen_config *config, uint64_t count)
+{
+	dumpdata chunk[1024];
+	uint64_t n = 0;
+	FILE *f = fopen(filename, "wb");
+
+	if(!f)
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to write to file '%s'", filename);
+		return 1;
+	}
+	while(n < count)
+	{
+		size_t len = count - n < 1024 ? count - n : 1024;
+		dumpgenRecords(config, n, chunk, len);
+		if(fwrite(chunk, sizeof(dumpdata), len, f) != len)
+			break;
+		n += len;
+	}
+	if(fclose(f) || n != count)
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to write to file '%s'", filename);
+		return 1;
+	}
+	prnlog("Wrote %llu records to '%s'", (unsigned long long) count, filename);
+	return 0;
+}
+
+int dumpgenLoadCsns(const char *filename, uint8_t (**csns)[8], size_t *ncsns)
+{
+	dumpdata rec;
+	size_t n = 0;
+	FILE *f = fopen(filename, "rb");
+
+	*csns = NULL;
+	*ncsns = 0;
+	if(!f)
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to open file '%s'", filename);
+		return 1;
+	}
+	while(fread(&rec, sizeof(dumpdata), 1, f) == 1)
+	{
+		uint8_t (*more)[8] = realloc(*csns, (n + 1) * 8);
+		if(!more)
+			break;
+		*csns = more;
+		memcpy((*csns)[n++], rec.csn, 8);
+	}
+	fclose(f);
+	if(n == 0)
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to read from file '%s'", filename);
+		free(*csns);
+		*csns = NULL;
+		return 1;
+	}
+	*ncsns = n;
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+// TEST CODE BELOW
+// ----------------------------------------------------------------------------
+
+int testDumpgen()
+{
+	int errors = 0;
+	dumpgen_config config = {true, {0x5B,0x7C,0x62,0xC4,0x91,0xC1,0x1B,0x39}, NULL, 0, false,
+							 {0xFE,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF}, 1};
+	dumpdata records[64], part[16];
+	audit_summary s;
+	audit_config audit = {true, {0}, 1, 0, NULL};
+	crack_plan plan;
+	uint8_t csn[8] = {0x00,0x0B,0x0F,0xFF,0xF7,0xFF,0x12,0xE0};
+	uint8_t div_key[8], mac[4];
+
+	prnlog("[+] Testing dump generator...");
+	memcpy(audit.key, config.key, 8);
+
+	// The canonical CSNs make a crackable dump for K_cus, and every MAC verifies
+	dumpgenRecords(&config, 0, records, DUMPGEN_CANONICAL_CSNS);
+	if(crackPlan((uint8_t*) records, DUMPGEN_CANONICAL_CSNS * sizeof(dumpdata), NULL, &plan) == 0)
+	{
+		if(plan.rejected != 0 || plan.known_after != 16)
+		{
+			logmsg(LOG_LEVEL_ERROR, "[+] FAILED: canonical CSNs, %d rejected, %d of 16 bytes", (int) plan.rejected, plan.known_after);
+			errors++;
+		}
+		freeCrackPlan(&plan);
+	}else errors++;
+
+	// Cycled and random CSNs, some with a standard key
+	dumpgenRecords(&config, 0, records, 64);
+	config.random_csns = true;
+	dumpgenRecords(&config, 0, records + 32, 32);
+	if(auditRecords(records, 64, &audit, NULL, &s) || s.passed != 64
+			|| memcmp(records[8].csn, dumpgen_canonical_csns[0], 8) != 0
+			|| memcmp(records[8].cc_nr + 8, records[0].cc_nr + 8, 4) == 0)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: elite records, %d of 64 verified", (int) s.passed);
+		errors++;
+	}
+	config.elite = audit.elite = false;
+	dumpgenRecords(&config, 0, records, 16);
+	if(auditRecords(records, 16, &audit, NULL, &s) || s.passed != 16)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: standard records, %d of 16 verified", (int) s.passed);
+		errors++;
+	}
+
+	// Record n is the same whether it is made alone or in a larger run
+	dumpgenRecords(&config, 5, part, 3);
+	if(memcmp(part, records + 5, 3 * sizeof(dumpdata)) != 0)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: records depend on how they are generated");
+		errors++;
+	}
+
+	// A record for a CSN of iclass_dump.bin, checked against the keytable printed by testElite
+	config.elite = true;
+	config.random_csns = false;
+	config.csns = (const uint8_t (*)[8]) csn;
+	config.ncsns = 1;
+	dumpgenRecords(&config, 0, records, 1);
+	{
+		uint8_t key_sel[8] = {0x35,0x35,0xF1,0xF1,0x7B,0x35,0x7B,0x7B}, key_sel_p[8];
+		permutekey_rev(key_sel, key_sel_p);
+		diversifyKey(csn, key_sel_p, div_key);
+		doReaderMAC(records[0].cc_nr, div_key, mac);
+		if(memcmp(mac, records[0].mac, 4) != 0)
+		{
+			logmsg(LOG_LEVEL_ERROR, "[+] FAILED: MAC does not match the hash2 keytable");
+			errors++;
+		}
+	}
+	if(errors == 0)
+		prnlog("[+] Dump generator tests ok");
+	return errors;
+}
@@ -0,0 +1,104 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#ifndef DUMPGEN_H
+#define DUMPGEN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "elite_crack.h"
+
+/**
+ * Generates dumps (see dumpdata) with correct reader MACs for a chosen key, to
+ * benchmark and test cracking, planning and audit with more data than iclass_dump.bin.
+ * The output is the same 24-byte record format that pm3 writes, which is also what
+ * -a reads as a corpus.
+ */
+#define DUMPGEN_CANONICAL_CSNS 8
+
+/**
+ * Eight CSNs of the form xxxxxxxxf7ff12e0 which, cracked in this order, recover
+ * keytable bytes 0-15 with at most 3 bytes per CSN (found with --solve ... --exact).
+ */
+extern const uint8_t dumpgen_canonical_csns[DUMPGEN_CANONICAL_CSNS][8];
+
+typedef struct {
+	bool elite;					// key is K_cus (iclass format), as for audit_config
+	uint8_t key[8];				// standard: master key on NIST format. elite: K_cus on iclass format
+	const uint8_t (*csns)[8];	// CSNs to use, cycled when there are more records. NULL = canonical
+	size_t ncsns;
+	bool random_csns;			// ignore csns, every record gets a random CSN
+	uint8_t cc[8];				// card challenge (e-purse) of every record
+	uint64_t seed;				// same seed, same dump
+} dumpgen_config;
+
+/**
+ * @brief Generates records. Record n only depends on the config and n, so a large dump
+ * can be made in pieces.
+ * @param config
+ * @param first number of the first record
+ * @param records where to put them
+ * @param count how many
+ */
+void dumpgenRecords(const dumpgen_config *config, uint64_t first, dumpdata *records, size_t count);
+/**
+ * @brief Writes a generated dump of count records
+ * @return 0 for ok, 1 for failz
+ */
+int dumpgenFile(const char *filename, const dumpgen_config *config, uint64_t count);
+
+/**
+ * @brief Reads the CSNs of a dumpfile, to generate records for the same CSNs under another key
+ * @param filename
+ * @param csns where to put them, free when done
+ * @param ncsns number of CSNs
+ * @return 0 for ok, 1 for failz
+ */
+int dumpgenLoadCsns(const char *filename, uint8_t (**csns)[8], size_t *ncsns);
+
+int testDumpgen();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DUMPGEN_H
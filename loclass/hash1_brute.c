@@ -39,99 +39,394 @@
 #include "cipherutils.h"
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
-#include <ctype.h>
+#include <time.h>
 #include "elite_crack.h"
+#include "fileutils.h"
+#include "threadpool.h"
+#include "hash1_brute.h"
+#include "hash1_simd.h"
 
-void calc_score(uint8_t* csn, uint8_t* k)
+/**
+  The scan space (256^free bytes) is cut into fixed-size chunks, one task each. Chunks are
+  handed to the pool a window at a time; when a window is done, the hits of each chunk are
+  written out in chunk order. That keeps the output deterministic, and memory bounded,
+  while nothing is printed from inside the loop.
+
+  Within a chunk, CSNs are hashed 64 at a time with hash1_x64_filter, and only the lanes
+  that pass the vector filter are handed to the (scalar) predicate.
+**/
+
+#define SCAN_CHUNK_BITS 20
+
+typedef struct {
+	uint8_t csn[8];
+	uint8_t k[8];
+} hash1_hit;
+
+typedef struct {
+	const hash1_scan_config *config;
+	hash1_predicate predicate;
+	const hash1_filter *filter;
+	uint8_t free_pos[8];
+	int nfree;
+	uint64_t first;
+	uint64_t count;
+	hash1_hit *hits;
+	size_t nhits;
+	size_t cap;
+	bool failed;	// out of memory for the hits, the rest of the chunk was not scanned
+} scan_chunk;
+
+bool hash1_default_predicate(const uint8_t csn[8], const uint8_t k[8], void *ctx)
 {
-    uint8_t score =0 ;
-    uint8_t i;
-    uint8_t goodvals[16] = {0};
-    uint8_t uniq_vals[8] = {0};
-    memset(goodvals, 0x00, 16);
-    memset(uniq_vals, 0x00, 8);
-    uint8_t badval = 0;
-    int badscore =0;
-    for(i=0; i < 8 ; i++)
-    {
-        if(k[i] == 0x01) continue;
-        if(k[i] == 0x00) continue;
-        if(k[i] == 0x45) continue;
-        if(k[i] < 16){
-            goodvals[k[i]] = 1;
-        }
-//        if(k[i] ==9 || k[i]==8){
-//            goodvals[k[i]] = 1;
-//        }
-
-        else if(k[i]>=16){
-            badscore++;
-            badval = k[i];
-        }
-    }
-    for(i =0; i < 16; i++)
-    {
-        if(goodvals[i])
-        {
-            uniq_vals[score] = i;
-            score +=1;
-        }
-    }
-    if(score >=1 && badscore < 2)
-    {
-        printf("CSN\t%02x%02x%02x%02x%02x%02x%02x%02x\t%02x %02x %02x %02x %02x %02x %02x %02x\t"
-               ,csn[0],csn[1],csn[2],csn[3],csn[4],csn[5],csn[6],csn[7]
-                ,k[0],k[1],k[2],k[3],k[4],k[5],k[6],k[7]
-                );
-        for(i =0 ; i < score; i++)
-        {
-            printf("%d,", uniq_vals[i]);
-        }
-        printf("\tbadscore: %d (%02x)", badscore, badval);
-        printf("\r\n");
-
-    }
+	(void) csn;
+	(void) ctx;
+	uint16_t goodvals = 0;
+	int i, badscore = 0;
+	for(i = 0 ; i < 8 ; i++)
+	{
+		if(k[i] == 0x01 || k[i] == 0x00 || k[i] == 0x45) continue;
+		if(k[i] < 16)
+			goodvals |= 1 << k[i];
+		else
+			badscore++;
+	}
+	return goodvals != 0 && badscore < 2;
+}
+
+static void scan_worker(void *arg)
+{
+	scan_chunk *c = (scan_chunk*) arg;
+	uint8_t csn[8][64], k[8][64], one[8], kone[8];
+	uint64_t n;
+	int i, lane;
+
+	for(i = 0 ; i < 8 ; i++)
+		memset(csn[i], c->config->csn[i], 64);
+
+	for(n = 0 ; n < c->count ; n += 64)
+	{
+		int lanes = (c->count - n) < 64 ? (int) (c->count - n) : 64;
+		uint64_t base = c->first + n;
+		// Place the indexes into the free bytes, last free byte is least significant
+		if(lanes == 64 && (base & 63) == 0)
+		{
+			// Aligned batch: only the last free byte differs between lanes
+			for(i = 0 ; i < c->nfree - 1 ; i++)
+				memset(csn[c->free_pos[i]], (base >> (8 * (c->nfree - 1 - i))) & 0xFF, 64);
+			for(lane = 0 ; lane < 64 ; lane++)
+				csn[c->free_pos[c->nfree - 1]][lane] = (base & 0xFF) + lane;
+		}else
+		{
+			for(lane = 0 ; lane < lanes ; lane++)
+			{
+				uint64_t idx = base + lane;
+				for(i = 0 ; i < c->nfree ; i++)
+					csn[c->free_pos[i]][lane] = (idx >> (8 * (c->nfree - 1 - i))) & 0xFF;
+			}
+		}
+		uint64_t mask;
+		if(c->filter)
+		{
+			mask = hash1_x64_filter((const uint8_t (*)[64]) csn, k, c->filter);
+		}else
+		{
+			hash1_x64((const uint8_t (*)[64]) csn, k);
+			mask = ~(uint64_t) 0;
+		}
+		if(lanes < 64)
+			mask &= ((uint64_t) 1 << lanes) - 1;
+
+		while(mask)
+		{
+			lane = __builtin_ctzll(mask);
+			mask &= mask - 1;
+			for(i = 0 ; i < 8 ; i++)
+			{
+				one[i] = csn[i][lane];
+				kone[i] = k[i][lane];
+			}
+			if(!c->predicate(one, kone, c->config->predicate_ctx))
+				continue;
+			if(c->nhits == c->cap)
+			{
+				size_t cap = c->cap ? c->cap * 2 : 64;
+				hash1_hit *h = realloc(c->hits, cap * sizeof(hash1_hit));
+				if(h == NULL)
+				{
+					c->failed = true;
+					return;
+				}
+				c->hits = h;
+				c->cap = cap;
+			}
+			memcpy(c->hits[c->nhits].csn, one, 8);
+			memcpy(c->hits[c->nhits].k, kone, 8);
+			c->nhits++;
+		}
+	}
+}
+
+static void scan_print(const hash1_hit *h)
+{
+	const uint8_t *csn = h->csn, *k = h->k;
+	prnlog("CSN\t%02x%02x%02x%02x%02x%02x%02x%02x\t%02x %02x %02x %02x %02x %02x %02x %02x"
+		   ,csn[0],csn[1],csn[2],csn[3],csn[4],csn[5],csn[6],csn[7]
+		   ,k[0],k[1],k[2],k[3],k[4],k[5],k[6],k[7]);
+}
+
+int hash1Scan(const hash1_scan_config *config, hash1_scan_result *result)
+{
+	hash1_scan_result r = {0, 0, 0};
+	scan_chunk proto;
+	int i, errors = 0;
+
+	memset(&proto, 0, sizeof(proto));
+	proto.config = config;
+	if(config->predicate)
+	{
+		proto.predicate = config->predicate;
+		proto.filter = config->filter;
+	}else
+	{
+		proto.predicate = hash1_default_predicate;
+		proto.filter = config->filter ? config->filter : &hash1_default_filter;
+	}
+	for(i = 0 ; i < 8 ; i++)
+		if(config->free_mask & (1 << i))
+			proto.free_pos[proto.nfree++] = i;
+
+	// The space is 256^nfree CSNs, which does not fit in 64 bits for eight free bytes,
+	// so it is walked by chunk and bounded by the last index instead of the count
+	uint64_t last = proto.nfree == 8 ? UINT64_MAX : ((uint64_t) 1 << (8 * proto.nfree)) - 1;
+	uint64_t chunksize = last < ((uint64_t) 1 << SCAN_CHUNK_BITS) ? last + 1 : (uint64_t) 1 << SCAN_CHUNK_BITS;
+	uint64_t nchunks = (last / chunksize) + 1;
 
+	FILE *out = NULL;
+	if(config->outfile)
+	{
+		out = fopen(config->outfile, "wb");
+		if(!out) {
+			logmsg(LOG_LEVEL_ERROR, "Failed to write to file '%s'", config->outfile);
+			return 1;
+		}
+	}
+	threadpool *pool = threadpool_create(config->threads);
+	if(pool == NULL)
+	{
+		if(out) fclose(out);
+		return 1;
+	}
+	size_t window = threadpool_size(pool) * 4;
+	scan_chunk *chunks = calloc(window, sizeof(scan_chunk));
+	if(chunks == NULL)
+	{
+		threadpool_destroy(pool);
+		if(out) fclose(out);
+		return 1;
+	}
+
+	struct timespec t1, t2;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	uint64_t next = 0, reported = 0;
+	bool done = false;
+	while(!done && next < nchunks)
+	{
+		size_t n, used = 0;
+		for(n = 0 ; n < window && next < nchunks ; n++)
+		{
+			uint64_t first = next * chunksize;
+			hash1_hit *hits = chunks[n].hits;
+			size_t cap = chunks[n].cap;
+			chunks[n] = proto;
+			chunks[n].hits = hits;
+			chunks[n].cap = cap;
+			chunks[n].first = first;
+			chunks[n].count = (last - first) < chunksize ? (last - first) + 1 : chunksize;
+			next++;
+			threadpool_submit(pool, scan_worker, &chunks[n]);
+			used++;
+		}
+		threadpool_wait(pool);
+
+		for(n = 0 ; n < used && !done ; n++)
+		{
+			size_t h;
+			if(chunks[n].failed)
+			{
+				prnlog("[+] hash1 scan: out of memory for the hits of chunk at %llu",
+					   (unsigned long long) chunks[n].first);
+				errors = 1;
+				done = true;
+				break;
+			}
+			for(h = 0 ; h < chunks[n].nhits ; h++)
+			{
+				if(out)
+				{
+					if(fwrite(&chunks[n].hits[h], sizeof(hash1_hit), 1, out) != 1)
+					{
+						logmsg(LOG_LEVEL_ERROR, "Failed to write to file '%s'", config->outfile);
+						errors = 1;
+						done = true;
+						break;
+					}
+				}else
+				{
+					scan_print(&chunks[n].hits[h]);
+				}
+				if(++r.hits == config->max_hits)
+				{
+					done = true;
+					break;
+				}
+			}
+			// 2^64 for the whole eight byte space, saturate
+			r.scanned = (UINT64_MAX - r.scanned) < chunks[n].count ? UINT64_MAX : r.scanned + chunks[n].count;
+		}
+		// Progress, roughly every 1/16th of the space
+		if(out && next - reported >= (nchunks + 15) / 16)
+		{
+			reported = next;
+			prnlog("[+] hash1 scan: %3d%% (%llu hits)", (int) (100.0 * next / nchunks),
+				   (unsigned long long) r.hits);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	r.seconds = (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / 1e9;
+
+	threadpool_destroy(pool);
+	for(i = 0 ; i < (int) window ; i++)
+		free(chunks[i].hits);
+	free(chunks);
+	if(out) fclose(out);
+
+	if(out)
+		prnlog("[+] Scanned %llu CSNs in %f seconds, %llu hits written to '%s'",
+			   (unsigned long long) r.scanned, r.seconds, (unsigned long long) r.hits, config->outfile);
+	if(result) *result = r;
+	return errors;
+}
+
+int hash1ParseTemplate(const char *tmpl, uint8_t csn[8], uint8_t *free_mask)
+{
+	int i;
+	*free_mask = 0;
+	if(strlen(tmpl) != 16) return 1;
+	for(i = 0 ; i < 8 ; i++)
+	{
+		const char *p = tmpl + 2 * i;
+		if((p[0] == 'x' || p[0] == 'X') && (p[1] == 'x' || p[1] == 'X'))
+		{
+			csn[i] = 0;
+			*free_mask |= 1 << i;
+			continue;
+		}
+		char byte[3] = {p[0], p[1], 0};
+		if(hexToBytes(byte, &csn[i], 1)) return 1;
+	}
+	return 0;
 }
 
 void brute_hash1(){
-    //uint8_t csn[8] = {0,0,0,0,0xf7,0xff,0x12,0xe0};
-    uint8_t k[8]= {0,0,0,0,0,0,0,0};
-    uint16_t a,b,c,d;
-	//uint8_t testcsn[8] ={0x00,0x0d,0x0f,0xfd,0xf7,0xff,0x12,0xe0} ;
-    uint8_t csn[8] = {0x04,0x0f,0x0f,0xf7,0xf7,0xff,0x12,0xe0};
-	//uint8_t testkey2[8] = {0};
-    hash1(csn, k);
-    printf("CSN\t%02x%02x%02x%02x%02x%02x%02x%02x\t%02x %02x %02x %02x %02x %02x %02x %02x\t"
-               ,csn[0],csn[1],csn[2],csn[3],csn[4],csn[5],csn[6],csn[7]
-                ,k[0],k[1],k[2],k[3],k[4],k[5],k[6],k[7]
-                );
-
-	//uint8_t testkey[8] ={0x05 ,0x01 ,0x00 ,0x10 ,0x45 ,0x08 ,0x45,0x56} ;
-    calc_score(csn,k);
-    printf("Brute forcing hashones\n");
-    //exit(1);
-    for(a=0;a < 256;a++)
-    {
-        //if(a > 0)printf("%d/256 done...\n", a);
-        for(b=0;b < 256 ; b++)
-            for(c=0;c < 256;c++)
-               for(d=0;d < 256;d++)
-                {
-                    csn[0] = a;
-                    csn[1] = b;
-                    csn[2] = c;
-                    csn[3] = d;
-                    csn[4] = 0xf7;
-                    csn[5] = 0xff;
-                    csn[6] = 0x12;
-                    csn[7] = 0xe0;
-                    hash1(csn, k);
-                    calc_score(csn,k);
-               }
-    }
+	hash1_scan_config config;
+	memset(&config, 0, sizeof(config));
+	hash1ParseTemplate("xxxxxxxxf7ff12e0", config.csn, &config.free_mask);
+	printf("Brute forcing hashones\n");
+	hash1Scan(&config, NULL);
+}
+
+// ----------------------------------------------------------------------------
+// TEST CODE BELOW
+// ----------------------------------------------------------------------------
 
+static bool test_predicate(const uint8_t csn[8], const uint8_t k[8], void *ctx)
+{
+	(void) csn;
+	(void) ctx;
+	return k[0] == 0x01;
 }
 
+static bool test_predicate_last(const uint8_t csn[8], const uint8_t k[8], void *ctx)
+{
+	(void) k;
+	(void) ctx;
+	return csn[7] == 0xFF;
+}
+
+int testHash1Scan()
+{
+	prnlog("[+] Testing hash1 scan...");
+	int errors = 0;
+
+	// Scan two free bytes with a custom predicate
+	hash1_scan_config config;
+	hash1_scan_result r1, r2;
+	memset(&config, 0, sizeof(config));
+	hash1ParseTemplate("xxxx0ffff7ff12e0", config.csn, &config.free_mask);
+	config.predicate = test_predicate;
+	config.outfile = "hash1_scan_test.bin";
+	config.threads = 3;
+	errors += hash1Scan(&config, &r1);
+
+	uint8_t *first = malloc(r1.hits * 16 + 1);
+	if(first == NULL || loadFile(config.outfile, first, r1.hits * 16))
+		errors++;
+	// Deterministic: same file with another thread count
+	config.threads = 1;
+	errors += hash1Scan(&config, &r2);
+	uint8_t *second = malloc(r2.hits * 16 + 1);
+	if(second == NULL || loadFile(config.outfile, second, r2.hits * 16))
+		errors++;
+	remove(config.outfile);
+
+	if(r1.scanned != 65536 || r1.hits == 0 || r1.hits != r2.hits || memcmp(first, second, r1.hits * 16))
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: hash1 scan not deterministic (%d / %d hits)", (int) r1.hits, (int) r2.hits);
+		errors++;
+	}else
+	{
+		// Each hit must really match, and be in CSN order
+		uint64_t i;
+		for(i = 0 ; i < r1.hits ; i++)
+		{
+			uint8_t k[8];
+			hash1(first + i * 16, k);
+			if(memcmp(k, first + i * 16 + 8, 8) || k[0] != 0x01 ||
+			   (i > 0 && memcmp(first + (i - 1) * 16, first + i * 16, 8) >= 0))
+			{
+				logmsg(LOG_LEVEL_ERROR, "[+] FAILED: bad hash1 scan hit %d", (int) i);
+				errors++;
+				break;
+			}
+		}
+	}
+	// The last CSN of the space is scanned too
+	hash1ParseTemplate("0ffff7ff12e0a0xx", config.csn, &config.free_mask);
+	config.predicate = test_predicate_last;
+	errors += hash1Scan(&config, &r1);
+	remove(config.outfile);
+	if(r1.scanned != 256 || r1.hits != 1)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: hash1 scan missed the end of the space (%d scanned, %d hits)",
+			   (int) r1.scanned, (int) r1.hits);
+		errors++;
+	}
+	// One of the "pretty optimal" CSNs in elite_crack.h
+	uint8_t optimal[8] = {0x00,0x13,0x94,0x7e,0x76,0xff,0x12,0xe0};
+	uint8_t k[8];
+	hash1(optimal, k);
+	if(!hash1_default_predicate(optimal, k, NULL))
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: default predicate rejects a known good CSN");
+		errors++;
+	}
+	free(first);
+	free(second);
+	if(!errors)
+		prnlog("[+] hash1 scan OK!");
+	return errors;
+}
@@ -42,8 +42,64 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "hash1_simd.h"
+
+/**
+ * Decides whether a CSN is interesting, given its hash1 k[0..7].
+ */
+typedef bool (*hash1_predicate)(const uint8_t csn[8], const uint8_t k[8], void *ctx);
+
+/**
+ * Configuration for a hash1 scan. The CSN template has fixed bytes and free bytes;
+ * every combination of values for the free bytes is tried. Free bytes are enumerated
+ * with the lowest index as the most significant, so hits come out in the same order
+ * as nested loops over csn[0], csn[1]... would produce them, no matter the thread count.
+ */
+typedef struct {
+	uint8_t csn[8];				// template, the fixed bytes
+	uint8_t free_mask;			// bit i set = csn[i] is free
+	hash1_predicate predicate;	// NULL = hash1_default_predicate
+	void *predicate_ctx;
+	const hash1_filter *filter;	// vector prefilter, only lanes passing it reach the predicate.
+								// NULL = none, or hash1_default_filter with the default predicate
+	int threads;				// 0 = one per core
+	const char *outfile;		// binary hits, 16 bytes each: <8 byte CSN><8 byte HASH1>. NULL = print
+	uint64_t max_hits;			// stop after this many, 0 = no limit
+} hash1_scan_config;
+
+typedef struct {
+	uint64_t scanned;			// saturates at 2^64 - 1 for a full eight byte space
+	uint64_t hits;
+	double seconds;
+} hash1_scan_result;
+
+/**
+ * @brief The classic scoring rule: a hit has at least one keytable index in 2..15 and
+ * at most one index that is neither one of those nor one of the usual helpers 0x00, 0x01, 0x45.
+ */
+bool hash1_default_predicate(const uint8_t csn[8], const uint8_t k[8], void *ctx);
+/**
+ * @brief Runs a multithreaded hash1 scan
+ * @param config
+ * @param result may be NULL
+ * @return 0 for ok, 1 for failz
+ */
+int hash1Scan(const hash1_scan_config *config, hash1_scan_result *result);
+/**
+ * @brief Parses a CSN template, hex with "xx" for free bytes, e.g. "xxxxxxxxf7ff12e0"
+ * @return 0 for ok, 1 for failz
+ */
+int hash1ParseTemplate(const char *tmpl, uint8_t csn[8], uint8_t *free_mask);
+/**
+ * @brief The original scan: csn[0..3] free, suffix f7 ff 12 e0, default predicate, hits printed
+ */
 void brute_hash1();
 
+int testHash1Scan();
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,275 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+/**
+  Vectorized hash1. The arithmetic is written once, with GCC vector extensions, and
+  instantiated for 32 and 64 byte lanes. On x86-64 each function is cloned for AVX-512,
+  AVX2 and baseline (SSE2) targets and the loader picks the best one for the CPU, so
+  the default build does not need -mavx2. Other targets (e.g. ESP32) get plain C.
+**/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "hash1_simd.h"
+#include "elite_crack.h"
+#include "fileutils.h"
+#include "cipherutils.h"
+#include "loclass_config.h"
+
+#if defined(__x86_64__) && defined(__linux__) && defined(__GNUC__) && !defined(__clang__)
+#define HASH1_CLONES __attribute__((target_clones("arch=skylake-avx512","avx2","default")))
+#else
+#define HASH1_CLONES
+#endif
+
+typedef uint8_t v32u8 __attribute__((vector_size(32)));
+typedef uint8_t v64u8 __attribute__((vector_size(64)));
+
+const hash1_filter hash1_default_filter = { 0x00, 0x0F, {0x00,0x01,0x45}, 3, 1, 1 };
+
+/*
+ * The same steps as hash1(), on whole vectors:
+ *	k[0] = xor of the CSN, k[1] = sum of the CSN
+ *	k[2] = rr(swap(csn[2]+k[1]))	k[3] = rl(swap(csn[3]+k[0]))
+ *	k[4] = -rr(csn[4]+k[2])			k[5] = -rl(csn[5]+k[3])
+ *	k[6] = rr(csn[6]+(k[4]^0x3c))	k[7] = rl(csn[7]+(k[5]^0xc3))
+ * and all of them & 0x7F.
+ */
+#define V_RR(v)		(((v) >> 1) | ((v) << 7))
+#define V_RL(v)		(((v) << 1) | ((v) >> 7))
+#define V_SWAP(v)	(((v) >> 4) | ((v) << 4))
+
+#define HASH1_VECTOR(V, csn, kv)											\
+	do {																	\
+		V c[8], t;															\
+		int _i;																\
+		for(_i = 0 ; _i < 8 ; _i++) memcpy(&c[_i], csn[_i], sizeof(V));	\
+		kv[0] = c[0]^c[1]^c[2]^c[3]^c[4]^c[5]^c[6]^c[7];					\
+		kv[1] = c[0]+c[1]+c[2]+c[3]+c[4]+c[5]+c[6]+c[7];					\
+		t = c[2] + kv[1];	t = V_SWAP(t);	kv[2] = V_RR(t);				\
+		t = c[3] + kv[0];	t = V_SWAP(t);	kv[3] = V_RL(t);				\
+		t = c[4] + kv[2];	kv[4] = -V_RR(t);								\
+		t = c[5] + kv[3];	kv[5] = -V_RL(t);								\
+		t = c[6] + (kv[4] ^ 0x3c);	kv[6] = V_RR(t);						\
+		t = c[7] + (kv[5] ^ 0xc3);	kv[7] = V_RL(t);						\
+		for(_i = 0 ; _i < 8 ; _i++) kv[_i] &= 0x7F;							\
+	} while(0)
+
+/*
+ * Classifies the eight hash1 bytes of 16 lanes (see hash1_filter), and returns 0xFF in
+ * the lanes that pass, 0x00 in the others. It works on 16 byte vectors whatever the
+ * kernel width, since wider byte compares get scalarized by GCC on some of the clones.
+ * hash1 bytes are 7-bit, so the comparisons are done signed; x86 has no unsigned byte
+ * compare before AVX-512.
+ */
+typedef int8_t v16s8 __attribute__((vector_size(16)));
+
+static inline v16s8 hash1_filter16(const v16s8 kv[8], const hash1_filter *f)
+{
+	v16s8 targets = {0}, others = {0};
+	int8_t lo = f->lo > 0x7F ? 0x7F : f->lo;
+	int8_t hi = f->hi > 0x7F ? 0x7F : f->hi;
+	int i, j;
+	for(i = 0 ; i < 8 ; i++)
+	{
+		v16s8 known = {0};
+		for(j = 0 ; j < f->nknown ; j++)
+			known |= (kv[i] == (int8_t) f->known[j]);
+		v16s8 inrange = (kv[i] >= lo) & (kv[i] <= hi);
+		targets -= inrange & ~known;
+		others -= ~inrange & ~known;
+	}
+	return (targets >= (int8_t) f->min_targets) & (others <= (int8_t) f->max_other);
+}
+
+#define HASH1_FILTER(V, kv, f, pass)										\
+	do {																	\
+		unsigned _c;														\
+		int _i;																\
+		for(_c = 0 ; _c < sizeof(V) / 16 ; _c++)							\
+		{																	\
+			v16s8 _k[8], _p;												\
+			for(_i = 0 ; _i < 8 ; _i++)										\
+				memcpy(&_k[_i], (const uint8_t *) &kv[_i] + 16 * _c, 16);	\
+			_p = hash1_filter16(_k, f);										\
+			memcpy((uint8_t *) &pass + 16 * _c, &_p, 16);					\
+		}																	\
+	} while(0)
+
+/*
+ * Turns a vector of 0xFF/0x00 lanes into a bitmask. Each lane is reduced to its own bit
+ * within a group of eight, and the eight bytes of a group are summed with one multiply.
+ */
+static const uint8_t lane_weights[64] = {
+	1,2,4,8,16,32,64,128, 1,2,4,8,16,32,64,128, 1,2,4,8,16,32,64,128, 1,2,4,8,16,32,64,128,
+	1,2,4,8,16,32,64,128, 1,2,4,8,16,32,64,128, 1,2,4,8,16,32,64,128, 1,2,4,8,16,32,64,128
+};
+#define MOVEMASK(V, pass, mask)												\
+	do {																	\
+		V _weights;															\
+		memcpy(&_weights, lane_weights, sizeof(V));							\
+		V _w = pass & _weights;												\
+		uint64_t _groups[sizeof(V) / 8];									\
+		unsigned _g;														\
+		memcpy(_groups, &_w, sizeof(V));									\
+		for(_g = 0 ; _g < sizeof(V) / 8 ; _g++)								\
+			mask |= ((_groups[_g] * 0x0101010101010101ULL) >> 56) << (8 * _g); \
+	} while(0)
+
+HASH1_CLONES
+void hash1_x32(const uint8_t csn[8][32], uint8_t k[8][32])
+{
+	v32u8 kv[8];
+	int i;
+	HASH1_VECTOR(v32u8, csn, kv);
+	for(i = 0 ; i < 8 ; i++) memcpy(k[i], &kv[i], 32);
+}
+
+HASH1_CLONES
+void hash1_x64(const uint8_t csn[8][64], uint8_t k[8][64])
+{
+	v64u8 kv[8];
+	int i;
+	HASH1_VECTOR(v64u8, csn, kv);
+	for(i = 0 ; i < 8 ; i++) memcpy(k[i], &kv[i], 64);
+}
+
+HASH1_CLONES
+uint32_t hash1_x32_filter(const uint8_t csn[8][32], uint8_t k[8][32], const hash1_filter *filter)
+{
+	v32u8 kv[8], pass;
+	uint32_t mask = 0;
+	int i;
+	HASH1_VECTOR(v32u8, csn, kv);
+	for(i = 0 ; i < 8 ; i++) memcpy(k[i], &kv[i], 32);
+	HASH1_FILTER(v32u8, kv, filter, pass);
+	MOVEMASK(v32u8, pass, mask);
+	return mask;
+}
+
+HASH1_CLONES
+uint64_t hash1_x64_filter(const uint8_t csn[8][64], uint8_t k[8][64], const hash1_filter *filter)
+{
+	v64u8 kv[8], pass;
+	uint64_t mask = 0;
+	int i;
+	HASH1_VECTOR(v64u8, csn, kv);
+	for(i = 0 ; i < 8 ; i++) memcpy(k[i], &kv[i], 64);
+	HASH1_FILTER(v64u8, kv, filter, pass);
+	MOVEMASK(v64u8, pass, mask);
+	return mask;
+}
+
+// ----------------------------------------------------------------------------
+// TEST CODE BELOW
+// ----------------------------------------------------------------------------
+
+#ifndef LOCLASS_NO_TESTS
+
+static bool scalar_filter(const uint8_t k[8], const hash1_filter *f)
+{
+	int i, j, targets = 0, others = 0;
+	for(i = 0 ; i < 8 ; i++)
+	{
+		bool known = false;
+		for(j = 0 ; j < f->nknown ; j++)
+			known |= (k[i] == f->known[j]);
+		if(known) continue;
+		if(k[i] >= f->lo && k[i] <= f->hi) targets++;
+		else others++;
+	}
+	return targets >= f->min_targets && others <= f->max_other;
+}
+
+int testHash1Simd()
+{
+	prnlog("[+] Testing SIMD hash1...");
+	uint8_t csn[8][64], k[8][64], csn32[8][32], kk[8][32];
+	uint8_t one[8], expected[8];
+	uint32_t seed = 0x12345678;
+	hash1_filter wide = { 0x10, 0x30, {0x05,0x7F}, 2, 2, 3 };
+	int round, lane, i, errors = 0;
+
+	for(round = 0 ; round < 200 && !errors ; round++)
+	{
+		for(i = 0 ; i < 8 ; i++)
+			for(lane = 0 ; lane < 64 ; lane++)
+			{
+				seed = seed * 1103515245 + 12345;
+				csn[i][lane] = seed >> 16;
+			}
+		// Make some lanes hit the filters
+		if(round & 1)
+		{
+			uint8_t good[8] = {0x00,0x13,0x94,0x7e,0x76,0xff,0x12,0xe0};
+			for(i = 0 ; i < 8 ; i++) csn[i][round % 64] = good[i];
+		}
+		const hash1_filter *f = (round & 2) ? &wide : &hash1_default_filter;
+		for(i = 0 ; i < 8 ; i++)
+			memcpy(csn32[i], csn[i], 32);
+		uint64_t mask = hash1_x64_filter((const uint8_t (*)[64]) csn, k, f);
+		uint32_t mask32 = hash1_x32_filter((const uint8_t (*)[32]) csn32, kk, f);
+		for(lane = 0 ; lane < 64 ; lane++)
+		{
+			for(i = 0 ; i < 8 ; i++) one[i] = csn[i][lane];
+			hash1(one, expected);
+			for(i = 0 ; i < 8 ; i++)
+			{
+				if(k[i][lane] != expected[i] || (lane < 32 && kk[i][lane] != expected[i]))
+				{
+					logmsg(LOG_LEVEL_ERROR, "[+] FAILED: SIMD hash1 differs, lane %d", lane);
+					printarr("csn", one, 8);
+					errors++;
+					break;
+				}
+			}
+			bool pass = scalar_filter(expected, f);
+			if(pass != ((mask >> lane) & 1) || (lane < 32 && pass != ((mask32 >> lane) & 1)))
+			{
+				logmsg(LOG_LEVEL_ERROR, "[+] FAILED: SIMD hash1 filter differs, lane %d", lane);
+				errors++;
+			}
+			if(errors) break;
+		}
+	}
+	if(!errors)
+		prnlog("[+] SIMD hash1 OK!");
+	return errors;
+}
+
+#endif // LOCLASS_NO_TESTS
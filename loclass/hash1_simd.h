@@ -0,0 +1,98 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#ifndef HASH1_SIMD_H
+#define HASH1_SIMD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * Batch versions of hash1 (see elite_crack.c), computing 32 or 64 CSNs per call.
+ * Data is in SoA layout: csn[i][lane] is byte i of the CSN in that lane, and likewise
+ * for the output k[i][lane]. hash1 is pure byte arithmetic, so every lane maps onto one
+ * byte of a SIMD register (AVX2 for 32 lanes, AVX-512 for 64, SSE2 or plain C otherwise).
+ */
+void hash1_x32(const uint8_t csn[8][32], uint8_t k[8][32]);
+void hash1_x64(const uint8_t csn[8][64], uint8_t k[8][64]);
+
+/**
+ * A lane filter on the hash1 output, evaluated with the same vector ops.
+ * Every k[i] is classified as
+ *	- known:  one of known[0..nknown-1] (keytable bytes that are already recovered)
+ *	- target: lo <= k[i] <= hi, and not known
+ *	- other:  anything else
+ * A lane passes if it has at least min_targets target positions and at most max_other
+ * other positions. Positions are counted, not distinct values, so when min_targets > 1
+ * the filter is a superset and a scalar predicate should confirm the lanes that pass.
+ */
+typedef struct {
+	uint8_t lo;
+	uint8_t hi;
+	uint8_t known[8];
+	uint8_t nknown;
+	uint8_t min_targets;
+	uint8_t max_other;
+} hash1_filter;
+
+/**
+ * The filter that matches hash1_default_predicate: targets 0..15, with 0x00, 0x01
+ * and 0x45 known, at least one target and at most one other.
+ */
+extern const hash1_filter hash1_default_filter;
+
+/**
+ * @brief hash1_x32 fused with a filter
+ * @return bitmask, bit n set if lane n passed the filter
+ */
+uint32_t hash1_x32_filter(const uint8_t csn[8][32], uint8_t k[8][32], const hash1_filter *filter);
+/**
+ * @brief hash1_x64 fused with a filter
+ * @return bitmask, bit n set if lane n passed the filter
+ */
+uint64_t hash1_x64_filter(const uint8_t csn[8][64], uint8_t k[8][64], const hash1_filter *filter);
+
+int testHash1Simd();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HASH1_SIMD_H
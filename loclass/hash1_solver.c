@@ -0,0 +1,735 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "elite_crack.h"
+#include "fileutils.h"
+#include "hash1_solver.h"
+
+// Chain values kept per index set, for pairing
+#define BUCKET_ENTRIES		8
+// Upper bound on search nodes for the exact set cover
+#define EXACT_NODE_LIMIT	2000000
+#define EXACT_MEMO_LIMIT	(1 << 20)
+
+/**
+  Keytable indices are 0..127, kept as a 128-bit set
+**/
+typedef struct {
+	uint64_t w[2];
+} idxset;
+
+static inline idxset set_or(idxset a, idxset b)		{ idxset r = {{a.w[0] | b.w[0], a.w[1] | b.w[1]}}; return r; }
+static inline idxset set_and(idxset a, idxset b)	{ idxset r = {{a.w[0] & b.w[0], a.w[1] & b.w[1]}}; return r; }
+static inline idxset set_andnot(idxset a, idxset b)	{ idxset r = {{a.w[0] & ~b.w[0], a.w[1] & ~b.w[1]}}; return r; }
+static inline bool set_empty(idxset a)				{ return (a.w[0] | a.w[1]) == 0; }
+static inline bool set_equal(idxset a, idxset b)	{ return a.w[0] == b.w[0] && a.w[1] == b.w[1]; }
+static inline int set_count(idxset a)				{ return __builtin_popcountll(a.w[0]) + __builtin_popcountll(a.w[1]); }
+static inline bool set_has(idxset a, int i)			{ return (a.w[i >> 6] >> (i & 63)) & 1; }
+static inline void set_add(idxset *a, int i)		{ a->w[i >> 6] |= (uint64_t) 1 << (i & 63); }
+
+static inline uint64_t set_hash(idxset a)
+{
+	uint64_t h = a.w[0] * 0x9E3779B97F4A7C15ULL ^ a.w[1];
+	h ^= h >> 29;
+	h *= 0xBF58476D1CE4E5B9ULL;
+	return h ^ (h >> 32);
+}
+
+/**
+  Open addressing map from index sets to a nonzero value
+**/
+typedef struct {
+	idxset set;
+	uint32_t value;
+} setmap_slot;
+
+typedef struct {
+	setmap_slot *slots;
+	size_t nslots;
+	size_t count;
+} setmap;
+
+static uint32_t setmap_get(const setmap *m, idxset set)
+{
+	if(m->nslots == 0) return 0;
+	size_t i = set_hash(set) & (m->nslots - 1);
+	while(m->slots[i].value)
+	{
+		if(set_equal(m->slots[i].set, set)) return m->slots[i].value;
+		i = (i + 1) & (m->nslots - 1);
+	}
+	return 0;
+}
+
+static int setmap_put(setmap *m, idxset set, uint32_t value)
+{
+	size_t i;
+	if(2 * (m->count + 1) > m->nslots)
+	{
+		size_t nslots = m->nslots ? m->nslots * 2 : 1024;
+		setmap_slot *slots = calloc(nslots, sizeof(setmap_slot));
+		if(slots == NULL) return 1;
+		for(i = 0 ; i < m->nslots ; i++)
+		{
+			if(!m->slots[i].value) continue;
+			size_t j = set_hash(m->slots[i].set) & (nslots - 1);
+			while(slots[j].value) j = (j + 1) & (nslots - 1);
+			slots[j] = m->slots[i];
+		}
+		free(m->slots);
+		m->slots = slots;
+		m->nslots = nslots;
+	}
+	i = set_hash(set) & (m->nslots - 1);
+	while(m->slots[i].value && !set_equal(m->slots[i].set, set))
+		i = (i + 1) & (m->nslots - 1);
+	if(!m->slots[i].value) m->count++;
+	m->slots[i].set = set;
+	m->slots[i].value = value;
+	return 0;
+}
+
+static void setmap_free(setmap *m)
+{
+	free(m->slots);
+	memset(m, 0, sizeof(setmap));
+}
+
+/**
+  One chain of hash1. sx is the byte sum (chain 0) or byte xor (chain 1) of the CSN,
+  c[0..2] are csn[2], csn[4], csn[6] or csn[3], csn[5], csn[7].
+**/
+typedef struct {
+	uint8_t sx;
+	uint8_t c[3];
+} chain_entry;
+
+typedef struct {
+	idxset set;
+	int first_other;			// lowest index which is neither target nor known, 128 = none
+	int nothers;
+	int nentries;
+	chain_entry e[BUCKET_ENTRIES];
+} chain_bucket;
+
+typedef struct {
+	chain_bucket *buckets;
+	size_t n;
+	size_t cap;
+	setmap map;
+} chain_buckets;
+
+typedef struct {
+	idxset set;
+	uint8_t csn[8];
+} candidate;
+
+typedef struct {
+	const hash1_solve_config *config;
+	idxset targets;
+	idxset known;
+	idxset allowed;				// targets | known
+	int max_unknown;
+	int max_other;
+	chain_buckets chain[2];
+	candidate *cands;
+	size_t ncands;
+	size_t capcands;
+	setmap candmap;
+	// exact search
+	setmap memo;
+	uint64_t nodes;
+} solver;
+
+/*
+ * The full (unmasked) byte of k[2], k[4], k[6] (chain 0) or k[3], k[5], k[7] (chain 1),
+ * from the csn byte and the previous full byte of the chain, exactly as in hash1().
+ */
+static inline uint8_t chain_step(int chain, int level, uint8_t c, uint8_t prev)
+{
+	uint8_t t;
+	switch(level)
+	{
+	case 0:
+		t = c + prev;
+		t = (t >> 4) | (t << 4);
+		return chain ? (t << 1) | (t >> 7) : (t >> 1) | (t << 7);
+	case 1:
+		t = c + prev;
+		return -(chain ? (t << 1) | (t >> 7) : (t >> 1) | (t << 7));
+	default:
+		t = c + (prev ^ (chain ? 0xc3 : 0x3c));
+		return chain ? (t << 1) | (t >> 7) : (t >> 1) | (t << 7);
+	}
+}
+
+static inline bool chain_ok(const solver *s, idxset set)
+{
+	return set_count(set_andnot(set, s->allowed)) <= s->max_other;
+}
+
+/*
+ * Buckets are keyed on the indices that are not known yet; which known indices a chain
+ * uses makes no difference to the attack.
+ */
+static int bucket_add(solver *s, int chain, idxset set, const chain_entry *e)
+{
+	chain_buckets *cb = &s->chain[chain];
+	set = set_andnot(set, s->known);
+	uint32_t idx = setmap_get(&cb->map, set);
+	if(idx == 0)
+	{
+		if(cb->n == cb->cap)
+		{
+			size_t cap = cb->cap ? cb->cap * 2 : 1024;
+			chain_bucket *b = realloc(cb->buckets, cap * sizeof(chain_bucket));
+			if(b == NULL) return 1;
+			cb->buckets = b;
+			cb->cap = cap;
+		}
+		chain_bucket *b = &cb->buckets[cb->n];
+		idxset others = set_andnot(set, s->allowed);
+		b->set = set;
+		b->nothers = set_count(others);
+		b->first_other = others.w[0] ? __builtin_ctzll(others.w[0])
+						: others.w[1] ? 64 + __builtin_ctzll(others.w[1]) : 128;
+		b->nentries = 0;
+		idx = ++cb->n;
+		if(setmap_put(&cb->map, set, idx)) return 1;
+	}
+	chain_bucket *b = &cb->buckets[idx - 1];
+	if(b->nentries < BUCKET_ENTRIES)
+		b->e[b->nentries++] = *e;
+	return 0;
+}
+
+/*
+ * Enumerates one chain, depth first over the sum/xor and the chain's three csn bytes,
+ * and drops a branch as soon as it has more "other" indices than allowed.
+ */
+static int enumerate_chain(solver *s, int chain)
+{
+	const hash1_solve_config *config = s->config;
+	int lo[3], hi[3], l, sx, c0, c1, c2;
+	for(l = 0 ; l < 3 ; l++)
+	{
+		int pos = 2 + chain + 2 * l;
+		lo[l] = (config->free_mask & (1 << pos)) ? 0 : config->csn[pos];
+		hi[l] = (config->free_mask & (1 << pos)) ? 255 : config->csn[pos];
+	}
+	for(sx = 0 ; sx < 256 ; sx++)
+	{
+		idxset s0 = {{0, 0}};
+		set_add(&s0, sx & 0x7F);
+		if(!chain_ok(s, s0)) continue;
+		for(c0 = lo[0] ; c0 <= hi[0] ; c0++)
+		{
+			uint8_t k0 = chain_step(chain, 0, c0, sx);
+			idxset s1 = s0;
+			set_add(&s1, k0 & 0x7F);
+			if(!chain_ok(s, s1)) continue;
+			for(c1 = lo[1] ; c1 <= hi[1] ; c1++)
+			{
+				uint8_t k1 = chain_step(chain, 1, c1, k0);
+				idxset s2 = s1;
+				set_add(&s2, k1 & 0x7F);
+				if(!chain_ok(s, s2)) continue;
+				for(c2 = lo[2] ; c2 <= hi[2] ; c2++)
+				{
+					uint8_t k2 = chain_step(chain, 2, c2, k1);
+					idxset s3 = s2;
+					set_add(&s3, k2 & 0x7F);
+					if(!chain_ok(s, s3)) continue;
+					chain_entry e = {sx, {c0, c1, c2}};
+					if(bucket_add(s, chain, s3, &e)) return 1;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * Given both chains, find csn[0] and csn[1] so that the CSN has the chains' sum and xor.
+ * With a = c0^c1 and b = c0+c1 = a + 2(c0&c1), the common bits d = c0&c1 are (b-a)/2,
+ * or that plus 0x80, and must not overlap a.
+ */
+static bool balance(const solver *s, const chain_entry *ea, const chain_entry *eb, uint8_t csn[8])
+{
+	const hash1_solve_config *config = s->config;
+	uint8_t xr = ea->c[0] ^ ea->c[1] ^ ea->c[2] ^ eb->c[0] ^ eb->c[1] ^ eb->c[2];
+	uint8_t sm = ea->c[0] + ea->c[1] + ea->c[2] + eb->c[0] + eb->c[1] + eb->c[2];
+	uint8_t a = eb->sx ^ xr;
+	uint8_t b = ea->sx - sm;
+	bool free0 = config->free_mask & 1, free1 = config->free_mask & 2;
+	uint8_t c0 = config->csn[0], c1 = config->csn[1];
+
+	if(free0 && free1)
+	{
+		uint8_t diff = b - a;
+		if(diff & 1) return false;
+		uint8_t d = diff >> 1;
+		if(d & a) d |= 0x80;
+		if(d & a) return false;
+		c0 = d | a;
+		c1 = d;
+	}else if(free0)
+	{
+		c0 = c1 ^ a;
+	}else if(free1)
+	{
+		c1 = c0 ^ a;
+	}
+	if((uint8_t) (c0 ^ c1) != a || (uint8_t) (c0 + c1) != b) return false;
+
+	csn[0] = c0;			csn[1] = c1;
+	csn[2] = ea->c[0];		csn[3] = eb->c[0];
+	csn[4] = ea->c[1];		csn[5] = eb->c[1];
+	csn[6] = ea->c[2];		csn[7] = eb->c[2];
+	return true;
+}
+
+static int pair_bucket(solver *s, const chain_bucket *a, const chain_bucket *b)
+{
+	idxset u = set_or(a->set, b->set);
+	idxset unknown = set_andnot(u, s->known);
+	int ia, ib;
+
+	if(set_count(set_andnot(u, s->allowed)) > s->max_other) return 0;
+	// Must recover some target, and the other unknowns must fit in one bruteforce
+	if(set_empty(set_and(unknown, s->targets))) return 0;
+	if(set_count(set_andnot(unknown, s->targets)) > s->max_unknown) return 0;
+	if(setmap_get(&s->candmap, u)) return 0;
+
+	for(ia = 0 ; ia < a->nentries ; ia++)
+		for(ib = 0 ; ib < b->nentries ; ib++)
+		{
+			uint8_t csn[8], k[8];
+			idxset set = u;
+			if(!balance(s, &a->e[ia], &b->e[ib], csn)) continue;
+			// bruteforceItem skips a k[7] that only feeds DES parity bits, so this CSN
+			// does not recover it. The bucket sets above are a superset for pruning.
+			hash1(csn, k);
+			if(hash1ParityOnly(k) && !set_has(s->known, k[7]))
+			{
+				set.w[k[7] >> 6] &= ~((uint64_t) 1 << (k[7] & 63));
+				if(set_empty(set_and(set_andnot(set, s->known), s->targets))) continue;
+				if(setmap_get(&s->candmap, set)) continue;
+			}
+			if(s->ncands == s->capcands)
+			{
+				size_t cap = s->capcands ? s->capcands * 2 : 1024;
+				candidate *c = realloc(s->cands, cap * sizeof(candidate));
+				if(c == NULL) return 1;
+				s->cands = c;
+				s->capcands = cap;
+			}
+			s->cands[s->ncands].set = set;
+			memcpy(s->cands[s->ncands].csn, csn, 8);
+			s->ncands++;
+			if(setmap_put(&s->candmap, set, s->ncands)) return 1;
+			if(set_equal(set, u)) return 0;
+		}
+	return 0;
+}
+
+/*
+ * Pairs every chain 0 bucket with every compatible chain 1 bucket. Chain 1 buckets are
+ * grouped by their lowest "other" index, so a chain 0 bucket that already uses up all
+ * max_other slots only looks at the groups of its own others.
+ */
+static int pair_chains(solver *s)
+{
+	chain_buckets *A = &s->chain[0], *B = &s->chain[1];
+	size_t *start = calloc(130, sizeof(size_t));
+	size_t *order = malloc((B->n + 1) * sizeof(size_t));
+	size_t i, j;
+	int o, errors = 0;
+	if(start == NULL || order == NULL)
+	{
+		free(start);
+		free(order);
+		return 1;
+	}
+	// Counting sort of chain 1 buckets on first_other
+	for(j = 0 ; j < B->n ; j++) start[B->buckets[j].first_other + 1]++;
+	for(o = 0 ; o < 129 ; o++) start[o + 1] += start[o];
+	{
+		size_t fill[129];
+		memcpy(fill, start, sizeof(fill));
+		for(j = 0 ; j < B->n ; j++) order[fill[B->buckets[j].first_other]++] = j;
+	}
+	for(i = 0 ; i < A->n && !errors ; i++)
+	{
+		const chain_bucket *a = &A->buckets[i];
+		if(a->nothers < s->max_other)
+		{
+			for(j = 0 ; j < B->n && !errors ; j++)
+				errors += pair_bucket(s, a, &B->buckets[j]);
+			continue;
+		}
+		// Only chain 1 buckets without others, or whose lowest other is one of ours
+		idxset others = set_andnot(a->set, s->allowed);
+		for(o = 0 ; o <= 128 && !errors ; o++)
+		{
+			if(o < 128 && !set_has(others, o)) continue;
+			for(j = start[o] ; j < start[o + 1] && !errors ; j++)
+				errors += pair_bucket(s, a, &B->buckets[order[j]]);
+		}
+	}
+	free(start);
+	free(order);
+	return errors;
+}
+
+static void add_step(hash1_solve_result *r, const candidate *c, idxset known)
+{
+	hash1_solve_step *step = &r->steps[r->nsteps++];
+	idxset unknown = set_andnot(c->set, known);
+	int i;
+	memcpy(step->csn, c->csn, 8);
+	hash1(step->csn, step->k);
+	step->nrecovered = 0;
+	for(i = 0 ; i < 128 ; i++)
+		if(set_has(unknown, i))
+			step->recovered[step->nrecovered++] = i;
+}
+
+/*
+ * Greedy set cover: take the CSN that recovers the most targets, ties broken by the
+ * fewest bytes to bruteforce.
+ */
+static void solve_greedy(const solver *s, hash1_solve_result *r)
+{
+	idxset known = s->known;
+	while(!set_empty(set_andnot(s->targets, known)) && r->nsteps < HASH1_SOLVE_MAX_STEPS)
+	{
+		size_t i, best = 0;
+		int bestgain = 0, bestunknown = 0;
+		for(i = 0 ; i < s->ncands ; i++)
+		{
+			idxset unknown = set_andnot(s->cands[i].set, known);
+			int n = set_count(unknown);
+			if(n == 0 || n > s->max_unknown) continue;
+			int gain = set_count(set_and(unknown, s->targets));
+			if(gain > bestgain || (gain == bestgain && gain && n < bestunknown))
+			{
+				best = i;
+				bestgain = gain;
+				bestunknown = n;
+			}
+		}
+		if(bestgain == 0) break;
+		add_step(r, &s->cands[best], known);
+		known = set_or(known, s->cands[best].set);
+	}
+	r->complete = set_empty(set_andnot(s->targets, known));
+}
+
+typedef struct {
+	idxset unknown;
+	int gain;
+	size_t cand;
+} move;
+
+static int move_cmp(const void *p1, const void *p2)
+{
+	const move *m1 = (const move*) p1, *m2 = (const move*) p2;
+	if(m1->gain != m2->gain) return m2->gain - m1->gain;
+	if(m1->unknown.w[0] != m2->unknown.w[0]) return m1->unknown.w[0] < m2->unknown.w[0] ? -1 : 1;
+	if(m1->unknown.w[1] != m2->unknown.w[1]) return m1->unknown.w[1] < m2->unknown.w[1] ? -1 : 1;
+	return m1->cand < m2->cand ? -1 : m1->cand > m2->cand;
+}
+
+/*
+ * Depth limited search for a cover in 'depth' more steps.
+ * Returns 1 if found (path filled in), 0 if there is none, -1 if out of nodes or memory.
+ * The memo remembers, per known set, the largest depth that failed.
+ */
+static int exact_search(solver *s, idxset known, int depth, size_t *path)
+{
+	idxset missing = set_andnot(s->targets, known);
+	int rem = set_count(missing), result = 0;
+	size_t i, n = 0;
+	if(rem == 0) return 1;
+	if(depth == 0 || rem > depth * s->max_unknown) return 0;
+	if(setmap_get(&s->memo, known) >= (uint32_t) depth) return 0;
+	if(++s->nodes > EXACT_NODE_LIMIT) return -1;
+
+	move *moves = malloc(s->ncands * sizeof(move));
+	if(moves == NULL) return -1;
+	for(i = 0 ; i < s->ncands ; i++)
+	{
+		idxset unknown = set_andnot(s->cands[i].set, known);
+		int u = set_count(unknown);
+		if(u == 0 || u > s->max_unknown) continue;
+		int gain = set_count(set_and(unknown, s->targets));
+		// The rest must still fit in depth-1 steps
+		if(gain == 0 || rem - gain > (depth - 1) * s->max_unknown) continue;
+		moves[n].unknown = unknown;
+		moves[n].gain = gain;
+		moves[n].cand = i;
+		n++;
+	}
+	qsort(moves, n, sizeof(move), move_cmp);
+	for(i = 0 ; i < n && result == 0 ; i++)
+	{
+		if(i > 0 && set_equal(moves[i].unknown, moves[i - 1].unknown)) continue;
+		path[0] = moves[i].cand;
+		result = exact_search(s, set_or(known, s->cands[moves[i].cand].set), depth - 1, path + 1);
+	}
+	free(moves);
+	if(result == 0 && s->memo.count < EXACT_MEMO_LIMIT)
+		if(setmap_put(&s->memo, known, depth)) return -1;
+	return result;
+}
+
+static void solve_exact(solver *s, hash1_solve_result *r)
+{
+	size_t path[HASH1_SOLVE_MAX_STEPS];
+	int rem = set_count(set_andnot(s->targets, s->known));
+	int depth, i;
+	// Iterative deepening, up to one step less than the greedy solution
+	for(depth = (rem + s->max_unknown - 1) / s->max_unknown ; depth < r->nsteps ; depth++)
+	{
+		int found = exact_search(s, s->known, depth, path);
+		if(found < 0) return;
+		if(found == 0) continue;
+		idxset known = s->known;
+		r->nsteps = 0;
+		for(i = 0 ; i < depth ; i++)
+		{
+			add_step(r, &s->cands[path[i]], known);
+			known = set_or(known, s->cands[path[i]].set);
+		}
+		break;
+	}
+	r->optimal = true;
+}
+
+int hash1Solve(const hash1_solve_config *config, hash1_solve_result *result)
+{
+	solver s;
+	int i, errors = 0;
+	struct timespec t1, t2;
+
+	memset(&s, 0, sizeof(s));
+	memset(result, 0, sizeof(hash1_solve_result));
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	s.config = config;
+	s.max_unknown = config->max_unknown > 0 ? config->max_unknown : 3;
+	s.max_other = config->max_other;
+	for(i = 0 ; i < 128 ; i++)
+	{
+		if(config->target[i]) set_add(&s.targets, i);
+		if(config->known[i] || (config->keytable && (config->keytable[i] & CRACKED)))
+			set_add(&s.known, i);
+	}
+	s.allowed = set_or(s.targets, s.known);
+
+	errors += enumerate_chain(&s, 0);
+	if(!errors) errors += enumerate_chain(&s, 1);
+	if(!errors) errors += pair_chains(&s);
+	if(!errors)
+	{
+		result->candidates = s.ncands;
+		solve_greedy(&s, result);
+		if(config->exact && result->complete)
+			solve_exact(&s, result);
+	}
+	if(errors)
+		prnlog("[+] hash1 solver ran out of memory");
+
+	for(i = 0 ; i < 2 ; i++)
+	{
+		free(s.chain[i].buckets);
+		setmap_free(&s.chain[i].map);
+	}
+	free(s.cands);
+	setmap_free(&s.candmap);
+	setmap_free(&s.memo);
+
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	result->seconds = (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / 1e9;
+	return errors || !result->complete;
+}
+
+void hash1PrintSolution(const hash1_solve_result *result)
+{
+	int i, j;
+	char recovered[8 * 5 + 1];
+	prnlog("// CSN                HASH1                     Bytes recovered");
+	for(i = 0 ; i < result->nsteps ; i++)
+	{
+		const hash1_solve_step *st = &result->steps[i];
+		const uint8_t *csn = st->csn, *k = st->k;
+		recovered[0] = 0;
+		for(j = 0 ; j < st->nrecovered ; j++)
+			sprintf(recovered + strlen(recovered), "%s%d", j ? "," : "", st->recovered[j]);
+		prnlog("%02x%02x%02x%02x%02x%02x%02x%02x   %02x %02x %02x %02x %02x %02x %02x %02x   {%s}"
+			   ,csn[0],csn[1],csn[2],csn[3],csn[4],csn[5],csn[6],csn[7]
+			   ,k[0],k[1],k[2],k[3],k[4],k[5],k[6],k[7], recovered);
+	}
+	prnlog("[+] %d CSNs%s%s, from %llu candidate index sets, in %f seconds", result->nsteps,
+		   result->complete ? "" : " (incomplete, some targets can not be reached)",
+		   result->optimal ? " (minimal)" : "",
+		   (unsigned long long) result->candidates, result->seconds);
+}
+
+int hash1ParseIndexList(const char *list, bool set[128])
+{
+	const char *p = list;
+	while(*p)
+	{
+		char *end;
+		long lo = strtol(p, &end, 0), hi = lo;
+		if(end == p) return 1;
+		p = end;
+		if(*p == '-')
+		{
+			hi = strtol(p + 1, &end, 0);
+			if(end == p + 1) return 1;
+			p = end;
+		}
+		if(lo < 0 || hi > 127 || lo > hi) return 1;
+		for( ; lo <= hi ; lo++) set[lo] = true;
+		if(*p == ',') p++;
+		else if(*p) return 1;
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+// TEST CODE BELOW
+// ----------------------------------------------------------------------------
+
+/*
+ * Replays a solution the way bruteforceItem would: every CSN must match the template,
+ * have the right hash1, need at most max_unknown bytes, and the targets must all be
+ * recovered in the end.
+ */
+static int checkSolution(const hash1_solve_config *config, const hash1_solve_result *r, int max_unknown)
+{
+	bool known[128];
+	int i, j, errors = 0;
+	for(i = 0 ; i < 128 ; i++)
+		known[i] = config->known[i] || (config->keytable && (config->keytable[i] & CRACKED));
+	for(i = 0 ; i < r->nsteps && !errors ; i++)
+	{
+		const hash1_solve_step *st = &r->steps[i];
+		uint8_t k[8];
+		int nunknown = 0, nnew = 0;
+		hash1((uint8_t*) st->csn, k);
+		for(j = 0 ; j < 8 ; j++)
+			if(!(config->free_mask & (1 << j)) && st->csn[j] != config->csn[j]) errors++;
+		if(memcmp(k, st->k, 8)) errors++;
+		for(j = 0 ; j < 8 ; j++)
+		{
+			if(known[k[j]]) continue;
+			// As in bruteforceItem, a k[7] that only feeds DES parity bits is not recovered
+			if(j == 7 && hash1ParityOnly(k)) break;
+			known[k[j]] = true;
+			nunknown++;
+			if(config->target[k[j]]) nnew++;
+		}
+		if(nunknown > max_unknown || nnew == 0 || nunknown != st->nrecovered) errors++;
+	}
+	for(i = 0 ; i < 128 ; i++)
+		if(config->target[i] && !known[i]) errors++;
+	return errors;
+}
+
+int testHash1Solver()
+{
+	prnlog("[+] Testing hash1 solver...");
+	hash1_solve_config config;
+	hash1_solve_result *r = malloc(sizeof(hash1_solve_result));
+	uint16_t keytable[128] = {0};
+	int i, greedy, errors = 0;
+	if(r == NULL) return 1;
+
+	// The setup of the CSNs in elite_crack.h: suffix ff 12 e0, recover indices 0..15
+	memset(&config, 0, sizeof(config));
+	config.free_mask = 0x1F;
+	config.csn[5] = 0xff; config.csn[6] = 0x12; config.csn[7] = 0xe0;
+	errors += hash1ParseIndexList("0-15", config.target);
+	config.max_unknown = 3;
+	config.max_other = 1;
+	if(hash1Solve(&config, r) || checkSolution(&config, r, 3) || r->nsteps > 8)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: hash1 solver, %d steps, complete: %d", r->nsteps, r->complete);
+		errors++;
+	}
+	greedy = r->nsteps;
+
+	// Seeded with a keytable where everything but 14 and 15 is cracked
+	for(i = 0 ; i < 128 ; i++)
+		if(i != 14 && i != 15) keytable[i] = CRACKED;
+	config.keytable = keytable;
+	if(hash1Solve(&config, r) || checkSolution(&config, r, 3) || r->nsteps != 1)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: seeded hash1 solver, %d steps", r->nsteps);
+		errors++;
+	}
+	config.keytable = NULL;
+
+	// Exact search can not do worse than greedy, and 16 targets need at least 6 steps
+	config.exact = true;
+	if(hash1Solve(&config, r) || checkSolution(&config, r, 3) || r->nsteps > greedy || r->nsteps < 6)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: exact hash1 solver, %d steps", r->nsteps);
+		errors++;
+	}
+
+	bool set[128] = {false};
+	if(hash1ParseIndexList("0x45,1-3", set) || !set[0x45] || !set[2] || set[0] || set[4]
+			|| !hash1ParseIndexList("5-", set) || !hash1ParseIndexList("200", set))
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: hash1 index list parsing");
+		errors++;
+	}
+	free(r);
+	if(!errors)
+		prnlog("[+] hash1 solver OK!");
+	return errors;
+}
@@ -0,0 +1,110 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+#ifndef HASH1_SOLVER_H
+#define HASH1_SOLVER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+  Constructive search for attack CSNs. Instead of scanning the CSN space, the solver runs
+  hash1 backwards: the eight outputs split into two independent chains,
+	k[1],k[2],k[4],k[6]  depend only on the byte sum S and csn[2], csn[4], csn[6]
+	k[0],k[3],k[5],k[7]  depend only on the byte xor X and csn[3], csn[5], csn[7]
+  Each chain is enumerated on its own (pruning on the keytable indices it produces), chains
+  are paired, and csn[0], csn[1] are then solved from c0^c1 and c0+c1 to hit S and X.
+  The CSNs found are used for a greedy (or exact) set cover of the target indices.
+**/
+
+#define HASH1_SOLVE_MAX_STEPS 64
+
+typedef struct {
+	uint8_t csn[8];				// template, the fixed bytes
+	uint8_t free_mask;			// bit i set = csn[i] is free. Leave csn[0] and csn[1] free, they
+								// are solved for last; fixing them leaves few solutions
+	bool target[128];			// keytable indices to recover, e.g. 0..15
+	bool known[128];			// indices already recovered
+	const uint16_t *keytable;	// optional, entries marked CRACKED are also known
+	int max_unknown;			// max bytes to bruteforce per CSN, 0 = 3 (what bruteforceItem supports)
+	int max_other;				// max distinct indices per CSN that are neither target nor known
+	bool exact;					// search for a minimal number of CSNs, not just a greedy one
+} hash1_solve_config;
+
+typedef struct {
+	uint8_t csn[8];
+	uint8_t k[8];
+	uint8_t recovered[8];		// keytable indices that become known with this CSN
+	int nrecovered;
+} hash1_solve_step;
+
+typedef struct {
+	hash1_solve_step steps[HASH1_SOLVE_MAX_STEPS];
+	int nsteps;
+	bool complete;				// all targets are covered
+	bool optimal;				// exact search finished, no shorter sequence exists
+	uint64_t candidates;		// distinct index sets found
+	double seconds;
+} hash1_solve_result;
+
+/**
+ * @brief Builds a sequence of CSNs which, attacked in order, recover all target indices
+ * @param config
+ * @param result
+ * @return 0 for ok, 1 for failz (including when not all targets could be covered)
+ */
+int hash1Solve(const hash1_solve_config *config, hash1_solve_result *result);
+/**
+ * @brief Prints a solution, one CSN per line
+ */
+void hash1PrintSolution(const hash1_solve_result *result);
+/**
+ * @brief Parses a list of keytable indices like "0-15,0x45" into a 128 entry bool array
+ * @return 0 for ok, 1 for failz
+ */
+int hash1ParseIndexList(const char *list, bool set[128]);
+
+int testHash1Solver();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HASH1_SOLVER_H
@@ -69,11 +69,10 @@ From "Dismantling iclass":
 #include "fileutils.h"
 #include "cipherutils.h"
 #include "des.h"
+#include "ikeys.h"
+#include "loclass_config.h"
 
-uint8_t pi[35] = {0x0F,0x17,0x1B,0x1D,0x1E,0x27,0x2B,0x2D,0x2E,0x33,0x35,0x39,0x36,0x3A,0x3C,0x47,0x4B,0x4D,0x4E,0x53,0x55,0x56,0x59,0x5A,0x5C,0x63,0x65,0x66,0x69,0x6A,0x6C,0x71,0x72,0x74,0x78};
-
-static des_context ctx_enc = {DES_ENCRYPT,{0}};
-static des_context ctx_dec = {DES_DECRYPT,{0}};
+const uint8_t pi[35] = {0x0F,0x17,0x1B,0x1D,0x1E,0x27,0x2B,0x2D,0x2E,0x33,0x35,0x39,0x36,0x3A,0x3C,0x47,0x4B,0x4D,0x4E,0x53,0x55,0x56,0x59,0x5A,0x5C,0x63,0x65,0x66,0x69,0x6A,0x6C,0x71,0x72,0x74,0x78};
 
 static int debug_print = 0;
 
@@ -391,14 +390,26 @@ void hash0(uint64_t c, uint8_t k[8])
  */
 void diversifyKey(uint8_t csn[8], uint8_t key[8], uint8_t div_key[8])
 {
+	// Prepare the DES key. The context is kept on the stack so that
+	// diversification can run on several threads at once.
+	des_context ctx = {DES_ENCRYPT,{0}};
+	des_setkey_enc( &ctx, key);
 
-	// Prepare the DES key
-	des_setkey_enc( &ctx_enc, key);
-
+	diversifyKeyWithContext(&ctx, csn, div_key);
+}
+/**
+ * @brief Same as diversifyKey, but with an already prepared DES key schedule. When many
+ * CSNs are diversified with the same master key, this saves the des_setkey_enc per CSN.
+ * @param ctx DES context, set up with des_setkey_enc and the master key
+ * @param csn
+ * @param div_key
+ */
+void diversifyKeyWithContext(des_context *ctx, uint8_t csn[8], uint8_t div_key[8])
+{
 	uint8_t crypted_csn[8] = {0};
 
 	// Calculate DES(CSN, KEY)
-	des_crypt_ecb(&ctx_enc,csn, crypted_csn);
+	des_crypt_ecb(ctx,csn, crypted_csn);
 
 	//Calculate HASH0(DES))
     uint64_t crypt_csn = x_bytes_to_num(crypted_csn, 8);
@@ -407,9 +418,28 @@ void diversifyKey(uint8_t csn[8], uint8_t key[8], uint8_t div_key[8])
 	hash0(crypt_csn,div_key);
 }
 
+int readKeyFile(uint8_t key[8], int size)
+{
+
+	FILE *f;
+
+	f = fopen("iclass_key.bin", "rb");
+	if (f)
+	{
+		if(fread(key, size, 1, f) == 1) return 0;
+	}
+	return 1;
+
+}
 
+// ----------------------------------------------------------------------------
+// TEST CODE BELOW
+// ----------------------------------------------------------------------------
 
+#ifndef LOCLASS_NO_TESTS
 
+static des_context ctx_enc = {DES_ENCRYPT,{0}};
+static des_context ctx_dec = {DES_DECRYPT,{0}};
 
 void testPermute()
 {
@@ -477,7 +507,7 @@ int testDES(Testcase testcase, des_context ctx_enc, des_context ctx_dec)
 	if(memcmp(testcase.uid,decrypted,8) != 0)
 	{
 		//Decryption fail
-		prnlog("Encryption <-> Decryption FAIL");
+		logmsg(LOG_LEVEL_ERROR, "Encryption <-> Decryption FAIL");
 		printarr("Input", testcase.uid, 8);
 		printarr("Decrypted", decrypted, 8);
 		retval = 1;
@@ -486,7 +516,7 @@ int testDES(Testcase testcase, des_context ctx_enc, des_context ctx_dec)
 	if(memcmp(des_encrypted_csn,testcase.t_key,8) != 0)
 	{
 		//Encryption fail
-		prnlog("Encryption != Expected result");
+		logmsg(LOG_LEVEL_ERROR, "Encryption != Expected result");
 		printarr("Output", des_encrypted_csn, 8);
 		printarr("Expected", testcase.t_key, 8);
 		retval = 1;
@@ -497,7 +527,7 @@ int testDES(Testcase testcase, des_context ctx_enc, des_context ctx_dec)
 	if(memcmp(div_key, testcase.div_key ,8) != 0)
 	{
 		//Key diversification fail
-		prnlog("Div key != expected result");
+		logmsg(LOG_LEVEL_ERROR, "Div key != expected result");
 		printarr("  csn   ", testcase.uid,8);
 		printarr("{csn}   ", des_encrypted_csn,8);
 		printarr("hash0   ", div_key, 8);
@@ -527,19 +557,19 @@ void des_checkParity(uint8_t* key)
 		if(parity != (key[i] & 0x1))
 		{
 			fails++;
-			prnlog("[+] parity1 fail, byte %d [%02x] was %d, should be %d",i,key[i],(key[i] & 0x1),parity);
+			logmsg(LOG_LEVEL_ERROR, "[+] parity1 fail, byte %d [%02x] was %d, should be %d",i,key[i],(key[i] & 0x1),parity);
 		}
 	}
 	if(fails)
 	{
-		prnlog("[+] parity fails: %d", fails);
+		logmsg(LOG_LEVEL_ERROR, "[+] parity fails: %d", fails);
 	}else
 	{
 		prnlog("[+] Key syntax is with parity bits inside each byte");
 	}
 }
 
-Testcase testcases[] ={
+static const Testcase testcases[] ={
 
 	{{0x8B,0xAC,0x60,0x1F,0x53,0xB8,0xED,0x11},{0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00},{0x02,0x04,0x06,0x08,0x01,0x03,0x05,0x07}},
 	{{0xAE,0x51,0xE5,0x62,0xE7,0x9A,0x99,0x39},{0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x01},{0x04,0x02,0x06,0x08,0x01,0x03,0x05,0x07}},
@@ -625,7 +655,7 @@ int testKeyDiversificationWithMasterkeyTestcases()
 	}
 	if(error)
 	{
-		prnlog("[+] %d errors occurred (%d testcases)", error, i);
+		logmsg(LOG_LEVEL_ERROR, "[+] %d errors occurred (%d testcases)", error, i);
 	}else
 	{
 		prnlog("[+] Hashing seems to work (%d testcases)", i);
@@ -658,7 +688,7 @@ uint64_t testCryptedCSN(uint64_t crypted_csn, uint64_t expected)
 	{
 
 		if(debug_print) {
-			prnlog("\n[+] FAIL!");
+			logmsg(LOG_LEVEL_ERROR, "\n[+] FAIL!");
 			print64bits("    expected       " ,  expected );
 		}
 		retval = 1;
@@ -726,7 +756,7 @@ int doTestsWithKnownInputs()
 
 	if(errors)
 	{
-		prnlog("[+] %d errors occurred (9 testcases)", errors);
+		logmsg(LOG_LEVEL_ERROR, "[+] %d errors occurred (9 testcases)", errors);
 	}else
 	{
 		prnlog("[+] Hashing seems to work (9 testcases)" );
@@ -734,19 +764,6 @@ int doTestsWithKnownInputs()
 	return errors;
 }
 
-int readKeyFile(uint8_t key[8], int size)
-{
-
-	FILE *f;
-
-	f = fopen("iclass_key.bin", "rb");
-	if (f)
-	{
-		if(fread(key, size, 1, f) == 1) return 0;
-	}
-	return 1;
-
-}
 
 
 int doKeyTests(uint8_t debuglevel)
@@ -788,6 +805,8 @@ int doKeyTests(uint8_t debuglevel)
 	return 0;
 }
 
+#endif // LOCLASS_NO_TESTS
+
 /**
 
 void checkParity2(uint8_t* key)
@@ -42,6 +42,8 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+#include "des.h"
 
 /**
  * @brief
@@ -64,6 +66,15 @@ int doKeyTests(uint8_t debuglevel);
  */
 
 void diversifyKey(uint8_t csn[8], uint8_t key[8], uint8_t div_key[8]);
+/**
+ * @brief Same as diversifyKey, but using a DES context already set up with
+ * des_setkey_enc(ctx, key). Thread safe as long as each thread uses its own ctx,
+ * or the ctx is only read.
+ * @param ctx
+ * @param csn
+ * @param div_key
+ */
+void diversifyKeyWithContext(des_context *ctx, uint8_t csn[8], uint8_t div_key[8]);
 /**
  * @brief Permutes a key from standard NIST format to Iclass specific format
  * @param key
@@ -0,0 +1,826 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#include "optimized_cipher.h"
+#include "ikeys.h"
+#include "des.h"
+#include "elite_crack.h"
+#include "fileutils.h"
+#include "threadpool.h"
+#include "jobs.h"
+
+#define JOB_CHECK_EVERY 256
+#define JOB_ITEM_UNITS 1000		// progress units per crack item
+
+typedef enum {
+	JOB_CRACK,
+	JOB_DIVERSIFY,
+	JOB_READER_MAC,
+	JOB_TAG_MAC,
+} job_type;
+
+struct job {
+	job_queue *q;
+	job_type type;
+	job_priority priority;
+	uint64_t seq;				// submission order, oldest first within a priority
+	void *user;
+	// Under q->lock
+	job_state state;
+	bool completed;				// on the completion queue
+	job *next;					// in q->queued or q->completed
+	job *all_prev, *all_next;	// in q->all
+	// Atomic
+	int cancel;
+	uint64_t done;
+	uint64_t total;
+	// Crack
+	dumpdata *dump;
+	size_t items;
+	uint16_t keytable[128];
+	uint8_t kcus[8];
+	bool have_kcus;
+	// Batches
+	void *batch;
+	size_t count;
+	bool elite;
+	uint8_t key[8];
+};
+
+struct job_queue {
+	pthread_t *workers;
+	int nworkers;
+	int fd[2];					// eventfd (both the same) or pipe, one token per completed job
+	// Under lock
+	pthread_mutex_t lock;
+	pthread_cond_t work;		// something was queued, or a crack slot freed up
+	pthread_cond_t changed;		// some job completed
+	job *queued;
+	job *completed, *completed_tail;
+	job *all;
+	int running_cracks;
+	uint64_t seq;
+	bool stopping;
+};
+
+// ----------------------------------------------------------------------------
+// Queue
+// ----------------------------------------------------------------------------
+
+static void jobNotify(job_queue *q)
+{
+	ssize_t r;
+#ifdef __linux__
+	uint64_t one = 1;
+	r = write(q->fd[1], &one, sizeof(one));
+#else
+	uint8_t one = 1;
+	r = write(q->fd[1], &one, sizeof(one));
+#endif
+	(void) r;
+}
+
+static void jobConsumeToken(job_queue *q)
+{
+	ssize_t r;
+#ifdef __linux__
+	uint64_t token;
+#else
+	uint8_t token;
+#endif
+	r = read(q->fd[0], &token, sizeof(token));
+	(void) r;
+}
+
+/*
+ * The queued job a worker should take next, or NULL. With only_above >= 0 (a crack
+ * running waiting jobs inline), only non-crack jobs of a higher priority qualify.
+ * Called with q->lock held.
+ */
+static job* jobPick(job_queue *q, int only_above)
+{
+	job *j, *best = NULL;
+	for(j = q->queued ; j ; j = j->next)
+	{
+		if(j->type == JOB_CRACK)
+		{
+			if(only_above >= 0) continue;
+			// Keep the last free worker for short jobs
+			if(q->nworkers > 1 && q->running_cracks >= q->nworkers - 1) continue;
+		}
+		if(only_above >= 0 && (int) j->priority <= only_above) continue;
+		if(!best || j->priority > best->priority ||
+		   (j->priority == best->priority && j->seq < best->seq))
+			best = j;
+	}
+	if(best)
+	{
+		job **p = &q->queued;
+		while(*p != best) p = &(*p)->next;
+		*p = best->next;
+		best->next = NULL;
+		best->state = JOB_RUNNING;
+		if(best->type == JOB_CRACK) q->running_cracks++;
+	}
+	return best;
+}
+
+/*
+ * Moves a job to its final state and onto the completion queue.
+ * Called with q->lock held.
+ */
+static void jobComplete(job_queue *q, job *j, job_state state)
+{
+	if(j->state == JOB_RUNNING && j->type == JOB_CRACK)
+	{
+		q->running_cracks--;
+		pthread_cond_broadcast(&q->work);
+	}
+	j->state = state;
+	j->completed = true;
+	j->next = NULL;
+	if(q->completed_tail)
+		q->completed_tail->next = j;
+	else
+		q->completed = j;
+	q->completed_tail = j;
+	jobNotify(q);
+	pthread_cond_broadcast(&q->changed);
+}
+
+// ----------------------------------------------------------------------------
+// Running jobs
+// ----------------------------------------------------------------------------
+
+static int jobRun(job *j);
+
+/*
+ * Runs the waiting non-crack jobs with a higher priority than the crack on this
+ * thread, so that they do not wait for the crack to finish.
+ */
+static void jobRunWaiting(job_queue *q, job_priority above)
+{
+	job *j;
+	pthread_mutex_lock(&q->lock);
+	while(!q->stopping && (j = jobPick(q, (int) above)) != NULL)
+	{
+		pthread_mutex_unlock(&q->lock);
+		int errors = jobRun(j);
+		pthread_mutex_lock(&q->lock);
+		jobComplete(q, j, __atomic_load_n(&j->cancel, __ATOMIC_RELAXED) ? JOB_CANCELLED :
+					errors ? JOB_FAILED : JOB_DONE);
+	}
+	pthread_mutex_unlock(&q->lock);
+}
+
+typedef struct {
+	job *j;
+	size_t item;
+} job_crack_ctx;
+
+static int jobCrackProgress(const crack_progress *p, void *arg)
+{
+	job_crack_ctx *c = (job_crack_ctx*) arg;
+	job *j = c->j;
+	uint64_t done = c->item * JOB_ITEM_UNITS;
+	if(p->total)
+		done += p->candidates * JOB_ITEM_UNITS / p->total;
+	__atomic_store_n(&j->done, done, __ATOMIC_RELAXED);
+	jobRunWaiting(j->q, j->priority);
+	return __atomic_load_n(&j->cancel, __ATOMIC_RELAXED);
+}
+
+static int jobRunCrack(job *j)
+{
+	job_crack_ctx c = {j, 0};
+	uint64_t kcus = 0;
+	int errors = 0;
+	size_t i;
+
+	setCrackProgress(jobCrackProgress, &c);
+	for(i = 0 ; i < j->items ; i++)
+	{
+		c.item = i;
+		errors += bruteforceItem(j->dump[i], j->keytable);
+		if(crackAborted()) break;
+		__atomic_store_n(&j->done, (i + 1) * JOB_ITEM_UNITS, __ATOMIC_RELAXED);
+	}
+	setCrackProgress(NULL, NULL);
+	if(__atomic_load_n(&j->cancel, __ATOMIC_RELAXED)) return 0;
+
+	if(calculateMasterKeyFromKeytable(j->keytable, &kcus) == 0)
+	{
+		memcpy(j->kcus, &kcus, 8);
+		j->have_kcus = true;
+	}
+	return errors;
+}
+
+static void jobRunDiversify(job *j)
+{
+	job_diversify_item *items = (job_diversify_item*) j->batch;
+	des_context ctx = {DES_ENCRYPT,{0}};
+	uint8_t keytable[128], key[8];
+	size_t n;
+
+	memcpy(key, j->key, 8);
+	if(j->elite)
+		hash2(key, keytable);
+	else
+		des_setkey_enc(&ctx, key);
+
+	for(n = 0 ; n < j->count ; n++)
+	{
+		if(n % JOB_CHECK_EVERY == 0)
+		{
+			__atomic_store_n(&j->done, n, __ATOMIC_RELAXED);
+			if(__atomic_load_n(&j->cancel, __ATOMIC_RELAXED)) return;
+		}
+		if(j->elite)
+			diversifyKeyElite(keytable, items[n].csn, items[n].div_key);
+		else
+			diversifyKeyWithContext(&ctx, items[n].csn, items[n].div_key);
+	}
+	__atomic_store_n(&j->done, j->count, __ATOMIC_RELAXED);
+}
+
+static void jobRunMACs(job *j)
+{
+	job_mac_item *items = (job_mac_item*) j->batch;
+	size_t n;
+
+	for(n = 0 ; n < j->count ; n++)
+	{
+		if(n % JOB_CHECK_EVERY == 0)
+		{
+			__atomic_store_n(&j->done, n, __ATOMIC_RELAXED);
+			if(__atomic_load_n(&j->cancel, __ATOMIC_RELAXED)) return;
+		}
+		if(j->type == JOB_READER_MAC)
+			opt_doReaderMAC(items[n].cc_nr, items[n].div_key, items[n].mac);
+		else
+			opt_doTagMAC(items[n].cc_nr, items[n].div_key, items[n].mac);
+	}
+	__atomic_store_n(&j->done, j->count, __ATOMIC_RELAXED);
+}
+
+/*
+ * Runs a job which jobPick handed out
+ * @return number of errors
+ */
+static int jobRun(job *j)
+{
+	switch(j->type)
+	{
+	case JOB_CRACK:
+		return jobRunCrack(j);
+	case JOB_DIVERSIFY:
+		jobRunDiversify(j);
+		return 0;
+	case JOB_READER_MAC:
+	case JOB_TAG_MAC:
+		jobRunMACs(j);
+		return 0;
+	}
+	return 1;
+}
+
+static void* jobWorker(void *arg)
+{
+	job_queue *q = (job_queue*) arg;
+	job *j;
+
+	pthread_mutex_lock(&q->lock);
+	while(!q->stopping)
+	{
+		if((j = jobPick(q, -1)) == NULL)
+		{
+			pthread_cond_wait(&q->work, &q->lock);
+			continue;
+		}
+		pthread_mutex_unlock(&q->lock);
+		int errors = jobRun(j);
+		pthread_mutex_lock(&q->lock);
+		jobComplete(q, j, __atomic_load_n(&j->cancel, __ATOMIC_RELAXED) ? JOB_CANCELLED :
+					errors ? JOB_FAILED : JOB_DONE);
+	}
+	pthread_mutex_unlock(&q->lock);
+	return NULL;
+}
+
+// ----------------------------------------------------------------------------
+// API
+// ----------------------------------------------------------------------------
+
+job_queue* jobQueueCreate(int threads)
+{
+	job_queue *q = calloc(1, sizeof(job_queue));
+	int i;
+
+	if(!q) return NULL;
+	if(threads <= 0) threads = numberOfCores();
+#ifdef __linux__
+	q->fd[0] = q->fd[1] = eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC);
+	if(q->fd[0] < 0)
+#else
+	if(pipe(q->fd) != 0 ||
+	   fcntl(q->fd[0], F_SETFL, O_NONBLOCK) != 0 || fcntl(q->fd[1], F_SETFL, O_NONBLOCK) != 0)
+#endif
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to create the completion descriptor: %s", strerror(errno));
+		free(q);
+		return NULL;
+	}
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_cond_init(&q->work, NULL);
+	pthread_cond_init(&q->changed, NULL);
+	q->workers = calloc(threads, sizeof(pthread_t));
+	for(i = 0 ; q->workers && i < threads ; i++)
+	{
+		if(pthread_create(&q->workers[i], NULL, jobWorker, q) != 0) break;
+		q->nworkers++;
+	}
+	if(q->nworkers < threads)
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to start the job workers");
+		jobQueueDestroy(q);
+		return NULL;
+	}
+	return q;
+}
+
+void jobQueueDestroy(job_queue *q)
+{
+	job *j;
+	int i;
+
+	if(!q) return;
+	pthread_mutex_lock(&q->lock);
+	q->stopping = true;
+	while((j = q->queued) != NULL)
+	{
+		q->queued = j->next;
+		jobComplete(q, j, JOB_CANCELLED);
+	}
+	for(j = q->all ; j ; j = j->all_next)
+		__atomic_store_n(&j->cancel, 1, __ATOMIC_RELAXED);
+	pthread_cond_broadcast(&q->work);
+	pthread_mutex_unlock(&q->lock);
+
+	for(i = 0 ; i < q->nworkers ; i++)
+		pthread_join(q->workers[i], NULL);
+
+	while((j = q->all) != NULL)
+	{
+		q->all = j->all_next;
+		free(j->dump);
+		free(j);
+	}
+#ifdef __linux__
+	close(q->fd[0]);
+#else
+	close(q->fd[0]);
+	close(q->fd[1]);
+#endif
+	pthread_cond_destroy(&q->changed);
+	pthread_cond_destroy(&q->work);
+	pthread_mutex_destroy(&q->lock);
+	free(q->workers);
+	free(q);
+}
+
+int jobQueueFd(job_queue *q)
+{
+	return q->fd[0];
+}
+
+job* jobNextCompleted(job_queue *q)
+{
+	job *j;
+	pthread_mutex_lock(&q->lock);
+	if((j = q->completed) != NULL)
+	{
+		q->completed = j->next;
+		if(!q->completed) q->completed_tail = NULL;
+		j->next = NULL;
+		j->completed = false;
+		jobConsumeToken(q);
+	}
+	pthread_mutex_unlock(&q->lock);
+	return j;
+}
+
+static job* jobNew(job_queue *q, job_type type, job_priority priority, void *user)
+{
+	job *j = calloc(1, sizeof(job));
+	if(!j) return NULL;
+	j->q = q;
+	j->type = type;
+	j->priority = priority;
+	j->user = user;
+	j->state = JOB_QUEUED;
+	return j;
+}
+
+static job* jobEnqueue(job_queue *q, job *j)
+{
+	pthread_mutex_lock(&q->lock);
+	if(q->stopping)
+	{
+		pthread_mutex_unlock(&q->lock);
+		free(j->dump);
+		free(j);
+		return NULL;
+	}
+	j->seq = q->seq++;
+	j->next = q->queued;
+	q->queued = j;
+	j->all_next = q->all;
+	if(q->all) q->all->all_prev = j;
+	q->all = j;
+	pthread_cond_broadcast(&q->work);
+	pthread_mutex_unlock(&q->lock);
+	return j;
+}
+
+job* jobSubmitCrack(job_queue *q, const dumpdata *dump, size_t items, job_priority priority, void *user)
+{
+	job *j = jobNew(q, JOB_CRACK, priority, user);
+	if(!j) return NULL;
+	j->dump = malloc(items ? items * sizeof(dumpdata) : 1);
+	if(!j->dump)
+	{
+		free(j);
+		return NULL;
+	}
+	memcpy(j->dump, dump, items * sizeof(dumpdata));
+	j->items = items;
+	j->total = items * JOB_ITEM_UNITS;
+	return jobEnqueue(q, j);
+}
+
+job* jobSubmitDiversify(job_queue *q, job_diversify_item *items, size_t count, bool elite,
+						const uint8_t key[8], job_priority priority, void *user)
+{
+	job *j = jobNew(q, JOB_DIVERSIFY, priority, user);
+	if(!j) return NULL;
+	j->batch = items;
+	j->count = j->total = count;
+	j->elite = elite;
+	memcpy(j->key, key, 8);
+	return jobEnqueue(q, j);
+}
+
+static job* jobSubmitMACs(job_queue *q, job_type type, job_mac_item *items, size_t count,
+						  job_priority priority, void *user)
+{
+	job *j = jobNew(q, type, priority, user);
+	if(!j) return NULL;
+	j->batch = items;
+	j->count = j->total = count;
+	return jobEnqueue(q, j);
+}
+
+job* jobSubmitReaderMAC(job_queue *q, job_mac_item *items, size_t count, job_priority priority, void *user)
+{
+	return jobSubmitMACs(q, JOB_READER_MAC, items, count, priority, user);
+}
+
+job* jobSubmitTagMAC(job_queue *q, job_mac_item *items, size_t count, job_priority priority, void *user)
+{
+	return jobSubmitMACs(q, JOB_TAG_MAC, items, count, priority, user);
+}
+
+job_state jobState(job *j)
+{
+	job_state state;
+	pthread_mutex_lock(&j->q->lock);
+	state = j->state;
+	pthread_mutex_unlock(&j->q->lock);
+	return state;
+}
+
+double jobProgress(job *j)
+{
+	job_state state = jobState(j);
+	if(state == JOB_DONE || state == JOB_FAILED) return 1.0;
+	if(!j->total) return 0.0;
+	return (double) __atomic_load_n(&j->done, __ATOMIC_RELAXED) / j->total;
+}
+
+void* jobUser(job *j)
+{
+	return j->user;
+}
+
+void jobCancel(job *j)
+{
+	job_queue *q = j->q;
+	pthread_mutex_lock(&q->lock);
+	__atomic_store_n(&j->cancel, 1, __ATOMIC_RELAXED);
+	if(j->state == JOB_QUEUED)
+	{
+		job **p = &q->queued;
+		while(*p != j) p = &(*p)->next;
+		*p = j->next;
+		jobComplete(q, j, JOB_CANCELLED);
+	}
+	pthread_mutex_unlock(&q->lock);
+}
+
+job_state jobWait(job *j)
+{
+	job_queue *q = j->q;
+	job_state state;
+	pthread_mutex_lock(&q->lock);
+	while(j->state == JOB_QUEUED || j->state == JOB_RUNNING)
+		pthread_cond_wait(&q->changed, &q->lock);
+	state = j->state;
+	pthread_mutex_unlock(&q->lock);
+	return state;
+}
+
+int jobCrackResult(job *j, uint16_t keytable[128], uint8_t kcus[8])
+{
+	if(j->type != JOB_CRACK || jobState(j) != JOB_DONE) return 1;
+	if(keytable) memcpy(keytable, j->keytable, sizeof(j->keytable));
+	if(!j->have_kcus) return 1;
+	if(kcus) memcpy(kcus, j->kcus, 8);
+	return 0;
+}
+
+void jobFree(job *j)
+{
+	job_queue *q;
+	if(!j) return;
+	q = j->q;
+	jobCancel(j);
+	jobWait(j);
+
+	pthread_mutex_lock(&q->lock);
+	if(j->completed)
+	{
+		job *prev = NULL, *c;
+		for(c = q->completed ; c != j ; c = c->next) prev = c;
+		if(prev) prev->next = j->next; else q->completed = j->next;
+		if(q->completed_tail == j) q->completed_tail = prev;
+		jobConsumeToken(q);
+	}
+	if(j->all_prev) j->all_prev->all_next = j->all_next; else q->all = j->all_next;
+	if(j->all_next) j->all_next->all_prev = j->all_prev;
+	pthread_mutex_unlock(&q->lock);
+	free(j->dump);
+	free(j);
+}
+
+// ----------------------------------------------------------------------------
+// TEST CODE BELOW
+// ----------------------------------------------------------------------------
+
+static bool jobTestReadable(job_queue *q)
+{
+	struct pollfd p = {jobQueueFd(q), POLLIN, 0};
+	return poll(&p, 1, 0) == 1 && (p.revents & POLLIN);
+}
+
+/*
+ * A dump whose first item needs three key bytes (2^24 candidates) and whose MAC
+ * never matches, so the crack keeps running until it is cancelled.
+ */
+static void jobTestLongDump(dumpdata *d)
+{
+	uint8_t csn[8] = {0x0b,0x00,0x0f,0xff,0xf7,0xff,0x12,0xe0};
+	memset(d, 0, sizeof(dumpdata));
+	memcpy(d->csn, csn, 8);
+}
+
+static void jobTestWaitRunning(job *j)
+{
+	struct timespec t = {0, 1000000};
+	while(jobState(j) == JOB_QUEUED)
+		nanosleep(&t, NULL);
+}
+
+static int jobTestResults(job_queue *q)
+{
+	enum { N = 600 };
+	job_diversify_item std[N], elite[N];
+	job_mac_item reader[N], tag[N];
+	uint8_t master[8] = {0x5b,0x7c,0x62,0xc4,0x91,0xc1,0x1b,0x39};
+	uint8_t kcus[8] = {0x9f,0x3a,0x41,0x77,0x0c,0xd2,0x65,0xe8};
+	uint8_t keytable[128];
+	uint8_t csn[8], expected[8], mac[4];
+	job *jobs[4];
+	int errors = 0, i, k, n;
+
+	srand(48);
+	for(n = 0 ; n < N ; n++)
+	{
+		for(i = 0 ; i < 8 ; i++)
+			std[n].csn[i] = elite[n].csn[i] = rand() & 0xFF;
+		for(i = 0 ; i < 12 ; i++)
+			reader[n].cc_nr[i] = tag[n].cc_nr[i] = rand() & 0xFF;
+		for(i = 0 ; i < 8 ; i++)
+			reader[n].div_key[i] = tag[n].div_key[i] = rand() & 0xFF;
+	}
+	jobs[0] = jobSubmitDiversify(q, std, N, false, master, JOB_PRIORITY_NORMAL, &std);
+	jobs[1] = jobSubmitDiversify(q, elite, N, true, kcus, JOB_PRIORITY_NORMAL, &elite);
+	jobs[2] = jobSubmitReaderMAC(q, reader, N, JOB_PRIORITY_NORMAL, &reader);
+	jobs[3] = jobSubmitTagMAC(q, tag, N, JOB_PRIORITY_NORMAL, &tag);
+	for(k = 0 ; k < 4 ; k++)
+	{
+		if(!jobs[k] || jobWait(jobs[k]) != JOB_DONE || jobProgress(jobs[k]) != 1.0)
+		{
+			logmsg(LOG_LEVEL_ERROR, "[+] FAILED: job %d did not finish", k);
+			return 1;
+		}
+	}
+	if(jobUser(jobs[2]) != &reader) errors++;
+
+	hash2(kcus, keytable);
+	for(n = 0 ; n < N ; n++)
+	{
+		memcpy(csn, std[n].csn, 8);
+		diversifyKey(csn, master, expected);
+		errors += memcmp(std[n].div_key, expected, 8) != 0;
+
+		memcpy(csn, elite[n].csn, 8);
+		diversifyKeyElite(keytable, csn, expected);
+		errors += memcmp(elite[n].div_key, expected, 8) != 0;
+
+		opt_doReaderMAC(reader[n].cc_nr, reader[n].div_key, mac);
+		errors += memcmp(reader[n].mac, mac, 4) != 0;
+		opt_doTagMAC(tag[n].cc_nr, tag[n].div_key, mac);
+		errors += memcmp(tag[n].mac, mac, 4) != 0;
+	}
+	if(errors) logmsg(LOG_LEVEL_ERROR, "[+] FAILED: job results differ from the reference (%d)", errors);
+
+	// All four completed, in some order, and the descriptor counts them
+	for(k = 0 ; k < 4 ; k++)
+	{
+		if(!jobTestReadable(q))
+		{
+			logmsg(LOG_LEVEL_ERROR, "[+] FAILED: completion descriptor not readable with %d jobs left", 4 - k);
+			errors++;
+			break;
+		}
+		job *c = jobNextCompleted(q);
+		if(!c)
+		{
+			errors++;
+			break;
+		}
+		jobFree(c);
+	}
+	if(jobTestReadable(q) || jobNextCompleted(q) != NULL)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: completion queue not empty after taking all jobs");
+		errors++;
+	}
+	return errors;
+}
+
+/*
+ * On a single worker: a running crack lets a waiting job of higher priority through,
+ * keeps one of equal priority queued, and stops when cancelled.
+ */
+static int jobTestCrackScheduling()
+{
+	job_queue *q = jobQueueCreate(1);
+	job_mac_item items[16];
+	dumpdata d;
+	uint16_t keytable[128];
+	int errors = 0;
+
+	if(!q) return 1;
+	memset(items, 0x42, sizeof(items));
+	jobTestLongDump(&d);
+	job *crack = jobSubmitCrack(q, &d, 1, JOB_PRIORITY_LOW, NULL);
+	jobTestWaitRunning(crack);
+	job *same = jobSubmitReaderMAC(q, items, 16, JOB_PRIORITY_LOW, NULL);
+	job *high = jobSubmitReaderMAC(q, items, 16, JOB_PRIORITY_HIGH, NULL);
+
+	if(jobWait(high) != JOB_DONE || jobState(crack) != JOB_RUNNING)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: high priority job did not run beside the crack");
+		errors++;
+	}
+	if(jobState(same) != JOB_QUEUED)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: job of the crack's priority did not wait for it");
+		errors++;
+	}
+	jobCancel(same);
+	if(jobState(same) != JOB_CANCELLED)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: queued job not cancelled at once");
+		errors++;
+	}
+	if(jobProgress(crack) <= 0.0)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: no progress reported for the running crack");
+		errors++;
+	}
+	jobCancel(crack);
+	if(jobWait(crack) != JOB_CANCELLED || jobCrackResult(crack, keytable, NULL) == 0)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: running crack not cancelled");
+		errors++;
+	}
+	jobQueueDestroy(q);
+	return errors;
+}
+
+/*
+ * On two workers: a second crack waits for the first, since the last free worker
+ * is kept for short jobs, which still get through
+ */
+static int jobTestCrackReserve()
+{
+	job_queue *q = jobQueueCreate(2);
+	job_diversify_item items[16];
+	uint8_t key[8] = {0};
+	dumpdata d;
+	int errors = 0;
+
+	if(!q) return 1;
+	memset(items, 0, sizeof(items));
+	jobTestLongDump(&d);
+	job *first = jobSubmitCrack(q, &d, 1, JOB_PRIORITY_NORMAL, NULL);
+	jobTestWaitRunning(first);
+	job *second = jobSubmitCrack(q, &d, 1, JOB_PRIORITY_NORMAL, NULL);
+	job *small = jobSubmitDiversify(q, items, 16, false, key, JOB_PRIORITY_LOW, NULL);
+
+	if(jobWait(small) != JOB_DONE || jobState(second) != JOB_QUEUED)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: cracks took the last free worker");
+		errors++;
+	}
+	// Destroying the queue cancels both cracks and frees the jobs
+	jobQueueDestroy(q);
+	return errors;
+}
+
+int testJobs()
+{
+	prnlog("[+] Testing job queue...");
+	int errors = 0;
+	job_queue *q = jobQueueCreate(2);
+	if(!q) return 1;
+	errors += jobTestResults(q);
+	jobQueueDestroy(q);
+	errors += jobTestCrackScheduling();
+	errors += jobTestCrackReserve();
+
+	if(errors == 0)
+		prnlog("[+] Job queue ok");
+	return errors;
+}
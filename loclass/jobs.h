@@ -0,0 +1,164 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#ifndef JOBS_H
+#define JOBS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "elite_crack.h"
+
+/**
+ * Asynchronous jobs for applications with an event loop: cracks, bulk diversification
+ * and MAC batches are submitted to a job_queue and run on its worker threads, and the
+ * caller gets a handle back right away. A job can be polled (jobState, jobProgress),
+ * waited for, cancelled, or picked up from the completion queue, whose file descriptor
+ * (an eventfd on Linux) is readable while there are completed jobs to pick up, so it
+ * can sit in the application's poll loop.
+ *
+ * Workers take the queued job with the highest priority, oldest first. So that short
+ * jobs are not stuck behind long cracks, cracks never occupy the last free worker of a
+ * pool with more than one, and a running crack runs waiting non-crack jobs of higher
+ * priority in between, every 0x10000 candidates.
+ */
+typedef enum {
+	JOB_PRIORITY_LOW,
+	JOB_PRIORITY_NORMAL,
+	JOB_PRIORITY_HIGH,
+} job_priority;
+
+typedef enum {
+	JOB_QUEUED,
+	JOB_RUNNING,
+	JOB_DONE,
+	JOB_FAILED,
+	JOB_CANCELLED,
+} job_state;
+
+typedef struct {
+	uint8_t csn[8];				// in
+	uint8_t div_key[8];			// out
+} job_diversify_item;
+
+typedef struct {
+	uint8_t cc_nr[12];			// in
+	uint8_t div_key[8];			// in
+	uint8_t mac[4];				// out
+} job_mac_item;
+
+typedef struct job_queue job_queue;
+typedef struct job job;
+
+/**
+ * @brief Starts a queue with its workers
+ * @param threads number of workers, 0 = one per core
+ * @return the queue, or NULL on failure
+ */
+job_queue* jobQueueCreate(int threads);
+/**
+ * @brief Cancels what is still queued or running, stops the workers, and frees the
+ * queue along with every job not freed yet
+ */
+void jobQueueDestroy(job_queue *q);
+/**
+ * @brief A descriptor that is readable while jobNextCompleted has something to return
+ */
+int jobQueueFd(job_queue *q);
+/**
+ * @brief Takes the oldest completed (done, failed or cancelled) job off the completion queue
+ * @return the job, or NULL if there is none
+ */
+job* jobNextCompleted(job_queue *q);
+
+/**
+ * @brief Cracks a dump like bruteforceDump, on a copy of the records
+ * @param user passed back by jobUser
+ * @return the job, or NULL on failure
+ */
+job* jobSubmitCrack(job_queue *q, const dumpdata *dump, size_t items, job_priority priority, void *user);
+/**
+ * @brief Diversifies the CSNs in place. items must stay valid until the job completes.
+ * @param elite key is K_cus (iclass format) instead of a master key on NIST format
+ */
+job* jobSubmitDiversify(job_queue *q, job_diversify_item *items, size_t count, bool elite,
+						const uint8_t key[8], job_priority priority, void *user);
+/**
+ * @brief Reader MACs (tag MACs) of the items, in place. items must stay valid until the job completes.
+ */
+job* jobSubmitReaderMAC(job_queue *q, job_mac_item *items, size_t count, job_priority priority, void *user);
+job* jobSubmitTagMAC(job_queue *q, job_mac_item *items, size_t count, job_priority priority, void *user);
+
+job_state jobState(job *j);
+/**
+ * @return how far the job has got, 0 to 1
+ */
+double jobProgress(job *j);
+void* jobUser(job *j);
+/**
+ * @brief Asks the job to stop. A queued job is cancelled at once, a running one at
+ * its next check (every 0x10000 candidates of a crack, every 256 items otherwise).
+ */
+void jobCancel(job *j);
+/**
+ * @brief Blocks until the job is done, failed or cancelled
+ * @return its final state
+ */
+job_state jobWait(job *j);
+/**
+ * @brief The result of a crack job
+ * @param keytable where to copy the keytable, with the crack status bits, may be NULL
+ * @param kcus where to put K_cus, may be NULL
+ * @return 0 if K_cus was recovered, 1 otherwise
+ */
+int jobCrackResult(job *j, uint16_t keytable[128], uint8_t kcus[8]);
+/**
+ * @brief Frees a job which has completed. It is taken off the completion queue if still on it.
+ */
+void jobFree(job *j);
+
+int testJobs();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JOBS_H
@@ -0,0 +1,540 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#ifndef LOCLASS_HPP
+#define LOCLASS_HPP
+
+/**
+ * C++20 layer over the C API: spans instead of fixed-size pointers, contexts that own
+ * the key schedules and precomputed state the C functions otherwise take as scratch
+ * arguments, and move-only handles for jobs.h. It is header-only and calls the C core
+ * for the work, except for namespace loclass::ct, a constexpr port of the cipher and of
+ * hash0 which is checked against the paper's test vectors at compile time.
+ *
+ * The C API takes non-const pointers to some inputs it only reads, hence the const_casts.
+ */
+
+#if __cplusplus < 202002L
+#error "loclass.hpp needs C++20"
+#endif
+
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <utility>
+
+#include "optimized_cipher.h"
+#include "ikeys.h"
+#include "des.h"
+#include "elite_crack.h"
+#include "jobs.h"
+
+namespace loclass {
+
+using block8 = std::array<uint8_t, 8>;
+using cc_nr12 = std::array<uint8_t, 12>;
+using mac4 = std::array<uint8_t, 4>;
+
+// ----------------------------------------------------------------------------
+// Tables, generated at compile time
+// ----------------------------------------------------------------------------
+
+namespace tables {
+
+/**
+ * Parity of each byte, for the feedback of the t and b registers
+ */
+inline constexpr std::array<uint8_t, 256> parity = [] {
+	std::array<uint8_t, 256> t{};
+	for(unsigned i = 0 ; i < 256 ; i++)
+		t[i] = std::popcount(i) & 1;
+	return t;
+}();
+
+/**
+ * select(0, 0, r) of the cipher, see opt__select in optimized_cipher.c. The x and y
+ * inputs only flip bits: select(x, y, r) = select(0, 0, r) ^ ((x ^ y) << 1) ^ x
+ */
+inline constexpr std::array<uint8_t, 256> select = [] {
+	std::array<uint8_t, 256> t{};
+	for(unsigned r = 0 ; r < 256 ; r++)
+	{
+		unsigned r_ls2 = r << 2;
+		unsigned z0 = ((r & r_ls2) >> 5) ^ ((r & ~r_ls2) >> 4) ^ ((r | r_ls2) >> 3);
+		unsigned z1 = ((r | r_ls2) >> 6) ^ ((r | r_ls2) >> 1) ^ (r >> 5) ^ r;
+		unsigned z2 = ((r & ~r_ls2) >> 4) ^ ((r & r_ls2) >> 3) ^ r;
+		t[r] = (z0 & 4) | (z1 & 2) | (z2 & 1);
+	}
+	return t;
+}();
+
+/**
+ * The pi table of hash0: the 35 bytes below 0x80 with four bits set, in increasing
+ * order, except that 0x39 comes before 0x36 as in the paper
+ */
+inline constexpr std::array<uint8_t, 35> pi = [] {
+	std::array<uint8_t, 35> t{};
+	size_t n = 0;
+	for(unsigned b = 0 ; b < 0x80 ; b++)
+		if(std::popcount(b) == 4)
+			t[n++] = b;
+	std::swap(t[11], t[12]);
+	return t;
+}();
+
+static_assert(pi[0] == 0x0F && pi[11] == 0x39 && pi[12] == 0x36 && pi[34] == 0x78);
+static_assert(select[0x00] == 0 && parity[0x71] == 0 && parity[0x70] == 1);
+
+} // namespace tables
+
+// ----------------------------------------------------------------------------
+// constexpr kernels
+// ----------------------------------------------------------------------------
+
+namespace ct {
+
+struct cipher_state {
+	uint8_t l, r, b;
+	uint16_t t;
+};
+
+constexpr cipher_state init(const block8 &k)
+{
+	return {uint8_t((k[0] ^ 0x4c) + 0xEC), uint8_t((k[0] ^ 0x4c) + 0x21), 0x4c, 0xE012};
+}
+
+/**
+ * @brief One step of the cipher with input bit y, as opt_successor
+ */
+constexpr cipher_state successor(const block8 &k, const cipher_state &s, unsigned y)
+{
+	unsigned t = s.t & 0xC533;		// taps 15, 14, 10, 8, 5, 4, 1, 0
+	unsigned T = tables::parity[t & 0xFF] ^ tables::parity[t >> 8];
+	unsigned B = tables::parity[s.b & 0x71];	// taps 6, 5, 4, 0
+	cipher_state n{};
+	n.t = uint16_t((s.t >> 1) | ((T ^ (s.r >> 7) ^ (s.r >> 3)) & 1) << 15);
+	n.b = uint8_t((s.b >> 1) | ((B ^ s.r) & 1) << 7);
+	n.r = uint8_t((k[tables::select[s.r] ^ ((T ^ y) << 1) ^ T] ^ n.b) + s.l);
+	n.l = uint8_t(n.r + s.r);
+	return n;
+}
+
+/**
+ * @brief Feeds bytes to the cipher, least significant bit first
+ */
+constexpr cipher_state feed(const block8 &k, cipher_state s, std::span<const uint8_t> in)
+{
+	for(uint8_t byte : in)
+		for(unsigned i = 0 ; i < 8 ; i++)
+			s = successor(k, s, (byte >> i) & 1);
+	return s;
+}
+
+constexpr mac4 output(const block8 &k, cipher_state s)
+{
+	mac4 mac{};
+	for(unsigned i = 0 ; i < 32 ; i++)
+	{
+		mac[i / 8] |= ((s.r >> 2) & 1) << (i % 8);
+		s = successor(k, s, 0);
+	}
+	return mac;
+}
+
+/**
+ * @brief The reader MAC, as doReaderMAC
+ */
+constexpr mac4 readerMAC(const cc_nr12 &cc_nr, const block8 &div_key)
+{
+	return output(div_key, feed(div_key, init(div_key), cc_nr));
+}
+
+/**
+ * @brief The tag MAC, as doTagMAC: the reader MAC followed by 32 zero bits
+ */
+constexpr mac4 tagMAC(const cc_nr12 &cc_nr, const block8 &div_key)
+{
+	constexpr std::array<uint8_t, 4> zeroes{};
+	return output(div_key, feed(div_key, feed(div_key, init(div_key), cc_nr), zeroes));
+}
+
+/**
+ * @brief hash0 of the DES output c (big-endian), as hash0 in ikeys.c
+ */
+constexpr block8 hash0(uint64_t c)
+{
+	uint8_t x = c >> 56;
+	uint8_t y = c >> 48;
+	std::array<uint8_t, 8> z{}, zt{};
+	block8 k{};
+	unsigned i, j;
+
+	// z' of the z values in swapped order (swapZvalues): z[0] is the lowest six bits
+	for(i = 0 ; i < 4 ; i++)
+	{
+		z[i] = ((c >> (6 * i)) & 0x3F) % (63 - i) + i;
+		z[i + 4] = ((c >> (6 * (i + 4))) & 0x3F) % (64 - i) + i;
+	}
+	// z^ = check(z'), ck(3, 2, ...) on each half
+	for(unsigned half = 0 ; half < 8 ; half += 4)
+		for(i = 3 ; i >= 1 ; i--)
+			for(j = i ; j-- > 0 ; )
+				if(z[half + i] == z[half + j])
+					z[half + i] = j;
+	// p, and z~ = permute(p, z^)
+	uint8_t p = tables::pi[x % 35];
+	if(x & 1) p = ~p;
+	unsigned l = 0, r = 4;
+	for(i = 0 ; i < 8 ; i++)
+		zt[i] = ((p >> i) & 1) ? (z[l++] + 1) & 0x3F : z[r++];
+
+	for(i = 0 ; i < 8 ; i++)
+	{
+		unsigned p_i = (p >> i) & 1;
+		if((y >> i) & 1)
+			k[i] = uint8_t((0x80 | (~(zt[i] << 1) & 0x7E) | p_i) + 1);
+		else
+			k[i] = uint8_t(((zt[i] << 1) & 0x7E) | (~p_i & 1));
+	}
+	return k;
+}
+
+// From the paper
+static_assert(readerMAC({0xFE,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0,0,0,0},
+						{0xE0,0x33,0xCA,0x41,0x9A,0xEE,0x43,0xF9}) == mac4{0x1d,0x49,0xC9,0xDA});
+// From the key diversification test cases in ikeys.c: DES output -> div key
+static_assert(hash0(0x0000000000000000) == block8{0x02,0x04,0x06,0x08,0x01,0x03,0x05,0x07});
+static_assert(hash0(0x0000000000000001) == block8{0x04,0x02,0x06,0x08,0x01,0x03,0x05,0x07});
+static_assert(hash0(0x0000000000000080) == block8{0x02,0x08,0x06,0x04,0x01,0x03,0x05,0x07});
+static_assert(hash0(0x0000000000400000) == block8{0x02,0x04,0x06,0x28,0x01,0x03,0x05,0x07});
+static_assert(hash0(0x0000000080000000) == block8{0x02,0x04,0x06,0x08,0x01,0x07,0x05,0x03});
+static_assert(hash0(0x0000800000000000) == block8{0x02,0x04,0x06,0x08,0x01,0x03,0x05,0x47});
+static_assert(hash0(0x0001000000000000) == block8{0xFE,0x04,0x06,0x08,0x01,0x03,0x05,0x07});
+static_assert(hash0(0x0080000000000000) == block8{0x02,0x04,0x06,0x08,0x01,0x03,0x05,0xF9});
+static_assert(hash0(0x0100000000000000) == block8{0x01,0x03,0x05,0x02,0x07,0x04,0x06,0x08});
+static_assert(hash0(0x0400000000000000) == block8{0x01,0x02,0x04,0x06,0x08,0x03,0x05,0x07});
+static_assert(hash0(0x2000000000000000) == block8{0x01,0x02,0x03,0x05,0x04,0x06,0x08,0x07});
+static_assert(hash0(0x8000000000000000) == block8{0x01,0x02,0x03,0x04,0x06,0x05,0x08,0x07});
+
+} // namespace ct
+
+// ----------------------------------------------------------------------------
+// Key diversification
+// ----------------------------------------------------------------------------
+
+/**
+ * Diversifies CSNs with one key. Owns the DES key schedule of a standard master key,
+ * or the hash2 keytable of an elite K_cus, so that they are set up once.
+ */
+class Diversifier {
+public:
+	/**
+	 * @param key master key on NIST format, or K_cus (iclass format) if elite
+	 */
+	Diversifier(const block8 &key, bool elite) : elite_(elite)
+	{
+		block8 k = key;
+		if(elite_)
+			hash2(k.data(), keytable_.data());
+		else
+			des_setkey_enc(&ctx_, k.data());
+	}
+
+	block8 operator()(const block8 &csn) const
+	{
+		block8 c = csn, div_key{};
+		if(elite_)
+			diversifyKeyElite(keytable_.data(), c.data(), div_key.data());
+		else
+			diversifyKeyWithContext(const_cast<des_context*>(&ctx_), c.data(), div_key.data());
+		return div_key;
+	}
+
+	void operator()(std::span<const block8> csns, std::span<block8> div_keys) const
+	{
+		assert(csns.size() == div_keys.size());
+		for(size_t n = 0 ; n < csns.size() ; n++)
+			div_keys[n] = (*this)(csns[n]);
+	}
+
+private:
+	bool elite_;
+	des_context ctx_ = {DES_ENCRYPT, {0}};
+	std::array<uint8_t, 128> keytable_{};
+};
+
+// ----------------------------------------------------------------------------
+// MACs
+// ----------------------------------------------------------------------------
+
+inline mac4 readerMAC(const cc_nr12 &cc_nr, const block8 &div_key)
+{
+	mac4 mac{};
+	opt_doReaderMAC(const_cast<uint8_t*>(cc_nr.data()), const_cast<uint8_t*>(div_key.data()), mac.data());
+	return mac;
+}
+
+inline mac4 tagMAC(const cc_nr12 &cc_nr, const block8 &div_key)
+{
+	mac4 mac{};
+	opt_doTagMAC(const_cast<uint8_t*>(cc_nr.data()), div_key.data(), mac.data());
+	return mac;
+}
+
+/**
+ * @brief The MAC over any number of bytes, e.g. for a block update
+ */
+inline mac4 mac(std::span<const uint8_t> data, const block8 &div_key)
+{
+	mac4 m{};
+	opt_doMAC_N(data.data(), data.size(), div_key.data(), m.data());
+	return m;
+}
+
+/**
+ * @brief Reader (tag) MACs of pairs of challenge and key
+ */
+inline void readerMACs(std::span<const cc_nr12> cc_nrs, std::span<const block8> div_keys, std::span<mac4> macs)
+{
+	assert(cc_nrs.size() == div_keys.size() && div_keys.size() == macs.size());
+	for(size_t n = 0 ; n < macs.size() ; n++)
+		macs[n] = readerMAC(cc_nrs[n], div_keys[n]);
+}
+
+inline void tagMACs(std::span<const cc_nr12> cc_nrs, std::span<const block8> div_keys, std::span<mac4> macs)
+{
+	assert(cc_nrs.size() == div_keys.size() && div_keys.size() == macs.size());
+	for(size_t n = 0 ; n < macs.size() ; n++)
+		macs[n] = tagMAC(cc_nrs[n], div_keys[n]);
+}
+
+/**
+ * Reader MACs of one CC * NR under many keys, as in a key search. Owns the
+ * opt_mac_spec of the challenge.
+ */
+class ReaderMacContext {
+public:
+	explicit ReaderMacContext(const cc_nr12 &cc_nr)
+	{
+		opt_macSpecialize(cc_nr.data(), &spec_);
+	}
+
+	mac4 operator()(const block8 &div_key) const
+	{
+		mac4 mac{};
+		opt_doReaderMAC_spec(&spec_, div_key.data(), mac.data());
+		return mac;
+	}
+
+	void operator()(std::span<const block8> div_keys, std::span<mac4> macs) const
+	{
+		assert(div_keys.size() == macs.size());
+		for(size_t n = 0 ; n < macs.size() ; n++)
+			opt_doReaderMAC_spec(&spec_, div_keys[n].data(), macs[n].data());
+	}
+
+private:
+	opt_mac_spec spec_;
+};
+
+/**
+ * Tag MACs of one card challenge (CC) and key for many reader nonces. Owns the
+ * cipher state after the CC, see opt_doTagMAC_1.
+ */
+class TagMacContext {
+public:
+	TagMacContext(std::span<const uint8_t, 8> cc, const block8 &div_key) : div_key_(div_key)
+	{
+		block8 c;
+		std::copy(cc.begin(), cc.end(), c.begin());
+		state_ = opt_doTagMAC_1(c.data(), div_key_.data());
+	}
+
+	mac4 operator()(std::span<const uint8_t, 4> nr) const
+	{
+		std::array<uint8_t, 4> n;
+		mac4 mac{};
+		std::copy(nr.begin(), nr.end(), n.begin());
+		opt_doTagMAC_2(state_, n.data(), mac.data(), div_key_.data());
+		return mac;
+	}
+
+private:
+	block8 div_key_;
+	State state_;
+};
+
+// ----------------------------------------------------------------------------
+// Jobs
+// ----------------------------------------------------------------------------
+
+enum class Priority {
+	Low = JOB_PRIORITY_LOW,
+	Normal = JOB_PRIORITY_NORMAL,
+	High = JOB_PRIORITY_HIGH,
+};
+
+enum class JobState {
+	Queued = JOB_QUEUED,
+	Running = JOB_RUNNING,
+	Done = JOB_DONE,
+	Failed = JOB_FAILED,
+	Cancelled = JOB_CANCELLED,
+};
+
+/**
+ * A submitted job. Destroying the handle cancels the job if it has not completed, and
+ * frees it. Handles must not outlive their JobQueue.
+ */
+class Job {
+public:
+	Job() = default;
+	explicit Job(job *j) : j_(j) {}
+	Job(const Job&) = delete;
+	Job& operator=(const Job&) = delete;
+	Job(Job &&o) noexcept : j_(std::exchange(o.j_, nullptr)) {}
+	Job& operator=(Job &&o) noexcept
+	{
+		if(this != &o)
+		{
+			reset();
+			j_ = std::exchange(o.j_, nullptr);
+		}
+		return *this;
+	}
+	~Job() { reset(); }
+
+	explicit operator bool() const { return j_ != nullptr; }
+	job* get() const { return j_; }
+
+	JobState state() const { return static_cast<JobState>(jobState(j_)); }
+	double progress() const { return jobProgress(j_); }
+	void cancel() { jobCancel(j_); }
+	JobState wait() { return static_cast<JobState>(jobWait(j_)); }
+
+	/**
+	 * @brief The result of a crack job, see jobCrackResult
+	 * @return true if K_cus was recovered
+	 */
+	bool crackResult(std::span<uint16_t, 128> keytable, block8 &kcus) const
+	{
+		return jobCrackResult(j_, keytable.data(), kcus.data()) == 0;
+	}
+
+	void reset()
+	{
+		if(j_) jobFree(std::exchange(j_, nullptr));
+	}
+
+private:
+	job *j_ = nullptr;
+};
+
+/**
+ * Owns a job_queue and its workers. Batch jobs work on the caller's items in place,
+ * which must stay valid until the job completes.
+ */
+class JobQueue {
+public:
+	/**
+	 * @param threads number of workers, 0 = one per core
+	 */
+	explicit JobQueue(int threads = 0) : q_(jobQueueCreate(threads))
+	{
+		if(!q_) throw std::runtime_error("loclass: cannot start the job queue");
+	}
+	JobQueue(const JobQueue&) = delete;
+	JobQueue& operator=(const JobQueue&) = delete;
+	JobQueue(JobQueue &&o) noexcept : q_(std::exchange(o.q_, nullptr)) {}
+	JobQueue& operator=(JobQueue &&o) noexcept
+	{
+		if(this != &o)
+		{
+			if(q_) jobQueueDestroy(q_);
+			q_ = std::exchange(o.q_, nullptr);
+		}
+		return *this;
+	}
+	~JobQueue()
+	{
+		if(q_) jobQueueDestroy(q_);
+	}
+
+	/**
+	 * @brief Readable while nextCompleted has something to return, see jobQueueFd
+	 */
+	int fd() const { return jobQueueFd(q_); }
+
+	/**
+	 * @brief The oldest completed job not picked up yet, or nullptr. It stays owned by
+	 * its Job handle; compare with Job::get.
+	 */
+	job* nextCompleted() { return jobNextCompleted(q_); }
+
+	Job crack(std::span<const dumpdata> dump, Priority priority = Priority::Normal, void *user = nullptr)
+	{
+		return Job(jobSubmitCrack(q_, dump.data(), dump.size(), static_cast<job_priority>(priority), user));
+	}
+
+	Job diversify(std::span<job_diversify_item> items, const block8 &key, bool elite,
+				  Priority priority = Priority::Normal, void *user = nullptr)
+	{
+		return Job(jobSubmitDiversify(q_, items.data(), items.size(), elite, key.data(),
+									  static_cast<job_priority>(priority), user));
+	}
+
+	Job readerMACs(std::span<job_mac_item> items, Priority priority = Priority::Normal, void *user = nullptr)
+	{
+		return Job(jobSubmitReaderMAC(q_, items.data(), items.size(), static_cast<job_priority>(priority), user));
+	}
+
+	Job tagMACs(std::span<job_mac_item> items, Priority priority = Priority::Normal, void *user = nullptr)
+	{
+		return Job(jobSubmitTagMAC(q_, items.data(), items.size(), static_cast<job_priority>(priority), user));
+	}
+
+private:
+	job_queue *q_;
+};
+
+} // namespace loclass
+
+#endif // LOCLASS_HPP
@@ -0,0 +1,68 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#ifndef LOCLASS_CONFIG_H
+#define LOCLASS_CONFIG_H
+
+/**
+ * Compile-time configuration. The defaults are for the host tools: everything built,
+ * fastest variants. For a small target, define LOCLASS_EMBEDDED (library.json does),
+ * or pick the options one by one:
+ *
+ * LOCLASS_NO_TESTS      leave out the self tests and their test vectors (the testXxx
+ *                       functions behind "TEST CODE BELOW" in the library sources)
+ * LOCLASS_DES_ECB_ONLY  leave out 3DES and the DES parity and weak key checks; iClass only
+ *                       needs single DES-ECB. CBC and the DES self test are already out
+ *                       unless POLARSSL_CIPHER_MODE_CBC / POLARSSL_SELF_TEST are defined.
+ * LOCLASS_SMALL         the smallest variants of the MAC and DES inner loops (rolled up)
+ *                       instead of the fastest (unrolled). The results are the same.
+ *
+ * LOCLASS_EMBEDDED implies LOCLASS_NO_TESTS and LOCLASS_DES_ECB_ONLY, and leaves the
+ * choice of LOCLASS_SMALL to the user. 'make size-report' shows what each costs, and
+ * 'make profile-bench' the speed of LOCLASS_SMALL against the default.
+ */
+
+#ifdef LOCLASS_EMBEDDED
+#ifndef LOCLASS_NO_TESTS
+#define LOCLASS_NO_TESTS
+#endif
+#ifndef LOCLASS_DES_ECB_ONLY
+#define LOCLASS_DES_ECB_ONLY
+#endif
+#endif
+
+#endif // LOCLASS_CONFIG_H
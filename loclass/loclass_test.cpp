@@ -0,0 +1,230 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+/**
+ * Checks of loclass.hpp against the C API, built by 'make cpp'. What can be checked
+ * at compile time is in the static_asserts of the header; this covers the rest.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "loclass.hpp"
+#include "logging.h"
+
+extern "C" const uint8_t pi[35];
+
+using namespace loclass;
+
+static block8 randomBlock()
+{
+	block8 b;
+	for(auto &v : b) v = rand() & 0xFF;
+	return b;
+}
+
+static cc_nr12 randomChallenge()
+{
+	cc_nr12 c;
+	for(auto &v : c) v = rand() & 0xFF;
+	return c;
+}
+
+static uint64_t toNum(const block8 &b)
+{
+	uint64_t n = 0;
+	for(uint8_t v : b) n = (n << 8) | v;
+	return n;
+}
+
+static int testKernels()
+{
+	int errors = 0;
+
+	if(memcmp(tables::pi.data(), pi, sizeof(pi)) != 0)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: generated pi table differs from ikeys.c");
+		errors++;
+	}
+	for(int n = 0 ; n < 1000 ; n++)
+	{
+		block8 key = randomBlock(), c = randomBlock(), div_key;
+		cc_nr12 cc_nr = randomChallenge();
+		mac4 mac;
+
+		hash0(toNum(c), div_key.data());
+		errors += ct::hash0(toNum(c)) != div_key;
+		opt_doReaderMAC(cc_nr.data(), key.data(), mac.data());
+		errors += ct::readerMAC(cc_nr, key) != mac || readerMAC(cc_nr, key) != mac;
+		errors += ReaderMacContext(cc_nr)(key) != mac;
+		opt_doTagMAC(cc_nr.data(), key.data(), mac.data());
+		errors += ct::tagMAC(cc_nr, key) != mac || tagMAC(cc_nr, key) != mac;
+		errors += TagMacContext(std::span(cc_nr).first<8>(), key)(std::span(cc_nr).subspan<8, 4>()) != mac;
+		errors += loclass::mac(cc_nr, key) != readerMAC(cc_nr, key);
+	}
+	if(errors) logmsg(LOG_LEVEL_ERROR, "[+] FAILED: %d kernel results differ from the C API", errors);
+	return errors;
+}
+
+static int testBatches()
+{
+	enum { N = 300 };
+	std::vector<block8> csns(N), div_keys(N), keys(N);
+	std::vector<cc_nr12> cc_nrs(N);
+	std::vector<mac4> macs(N), spec_macs(N);
+	block8 master = {0x5b,0x7c,0x62,0xc4,0x91,0xc1,0x1b,0x39};
+	block8 kcus = {0x9f,0x3a,0x41,0x77,0x0c,0xd2,0x65,0xe8};
+	int errors = 0;
+
+	for(int n = 0 ; n < N ; n++)
+	{
+		csns[n] = randomBlock();
+		keys[n] = randomBlock();
+		cc_nrs[n] = randomChallenge();
+	}
+
+	Diversifier standard(master, false);
+	standard(csns, div_keys);
+	for(int n = 0 ; n < N ; n++)
+	{
+		block8 csn = csns[n], expected;
+		diversifyKey(csn.data(), master.data(), expected.data());
+		errors += div_keys[n] != expected;
+	}
+
+	Diversifier elite(kcus, true);
+	elite(csns, div_keys);
+	uint8_t keytable[128], key_index[8], key_sel[8];
+	hash2(kcus.data(), keytable);
+	for(int n = 0 ; n < N ; n++)
+	{
+		block8 csn = csns[n], key_sel_p, expected;
+		hash1(csn.data(), key_index);
+		for(int i = 0 ; i < 8 ; i++)
+			key_sel[i] = keytable[key_index[i]];
+		permutekey_rev(key_sel, key_sel_p.data());
+		diversifyKey(csn.data(), key_sel_p.data(), expected.data());
+		errors += div_keys[n] != expected;
+	}
+
+	readerMACs(cc_nrs, keys, macs);
+	ReaderMacContext spec(cc_nrs[0]);
+	spec(keys, spec_macs);
+	for(int n = 0 ; n < N ; n++)
+		errors += macs[n] != readerMAC(cc_nrs[n], keys[n]) || spec_macs[n] != readerMAC(cc_nrs[0], keys[n]);
+	tagMACs(cc_nrs, keys, macs);
+	for(int n = 0 ; n < N ; n++)
+		errors += macs[n] != tagMAC(cc_nrs[n], keys[n]);
+
+	if(errors) logmsg(LOG_LEVEL_ERROR, "[+] FAILED: %d batch results differ from the C API", errors);
+	return errors;
+}
+
+static int testJobHandles()
+{
+	enum { N = 100 };
+	std::vector<job_diversify_item> items(N);
+	std::vector<job_mac_item> macs(N);
+	block8 master = {0x5b,0x7c,0x62,0xc4,0x91,0xc1,0x1b,0x39};
+	dumpdata d = {{0x0b,0x00,0x0f,0xff,0xf7,0xff,0x12,0xe0},{0},{0}};
+	int errors = 0;
+
+	for(auto &item : items)
+	{
+		block8 csn = randomBlock();
+		memcpy(item.csn, csn.data(), 8);
+	}
+	for(auto &item : macs)
+		memset(&item, rand() & 0xFF, sizeof(item));
+
+	JobQueue q(2);
+	Job div = q.diversify(items, master, false);
+	Job mac = q.readerMACs(macs, Priority::High);
+	// A crack that runs until cancelled, by its handle going away
+	Job crack = q.crack(std::span(&d, 1), Priority::Low);
+	Job moved = std::move(mac);
+
+	if(mac || !moved || div.wait() != JobState::Done || moved.wait() != JobState::Done)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: batch jobs through the handles");
+		return 1;
+	}
+	Diversifier standard(master, false);
+	for(auto &item : items)
+	{
+		block8 csn, div_key;
+		memcpy(csn.data(), item.csn, 8);
+		memcpy(div_key.data(), item.div_key, 8);
+		errors += standard(csn) != div_key;
+	}
+	for(auto &item : macs)
+	{
+		cc_nr12 cc_nr;
+		block8 key;
+		memcpy(cc_nr.data(), item.cc_nr, 12);
+		memcpy(key.data(), item.div_key, 8);
+		errors += memcmp(readerMAC(cc_nr, key).data(), item.mac, 4) != 0;
+	}
+
+	job *first = q.nextCompleted(), *second = q.nextCompleted();
+	if(!((first == div.get() && second == moved.get()) || (first == moved.get() && second == div.get())))
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: completion queue through the handles");
+		errors++;
+	}
+	crack.reset();
+	if(crack || q.nextCompleted() != nullptr)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: freeing a running crack");
+		errors++;
+	}
+	if(errors) logmsg(LOG_LEVEL_ERROR, "[+] FAILED: %d job results differ from the C API", errors);
+	return errors;
+}
+
+int main()
+{
+	prnlog("[+] Testing C++ API...");
+	srand(49);
+	int errors = testKernels();
+	errors += testBatches();
+	errors += testJobHandles();
+	if(errors == 0)
+		prnlog("[+] C++ API ok");
+	return errors ? 1 : 0;
+}
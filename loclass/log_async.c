@@ -0,0 +1,249 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "log_async.h"
+
+/**
+  Single consumer ring. Producers only ever write at the head, under the lock. The
+  consumer calls the inner sink on the tail slot without holding the lock, and only
+  then frees the slot, so a slot is never overwritten while it is being written out.
+**/
+
+typedef struct {
+	log_level level;
+	char text[LOG_LINE_MAX];
+} log_slot;
+
+typedef struct {
+	log_slot *slots;
+	size_t capacity;
+	size_t head;
+	size_t count;
+	uint64_t dropped;
+	uint64_t reported;
+	bool running;
+	log_sink inner;
+	void *ctx;
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	pthread_t thread;
+} log_ring;
+
+static log_ring ring;
+static bool started = false;
+
+static void asyncSink(log_level level, const char *line, void *ctx)
+{
+	(void) ctx;
+	pthread_mutex_lock(&ring.lock);
+	if(ring.count == ring.capacity)
+	{
+		ring.dropped++;
+	}else
+	{
+		log_slot *slot = &ring.slots[ring.head];
+		slot->level = level;
+		strncpy(slot->text, line, LOG_LINE_MAX - 1);
+		slot->text[LOG_LINE_MAX - 1] = 0;
+		ring.head = (ring.head + 1) % ring.capacity;
+		ring.count++;
+		pthread_cond_signal(&ring.ready);
+	}
+	pthread_mutex_unlock(&ring.lock);
+}
+
+static void *writer(void *arg)
+{
+	(void) arg;
+	char note[64];
+	pthread_mutex_lock(&ring.lock);
+	for(;;)
+	{
+		while(ring.count == 0 && ring.running)
+			pthread_cond_wait(&ring.ready, &ring.lock);
+		if(ring.count == 0 && !ring.running)
+			break;
+		size_t tail = (ring.head + ring.capacity - ring.count) % ring.capacity;
+		uint64_t dropped = ring.dropped - ring.reported;
+		ring.reported = ring.dropped;
+		pthread_mutex_unlock(&ring.lock);
+
+		if(dropped)
+		{
+			snprintf(note, sizeof(note), "[log] %llu lines dropped", (unsigned long long) dropped);
+			ring.inner(LOG_LEVEL_WARN, note, ring.ctx);
+		}
+		ring.inner(ring.slots[tail].level, ring.slots[tail].text, ring.ctx);
+
+		pthread_mutex_lock(&ring.lock);
+		ring.count--;
+	}
+	pthread_mutex_unlock(&ring.lock);
+	return NULL;
+}
+
+int logAsyncStart(log_sink inner, void *ctx, size_t lines)
+{
+	if(started) return 1;
+	memset(&ring, 0, sizeof(ring));
+	ring.capacity = lines ? lines : 1024;
+	ring.slots = malloc(ring.capacity * sizeof(log_slot));
+	if(ring.slots == NULL) return 1;
+	ring.inner = inner ? inner : logStdoutSink;
+	ring.ctx = inner ? ctx : NULL;
+	ring.running = true;
+	pthread_mutex_init(&ring.lock, NULL);
+	pthread_cond_init(&ring.ready, NULL);
+	if(pthread_create(&ring.thread, NULL, writer, NULL))
+	{
+		pthread_mutex_destroy(&ring.lock);
+		pthread_cond_destroy(&ring.ready);
+		free(ring.slots);
+		ring.slots = NULL;
+		return 1;
+	}
+	started = true;
+	setLogSink(asyncSink, NULL);
+	return 0;
+}
+
+void logAsyncStop()
+{
+	if(!started) return;
+	// Returns once no thread is inside asyncSink any more, so the ring can go
+	setLogSink(NULL, NULL);
+	pthread_mutex_lock(&ring.lock);
+	ring.running = false;
+	pthread_cond_signal(&ring.ready);
+	pthread_mutex_unlock(&ring.lock);
+	pthread_join(ring.thread, NULL);
+	if(ring.dropped > ring.reported)
+	{
+		char note[64];
+		snprintf(note, sizeof(note), "[log] %llu lines dropped", (unsigned long long) (ring.dropped - ring.reported));
+		ring.inner(LOG_LEVEL_WARN, note, ring.ctx);
+	}
+	pthread_mutex_destroy(&ring.lock);
+	pthread_cond_destroy(&ring.ready);
+	free(ring.slots);
+	ring.slots = NULL;
+	started = false;
+}
+
+uint64_t logAsyncDropped()
+{
+	uint64_t dropped;
+	if(!started) return 0;
+	pthread_mutex_lock(&ring.lock);
+	dropped = ring.dropped;
+	pthread_mutex_unlock(&ring.lock);
+	return dropped;
+}
+
+// ----------------------------------------------------------------------------
+// TEST CODE BELOW
+// ----------------------------------------------------------------------------
+
+typedef struct {
+	int lines;
+	int expected;
+	int out_of_order;
+	int notes;
+	pthread_mutex_t gate;	// held by the test to stall the writer
+} test_async;
+
+static void testSink(log_level level, const char *line, void *ctx)
+{
+	test_async *t = (test_async*) ctx;
+	int n;
+	pthread_mutex_lock(&t->gate);
+	pthread_mutex_unlock(&t->gate);
+	if(level == LOG_LEVEL_WARN && strncmp(line, "[log]", 5) == 0)
+	{
+		t->notes++;
+		return;
+	}
+	if(sscanf(line, "line %d", &n) != 1 || n < t->expected) t->out_of_order++;
+	t->expected = n + 1;
+	t->lines++;
+}
+
+int testLogAsync()
+{
+	test_async t;
+	int i, errors = 0;
+	prnlog("[+] Testing async logging...");
+	memset(&t, 0, sizeof(t));
+	pthread_mutex_init(&t.gate, NULL);
+
+	// Everything arrives, in order
+	if(logAsyncStart(testSink, &t, 1024)) return 1;
+	for(i = 0 ; i < 1000 ; i++)
+		prnlog("line %d", i);
+	uint64_t dropped = logAsyncDropped();
+	logAsyncStop();
+	if(t.lines != 1000 || dropped || t.out_of_order || t.notes)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: async log, %d lines, %d dropped", t.lines, (int) dropped);
+		errors++;
+	}
+
+	// With the writer stalled, the ring fills up and the rest is dropped, not waited for
+	memset(&t, 0, sizeof(t));
+	pthread_mutex_init(&t.gate, NULL);
+	pthread_mutex_lock(&t.gate);
+	if(logAsyncStart(testSink, &t, 8)) return 1;
+	for(i = 0 ; i < 100 ; i++)
+		prnlog("line %d", i);
+	dropped = logAsyncDropped();
+	pthread_mutex_unlock(&t.gate);
+	logAsyncStop();
+	// A slot is only freed after the sink returns, so exactly 8 lines fit
+	if(dropped != 92 || t.lines != 8 || t.notes != 1)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: async log overflow, %d lines, %d dropped", t.lines, (int) dropped);
+		errors++;
+	}
+	pthread_mutex_destroy(&t.gate);
+	if(!errors)
+		prnlog("[+] Async logging OK!");
+	return errors;
+}
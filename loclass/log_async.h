@@ -0,0 +1,74 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+#ifndef LOG_ASYNC_H
+#define LOG_ASYNC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "logging.h"
+
+/**
+ * @brief Installs an asynchronous log sink. Lines are copied into a ring buffer, which is
+ * allocated once here, and a background thread hands them to 'inner'. Logging never
+ * blocks on I/O: when the ring is full, lines are dropped and counted, and the count
+ * is reported through 'inner' once there is room again.
+ * @param inner the sink doing the actual output, NULL = stdout
+ * @param ctx passed to inner
+ * @param lines ring buffer size in lines, 0 = 1024
+ * @return 0 for ok, 1 for failz
+ */
+int logAsyncStart(log_sink inner, void *ctx, size_t lines);
+/**
+ * @brief Writes out what is queued, stops the thread and goes back to the default sink
+ */
+void logAsyncStop();
+/**
+ * @brief Lines dropped because the ring was full, since logAsyncStart
+ */
+uint64_t logAsyncDropped();
+
+int testLogAsync();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LOG_ASYNC_H
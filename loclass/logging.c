@@ -0,0 +1,187 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <sched.h>
+#include "logging.h"
+#include "loclass_config.h"
+
+/**
+  The sink and its ctx are published together as one slot, and the slots are swapped
+  with a pointer store. A caller pins the slot it is about to use by counting itself in
+  it, and setLogSink waits until nobody is left in the old slot before returning. So
+  once setLogSink returns, the old sink is not running and will not be called again,
+  and its ctx can be torn down.
+**/
+
+typedef struct {
+	log_sink sink;
+	void *ctx;
+	int users;
+} sink_slot;
+
+static sink_slot slots[2] = {{logStdoutSink, NULL, 0}, {logStdoutSink, NULL, 0}};
+static sink_slot *current = &slots[0];
+static int setting = 0;
+static log_level max_level = LOG_LEVEL_INFO;
+
+void setLogSink(log_sink s, void *ctx)
+{
+	// One setter at a time
+	while(__atomic_test_and_set(&setting, __ATOMIC_ACQUIRE))
+		sched_yield();
+	sink_slot *old = __atomic_load_n(&current, __ATOMIC_SEQ_CST);
+	sink_slot *next = old == &slots[0] ? &slots[1] : &slots[0];
+	next->sink = s ? s : logStdoutSink;
+	next->ctx = s ? ctx : NULL;
+	__atomic_store_n(&current, next, __ATOMIC_SEQ_CST);
+	while(__atomic_load_n(&old->users, __ATOMIC_SEQ_CST) != 0)
+		sched_yield();
+	__atomic_clear(&setting, __ATOMIC_RELEASE);
+}
+
+void setLogLevel(log_level level)
+{
+	max_level = level;
+}
+
+log_level getLogLevel()
+{
+	return max_level;
+}
+
+void logStdoutSink(log_level level, const char *line, void *ctx)
+{
+	(void) level;
+	(void) ctx;
+	printf("%s\n", line);
+}
+
+static void vlogmsg(log_level level, const char *fmt, va_list args)
+{
+	char line[LOG_LINE_MAX];
+	if(level > max_level) return;
+	int n = vsnprintf(line, sizeof(line), fmt, args);
+	// Mark lines that did not fit
+	if(n >= (int) sizeof(line))
+		memcpy(line + sizeof(line) - 4, "...", 4);
+
+	sink_slot *slot;
+	for(;;)
+	{
+		slot = __atomic_load_n(&current, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&slot->users, 1, __ATOMIC_SEQ_CST);
+		// Still the current one after counting in, so a setter will wait for us
+		if(__atomic_load_n(&current, __ATOMIC_SEQ_CST) == slot) break;
+		__atomic_sub_fetch(&slot->users, 1, __ATOMIC_SEQ_CST);
+	}
+	slot->sink(level, line, slot->ctx);
+	__atomic_sub_fetch(&slot->users, 1, __ATOMIC_SEQ_CST);
+}
+
+void logmsg(log_level level, const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	vlogmsg(level, fmt, args);
+	va_end(args);
+}
+
+void prnlog(const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	vlogmsg(LOG_LEVEL_INFO, fmt, args);
+	va_end(args);
+}
+
+// ----------------------------------------------------------------------------
+// TEST CODE BELOW
+// ----------------------------------------------------------------------------
+
+#ifndef LOCLASS_NO_TESTS
+
+typedef struct {
+	int lines;
+	log_level level;
+	char last[LOG_LINE_MAX];
+} test_capture;
+
+static void captureSink(log_level level, const char *line, void *ctx)
+{
+	test_capture *c = (test_capture*) ctx;
+	c->lines++;
+	c->level = level;
+	strncpy(c->last, line, sizeof(c->last) - 1);
+}
+
+int testLogging()
+{
+	test_capture c;
+	char big[LOG_LINE_MAX * 2];
+	int errors = 0;
+	log_level old = getLogLevel();
+
+	prnlog("[+] Testing logging...");
+	memset(&c, 0, sizeof(c));
+	setLogSink(captureSink, &c);
+	setLogLevel(LOG_LEVEL_INFO);
+
+	prnlog("hello %d", 42);
+	if(c.lines != 1 || c.level != LOG_LEVEL_INFO || strcmp(c.last, "hello 42")) errors++;
+	// Filtered
+	logmsg(LOG_LEVEL_DEBUG, "debug");
+	if(c.lines != 1) errors++;
+	logmsg(LOG_LEVEL_ERROR, "error");
+	if(c.lines != 2 || c.level != LOG_LEVEL_ERROR) errors++;
+	// Too long, cut and marked
+	memset(big, 'x', sizeof(big) - 1);
+	big[sizeof(big) - 1] = 0;
+	prnlog("%s", big);
+	if(strlen(c.last) != LOG_LINE_MAX - 1 || strcmp(c.last + LOG_LINE_MAX - 4, "...")) errors++;
+
+	setLogSink(NULL, NULL);
+	setLogLevel(old);
+	if(errors)
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: logging, %d errors", errors);
+	else
+		prnlog("[+] Logging OK!");
+	return errors;
+}
+
+#endif // LOCLASS_NO_TESTS
@@ -0,0 +1,104 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+#ifndef LOGGING_H
+#define LOGGING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/**
+  Logging. Every message is formatted into a fixed buffer on the stack (lines longer than
+  LOG_LINE_MAX are cut), and handed to the sink as one line without the newline. Nothing
+  is allocated. The default sink prints to stdout; an embedder can plug in its own, and
+  log_async.h has a sink which moves the actual I/O to a background thread.
+**/
+
+#define LOG_LINE_MAX 1024
+
+typedef enum {
+	LOG_LEVEL_ERROR,
+	LOG_LEVEL_WARN,
+	LOG_LEVEL_INFO,
+	LOG_LEVEL_DEBUG
+} log_level;
+
+/**
+ * A sink receives complete lines, without trailing newline. It may be called from
+ * several threads at once.
+ */
+typedef void (*log_sink)(log_level level, const char *line, void *ctx);
+
+/**
+ * @brief Sets where log lines go. Safe while other threads are logging: it returns once no
+ * thread is still inside the previous sink, so that sink's ctx may be freed afterwards.
+ * Must not be called from inside a sink.
+ * @param sink the sink, or NULL for the default (stdout)
+ * @param ctx passed to the sink
+ */
+void setLogSink(log_sink sink, void *ctx);
+/**
+ * @brief Messages less severe than this are dropped. Default is LOG_LEVEL_INFO.
+ */
+void setLogLevel(log_level level);
+log_level getLogLevel();
+/**
+ * @brief The default sink, printf to stdout
+ */
+void logStdoutSink(log_level level, const char *line, void *ctx);
+
+void logmsg(log_level level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+/**
+ * Utility function to print to console. This is used consistently within the library instead
+ * of printf. It logs at LOG_LEVEL_INFO, so it ends up in the sink set with setLogSink
+ * (stdout by default). The reason to have this method is to make it simple to plug this
+ * library into proxmark, which has this function already to write also to a logfile.
+ * Errors, warnings and debug chatter go through logmsg with their level instead, so that
+ * a --log-level other than info still shows (or hides) them.
+ * @param fmt
+ */
+void prnlog(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+int testLogging();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LOGGING_H
@@ -37,40 +37,148 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <getopt.h>
 #include "cipherutils.h"
 #include "cipher.h"
 #include "ikeys.h"
 #include "fileutils.h"
+#include "log_async.h"
 #include "elite_crack.h"
 #include "hash1_brute.h"
+#include "hash1_simd.h"
+#include "hash1_solver.h"
+#include "divkey_cache.h"
+#include "audit.h"
+#include "crack_plan.h"
+#include "batch.h"
+#include "dumpgen.h"
+#include "fuzz.h"
+#include "tag_engine.h"
+#include "sim.h"
+#include "provision.h"
+#include "service.h"
+#include "jobs.h"
+#include "loclass_config.h"
+// Long options without a short equivalent
+#define OPT_MAX_HITS	1000
+#define OPT_SOLVE		1001
+#define OPT_TARGETS		1002
+#define OPT_KNOWN		1003
+#define OPT_MAX_UNKNOWN	1004
+#define OPT_MAX_OTHER	1005
+#define OPT_EXACT		1006
+#define OPT_PROGRESS_FILE	1007
+#define OPT_LOG_LEVEL	1008
+#define OPT_LOG_ASYNC	1009
+#define OPT_PLAN		1010
+#define OPT_BATCH		1011
+#define OPT_CACHE		1012
+#define OPT_GENERATE	1013
+#define OPT_CSNS		1014
+#define OPT_COUNT		1015
+#define OPT_SEED		1016
+#define OPT_FUZZ		1017
+#define OPT_FUZZ_REPRO	1018
+#define OPT_TAG_BENCH	1019
+#define OPT_SIMULATE	1020
+#define OPT_CARDS		1021
+#define OPT_RATE		1022
+#define OPT_PROVISION	1023
+#define OPT_OLD_KEY		1024
+#define OPT_OLD_ELITE	1025
+#define OPT_SERVE		1026
+#define OPT_PIN			1027
+
 int unitTests()
 {
-	int errors = testCipherUtils();
+#ifdef LOCLASS_NO_TESTS
+	prnlog("[+] Built with LOCLASS_NO_TESTS, there are no tests to run");
+	return 1;
+#else
+	int errors = testLogging();
+	errors += testLogAsync();
+	errors += testCipherUtils();
 	errors += testMAC();
 	errors += doKeyTests(0);
 	errors += testElite();
 	errors += testOptMAC();
+	errors += testDivkeyCache();
+	errors += testAudit();
+	errors += testHash1Simd();
+	errors += testHash1Scan();
+	errors += testHash1Solver();
+	errors += testCrackPlan();
+	errors += testBatch();
+	errors += testDumpgen();
+	errors += testFuzz();
+	errors += testTagEngine();
+	errors += testSim();
+	errors += testProvision();
+	errors += testService();
+	errors += testJobs();
 
 
 	if(errors)
     {
-        prnlog("OBS! There were errors!!!");
+        logmsg(LOG_LEVEL_ERROR, "OBS! There were errors!!!");
     }
 	return errors;
+#endif
 }
+typedef struct {
+	const char *file;
+	bool tty;
+} cli_progress;
+
+/**
+ * Progress of -f: a status line on stderr (when it is a terminal), and optionally
+ * the same numbers as JSON in a file, replaced atomically on every update.
+ */
+static int cliProgress(const crack_progress *p, void *ctx)
+{
+	cli_progress *cli = (cli_progress*) ctx;
+	if(cli->tty)
+	{
+		if(p->done)
+			fprintf(stderr, "\r\033[K");
+		else
+			fprintf(stderr, "\r[item %d/%d] %d bytes %5.1f%%  %llu candidates  %.0f/s  ETA %.0fs\033[K",
+					p->item + 1, p->items, p->bytes, p->total ? 100.0 * p->candidates / p->total : 0.0,
+					(unsigned long long) p->candidates_all, p->rate, p->eta);
+		fflush(stderr);
+	}
+	if(cli->file)
+	{
+		char tmp[1024];
+		snprintf(tmp, sizeof(tmp), "%s.tmp", cli->file);
+		FILE *f = fopen(tmp, "w");
+		if(f)
+		{
+			fprintf(f, "{\"item\": %d, \"items\": %d, \"bytes\": %d, \"candidates\": %llu, \"total\": %llu, "
+					"\"candidates_all\": %llu, \"seconds\": %.3f, \"rate\": %.1f, \"eta\": %.1f, \"done\": %s}\n",
+					p->item, p->items, p->bytes, (unsigned long long) p->candidates, (unsigned long long) p->total,
+					(unsigned long long) p->candidates_all, p->seconds, p->rate, p->eta, p->done ? "true" : "false");
+			fclose(f);
+			rename(tmp, cli->file);
+		}
+	}
+	return 0;
+}
+
 int showHelp()
 {
     prnlog("Usage: loclass [options]");
 	prnlog("Options:");
-    prnlog("-t                 Perform self-test");
-    prnlog("-h                 Show this help");
+    prnlog("-t, --test         Perform self-test");
+    prnlog("-h, --help         Show this help");
     prnlog("-d <CSN> -k <key>  Calculate diversified key, based on CSN and K_CUS. Key should be on standard NIST-format, not iclass format ");
-	prnlog("-f <filename>      Bruteforce iclass dumpfile");
+	prnlog("-f, --file <file>  Bruteforce iclass dumpfile");
 	prnlog("                   An iclass dumpfile is assumed to consist of an arbitrary number of malicious CSNs, and their protocol responses");
 	prnlog("                   The the binary format of the file is expected to be as follows: ");
 	prnlog("                   <8 byte CSN><8 byte CC><4 byte NR><4 byte MAC>");
@@ -78,7 +186,65 @@ int showHelp()
 	prnlog("                   <8 byte CSN><8 byte CC><4 byte NR><4 byte MAC>");
 	prnlog("                  ... totalling N*24 bytes");
 	prnlog("                  Check iclass_dump.bin for an example");
-
+	prnlog("                  Progress is shown on a status line; --progress-file <file> also writes it as JSON");
+	prnlog("--plan -f <filename>");
+	prnlog("                   Dry run: show how many bytes each item of the dump will bruteforce, which items");
+	prnlog("                   are rejected (> 3 bytes), the total candidates and an ETA for this machine.");
+	prnlog("-a <filename> -k <key> [-e] [-o <bitmap>] [-j <threads>]");
+	prnlog("                   Audit a corpus of captured authentications (same format as the dumpfile),");
+	prnlog("                   and check which reader MACs were made with the given key.");
+	prnlog("                   The key is a master key on NIST-format, or with -e an elite K_cus on iclass format.");
+	prnlog("                   -o writes a bitmap with one bit per record (LSB first), set if the MAC verified.");
+	prnlog("                   -j sets the number of worker threads (default: one per core)");
+	prnlog("-s, --scan-hash1 <template> [-o <hits>] [-j <threads>] [--max-hits <n>]");
+	prnlog("                   Scan CSNs for useful hash1 values. The template is 16 hex digits, with xx for");
+	prnlog("                   bytes to enumerate, e.g. xxxxxxxxf7ff12e0 (the classic 2^32 scan).");
+	prnlog("                   Hits are printed, or with -o written as <8 byte CSN><8 byte HASH1> records,");
+	prnlog("                   in CSN order regardless of the number of threads.");
+	prnlog("--solve <template> [--targets <list>] [--known <list>] [--max-unknown <n>] [--max-other <n>] [--exact]");
+	prnlog("                   Construct a short sequence of CSNs which recovers the target keytable indices,");
+	prnlog("                   by running hash1 backwards instead of scanning. The template is as for -s,");
+	prnlog("                   e.g. xxxxxxxxxxff12e0. Lists are indices or ranges, e.g. 0-15,0x45.");
+	prnlog("                   --targets defaults to 0-15, --known are indices already recovered,");
+	prnlog("                   --max-unknown bytes to bruteforce per CSN (default 3), --max-other indices");
+	prnlog("                   outside targets and known per CSN (default 1). --exact minimizes the CSN count.");
+	prnlog("--batch <dir|manifest> [--cache <dir>] [-j <threads>]");
+	prnlog("                   Crack many dumps over one pool of worker threads. Every file in the directory");
+	prnlog("                   is a dump, or the manifest lists one dump per line as <path> [<group>].");
+	prnlog("                   Dumps in the same group share K_cus and are solved as one keytable.");
+	prnlog("                   Results are cached by content hash in --cache (default .loclass-cache,");
+	prnlog("                   \"\" to disable), so dumps that were cracked before are not cracked again.");
+	prnlog("--generate <filename> -k <key> [-e] [--csns canonical|random|<dumpfile>] [--count <n>] [--seed <n>]");
+	prnlog("                   Write a synthetic dump with valid reader MACs for the key (as for -a, with -e an");
+	prnlog("                   elite K_cus). CSNs are the eight canonical ones that recover K_cus, random ones,");
+	prnlog("                   or those of an existing dump, repeated for --count records (default: one pass).");
+	prnlog("                   NRs are random; the same --seed gives the same dump.");
+	prnlog("--fuzz [--count <n>] [--seed <n>] [-j <threads>]");
+	prnlog("                   Compare every implementation of the MACs, hash0, hash1, diversifyKey and DES");
+	prnlog("                   on --count random inputs (default 1000000). The first mismatch is printed");
+	prnlog("                   minimized, with the --fuzz-repro <hex> command that runs it again.");
+	prnlog("--tag-bench [--count <n>] [--seed <n>] [-j <threads>]");
+	prnlog("                   Latency of emulated tag responses: --count requests (default 1000000) with");
+	prnlog("                   random NRs for 64 cards with 2 CCs each, answered from the per-card cache of");
+	prnlog("                   post-CC states. Exits 1 if p99 is outside the 320.9 us response window.");
+	prnlog("--simulate [-k <key>] [-e] [--cards <n>] [--count <n>] [--rate <n>] [-j <threads>] [--seed <n>]");
+	prnlog("                   Simulate authentications between virtual readers (one per thread) and virtual");
+	prnlog("                   cards (default 1000), --count in total (default 1000000), at --rate per second");
+	prnlog("                   (default unlimited). The key is as for -a; without -k one is made from --seed.");
+	prnlog("                   Prints authentications per second and latency per stage.");
+	prnlog("--provision <csnfile> -k <key> [-e] --old-key <key> [--old-elite] -o <file> [-j <threads>]");
+	prnlog("                   Re-key a batch of cards. CSNs are read one per line as 16 hex digits (- for");
+	prnlog("                   stdin). For each one a %d byte record is written to -o: CSN, old div key,", PROVISION_RECORD_SIZE);
+	prnlog("                   new div key, their XOR (the data of the key update write) and the MAC of that");
+	prnlog("                   write to block 3 under the old key. Keys are as for -a, --old-elite for an elite old key.");
+	prnlog("--serve <socket> [-j <workers>] [--pin]");
+	prnlog("                   Run a daemon answering diversifyKey, reader MAC and tag MAC requests on a UNIX");
+	prnlog("                   socket (protocol in service.h). Concurrent requests are batched for the workers;");
+	prnlog("                   --pin pins worker i to core i. Stops on SIGINT/SIGTERM and prints its counters.");
+	prnlog("--log-level <error|warn|info|debug>  Only show messages at this level or more severe (default info)");
+	prnlog("--log-async        Write output from a background thread, so the work never waits on the terminal");
+	prnlog("%s", "");
+	prnlog("Long options: --test --help --file --audit --key --elite --output --threads --scan-hash1 --solve --progress-file --plan --batch --cache --generate --fuzz --fuzz-repro --tag-bench --simulate --provision --serve --log-level --log-async");
 	return 0;
 }
 
@@ -90,45 +256,359 @@ int main (int argc, char **argv)
 	prnlog("Comes with ABSOLUTELY NO WARRANTY");
 	prnlog("Released as GPLv2\n");
 	prnlog("WARNING");
-	prnlog("");
+	prnlog("%s", "");
 	prnlog("THIS TOOL IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. ");
-	prnlog("");
+	prnlog("%s", "");
 	prnlog("USAGE OF THIS TOOL IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL ");
 	prnlog("PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, ");
 	prnlog("AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. ");
-	prnlog("");
+	prnlog("%s", "");
 	prnlog("THIS TOOL SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. ");
 
 	char *fileName = NULL;
+	char *auditFileName = NULL;
+	char *scanTemplate = NULL;
+	char *keyHex = NULL;
+	char *outputName = NULL;
+	bool elite = false;
+	int threads = 0;
+	uint64_t maxHits = 0;
+	char *solveTemplate = NULL;
+	char *targetList = "0-15";
+	char *knownList = NULL;
+	int maxUnknown = 3;
+	int maxOther = 1;
+	bool exact = false;
+	char *progressFile = NULL;
+	bool logAsync = false;
+	bool plan = false;
+	char *batchPath = NULL;
+	char *cacheDir = ".loclass-cache";
+	char *generateName = NULL;
+	char *csnSet = "canonical";
+	uint64_t count = 0;
+	uint64_t seed = 1;
+	bool fuzz = false;
+	char *fuzzRepro = NULL;
+	bool tagBenchRun = false;
+	bool simulate = false;
+	int cards = 1000;
+	double rate = 0;
+	char *provisionName = NULL;
+	char *oldKeyHex = NULL;
+	bool oldElite = false;
+	char *servePath = NULL;
+	bool pin = false;
 	int c;
 
-    while ((c = getopt (argc, argv, "xthf:")) != -1)
+	static struct option long_options[] = {
+		{"test",		no_argument,		0, 't'},
+		{"help",		no_argument,		0, 'h'},
+		{"file",		required_argument,	0, 'f'},
+		{"audit",		required_argument,	0, 'a'},
+		{"key",			required_argument,	0, 'k'},
+		{"elite",		no_argument,		0, 'e'},
+		{"output",		required_argument,	0, 'o'},
+		{"threads",		required_argument,	0, 'j'},
+		{"scan-hash1",	required_argument,	0, 's'},
+		{"max-hits",	required_argument,	0, OPT_MAX_HITS},
+		{"solve",		required_argument,	0, OPT_SOLVE},
+		{"targets",		required_argument,	0, OPT_TARGETS},
+		{"known",		required_argument,	0, OPT_KNOWN},
+		{"max-unknown",	required_argument,	0, OPT_MAX_UNKNOWN},
+		{"max-other",	required_argument,	0, OPT_MAX_OTHER},
+		{"exact",		no_argument,		0, OPT_EXACT},
+		{"progress-file",	required_argument,	0, OPT_PROGRESS_FILE},
+		{"log-level",	required_argument,	0, OPT_LOG_LEVEL},
+		{"log-async",	no_argument,		0, OPT_LOG_ASYNC},
+		{"plan",		no_argument,		0, OPT_PLAN},
+		{"batch",		required_argument,	0, OPT_BATCH},
+		{"cache",		required_argument,	0, OPT_CACHE},
+		{"generate",	required_argument,	0, OPT_GENERATE},
+		{"csns",		required_argument,	0, OPT_CSNS},
+		{"count",		required_argument,	0, OPT_COUNT},
+		{"seed",		required_argument,	0, OPT_SEED},
+		{"fuzz",		no_argument,		0, OPT_FUZZ},
+		{"fuzz-repro",	required_argument,	0, OPT_FUZZ_REPRO},
+		{"tag-bench",	no_argument,		0, OPT_TAG_BENCH},
+		{"simulate",	no_argument,		0, OPT_SIMULATE},
+		{"cards",		required_argument,	0, OPT_CARDS},
+		{"rate",		required_argument,	0, OPT_RATE},
+		{"provision",	required_argument,	0, OPT_PROVISION},
+		{"old-key",		required_argument,	0, OPT_OLD_KEY},
+		{"old-elite",	no_argument,		0, OPT_OLD_ELITE},
+		{"serve",		required_argument,	0, OPT_SERVE},
+		{"pin",			no_argument,		0, OPT_PIN},
+		{0, 0, 0, 0}
+	};
+
+	while ((c = getopt_long (argc, argv, "thf:a:k:eo:j:s:", long_options, NULL)) != -1)
 	  switch (c)
 		{
-        case  'x':
-            brute_hash1();
-            return 0;
 		case 't':
 		  return unitTests();
 		case 'h':
 		  return showHelp();
 		case 'f':
 		  fileName = optarg;
-		  return bruteforceFileNoKeys(fileName);
+		  break;
+		case 'a':
+		  auditFileName = optarg;
+		  break;
+		case 'k':
+		  keyHex = optarg;
+		  break;
+		case 'e':
+		  elite = true;
+		  break;
+		case 'o':
+		  outputName = optarg;
+		  break;
+		case 'j':
+		  threads = atoi(optarg);
+		  break;
+		case 's':
+		  scanTemplate = optarg;
+		  break;
+		case OPT_MAX_HITS:
+		  maxHits = strtoull(optarg, NULL, 0);
+		  break;
+		case OPT_SOLVE:
+		  solveTemplate = optarg;
+		  break;
+		case OPT_TARGETS:
+		  targetList = optarg;
+		  break;
+		case OPT_KNOWN:
+		  knownList = optarg;
+		  break;
+		case OPT_MAX_UNKNOWN:
+		  maxUnknown = atoi(optarg);
+		  break;
+		case OPT_MAX_OTHER:
+		  maxOther = atoi(optarg);
+		  break;
+		case OPT_EXACT:
+		  exact = true;
+		  break;
+		case OPT_PROGRESS_FILE:
+		  progressFile = optarg;
+		  break;
+		case OPT_LOG_LEVEL:
+		  {
+			  static const char *levels[] = {"error", "warn", "info", "debug"};
+			  int l;
+			  for(l = 0 ; l < 4 && strcmp(optarg, levels[l]) ; l++) ;
+			  if(l == 4)
+			  {
+				  logmsg(LOG_LEVEL_ERROR, "Unknown log level '%s'", optarg);
+				  return 1;
+			  }
+			  setLogLevel((log_level) l);
+		  }
+		  break;
+		case OPT_LOG_ASYNC:
+		  logAsync = true;
+		  break;
+		case OPT_PLAN:
+		  plan = true;
+		  break;
+		case OPT_BATCH:
+		  batchPath = optarg;
+		  break;
+		case OPT_CACHE:
+		  cacheDir = optarg;
+		  break;
+		case OPT_GENERATE:
+		  generateName = optarg;
+		  break;
+		case OPT_CSNS:
+		  csnSet = optarg;
+		  break;
+		case OPT_COUNT:
+		  count = strtoull(optarg, NULL, 0);
+		  break;
+		case OPT_SEED:
+		  seed = strtoull(optarg, NULL, 0);
+		  break;
+		case OPT_FUZZ:
+		  fuzz = true;
+		  break;
+		case OPT_FUZZ_REPRO:
+		  fuzzRepro = optarg;
+		  break;
+		case OPT_TAG_BENCH:
+		  tagBenchRun = true;
+		  break;
+		case OPT_SIMULATE:
+		  simulate = true;
+		  break;
+		case OPT_CARDS:
+		  cards = atoi(optarg);
+		  break;
+		case OPT_RATE:
+		  rate = atof(optarg);
+		  break;
+		case OPT_PROVISION:
+		  provisionName = optarg;
+		  break;
+		case OPT_OLD_KEY:
+		  oldKeyHex = optarg;
+		  break;
+		case OPT_OLD_ELITE:
+		  oldElite = true;
+		  break;
+		case OPT_SERVE:
+		  servePath = optarg;
+		  break;
+		case OPT_PIN:
+		  pin = true;
+		  break;
 		case '?':
-		  if (optopt == 'f')
-			fprintf (stderr, "Option -%c requires an argument.\n", optopt);
-		  else if (isprint (optopt))
-			fprintf (stderr, "Unknown option `-%c'.\n", optopt);
-		  else
-			fprintf (stderr,
-					 "Unknown option character `\\x%x'.\n",
-					 optopt);
+		  // getopt_long has already complained
 		  return 1;
 		//default:
 		  //showHelp();
 		}
 
+	if(logAsync && logAsyncStart(NULL, NULL, 0) == 0)
+		atexit(logAsyncStop);
+
+	if(auditFileName)
+	{
+		audit_config audit = {elite, {0}, threads, 0, outputName};
+		if(keyHex == NULL || hexToBytes(keyHex, audit.key, 8))
+		{
+			prnlog("Audit requires an 8-byte hex key, -k <key>");
+			return 1;
+		}
+		return auditFile(auditFileName, &audit, NULL);
+	}
+	if(scanTemplate)
+	{
+		hash1_scan_config scan;
+		memset(&scan, 0, sizeof(scan));
+		if(hash1ParseTemplate(scanTemplate, scan.csn, &scan.free_mask))
+		{
+			logmsg(LOG_LEVEL_ERROR, "Bad CSN template '%s', expected 16 hex digits with xx for free bytes", scanTemplate);
+			return 1;
+		}
+		scan.threads = threads;
+		scan.outfile = outputName;
+		scan.max_hits = maxHits;
+		return hash1Scan(&scan, NULL);
+	}
+	if(solveTemplate)
+	{
+		hash1_solve_config solve;
+		memset(&solve, 0, sizeof(solve));
+		if(hash1ParseTemplate(solveTemplate, solve.csn, &solve.free_mask))
+		{
+			logmsg(LOG_LEVEL_ERROR, "Bad CSN template '%s', expected 16 hex digits with xx for free bytes", solveTemplate);
+			return 1;
+		}
+		if(hash1ParseIndexList(targetList, solve.target) ||
+		   (knownList && hash1ParseIndexList(knownList, solve.known)))
+		{
+			logmsg(LOG_LEVEL_ERROR, "Bad index list, expected indices or ranges 0..127, e.g. 0-15,0x45");
+			return 1;
+		}
+		solve.max_unknown = maxUnknown;
+		solve.max_other = maxOther;
+		solve.exact = exact;
+		hash1_solve_result *result = malloc(sizeof(hash1_solve_result));
+		if(result == NULL) return 1;
+		int errors = hash1Solve(&solve, result);
+		hash1PrintSolution(result);
+		free(result);
+		return errors;
+	}
+	if(fuzzRepro)
+		return fuzzReproduce(fuzzRepro);
+	if(fuzz)
+	{
+		fuzz_config fc = {threads, count ? count : 1000000, seed};
+		return fuzzRun(&fc, NULL);
+	}
+	if(tagBenchRun)
+	{
+		tag_bench_config tb = {threads, 64, 2, count ? count : 1000000, seed};
+		return tagBench(&tb, NULL);
+	}
+	if(simulate)
+	{
+		sim_config sc = {elite, {0}, threads, cards, count ? count : 1000000, rate, seed};
+		if(keyHex == NULL)
+		{
+			memcpy(sc.key, &seed, 8);
+		}else if(hexToBytes(keyHex, sc.key, 8))
+		{
+			prnlog("Simulation requires an 8-byte hex key, -k <key>");
+			return 1;
+		}
+		return simRun(&sc, NULL);
+	}
+	if(provisionName)
+	{
+		provision_config pc = {{oldElite, {0}}, {elite, {0}}, threads};
+		if(keyHex == NULL || hexToBytes(keyHex, pc.new_key.key, 8) ||
+		   oldKeyHex == NULL || hexToBytes(oldKeyHex, pc.old_key.key, 8))
+		{
+			prnlog("Provisioning requires 8-byte hex keys, -k <new key> --old-key <old key>");
+			return 1;
+		}
+		if(outputName == NULL)
+		{
+			prnlog("Provisioning requires an output file, -o <file>");
+			return 1;
+		}
+		return provisionFile(provisionName, outputName, &pc);
+	}
+	if(servePath)
+	{
+		service_config svc = {servePath, threads, pin};
+		return serviceRun(&svc);
+	}
+	if(generateName)
+	{
+		dumpgen_config gen = {elite, {0}, NULL, 0, false, {0xFE,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF}, seed};
+		uint8_t (*csns)[8] = NULL;
+		if(keyHex == NULL || hexToBytes(keyHex, gen.key, 8))
+		{
+			prnlog("Generating a dump requires an 8-byte hex key, -k <key>");
+			return 1;
+		}
+		if(strcmp(csnSet, "random") == 0)
+		{
+			gen.random_csns = true;
+			gen.ncsns = 128;
+		}else if(strcmp(csnSet, "canonical") == 0)
+		{
+			gen.ncsns = DUMPGEN_CANONICAL_CSNS;
+		}else
+		{
+			if(dumpgenLoadCsns(csnSet, &csns, &gen.ncsns))
+				return 1;
+			gen.csns = (const uint8_t (*)[8]) csns;
+		}
+		int result = dumpgenFile(generateName, &gen, count ? count : gen.ncsns);
+		free(csns);
+		return result;
+	}
+	if(batchPath)
+	{
+		batch_config batch = {threads, cacheDir};
+		return batchCrack(batchPath, &batch, NULL);
+	}
+	if(fileName && plan)
+		return crackPlanFile(fileName);
+	if(fileName)
+	{
+		cli_progress progress = {progressFile, isatty(STDERR_FILENO)};
+		setCrackProgress(cliProgress, &progress);
+		return bruteforceFileNoKeys(fileName);
+	}
+
     showHelp();
 
 	return 0;
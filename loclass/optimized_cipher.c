@@ -60,6 +60,7 @@
 **/
 
 #include "optimized_cipher.h"
+#include "loclass_config.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -122,6 +123,24 @@ void opt_suc(const uint8_t* k,State* s, uint8_t *in, uint8_t length, bool add32Z
 {
 	State x2;
 	int i;
+#if defined(LOCLASS_SMALL)
+	int j;
+	for(i =0 ; i < length  ; i++)
+	{
+		for(j = 7 ; j >= 0 ; j--)
+		{
+			opt_successor(k,s,1 & (in[i] >> j),&x2);
+			*s = x2;
+		}
+	}
+	//For tag MAC, an additional 32 zeroes
+	if(add32Zeroes)
+		for(i =0 ; i < 32 ; i++)
+		{
+			opt_successor(k,s,0,&x2);
+			*s = x2;
+		}
+#else
 	uint8_t head = 0;
 	for(i =0 ; i < length  ; i++)
 	{
@@ -157,6 +176,7 @@ void opt_suc(const uint8_t* k,State* s, uint8_t *in, uint8_t length, bool add32Z
 			opt_successor(k,s,0,&x2);
 			opt_successor(k,&x2,0,s);
 		}
+#endif
 }
 
 void opt_output(const uint8_t* k,State* s,  uint8_t *buffer)
@@ -164,6 +184,20 @@ void opt_output(const uint8_t* k,State* s,  uint8_t *buffer)
 	uint8_t times = 0;
 	uint8_t bout = 0;
 	State temp = {0,0,0,0};
+#if defined(LOCLASS_SMALL)
+	int i;
+	for( ; times < 4 ; times++)
+	{
+		bout = 0;
+		for(i = 7 ; i >= 0 ; i--)
+		{
+			bout |= ((s->r >> 2) & 1) << i;
+			opt_successor(k,s,0,&temp);
+			*s = temp;
+		}
+		buffer[times] = bout;
+	}
+#else
 	for( ; times < 4 ; times++)
 	{
 		bout =0;
@@ -185,7 +219,7 @@ void opt_output(const uint8_t* k,State* s,  uint8_t *buffer)
 		opt_successor(k,&temp,0,s);
 		buffer[times] = bout;
 	}
-
+#endif
 }
 
 void opt_MAC(uint8_t* k, uint8_t* input, uint8_t* out)
@@ -216,7 +250,7 @@ void opt_reverse_arraybytecpy(uint8_t* dest, uint8_t *src, size_t len)
 
 void opt_doReaderMAC(uint8_t *cc_nr_p, uint8_t *div_key_p, uint8_t mac[4])
 {
-	static uint8_t cc_nr[12];
+	uint8_t cc_nr[12];
 
 	opt_reverse_arraybytecpy(cc_nr, cc_nr_p,12);
 	uint8_t dest []= {0,0,0,0,0,0,0,0};
@@ -227,7 +261,7 @@ void opt_doReaderMAC(uint8_t *cc_nr_p, uint8_t *div_key_p, uint8_t mac[4])
 }
 void opt_doTagMAC(uint8_t *cc_p, const uint8_t *div_key_p, uint8_t mac[4])
 {
-	static uint8_t cc_nr[8+4+4];
+	uint8_t cc_nr[8+4+4];
 	opt_reverse_arraybytecpy(cc_nr, cc_p,12);
 	State _init  =  {
 			((div_key_p[0] ^ 0x4c) + 0xEC) & 0xFF,// l
@@ -243,6 +277,29 @@ void opt_doTagMAC(uint8_t *cc_p, const uint8_t *div_key_p, uint8_t mac[4])
 	return;
 
 }
+void opt_doMAC_N(const uint8_t *in_p, size_t len, const uint8_t *div_key_p, uint8_t mac[4])
+{
+	uint8_t chunk[64];
+	State _init  =  {
+			((div_key_p[0] ^ 0x4c) + 0xEC) & 0xFF,// l
+			((div_key_p[0] ^ 0x4c) + 0x21) & 0xFF,// r
+			0x4c, // b
+			0xE012 // t
+			};
+	//opt_suc takes at most 255 bytes at a time
+	while(len > 0)
+	{
+		size_t n = len < sizeof(chunk) ? len : sizeof(chunk);
+		opt_reverse_arraybytecpy(chunk, (uint8_t*) in_p, n);
+		opt_suc(div_key_p,&_init,chunk, n,false);
+		in_p += n;
+		len -= n;
+	}
+	uint8_t dest []= {0,0,0,0};
+	opt_output(div_key_p,&_init, dest);
+	//The output MAC must also be reversed
+	opt_reverse_arraybytecpy(mac, dest,4);
+}
 /**
  * The tag MAC can be divided (both can, but no point in dividing the reader mac) into
  * two functions, since the first 8 bytes are known, we can pre-calculate the state
@@ -253,7 +310,7 @@ void opt_doTagMAC(uint8_t *cc_p, const uint8_t *div_key_p, uint8_t mac[4])
  */
 State opt_doTagMAC_1(uint8_t *cc_p, const uint8_t *div_key_p)
 {
-	static uint8_t cc_nr[8];
+	uint8_t cc_nr[8];
 	opt_reverse_arraybytecpy(cc_nr, cc_p,8);
 	State _init  =  {
 			((div_key_p[0] ^ 0x4c) + 0xEC) & 0xFF,// l
@@ -275,7 +332,7 @@ State opt_doTagMAC_1(uint8_t *cc_p, const uint8_t *div_key_p)
  */
 void opt_doTagMAC_2(State _init,  uint8_t* nr, uint8_t mac[4], const uint8_t* div_key_p)
 {
-	static uint8_t _nr [4];
+	uint8_t _nr [4];
 	opt_reverse_arraybytecpy(_nr, nr, 4);
 	opt_suc(div_key_p,&_init,_nr, 4, true);
 	//opt_suc(div_key_p,&_init,nr, 4, false);
@@ -285,3 +342,101 @@ void opt_doTagMAC_2(State _init,  uint8_t* nr, uint8_t mac[4], const uint8_t* di
 	opt_reverse_arraybytecpy(mac, dest,4);
 	return;
 }
+
+/*
+ * opt_successor with the y-dependent part of select() taken out: ysel is (y << 1).
+ * Being inline, a constant ysel (the zero bits during output) folds away.
+ */
+static inline void opt_successor_sel(const uint8_t* k, const State *s, uint8_t ysel, State* successor)
+{
+	uint8_t Tt = 1 & opt_T(s);
+
+	successor->t = (s->t >> 1);
+	successor->t |= (Tt ^ (s->r >> 7 & 0x1) ^ (s->r >> 3 & 0x1)) << 15;
+
+	successor->b = s->b >> 1;
+	successor->b |= (opt_B(s) ^ (s->r & 0x1)) << 7;
+
+	successor->r = (k[(opt__select(Tt,0,s->r)) ^ ysel] ^ successor->b) + s->l ;
+	successor->l = successor->r+s->r;
+}
+
+void opt_macSpecialize(const uint8_t *cc_nr_p, opt_mac_spec *spec)
+{
+	int i, j;
+	//opt_doReaderMAC bit-reverses every byte and then feeds it msb first
+	for(i = 0 ; i < 12 ; i++)
+		for(j = 0 ; j < 8 ; j++)
+			spec->ysel[i * 8 + j] = ((cc_nr_p[i] >> j) & 1) << 1;
+}
+
+void opt_doReaderMAC_spec(const opt_mac_spec *spec, const uint8_t *div_key_p, uint8_t mac[4])
+{
+	const uint8_t *k = div_key_p;
+	const uint8_t *y = spec->ysel;
+	const uint8_t *end = y + sizeof(spec->ysel);
+	State s  =  {
+			((k[0] ^ 0x4c) + 0xEC) & 0xFF,// l
+			((k[0] ^ 0x4c) + 0x21) & 0xFF,// r
+			0x4c, // b
+			0xE012 // t
+			};
+	State x2;
+	uint8_t dest[4];
+	uint8_t times, bout;
+
+#if defined(LOCLASS_SMALL)
+	int bit;
+	for( ; y < end ; y++)
+	{
+		opt_successor_sel(k,&s,*y,&x2);
+		s = x2;
+	}
+	for(times = 0 ; times < 4 ; times++)
+	{
+		bout = 0;
+		for(bit = 7 ; bit >= 0 ; bit--)
+		{
+			bout |= ((s.r >> 2) & 1) << bit;
+			opt_successor_sel(k,&s,0,&x2);
+			s = x2;
+		}
+		dest[times] = bout;
+	}
+#else
+	for( ; y < end ; y += 8)
+	{
+		opt_successor_sel(k,&s,y[0],&x2);
+		opt_successor_sel(k,&x2,y[1],&s);
+		opt_successor_sel(k,&s,y[2],&x2);
+		opt_successor_sel(k,&x2,y[3],&s);
+		opt_successor_sel(k,&s,y[4],&x2);
+		opt_successor_sel(k,&x2,y[5],&s);
+		opt_successor_sel(k,&s,y[6],&x2);
+		opt_successor_sel(k,&x2,y[7],&s);
+	}
+	//Same as opt_output
+	for(times = 0 ; times < 4 ; times++)
+	{
+		bout = (s.r & 0x4) << 5;
+		opt_successor_sel(k,&s,0,&x2);
+		bout |= (x2.r & 0x4) << 4;
+		opt_successor_sel(k,&x2,0,&s);
+		bout |= (s.r & 0x4) << 3;
+		opt_successor_sel(k,&s,0,&x2);
+		bout |= (x2.r & 0x4) << 2;
+		opt_successor_sel(k,&x2,0,&s);
+		bout |= (s.r & 0x4) << 1;
+		opt_successor_sel(k,&s,0,&x2);
+		bout |= (x2.r & 0x4) ;
+		opt_successor_sel(k,&x2,0,&s);
+		bout |= (s.r & 0x4) >> 1;
+		opt_successor_sel(k,&s,0,&x2);
+		bout |= (x2.r & 0x4) >> 2;
+		opt_successor_sel(k,&x2,0,&s);
+		dest[times] = bout;
+	}
+#endif
+	//The output MAC must also be reversed
+	opt_reverse_arraybytecpy(mac, dest, 4);
+}
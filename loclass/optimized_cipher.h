@@ -43,6 +43,7 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include <stddef.h>
 
 /**
 * Definition 1 (Cipher state). A cipher state of iClass s is an element of F 40/2
@@ -87,6 +88,40 @@ State opt_doTagMAC_1(uint8_t *cc_p, const uint8_t *div_key_p);
  */
 void opt_doTagMAC_2(State _init, uint8_t* nr, uint8_t mac[4], const uint8_t* div_key_p);
 
+/**
+ * @brief MAC over any number of bytes, in protocol order like cc_nr. With the block
+ * number and the 8 data bytes this is the MAC of a write (UPDATE) command.
+ * @param in_p - the data
+ * @param len - its length in bytes
+ * @param div_key_p - the key to use
+ * @param mac - where to store the MAC
+ */
+void opt_doMAC_N(const uint8_t *in_p, size_t len, const uint8_t *div_key_p, uint8_t mac[4]);
+
+/**
+ * A reader MAC specialized for one cc_nr. When cracking a dump item, the cc_nr stays
+ * the same while the key changes, so the 96 input bits are known up front. Each bit y
+ * only flips bit 1 of the key-byte index chosen by select(), so it is stored as that
+ * xor-mask (0 or 2), already in the order the cipher consumes it.
+ **/
+typedef struct {
+	uint8_t ysel[96];
+} opt_mac_spec;
+
+/**
+ * @brief Precomputes the input bits of a cc_nr for opt_doReaderMAC_spec
+ * @param cc_nr_p - the 12 byte CC * NR, as given to opt_doReaderMAC
+ * @param spec - where to store the result
+ */
+void opt_macSpecialize(const uint8_t *cc_nr_p, opt_mac_spec *spec);
+/**
+ * @brief The reader MAC over a specialized cc_nr. Same result as opt_doReaderMAC.
+ * @param spec - from opt_macSpecialize
+ * @param div_key_p - the key to use
+ * @param mac - where to store the MAC
+ */
+void opt_doReaderMAC_spec(const opt_mac_spec *spec, const uint8_t *div_key_p, uint8_t mac[4]);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,398 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <time.h>
+#include "cipher.h"
+#include "cipherutils.h"
+#include "optimized_cipher.h"
+#include "ikeys.h"
+#include "des.h"
+#include "elite_crack.h"
+#include "fileutils.h"
+#include "threadpool.h"
+#include "provision.h"
+
+typedef char provision_record_size_check[sizeof(provision_record) == PROVISION_RECORD_SIZE ? 1 : -1];
+
+/*
+ * What is shared between all CSNs for a key: the DES key schedule of a standard
+ * master key (only read, so all threads can use it), or the keytable of K_cus.
+ */
+typedef struct {
+	bool elite;
+	des_context master;
+	uint8_t keytable[128];
+} provision_schedule;
+
+typedef struct {
+	const provision_schedule *old_ks;
+	const provision_schedule *new_ks;
+	const uint8_t (*csns)[8];
+	provision_record *records;
+	size_t count;
+} provision_task;
+
+static void provisionSchedule(const provision_key *key, provision_schedule *ks)
+{
+	uint8_t k[8];
+	memset(ks, 0, sizeof(provision_schedule));
+	memcpy(k, key->key, 8);
+	ks->elite = key->elite;
+	if(key->elite)
+	{
+		hash2(k, ks->keytable);
+	}else
+	{
+		ks->master.mode = DES_ENCRYPT;
+		des_setkey_enc(&ks->master, k);
+	}
+}
+
+/*
+ * The div keys of up to PROVISION_CHUNK CSNs, one stage at a time:
+ * (elite: hash1, gather and permutekey_rev, setkey), encrypt, hash0
+ */
+static void provisionDivKeys(const provision_schedule *ks, const uint8_t (*csns)[8], size_t count,
+							 uint8_t (*div_keys)[8])
+{
+	uint8_t key_sel_p[PROVISION_CHUNK][8];
+	uint8_t crypted[PROVISION_CHUNK][8];
+	uint8_t csn[8], key_index[8], key_sel[8];
+	des_context ctx = {DES_ENCRYPT,{0}};
+	size_t n;
+	int i;
+
+	if(ks->elite)
+	{
+		for(n = 0 ; n < count ; n++)
+		{
+			memcpy(csn, csns[n], 8);
+			hash1(csn, key_index);
+			for(i = 0 ; i < 8 ; i++)
+				key_sel[i] = ks->keytable[key_index[i]];
+			permutekey_rev(key_sel, key_sel_p[n]);
+		}
+		for(n = 0 ; n < count ; n++)
+		{
+			memcpy(csn, csns[n], 8);
+			des_setkey_enc(&ctx, key_sel_p[n]);
+			des_crypt_ecb(&ctx, csn, crypted[n]);
+		}
+	}else
+	{
+		for(n = 0 ; n < count ; n++)
+		{
+			memcpy(csn, csns[n], 8);
+			des_crypt_ecb((des_context*) &ks->master, csn, crypted[n]);
+		}
+	}
+	for(n = 0 ; n < count ; n++)
+		hash0(x_bytes_to_num(crypted[n], 8), div_keys[n]);
+}
+
+static void provisionChunk(void *arg)
+{
+	provision_task *task = (provision_task*) arg;
+	uint8_t old_div[PROVISION_CHUNK][8], new_div[PROVISION_CHUNK][8];
+	uint8_t block[9];
+	size_t n;
+	int i;
+
+	provisionDivKeys(task->old_ks, task->csns, task->count, old_div);
+	provisionDivKeys(task->new_ks, task->csns, task->count, new_div);
+	block[0] = PROVISION_KEY_BLOCK;
+	for(n = 0 ; n < task->count ; n++)
+	{
+		provision_record *rec = &task->records[n];
+		memcpy(rec->csn, task->csns[n], 8);
+		memcpy(rec->old_div_key, old_div[n], 8);
+		memcpy(rec->new_div_key, new_div[n], 8);
+		for(i = 0 ; i < 8 ; i++)
+			rec->xor_key[i] = old_div[n][i] ^ new_div[n][i];
+		memcpy(block + 1, rec->xor_key, 8);
+		opt_doMAC_N(block, sizeof(block), old_div[n], rec->update_mac);
+	}
+}
+
+/*
+ * Reads up to max CSNs. Returns the number read, or -1 on a bad line
+ */
+static long provisionRead(FILE *in, uint8_t (*csns)[8], size_t max, uint64_t *line)
+{
+	char buf[256];
+	size_t n = 0;
+
+	while(n < max && fgets(buf, sizeof(buf), in))
+	{
+		char *p = buf, *end;
+		(*line)++;
+		while(isspace((unsigned char) *p)) p++;
+		if(*p == 0 || *p == '#') continue;
+		end = p + strlen(p);
+		while(end > p && isspace((unsigned char) end[-1])) *--end = 0;
+		if(strlen(p) != 16 || hexToBytes(p, csns[n], 8))
+		{
+			logmsg(LOG_LEVEL_ERROR, "Line %llu: expected a CSN as 16 hex digits, got '%s'", (unsigned long long) *line, p);
+			return -1;
+		}
+		n++;
+	}
+	return n;
+}
+
+int provisionStream(FILE *in, FILE *out, const provision_config *config, uint64_t *count)
+{
+	int threads = config->threads ? config->threads : numberOfCores();
+	size_t window = (size_t) threads * 4 * PROVISION_CHUNK;
+	provision_schedule old_ks, new_ks;
+	uint64_t total = 0, line = 0;
+	int errors = 0;
+	long got;
+
+	uint8_t (*csns)[8] = malloc(window * 8);
+	provision_record *records = malloc(window * sizeof(provision_record));
+	provision_task *tasks = malloc(threads * 4 * sizeof(provision_task));
+	threadpool *pool = threadpool_create(threads);
+	if(!csns || !records || !tasks || !pool)
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to set up provisioning");
+		free(csns); free(records); free(tasks);
+		if(pool) threadpool_destroy(pool);
+		return 1;
+	}
+	provisionSchedule(&config->old_key, &old_ks);
+	provisionSchedule(&config->new_key, &new_ks);
+
+	// Read a window of CSNs, compute it on all cores, write it in order, repeat
+	while((got = provisionRead(in, csns, window, &line)) > 0)
+	{
+		size_t first, t = 0;
+		for(first = 0 ; first < (size_t) got ; first += PROVISION_CHUNK, t++)
+		{
+			tasks[t].old_ks = &old_ks;
+			tasks[t].new_ks = &new_ks;
+			tasks[t].csns = (const uint8_t (*)[8]) csns + first;
+			tasks[t].records = records + first;
+			tasks[t].count = got - first < PROVISION_CHUNK ? got - first : PROVISION_CHUNK;
+			if(threadpool_submit(pool, provisionChunk, &tasks[t]))
+			{
+				logmsg(LOG_LEVEL_ERROR, "Failed to queue provisioning work");
+				errors++;
+				break;
+			}
+		}
+		// Chunks already queued use the buffers, so wait for them even if queueing failed
+		threadpool_wait(pool);
+		if(errors)
+			break;
+		if(fwrite(records, sizeof(provision_record), got, out) != (size_t) got)
+		{
+			logmsg(LOG_LEVEL_ERROR, "Failed to write the records");
+			errors++;
+			break;
+		}
+		total += got;
+	}
+	if(got < 0)
+		errors++;
+
+	threadpool_destroy(pool);
+	free(csns);
+	free(records);
+	free(tasks);
+	if(count) *count = total;
+	return errors ? 1 : 0;
+}
+
+int provisionFile(const char *infile, const char *outfile, const provision_config *config)
+{
+	FILE *in = strcmp(infile, "-") == 0 ? stdin : fopen(infile, "r");
+	FILE *out;
+	struct timespec t1, t2;
+	uint64_t count = 0;
+	int errors;
+
+	if(!in)
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to read CSNs from '%s'", infile);
+		return 1;
+	}
+	out = fopen(outfile, "wb");
+	if(!out)
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to write to file '%s'", outfile);
+		if(in != stdin) fclose(in);
+		return 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	errors = provisionStream(in, out, config, &count);
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	if(fclose(out))
+		errors = 1;
+	if(in != stdin)
+		fclose(in);
+
+	double seconds = (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / 1e9;
+	prnlog("[%s] %llu records of %d bytes written to %s, %.0f CSNs/s", errors ? "!" : "+",
+		   (unsigned long long) count, PROVISION_RECORD_SIZE, outfile, seconds > 0 ? count / seconds : 0.0);
+	return errors;
+}
+
+// ----------------------------------------------------------------------------
+// TEST CODE BELOW
+// ----------------------------------------------------------------------------
+
+// The record for one CSN, with the reference implementations
+static void provisionReference(const provision_config *config, uint8_t csn[8], provision_record *rec)
+{
+	const provision_key *keys[2] = {&config->old_key, &config->new_key};
+	uint8_t *div_keys[2] = {rec->old_div_key, rec->new_div_key};
+	uint8_t keytable[128], key_index[8], key_sel[8], key_sel_p[8], key[8], block[9];
+	mac_ctx ctx;
+	int k, i;
+
+	memcpy(rec->csn, csn, 8);
+	for(k = 0 ; k < 2 ; k++)
+	{
+		memcpy(key, keys[k]->key, 8);
+		if(keys[k]->elite)
+		{
+			hash2(key, keytable);
+			hash1(csn, key_index);
+			for(i = 0 ; i < 8 ; i++)
+				key_sel[i] = keytable[key_index[i]];
+			permutekey_rev(key_sel, key_sel_p);
+			diversifyKey(csn, key_sel_p, div_keys[k]);
+		}else
+		{
+			diversifyKey(csn, key, div_keys[k]);
+		}
+	}
+	block[0] = PROVISION_KEY_BLOCK;
+	for(i = 0 ; i < 8 ; i++)
+		block[1 + i] = rec->xor_key[i] = rec->old_div_key[i] ^ rec->new_div_key[i];
+	macInit(&ctx, rec->old_div_key);
+	macUpdate(&ctx, block, 9);
+	macFinal(&ctx, rec->update_mac);
+}
+
+int testProvision()
+{
+	int errors = 0;
+	provision_config config = {{false, {0x5B,0x7C,0x62,0xC4,0x91,0xC1,0x1B,0x39}},
+							   {true, {0x01,0x23,0x45,0x67,0x89,0xAB,0xCD,0xEF}}, 2};
+	const uint64_t count = 2 * PROVISION_CHUNK + 77;
+	provision_record rec, expected;
+	uint8_t csn[8];
+	uint64_t n, written = 0;
+	FILE *in = tmpfile(), *out = tmpfile();
+
+	prnlog("[+] Testing provisioning pipeline...");
+	if(!in || !out)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: no temporary files");
+		if(in) fclose(in);
+		if(out) fclose(out);
+		return 1;
+	}
+
+	// CSN n is n, in hex, with a comment and blank lines in between
+	fprintf(in, "# CSNs\n\n");
+	for(n = 0 ; n < count ; n++)
+		fprintf(in, "%016llx\n", (unsigned long long) (n * 0x0101010101ULL + 0x12E0));
+	rewind(in);
+	if(provisionStream(in, out, &config, &written) || written != count)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: provisioning %llu CSNs, %llu records", (unsigned long long) count,
+			   (unsigned long long) written);
+		errors++;
+	}
+
+	rewind(out);
+	for(n = 0 ; n < written && !errors ; n++)
+	{
+		uint64_t c = n * 0x0101010101ULL + 0x12E0;
+		int i;
+		for(i = 0 ; i < 8 ; i++)
+			csn[i] = c >> (8 * (7 - i));
+		if(fread(&rec, sizeof(rec), 1, out) != 1)
+		{
+			logmsg(LOG_LEVEL_ERROR, "[+] FAILED: record %llu missing", (unsigned long long) n);
+			errors++;
+			break;
+		}
+		// Checking all of them is slow with the reference code
+		if(n % 61 && n != written - 1) continue;
+		provisionReference(&config, csn, &expected);
+		if(memcmp(&rec, &expected, sizeof(rec)) != 0)
+		{
+			logmsg(LOG_LEVEL_ERROR, "[+] FAILED: record %llu differs from the reference", (unsigned long long) n);
+			printvar("CSN", csn, 8);
+			printvar("got     ", (uint8_t*) &rec, sizeof(rec));
+			printvar("expected", (uint8_t*) &expected, sizeof(expected));
+			errors++;
+		}
+	}
+	fclose(in);
+	fclose(out);
+
+	// A bad line fails the stream
+	in = tmpfile();
+	out = tmpfile();
+	if(in && out)
+	{
+		fprintf(in, "0102030405060708\n01020304xx060708\n");
+		rewind(in);
+		if(provisionStream(in, out, &config, NULL) == 0)
+		{
+			logmsg(LOG_LEVEL_ERROR, "[+] FAILED: a bad CSN line was accepted");
+			errors++;
+		}
+	}
+	if(in) fclose(in);
+	if(out) fclose(out);
+
+	if(errors == 0)
+		prnlog("[+] Provisioning ok");
+	return errors;
+}
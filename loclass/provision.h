@@ -0,0 +1,108 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#ifndef PROVISION_H
+#define PROVISION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * Bulk provisioning / re-keying for an encoding station. For every CSN the card's
+ * diversified key under the old and under the new key is computed, along with what
+ * the key update needs: the new key XOR the old one (the data of the write to block 3),
+ * and the MAC of that write under the old key.
+ *
+ * Standard keys share one DES key schedule, elite keys one keytable (hash2). CSNs
+ * are processed in chunks of PROVISION_CHUNK, one stage at a time over the chunk,
+ * and the chunks are spread over all cores. Records come out in input order.
+ */
+#define PROVISION_CHUNK 1024
+#define PROVISION_KEY_BLOCK 3
+
+typedef struct {
+	bool elite;					// key is K_cus (iclass format), as for audit_config
+	uint8_t key[8];				// standard: master key on NIST format. elite: K_cus on iclass format
+} provision_key;
+
+typedef struct {
+	provision_key old_key;
+	provision_key new_key;
+	int threads;				// 0 = one per core
+} provision_config;
+
+/**
+ * Output record, PROVISION_RECORD_SIZE bytes, written as is
+ */
+typedef struct {
+	uint8_t csn[8];
+	uint8_t old_div_key[8];
+	uint8_t new_div_key[8];
+	uint8_t xor_key[8];			// new_div_key ^ old_div_key
+	uint8_t update_mac[4];		// MAC(old_div_key, PROVISION_KEY_BLOCK * xor_key)
+} provision_record;
+
+#define PROVISION_RECORD_SIZE 36
+
+/**
+ * @brief Computes records for a CSN stream
+ * @param in CSNs, one per line as 16 hex digits. Blank lines and lines starting with # are skipped
+ * @param out where the records go
+ * @param config
+ * @param count number of records written, may be NULL
+ * @return 0 for ok, 1 for failz
+ */
+int provisionStream(FILE *in, FILE *out, const provision_config *config, uint64_t *count);
+/**
+ * @brief provisionStream on files, "-" reads from stdin
+ * @return 0 for ok, 1 for failz
+ */
+int provisionFile(const char *infile, const char *outfile, const provision_config *config);
+
+int testProvision();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PROVISION_H
@@ -0,0 +1,969 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#ifdef __linux__
+#define _GNU_SOURCE				// pthread_setaffinity_np
+#endif
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "optimized_cipher.h"
+#include "ikeys.h"
+#include "des.h"
+#include "fileutils.h"
+#include "threadpool.h"
+#include "service.h"
+
+typedef char service_msg_size_check[sizeof(service_msg) == SERVICE_MSG_SIZE ? 1 : -1];
+typedef char service_stats_size_check[sizeof(service_stats_msg) <= 20 ? 1 : -1];
+
+#define SERVICE_BUCKETS 32
+
+typedef struct {
+	service_msg msg;
+	int conn;					// slot in service.conns
+	uint32_t gen;				// generation of that slot, to drop responses to a closed connection
+	uint64_t arrived;
+} service_request;
+
+typedef struct service_batch {
+	struct service_batch *next;
+	int count;
+	service_request req[SERVICE_MAX_BATCH];
+} service_batch;
+
+typedef struct {
+	int fd;						// -1 = free slot
+	uint32_t gen;
+	uint8_t in[SERVICE_MSG_SIZE];
+	int inlen;
+	uint8_t *out;
+	size_t outlen, outcap;
+	int pending;				// requests at the workers
+} service_conn;
+
+struct service {
+	service_config config;
+	int listen_fd;
+	int wake[2];				// pipe, wakes the I/O thread for finished batches and stop
+	pthread_t io;
+	pthread_t *workers;
+	int nworkers;
+	// Under lock
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	service_batch *todo, *todo_tail;
+	service_batch *done;
+	bool stopping;
+	uint64_t requests, batches, connections;
+	uint64_t latency[SERVICE_BUCKETS];
+	uint64_t max_ns;
+	// I/O thread only
+	service_conn conns[SERVICE_MAX_CONNS];
+	uint64_t started;
+};
+
+static uint64_t serviceNow()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/*
+ * Interpolated within the log2 bucket, and never above the largest latency, as simPercentile
+ */
+static uint64_t servicePercentile(const uint64_t *h, uint64_t count, uint64_t max_ns, double p)
+{
+	double rank = p * count;
+	uint64_t seen = 0;
+	int i;
+	for(i = 0 ; i < SERVICE_BUCKETS ; i++)
+	{
+		if(h[i] == 0 || seen + h[i] < rank)
+		{
+			seen += h[i];
+			continue;
+		}
+		double lo = i ? (double) (1ULL << i) : 0;
+		double hi = i < SERVICE_BUCKETS - 1 ? (double) (2ULL << i) : (double) max_ns;
+		double v = lo + (hi - lo) * (rank - seen) / h[i];
+		return v < max_ns ? (uint64_t) v : max_ns;
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Workers
+// ----------------------------------------------------------------------------
+
+static void serviceDiversify(service_batch *b)
+{
+	des_context ctx = {DES_ENCRYPT,{0}};
+	bool done[SERVICE_MAX_BATCH] = {false};
+	int i, j;
+
+	// One key schedule per distinct key in the batch
+	for(i = 0 ; i < b->count ; i++)
+	{
+		service_msg *m = &b->req[i].msg;
+		if(m->op != SERVICE_OP_DIVERSIFY || done[i]) continue;
+		uint8_t key[8];
+		memcpy(key, m->data + 8, 8);
+		des_setkey_enc(&ctx, key);
+		for(j = i ; j < b->count ; j++)
+		{
+			service_msg *o = &b->req[j].msg;
+			if(o->op != SERVICE_OP_DIVERSIFY || done[j] || memcmp(o->data + 8, key, 8) != 0) continue;
+			uint8_t csn[8];
+			memcpy(csn, o->data, 8);
+			diversifyKeyWithContext(&ctx, csn, o->data);
+			memset(o->data + 8, 0, 12);
+			done[j] = true;
+		}
+	}
+}
+
+static void serviceTagMACs(service_batch *b)
+{
+	bool done[SERVICE_MAX_BATCH] = {false};
+	uint8_t mac[4];
+	int i, j;
+
+	// One opt_doTagMAC_1 per distinct CC and key
+	for(i = 0 ; i < b->count ; i++)
+	{
+		service_msg *m = &b->req[i].msg;
+		if(m->op != SERVICE_OP_TAG_MAC || done[i]) continue;
+		uint8_t cc[8], key[8];
+		memcpy(cc, m->data, 8);
+		memcpy(key, m->data + 12, 8);
+		State state = opt_doTagMAC_1(cc, key);
+		for(j = i ; j < b->count ; j++)
+		{
+			service_msg *o = &b->req[j].msg;
+			if(o->op != SERVICE_OP_TAG_MAC || done[j] ||
+			   memcmp(o->data, cc, 8) != 0 || memcmp(o->data + 12, key, 8) != 0) continue;
+			opt_doTagMAC_2(state, o->data + 8, mac, key);
+			memset(o->data, 0, sizeof(o->data));
+			memcpy(o->data, mac, 4);
+			done[j] = true;
+		}
+	}
+}
+
+static void serviceProcess(service_batch *b)
+{
+	int i;
+	serviceDiversify(b);
+	serviceTagMACs(b);
+	for(i = 0 ; i < b->count ; i++)
+	{
+		service_msg *m = &b->req[i].msg;
+		if(m->op == SERVICE_OP_READER_MAC)
+		{
+			uint8_t mac[4];
+			opt_doReaderMAC(m->data, m->data + 12, mac);
+			memset(m->data, 0, sizeof(m->data));
+			memcpy(m->data, mac, 4);
+		}else if(m->op < SERVICE_OP_DIVERSIFY || m->op > SERVICE_OP_TAG_MAC)
+		{
+			m->status = SERVICE_BAD_OP;
+			memset(m->data, 0, sizeof(m->data));
+		}
+	}
+}
+
+static void* serviceWorker(void *arg)
+{
+	service *s = (service*) arg;
+	for(;;)
+	{
+		pthread_mutex_lock(&s->lock);
+		while(!s->todo && !s->stopping)
+			pthread_cond_wait(&s->cond, &s->lock);
+		service_batch *b = s->todo;
+		if(!b)
+		{
+			pthread_mutex_unlock(&s->lock);
+			return NULL;
+		}
+		s->todo = b->next;
+		pthread_mutex_unlock(&s->lock);
+
+		serviceProcess(b);
+
+		pthread_mutex_lock(&s->lock);
+		b->next = s->done;
+		s->done = b;
+		pthread_mutex_unlock(&s->lock);
+		if(write(s->wake[1], "", 1) < 0)
+		{
+			// The pipe is full, so the I/O thread is going to wake up anyway
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+// I/O thread
+// ----------------------------------------------------------------------------
+
+static void serviceSubmit(service *s, service_batch *b)
+{
+	b->next = NULL;
+	pthread_mutex_lock(&s->lock);
+	if(s->todo)
+		s->todo_tail->next = b;
+	else
+		s->todo = b;
+	s->todo_tail = b;
+	s->batches++;
+	pthread_cond_signal(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+}
+
+static void serviceClose(service *s, service_conn *c)
+{
+	(void) s;
+	close(c->fd);
+	c->fd = -1;
+	c->gen++;
+	c->inlen = 0;
+	c->outlen = 0;
+	c->pending = 0;
+}
+
+// Responses a connection has coming, queued or still at the workers
+static int serviceBacklog(const service_conn *c)
+{
+	return c->outlen / SERVICE_MSG_SIZE + c->pending;
+}
+
+static void serviceFlush(service *s, service_conn *c)
+{
+	size_t sent = 0;
+	while(sent < c->outlen)
+	{
+		ssize_t n = send(c->fd, c->out + sent, c->outlen - sent, MSG_NOSIGNAL);
+		if(n > 0)
+			sent += n;
+		else if(n < 0 && errno == EINTR)
+			continue;
+		else if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		else
+		{
+			serviceClose(s, c);
+			return;
+		}
+	}
+	memmove(c->out, c->out + sent, c->outlen - sent);
+	c->outlen -= sent;
+}
+
+static void serviceRespond(service *s, service_conn *c, const service_msg *msg)
+{
+	if(c->outlen + SERVICE_MSG_SIZE > c->outcap)
+	{
+		size_t cap = c->outcap ? 2 * c->outcap : 64 * SERVICE_MSG_SIZE;
+		uint8_t *out = realloc(c->out, cap);
+		if(!out)
+		{
+			serviceClose(s, c);
+			return;
+		}
+		c->out = out;
+		c->outcap = cap;
+	}
+	memcpy(c->out + c->outlen, msg, SERVICE_MSG_SIZE);
+	c->outlen += SERVICE_MSG_SIZE;
+}
+
+static void serviceStats(service *s, service_msg *msg)
+{
+	service_stats stats;
+	service_stats_msg m;
+	serviceGetStats(s, &stats);
+	m.requests = stats.requests;
+	m.batches = stats.batches;
+	m.connections = stats.connections;
+	m.p50_ns = stats.p50_ns > UINT32_MAX ? UINT32_MAX : stats.p50_ns;
+	m.p99_ns = stats.p99_ns > UINT32_MAX ? UINT32_MAX : stats.p99_ns;
+	memset(msg->data, 0, sizeof(msg->data));
+	memcpy(msg->data, &m, sizeof(m));
+	msg->status = SERVICE_OK;
+}
+
+/*
+ * Reads what is there from a connection, adding requests to *batch (which is
+ * submitted and replaced when full)
+ */
+static void serviceRead(service *s, int slot, service_batch **batch)
+{
+	service_conn *c = &s->conns[slot];
+	uint8_t buf[SERVICE_MSG_SIZE * 64];
+	for(;;)
+	{
+		// A client that does not read its responses is not read from either
+		if(serviceBacklog(c) >= SERVICE_MAX_BACKLOG)
+			return;
+		ssize_t n = read(c->fd, buf, sizeof(buf));
+		if(n == 0 || (n < 0 && errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK))
+		{
+			serviceClose(s, c);
+			return;
+		}
+		if(n < 0)
+		{
+			if(errno == EINTR) continue;
+			return;
+		}
+		uint64_t now = serviceNow();
+		ssize_t i = 0;
+		while(i < n)
+		{
+			int take = SERVICE_MSG_SIZE - c->inlen;
+			if(take > n - i) take = n - i;
+			memcpy(c->in + c->inlen, buf + i, take);
+			c->inlen += take;
+			i += take;
+			if(c->inlen < SERVICE_MSG_SIZE) break;
+			c->inlen = 0;
+
+			service_msg msg;
+			memcpy(&msg, c->in, SERVICE_MSG_SIZE);
+			if(msg.op == SERVICE_OP_STATS)
+			{
+				serviceStats(s, &msg);
+				serviceRespond(s, c, &msg);
+				continue;
+			}
+			if(*batch == NULL)
+			{
+				if((*batch = malloc(sizeof(service_batch))) == NULL)
+				{
+					serviceClose(s, c);
+					return;
+				}
+				(*batch)->count = 0;
+			}
+			service_request *r = &(*batch)->req[(*batch)->count++];
+			r->msg = msg;
+			r->msg.status = SERVICE_OK;
+			r->conn = slot;
+			r->gen = c->gen;
+			r->arrived = now;
+			c->pending++;
+			if((*batch)->count == SERVICE_MAX_BATCH)
+			{
+				serviceSubmit(s, *batch);
+				*batch = NULL;
+			}
+		}
+	}
+}
+
+static void serviceCollect(service *s)
+{
+	service_batch *done, *next;
+	uint64_t now = serviceNow();
+	int i;
+
+	pthread_mutex_lock(&s->lock);
+	done = s->done;
+	s->done = NULL;
+	for(next = done ; next ; next = next->next)
+		for(i = 0 ; i < next->count ; i++)
+		{
+			uint64_t ns = now - next->req[i].arrived;
+			int b = ns ? 63 - __builtin_clzll(ns) : 0;
+			s->latency[b < SERVICE_BUCKETS ? b : SERVICE_BUCKETS - 1]++;
+			if(ns > s->max_ns) s->max_ns = ns;
+			s->requests++;
+		}
+	pthread_mutex_unlock(&s->lock);
+
+	for( ; done ; done = next)
+	{
+		next = done->next;
+		for(i = 0 ; i < done->count ; i++)
+		{
+			service_request *r = &done->req[i];
+			service_conn *c = &s->conns[r->conn];
+			if(c->fd >= 0 && c->gen == r->gen)
+			{
+				c->pending--;
+				serviceRespond(s, c, &r->msg);
+			}
+		}
+		free(done);
+	}
+}
+
+static void* serviceIO(void *arg)
+{
+	service *s = (service*) arg;
+	struct pollfd fds[2 + SERVICE_MAX_CONNS];
+	int slots[2 + SERVICE_MAX_CONNS];
+	int i, nfds;
+
+	for(;;)
+	{
+		fds[0].fd = s->wake[0];
+		fds[0].events = POLLIN;
+		fds[1].fd = s->listen_fd;
+		fds[1].events = POLLIN;
+		nfds = 2;
+		for(i = 0 ; i < SERVICE_MAX_CONNS ; i++)
+		{
+			if(s->conns[i].fd < 0) continue;
+			fds[nfds].fd = s->conns[i].fd;
+			fds[nfds].events = (serviceBacklog(&s->conns[i]) < SERVICE_MAX_BACKLOG ? POLLIN : 0) |
+							   (s->conns[i].outlen ? POLLOUT : 0);
+			slots[nfds++] = i;
+		}
+		if(poll(fds, nfds, -1) < 0)
+		{
+			if(errno == EINTR) continue;
+			break;
+		}
+
+		if(fds[0].revents)
+		{
+			char drain[256];
+			while(read(s->wake[0], drain, sizeof(drain)) > 0)
+				;
+			pthread_mutex_lock(&s->lock);
+			bool stopping = s->stopping;
+			pthread_mutex_unlock(&s->lock);
+			if(stopping) break;
+			serviceCollect(s);
+		}
+		if(fds[1].revents & POLLIN)
+		{
+			int fd;
+			while((fd = accept(s->listen_fd, NULL, NULL)) >= 0)
+			{
+				for(i = 0 ; i < SERVICE_MAX_CONNS && s->conns[i].fd >= 0 ; i++)
+					;
+				if(i == SERVICE_MAX_CONNS)
+				{
+					close(fd);
+					continue;
+				}
+				fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+				s->conns[i].fd = fd;
+				pthread_mutex_lock(&s->lock);
+				s->connections++;
+				pthread_mutex_unlock(&s->lock);
+			}
+		}
+
+		// Everything read in this round goes out as one batch
+		service_batch *batch = NULL;
+		for(i = 2 ; i < nfds ; i++)
+			if(fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+			{
+				service_conn *c = &s->conns[slots[i]];
+				if(c->fd != fds[i].fd)
+					continue;
+				// Hung up while held back: nobody is left to take the responses
+				if(!(fds[i].revents & POLLIN) && serviceBacklog(c) >= SERVICE_MAX_BACKLOG)
+					serviceClose(s, c);
+				else
+					serviceRead(s, slots[i], &batch);
+			}
+		if(batch)
+			serviceSubmit(s, batch);
+
+		for(i = 0 ; i < SERVICE_MAX_CONNS ; i++)
+			if(s->conns[i].fd >= 0 && s->conns[i].outlen)
+				serviceFlush(s, &s->conns[i]);
+	}
+	return NULL;
+}
+
+// ----------------------------------------------------------------------------
+// Setup
+// ----------------------------------------------------------------------------
+
+/*
+ * Tears down a service that has no I/O thread (any more): stops and joins the first
+ * nworkers workers, then frees everything
+ */
+static void serviceFree(service *s, int nworkers)
+{
+	int i;
+	pthread_mutex_lock(&s->lock);
+	s->stopping = true;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	for(i = 0 ; i < nworkers ; i++)
+		pthread_join(s->workers[i], NULL);
+
+	// Batches nobody is going to answer any more
+	while(s->todo)
+	{
+		service_batch *b = s->todo;
+		s->todo = b->next;
+		free(b);
+	}
+	while(s->done)
+	{
+		service_batch *b = s->done;
+		s->done = b->next;
+		free(b);
+	}
+	for(i = 0 ; i < SERVICE_MAX_CONNS ; i++)
+	{
+		if(s->conns[i].fd >= 0)
+			close(s->conns[i].fd);
+		free(s->conns[i].out);
+	}
+	if(s->listen_fd >= 0) close(s->listen_fd);
+	if(s->wake[0] >= 0) close(s->wake[0]);
+	if(s->wake[1] >= 0) close(s->wake[1]);
+	unlink(s->config.path);
+	pthread_mutex_destroy(&s->lock);
+	pthread_cond_destroy(&s->cond);
+	free(s->workers);
+	free(s);
+}
+
+service* serviceStart(const service_config *config)
+{
+	struct sockaddr_un addr;
+	int i;
+
+	if(strlen(config->path) >= sizeof(addr.sun_path))
+	{
+		logmsg(LOG_LEVEL_ERROR, "Socket path too long: %s", config->path);
+		return NULL;
+	}
+	service *s = calloc(1, sizeof(service));
+	if(!s) return NULL;
+	s->config = *config;
+	s->nworkers = config->workers ? config->workers : numberOfCores();
+	s->listen_fd = -1;
+	s->wake[0] = s->wake[1] = -1;
+	for(i = 0 ; i < SERVICE_MAX_CONNS ; i++)
+		s->conns[i].fd = -1;
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->cond, NULL);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, config->path);
+	unlink(config->path);
+	s->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(s->listen_fd < 0 || bind(s->listen_fd, (struct sockaddr*) &addr, sizeof(addr)) ||
+	   listen(s->listen_fd, SERVICE_MAX_CONNS) || pipe(s->wake))
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to listen on %s: %s", config->path, strerror(errno));
+		serviceFree(s, 0);
+		return NULL;
+	}
+	fcntl(s->listen_fd, F_SETFL, fcntl(s->listen_fd, F_GETFL) | O_NONBLOCK);
+	fcntl(s->wake[0], F_SETFL, fcntl(s->wake[0], F_GETFL) | O_NONBLOCK);
+	fcntl(s->wake[1], F_SETFL, fcntl(s->wake[1], F_GETFL) | O_NONBLOCK);
+
+	s->workers = calloc(s->nworkers, sizeof(pthread_t));
+	if(!s->workers)
+	{
+		serviceFree(s, 0);
+		return NULL;
+	}
+	s->started = serviceNow();
+	for(i = 0 ; i < s->nworkers ; i++)
+	{
+		int err = pthread_create(&s->workers[i], NULL, serviceWorker, s);
+		if(err)
+		{
+			logmsg(LOG_LEVEL_ERROR, "Failed to start service workers: %s", strerror(err));
+			serviceFree(s, i);
+			return NULL;
+		}
+#ifdef __linux__
+		if(config->pin)
+		{
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(i % numberOfCores(), &set);
+			pthread_setaffinity_np(s->workers[i], sizeof(set), &set);
+		}
+#endif
+	}
+	if(pthread_create(&s->io, NULL, serviceIO, s))
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to start the service I/O thread");
+		serviceFree(s, s->nworkers);
+		return NULL;
+	}
+	return s;
+}
+
+void serviceGetStats(service *s, service_stats *stats)
+{
+	pthread_mutex_lock(&s->lock);
+	stats->requests = s->requests;
+	stats->batches = s->batches;
+	stats->connections = s->connections;
+	stats->seconds = (serviceNow() - s->started) / 1e9;
+	stats->p50_ns = servicePercentile(s->latency, s->requests, s->max_ns, 0.50);
+	stats->p99_ns = servicePercentile(s->latency, s->requests, s->max_ns, 0.99);
+	stats->max_ns = s->max_ns;
+	pthread_mutex_unlock(&s->lock);
+}
+
+void serviceStop(service *s)
+{
+	pthread_mutex_lock(&s->lock);
+	s->stopping = true;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	if(write(s->wake[1], "", 1) < 0)
+	{
+		// Full, the I/O thread wakes up anyway
+	}
+	pthread_join(s->io, NULL);
+	serviceFree(s, s->nworkers);
+}
+
+int serviceRun(const service_config *config)
+{
+	sigset_t set;
+	int sig;
+	service_stats st;
+
+	// Block the signals before any thread starts, so they all inherit it and only sigwait sees them
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	service *s = serviceStart(config);
+	if(!s) return 1;
+	prnlog("[+] Listening on %s with %d workers%s", config->path, s->nworkers,
+		   config->pin ? ", pinned" : "");
+	sigwait(&set, &sig);
+
+	serviceGetStats(s, &st);
+	serviceStop(s);
+	prnlog("[+] Stopped. %llu requests in %llu batches (%.1f per batch) from %llu connections",
+		   (unsigned long long) st.requests, (unsigned long long) st.batches,
+		   st.batches ? (double) st.requests / st.batches : 0.0, (unsigned long long) st.connections);
+	prnlog("Requests/s      : %.0f", st.seconds > 0 ? st.requests / st.seconds : 0.0);
+	prnlog("Latency (us)    : p50 %.1f  p99 %.1f  max %.1f", st.p50_ns / 1000.0, st.p99_ns / 1000.0,
+		   st.max_ns / 1000.0);
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Client
+// ----------------------------------------------------------------------------
+
+int serviceConnect(const char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if(strlen(path) >= sizeof(addr.sun_path))
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0) return -1;
+	if(connect(fd, (struct sockaddr*) &addr, sizeof(addr)))
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int serviceWriteAll(int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	while(len > 0)
+	{
+		ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) return 1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int serviceReadAll(int fd, void *buf, size_t len)
+{
+	uint8_t *p = buf;
+	while(len > 0)
+	{
+		ssize_t n = read(fd, p, len);
+		if(n < 0 && errno == EINTR) continue;
+		if(n <= 0) return 1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+int serviceCall(int fd, service_msg *msg)
+{
+	if(serviceWriteAll(fd, msg, SERVICE_MSG_SIZE))
+		return 1;
+	return serviceReadAll(fd, msg, SERVICE_MSG_SIZE);
+}
+
+// ----------------------------------------------------------------------------
+// TEST CODE BELOW
+// ----------------------------------------------------------------------------
+
+#define SERVICE_TEST_REQUESTS 300
+#define SERVICE_TEST_FLOOD 100000
+
+typedef struct {
+	const char *path;
+	int client;
+	int errors;
+} service_test_client;
+
+// What the daemon should answer to request n of a client
+static void serviceTestRequest(int client, int n, service_msg *req, uint8_t expected[8])
+{
+	uint8_t csn[8], key[8], cc_nr[12];
+	int i;
+
+	memset(req, 0, sizeof(*req));
+	req->op = SERVICE_OP_DIVERSIFY + n % 3;
+	req->id = client * 100000 + n;
+	// Few keys and CCs, so that batches have something to share
+	for(i = 0 ; i < 8 ; i++)
+	{
+		csn[i] = n * 7 + i;
+		key[i] = (n % 4) * 0x11 + i;
+	}
+	for(i = 0 ; i < 12 ; i++)
+		cc_nr[i] = i < 8 ? (n % 2) + i : n * 13 + client + i;
+
+	switch(req->op)
+	{
+	case SERVICE_OP_DIVERSIFY:
+		memcpy(req->data, csn, 8);
+		memcpy(req->data + 8, key, 8);
+		diversifyKey(csn, key, expected);
+		break;
+	case SERVICE_OP_READER_MAC:
+		memcpy(req->data, cc_nr, 12);
+		memcpy(req->data + 12, key, 8);
+		opt_doReaderMAC(cc_nr, key, expected);
+		break;
+	default:
+		memcpy(req->data, cc_nr, 12);
+		memcpy(req->data + 12, key, 8);
+		opt_doTagMAC(cc_nr, key, expected);
+		break;
+	}
+}
+
+static void* serviceTestClient(void *arg)
+{
+	service_test_client *t = (service_test_client*) arg;
+	service_msg req[SERVICE_TEST_REQUESTS], resp;
+	uint8_t expected[SERVICE_TEST_REQUESTS][8];
+	bool seen[SERVICE_TEST_REQUESTS] = {false};
+	int fd = serviceConnect(t->path);
+	int n;
+
+	if(fd < 0)
+	{
+		t->errors++;
+		return NULL;
+	}
+	// All requests at once, then collect the responses in whatever order they come
+	for(n = 0 ; n < SERVICE_TEST_REQUESTS ; n++)
+		serviceTestRequest(t->client, n, &req[n], expected[n]);
+	if(serviceWriteAll(fd, req, sizeof(req)))
+		t->errors++;
+	for(n = 0 ; n < SERVICE_TEST_REQUESTS && !t->errors ; n++)
+	{
+		if(serviceReadAll(fd, &resp, sizeof(resp)))
+		{
+			t->errors++;
+			break;
+		}
+		int i = resp.id - t->client * 100000;
+		int len = resp.op == SERVICE_OP_DIVERSIFY ? 8 : 4;
+		if(i < 0 || i >= SERVICE_TEST_REQUESTS || seen[i] || resp.status != SERVICE_OK ||
+		   resp.op != req[i].op || memcmp(resp.data, expected[i], len) != 0)
+		{
+			logmsg(LOG_LEVEL_ERROR, "[+] FAILED: client %d, bad response for id %u", t->client, resp.id);
+			t->errors++;
+			break;
+		}
+		seen[i] = true;
+	}
+	close(fd);
+	return NULL;
+}
+
+int testService()
+{
+	int errors = 0;
+	char path[64];
+	service_config config = {path, 2, false};
+	service_test_client clients[3];
+	pthread_t threads[3];
+	service_stats stats;
+	service_msg msg;
+	int i, fd;
+
+	prnlog("[+] Testing MAC service...");
+	snprintf(path, sizeof(path), "/tmp/loclass-test-%d.sock", (int) getpid());
+	service *s = serviceStart(&config);
+	if(!s)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: could not start the service");
+		return 1;
+	}
+
+	for(i = 0 ; i < 3 ; i++)
+	{
+		clients[i].path = path;
+		clients[i].client = i;
+		clients[i].errors = 0;
+		pthread_create(&threads[i], NULL, serviceTestClient, &clients[i]);
+	}
+	for(i = 0 ; i < 3 ; i++)
+	{
+		pthread_join(threads[i], NULL);
+		errors += clients[i].errors;
+	}
+
+	// A single request, an unknown op, and the counters
+	fd = serviceConnect(path);
+	memset(&msg, 0, sizeof(msg));
+	msg.op = 99;
+	msg.id = 7;
+	if(fd < 0 || serviceCall(fd, &msg) || msg.status != SERVICE_BAD_OP || msg.id != 7)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: unknown op not rejected");
+		errors++;
+	}
+	memset(&msg, 0, sizeof(msg));
+	msg.op = SERVICE_OP_STATS;
+	service_stats_msg sm;
+	if(fd < 0 || serviceCall(fd, &msg) || msg.status != SERVICE_OK)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: stats request");
+		errors++;
+	}
+	memcpy(&sm, msg.data, sizeof(sm));
+	if(sm.requests != 3 * SERVICE_TEST_REQUESTS + 1 || sm.connections != 4 || sm.batches == 0)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: counters: %u requests, %u batches, %u connections", sm.requests,
+			   sm.batches, sm.connections);
+		errors++;
+	}
+	if(fd >= 0) close(fd);
+
+	// A client that only writes gets held back, and still gets every answer once it reads
+	fd = serviceConnect(path);
+	if(fd >= 0)
+	{
+		int sent = 0, idle = 0, got = 0;
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		memset(&msg, 0, sizeof(msg));
+		msg.op = 99;
+		while(sent < SERVICE_TEST_FLOOD && idle < 20)
+		{
+			msg.id = sent;
+			ssize_t n = send(fd, &msg, SERVICE_MSG_SIZE, MSG_NOSIGNAL);
+			if(n == SERVICE_MSG_SIZE)
+			{
+				sent++;
+				idle = 0;
+			}else if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			{
+				idle++;
+				usleep(10000);
+			}else
+				break;
+		}
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+		for(got = 0 ; got < sent ; got++)
+			if(serviceReadAll(fd, &msg, sizeof(msg)) || msg.status != SERVICE_BAD_OP)
+				break;
+		if(sent == SERVICE_TEST_FLOOD || got != sent)
+		{
+			logmsg(LOG_LEVEL_ERROR, "[+] FAILED: backpressure, %d requests sent, %d answered", sent, got);
+			errors++;
+		}
+		close(fd);
+	}else
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: could not connect");
+		errors++;
+	}
+
+	serviceGetStats(s, &stats);
+	prnlog("[+] %llu requests in %llu batches", (unsigned long long) stats.requests,
+		   (unsigned long long) stats.batches);
+	serviceStop(s);
+	if(access(path, F_OK) == 0)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: socket left behind");
+		errors++;
+	}
+
+	if(errors == 0)
+		prnlog("[+] MAC service ok");
+	return errors;
+}
@@ -0,0 +1,153 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#ifndef SERVICE_H
+#define SERVICE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * A local daemon for diversifyKey, reader MAC and tag MAC, so that tools don't each
+ * have to link the library. Clients talk to it over a UNIX stream socket with fixed
+ * size messages (service_msg, in host byte order). A client may send many requests
+ * without waiting; every response carries the id of its request, and responses to
+ * one connection may come back in any order.
+ *
+ * One thread does all socket I/O. Whatever requests it reads in one round, from all
+ * connections, go to the workers as one batch (at most SERVICE_MAX_BATCH). Under load
+ * batches fill up by themselves, and a single request on an idle daemon is sent off
+ * as soon as it is read, so coalescing never waits for more requests.
+ * In a batch, requests for the same key share one DES key schedule, and tag MACs with
+ * the same key and CC share the state after the CC (opt_doTagMAC_1).
+ * A connection with SERVICE_MAX_BACKLOG responses outstanding, queued for sending or
+ * still being worked on, is not read from until its client has taken some of them.
+ */
+#define SERVICE_MSG_SIZE 28
+#define SERVICE_MAX_BATCH 256
+#define SERVICE_MAX_CONNS 64
+#define SERVICE_MAX_BACKLOG (4 * SERVICE_MAX_BATCH)
+
+enum {
+	SERVICE_OP_DIVERSIFY = 1,	// data: csn[8] key[8] -> div_key[8]
+	SERVICE_OP_READER_MAC,		// data: cc_nr[12] div_key[8] -> mac[4]
+	SERVICE_OP_TAG_MAC,			// data: cc_nr[12] div_key[8] -> mac[4]
+	SERVICE_OP_STATS,			// -> service_stats_msg
+};
+
+enum {
+	SERVICE_OK = 0,
+	SERVICE_BAD_OP,
+};
+
+typedef struct {
+	uint8_t op;
+	uint8_t status;				// response: SERVICE_OK or SERVICE_BAD_OP
+	uint8_t reserved[2];
+	uint32_t id;				// chosen by the client, echoed in the response
+	uint8_t data[20];
+} service_msg;
+
+/**
+ * The data of a SERVICE_OP_STATS response
+ */
+typedef struct {
+	uint32_t requests;			// counters wrap around at 2^32
+	uint32_t batches;
+	uint32_t connections;
+	uint32_t p50_ns;			// request latency in the daemon, read to response queued,
+	uint32_t p99_ns;			// as the upper end of a log2 bucket
+} service_stats_msg;
+
+typedef struct {
+	const char *path;			// socket path, replaced if it exists
+	int workers;				// 0 = one per core
+	bool pin;					// pin worker i to core i (Linux)
+} service_config;
+
+typedef struct {
+	uint64_t requests;
+	uint64_t batches;
+	uint64_t connections;
+	double seconds;
+	uint64_t p50_ns, p99_ns, max_ns;
+} service_stats;
+
+typedef struct service service;
+
+/**
+ * @brief Binds the socket and starts the I/O thread and the workers
+ * @return the service, or NULL on failure
+ */
+service* serviceStart(const service_config *config);
+/**
+ * @brief The counters so far
+ */
+void serviceGetStats(service *s, service_stats *stats);
+/**
+ * @brief Stops the threads, closes all connections, removes the socket and frees the service
+ */
+void serviceStop(service *s);
+/**
+ * @brief Runs the daemon until SIGINT or SIGTERM, then prints the counters
+ * @return 0 for ok, 1 for failz
+ */
+int serviceRun(const service_config *config);
+
+/**
+ * @brief Connects to a daemon
+ * @return the socket, or -1
+ */
+int serviceConnect(const char *path);
+/**
+ * @brief Sends one request and waits for its response, which replaces msg.
+ * Only for connections without other requests in flight.
+ * @return 0 for ok, 1 for failz
+ */
+int serviceCall(int fd, service_msg *msg);
+
+int testService();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SERVICE_H
@@ -0,0 +1,414 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include "cipher.h"
+#include "cipherutils.h"
+#include "optimized_cipher.h"
+#include "ikeys.h"
+#include "des.h"
+#include "elite_crack.h"
+#include "fileutils.h"
+#include "threadpool.h"
+#include "tag_engine.h"
+#include "sim.h"
+
+static const char *sim_stage_names[SIM_STAGES] = {"reader key", "reader MAC", "card", "verify", "total"};
+
+typedef struct {
+	uint8_t csn[8];
+	uint8_t cc[8];				// e-purse
+	tag_card tag;				// div key and cached post-CC states
+} sim_card;
+
+typedef struct {
+	const sim_config *config;
+	const uint8_t *keytable;	// elite: hash2 of K_cus
+	des_context master;			// standard: master key, set up once
+	uint64_t rnd;
+} sim_reader;
+
+typedef struct {
+	sim_reader reader;
+	sim_card *cards;
+	int ncards;
+	uint64_t auths;
+	double rate;				// of this reader, 0 = unlimited
+	uint64_t failed;
+	sim_histogram stage[SIM_STAGES];
+} sim_task;
+
+static uint64_t simNow()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static void simRecord(sim_histogram *h, uint64_t ns)
+{
+	int b = ns ? 63 - __builtin_clzll(ns) : 0;
+	h->buckets[b < SIM_BUCKETS ? b : SIM_BUCKETS - 1]++;
+	h->count++;
+	h->sum_ns += ns;
+	if(ns > h->max_ns) h->max_ns = ns;
+}
+
+static void simMerge(sim_histogram *to, const sim_histogram *from)
+{
+	int i;
+	to->count += from->count;
+	to->sum_ns += from->sum_ns;
+	if(from->max_ns > to->max_ns) to->max_ns = from->max_ns;
+	for(i = 0 ; i < SIM_BUCKETS ; i++)
+		to->buckets[i] += from->buckets[i];
+}
+
+uint64_t simPercentile(const sim_histogram *h, double p)
+{
+	double rank = p * h->count;
+	uint64_t seen = 0;
+	int i;
+	if(h->count == 0) return 0;
+	for(i = 0 ; i < SIM_BUCKETS ; i++)
+	{
+		uint64_t n = h->buckets[i];
+		if(n == 0 || seen + n < rank)
+		{
+			seen += n;
+			continue;
+		}
+		// Spread the samples of the bucket evenly over it. The last bucket takes
+		// everything above, and nothing lies beyond the largest sample.
+		double lo = i ? (double) (1ULL << i) : 0;
+		double hi = i < SIM_BUCKETS - 1 ? (double) (2ULL << i) : (double) h->max_ns;
+		double v = lo + (hi - lo) * (rank - seen) / n;
+		return v < h->max_ns ? (uint64_t) v : h->max_ns;
+	}
+	return h->max_ns;
+}
+
+/*
+ * The key a reader uses for a CSN: the master key diversified, or for elite the
+ * keytable bytes picked by hash1 of the CSN
+ */
+static void simDivKey(const sim_config *config, const uint8_t *keytable, des_context *master,
+					  const uint8_t csn[8], uint8_t div_key[8])
+{
+	uint8_t c[8];
+	memcpy(c, csn, 8);
+	if(config->elite)
+	{
+		diversifyKeyElite(keytable, c, div_key);
+	}else
+	{
+		diversifyKeyWithContext(master, c, div_key);
+	}
+}
+
+static void simReaderInit(sim_reader *reader, const sim_config *config, const uint8_t *keytable, uint64_t seed)
+{
+	uint8_t key[8];
+	memset(reader, 0, sizeof(sim_reader));
+	reader->config = config;
+	reader->keytable = keytable;
+	reader->rnd = seed;
+	memcpy(key, config->key, 8);
+	reader->master.mode = DES_ENCRYPT;
+	des_setkey_enc(&reader->master, key);
+}
+
+/*
+ * One authentication of a card by a reader. The card has already answered SELECT
+ * and READCHECK, so the reader knows the CSN and CC.
+ * Returns 0 for ok, 1 if a MAC did not verify
+ */
+static int simAuthenticate(sim_reader *reader, sim_card *card, sim_histogram stage[SIM_STAGES])
+{
+	uint8_t div_key[8], cc_nr[12], reader_mac[4], card_mac[4], tag_mac[4], expected[4];
+	uint64_t r, t0, t1, t2, t3, t4;
+	int failed = 0;
+
+	t0 = simNow();
+	simDivKey(reader->config, reader->keytable, &reader->master, card->csn, div_key);
+	t1 = simNow();
+
+	r = splitmix64(&reader->rnd);
+	memcpy(cc_nr, card->cc, 8);
+	memcpy(cc_nr + 8, &r, 4);
+	opt_doReaderMAC(cc_nr, div_key, reader_mac);
+	t2 = simNow();
+
+	// CHECK: the card only answers if the reader MAC is right
+	opt_doReaderMAC(cc_nr, card->tag.div_key, card_mac);
+	if(memcmp(card_mac, reader_mac, 4) != 0)
+		failed = 1;
+	else
+		tagRespond(&card->tag, card->cc, cc_nr + 8, tag_mac);
+	t3 = simNow();
+
+	if(!failed)
+	{
+		opt_doTagMAC(cc_nr, div_key, expected);
+		failed = memcmp(expected, tag_mac, 4) != 0;
+	}
+	t4 = simNow();
+
+	simRecord(&stage[SIM_STAGE_KEY], t1 - t0);
+	simRecord(&stage[SIM_STAGE_READER_MAC], t2 - t1);
+	simRecord(&stage[SIM_STAGE_CARD], t3 - t2);
+	simRecord(&stage[SIM_STAGE_VERIFY], t4 - t3);
+	simRecord(&stage[SIM_STAGE_TOTAL], t4 - t0);
+	return failed;
+}
+
+static void simWorker(void *arg)
+{
+	sim_task *task = (sim_task*) arg;
+	uint64_t start = simNow();
+	uint64_t n;
+
+	for(n = 0 ; n < task->auths ; n++)
+	{
+		if(task->rate > 0)
+		{
+			// Open loop: authentication n starts at n / rate, late ones are not skipped
+			uint64_t due = start + (uint64_t) (n * 1e9 / task->rate);
+			uint64_t now = simNow();
+			if(now < due)
+			{
+				struct timespec ts = {(due - now) / 1000000000ULL, (due - now) % 1000000000ULL};
+				nanosleep(&ts, NULL);
+			}
+		}
+		sim_card *card = &task->cards[splitmix64(&task->reader.rnd) % task->ncards];
+		task->failed += simAuthenticate(&task->reader, card, task->stage);
+	}
+}
+
+static void simPrint(const sim_result *r)
+{
+	const sim_histogram *total = &r->stage[SIM_STAGE_TOTAL];
+	uint64_t most = 0;
+	int i;
+
+	prnlog("Authentications/s : %.0f", r->seconds > 0 ? r->auths / r->seconds : 0.0);
+	prnlog("Failed            : %llu", (unsigned long long) r->failed);
+	prnlog("Stage          mean us    p50 us    p99 us    max us");
+	for(i = 0 ; i < SIM_STAGES ; i++)
+	{
+		const sim_histogram *h = &r->stage[i];
+		prnlog("%-12s %9.2f %9.2f %9.2f %9.2f", sim_stage_names[i],
+			   h->count ? h->sum_ns / 1000.0 / h->count : 0.0,
+			   simPercentile(h, 0.50) / 1000.0, simPercentile(h, 0.99) / 1000.0, h->max_ns / 1000.0);
+	}
+	for(i = 0 ; i < SIM_BUCKETS ; i++)
+		if(total->buckets[i] > most) most = total->buckets[i];
+	prnlog("Authentication latency:");
+	for(i = 0 ; i < SIM_BUCKETS ; i++)
+	{
+		char bar[41];
+		int len;
+		if(total->buckets[i] == 0) continue;
+		len = 40 * total->buckets[i] / most;
+		memset(bar, '#', len);
+		bar[len] = 0;
+		prnlog("%9.3f - %9.3f us %10llu %s", (1ULL << i) / 1000.0, (2ULL << i) / 1000.0,
+			   (unsigned long long) total->buckets[i], bar);
+	}
+}
+
+int simRun(const sim_config *config, sim_result *result)
+{
+	int threads = config->threads ? config->threads : numberOfCores();
+	uint8_t keytable[128], key[8];
+	uint64_t rnd = config->seed;
+	uint64_t start;
+	sim_result r;
+	int i, j;
+
+	if(config->cards < 1)
+	{
+		prnlog("Simulation needs at least one card");
+		return 1;
+	}
+	if(threads > config->cards)
+		threads = config->cards;
+
+	sim_card *cards = malloc(config->cards * sizeof(sim_card));
+	sim_task *tasks = calloc(threads, sizeof(sim_task));
+	threadpool *pool = threadpool_create(threads);
+	if(!cards || !tasks || !pool)
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to set up the simulation");
+		free(cards); free(tasks);
+		if(pool) threadpool_destroy(pool);
+		return 1;
+	}
+
+	memcpy(key, config->key, 8);
+	if(config->elite)
+		hash2(key, keytable);
+
+	// The cards are personalized with the same key derivation the readers use
+	sim_reader issuer;
+	simReaderInit(&issuer, config, keytable, 0);
+	for(i = 0 ; i < config->cards ; i++)
+	{
+		uint64_t c = splitmix64(&rnd), e = splitmix64(&rnd);
+		uint8_t div_key[8];
+		memcpy(cards[i].csn, &c, 8);
+		cards[i].csn[6] = 0x12;
+		cards[i].csn[7] = 0xE0;
+		memcpy(cards[i].cc, &e, 8);
+		simDivKey(config, keytable, &issuer.master, cards[i].csn, div_key);
+		tagCardInit(&cards[i].tag, div_key);
+	}
+
+	prnlog("[+] Simulating %llu %s authentications: %d cards, %d readers, %s",
+		   (unsigned long long) config->auths, config->elite ? "elite" : "standard",
+		   config->cards, threads, config->rate > 0 ? "rate limited" : "unlimited rate");
+	start = simNow();
+	for(i = 0 ; i < threads ; i++)
+	{
+		sim_task *task = &tasks[i];
+		simReaderInit(&task->reader, config, keytable, splitmix64(&rnd));
+		// Each reader gets its own cards
+		task->cards = cards + config->cards * i / threads;
+		task->ncards = config->cards * (i + 1) / threads - config->cards * i / threads;
+		task->auths = config->auths * (i + 1) / threads - config->auths * i / threads;
+		task->rate = config->rate / threads;
+		threadpool_submit(pool, simWorker, task);
+	}
+	threadpool_wait(pool);
+	threadpool_destroy(pool);
+
+	memset(&r, 0, sizeof(r));
+	r.seconds = (simNow() - start) / 1e9;
+	for(i = 0 ; i < threads ; i++)
+	{
+		r.auths += tasks[i].auths;
+		r.failed += tasks[i].failed;
+		for(j = 0 ; j < SIM_STAGES ; j++)
+			simMerge(&r.stage[j], &tasks[i].stage[j]);
+	}
+	for(i = 0 ; i < config->cards ; i++)
+		tagCardDestroy(&cards[i].tag);
+	free(cards);
+	free(tasks);
+
+	simPrint(&r);
+	if(result) *result = r;
+	return r.failed ? 1 : 0;
+}
+
+// ----------------------------------------------------------------------------
+// TEST CODE BELOW
+// ----------------------------------------------------------------------------
+
+int testSim()
+{
+	int errors = 0;
+	sim_result r;
+	sim_config config = {false, {0x5B,0x7C,0x62,0xC4,0x91,0xC1,0x1B,0x39}, 2, 8, 2000, 0, 1};
+
+	prnlog("[+] Testing authentication simulator...");
+	if(simRun(&config, &r) || r.auths != 2000 || r.stage[SIM_STAGE_TOTAL].count != 2000)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: standard key simulation");
+		errors++;
+	}
+	config.elite = true;
+	config.auths = 300;
+	if(simRun(&config, &r) || r.auths != 300)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: elite key simulation");
+		errors++;
+	}
+	// 200 authentications at 20000/s can't take less than 10ms
+	config.elite = false;
+	config.auths = 200;
+	config.rate = 20000;
+	if(simRun(&config, &r) || r.seconds < 0.0095)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: rate limit, %.4f seconds", r.seconds);
+		errors++;
+	}
+
+	// A card personalized with another key must fail
+	{
+		sim_reader reader;
+		sim_card card;
+		sim_histogram stage[SIM_STAGES];
+		uint8_t wrong[8] = {1,2,3,4,5,6,7,8};
+		memset(stage, 0, sizeof(stage));
+		memset(&card, 0, sizeof(card));
+		simReaderInit(&reader, &config, NULL, 1);
+		tagCardInit(&card.tag, wrong);
+		if(simAuthenticate(&reader, &card, stage) != 1 || stage[SIM_STAGE_TOTAL].count != 1)
+		{
+			logmsg(LOG_LEVEL_ERROR, "[+] FAILED: authentication with the wrong key succeeded");
+			errors++;
+		}
+		tagCardDestroy(&card.tag);
+	}
+
+	// Percentiles are interpolated within their bucket, and never above the maximum
+	{
+		sim_histogram h;
+		memset(&h, 0, sizeof(h));
+		simRecord(&h, 1000);	// bucket 9, [512, 1024)
+		simRecord(&h, 1500);	// bucket 10, [1024, 2048)
+		simRecord(&h, 1500);
+		simRecord(&h, 70000);	// bucket 16, [65536, 131072)
+		uint64_t p50 = simPercentile(&h, 0.5), p99 = simPercentile(&h, 0.99);
+		if(p50 != 1536 || p99 > h.max_ns || p99 < 65536 || p50 > p99 || h.max_ns != 70000)
+		{
+			logmsg(LOG_LEVEL_ERROR, "[+] FAILED: histogram percentiles");
+			errors++;
+		}
+	}
+
+	if(errors == 0)
+		prnlog("[+] Simulator ok");
+	return errors;
+}
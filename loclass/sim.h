@@ -0,0 +1,116 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#ifndef SIM_H
+#define SIM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * In-process simulation of iClass authentications, as load for a backend without any
+ * hardware. A virtual card has a CSN, an e-purse CC and its diversified key, and answers
+ * through the tag response engine (tag_engine.h). A virtual reader knows the master key,
+ * derives the card key from the CSN (standard or elite keytable), sends an NR with its
+ * reader MAC and checks the tag MAC that comes back.
+ *
+ * Each thread is a reader with its own share of the cards, so a card never talks to
+ * two readers at once. Every stage is timed into a log2 histogram.
+ */
+enum {
+	SIM_STAGE_KEY,				// reader: diversified key from the CSN
+	SIM_STAGE_READER_MAC,		// reader: NR and reader MAC
+	SIM_STAGE_CARD,				// card: verify reader MAC, tag MAC
+	SIM_STAGE_VERIFY,			// reader: verify tag MAC
+	SIM_STAGE_TOTAL,			// the whole authentication
+	SIM_STAGES
+};
+
+/**
+ * Bucket i counts latencies in [2^i, 2^(i+1)) nanoseconds
+ */
+#define SIM_BUCKETS 32
+
+typedef struct {
+	uint64_t count;
+	uint64_t sum_ns;
+	uint64_t max_ns;
+	uint64_t buckets[SIM_BUCKETS];
+} sim_histogram;
+
+typedef struct {
+	bool elite;					// key is K_cus (iclass format), as for audit_config
+	uint8_t key[8];				// standard: master key on NIST format. elite: K_cus on iclass format
+	int threads;				// readers, 0 = one per core
+	int cards;
+	uint64_t auths;				// authentications in total
+	double rate;				// authentications per second over all readers, 0 = unlimited
+	uint64_t seed;
+} sim_config;
+
+typedef struct {
+	uint64_t auths;
+	uint64_t failed;			// reader or tag MAC did not verify
+	double seconds;
+	sim_histogram stage[SIM_STAGES];
+} sim_result;
+
+/**
+ * @brief Runs the simulation and prints throughput and per-stage latencies
+ * @param config
+ * @param result where to store the numbers, may be NULL
+ * @return 0 for ok, 1 if an authentication failed or the setup did
+ */
+int simRun(const sim_config *config, sim_result *result);
+/**
+ * @brief The latency at or below which a fraction p of the histogram lies, interpolated
+ * within its bucket and at most the largest latency seen
+ * @return nanoseconds
+ */
+uint64_t simPercentile(const sim_histogram *h, double p);
+
+int testSim();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SIM_H
@@ -0,0 +1,312 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include "optimized_cipher.h"
+#include "cipher.h"
+#include "cipherutils.h"
+#include "fileutils.h"
+#include "threadpool.h"
+#include "tag_engine.h"
+
+void tagCardInit(tag_card *card, const uint8_t div_key[8])
+{
+	memset(card, 0, sizeof(tag_card));
+	memcpy(card->div_key, div_key, 8);
+	pthread_mutex_init(&card->lock, NULL);
+}
+
+void tagCardDestroy(tag_card *card)
+{
+	pthread_mutex_destroy(&card->lock);
+}
+
+static int tagCacheFind(const tag_card *card, const uint8_t cc[8])
+{
+	int i;
+	for(i = 0 ; i < TAG_CACHE_WAYS ; i++)
+		if(card->cache[i].used && memcmp(card->cache[i].cc, cc, 8) == 0)
+			return i;
+	return -1;
+}
+
+void tagRespond(tag_card *card, const uint8_t cc[8], const uint8_t nr[4], uint8_t mac[4])
+{
+	uint8_t cc_p[8], nr_p[4];
+	State state;
+	int i;
+
+	memcpy(cc_p, cc, 8);
+	memcpy(nr_p, nr, 4);
+
+	pthread_mutex_lock(&card->lock);
+	i = tagCacheFind(card, cc);
+	if(i >= 0)
+	{
+		state = card->cache[i].state;
+		card->cache[i].used = ++card->clock;
+		card->hits++;
+	}
+	pthread_mutex_unlock(&card->lock);
+
+	if(i < 0)
+	{
+		// Not under the lock, other CCs of this card can be answered meanwhile
+		state = opt_doTagMAC_1(cc_p, card->div_key);
+
+		pthread_mutex_lock(&card->lock);
+		card->misses++;
+		// Another thread may have added it by now
+		if(tagCacheFind(card, cc) < 0)
+		{
+			int victim = 0;
+			for(i = 1 ; i < TAG_CACHE_WAYS ; i++)
+				if(card->cache[i].used < card->cache[victim].used)
+					victim = i;
+			memcpy(card->cache[victim].cc, cc, 8);
+			card->cache[victim].state = state;
+			card->cache[victim].used = ++card->clock;
+		}
+		pthread_mutex_unlock(&card->lock);
+	}
+	opt_doTagMAC_2(state, nr_p, mac, card->div_key);
+}
+
+typedef struct {
+	const tag_bench_config *config;
+	tag_card *cards;
+	uint64_t first, count;
+	uint32_t *latency;			// nanoseconds, one per request
+} tag_bench_task;
+
+static void tagBenchWorker(void *arg)
+{
+	tag_bench_task *task = (tag_bench_task*) arg;
+	const tag_bench_config *config = task->config;
+	uint64_t rnd = config->seed ^ (task->first * 0xD6E8FEB86659FD93ULL);
+	uint8_t cc[8], nr[4], mac[4];
+	struct timespec t1, t2;
+	uint64_t n;
+
+	for(n = 0 ; n < task->count ; n++)
+	{
+		uint64_t r = splitmix64(&rnd);
+		int card = (r >> 32) % config->cards;
+		// CC number c of card k is fixed, so CCs come back and hit the cache
+		uint64_t c = ((uint64_t) card << 32) | ((r >> 16) & 0xFFFF) % config->ccs;
+		memcpy(cc, &c, 8);
+		memcpy(nr, &r, 4);
+
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		tagRespond(&task->cards[card], cc, nr, mac);
+		clock_gettime(CLOCK_MONOTONIC, &t2);
+
+		uint64_t ns = (t2.tv_sec - t1.tv_sec) * 1000000000ULL + t2.tv_nsec - t1.tv_nsec;
+		task->latency[task->first + n] = ns > UINT32_MAX ? UINT32_MAX : ns;
+	}
+}
+
+static int compareLatency(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t*) a, y = *(const uint32_t*) b;
+	return x < y ? -1 : x > y;
+}
+
+static double percentile(const uint32_t *sorted, uint64_t n, double p)
+{
+	uint64_t i = (uint64_t) (p * (n - 1));
+	return sorted[i] / 1000.0;
+}
+
+int tagBench(const tag_bench_config *config, tag_bench_result *result)
+{
+	tag_bench_result r;
+	struct timespec t1, t2;
+	uint64_t hits = 0, misses = 0;
+	int threads = config->threads ? config->threads : numberOfCores();
+	int i;
+
+	if(config->cards < 1 || config->ccs < 1 || config->requests < 1)
+	{
+		prnlog("Tag bench needs at least one card, CC and request");
+		return 1;
+	}
+
+	tag_card *cards = malloc(config->cards * sizeof(tag_card));
+	uint32_t *latency = malloc(config->requests * sizeof(uint32_t));
+	tag_bench_task *tasks = calloc(threads, sizeof(tag_bench_task));
+	threadpool *pool = threadpool_create(threads);
+	if(!cards || !latency || !tasks || !pool)
+	{
+		logmsg(LOG_LEVEL_ERROR, "Failed to set up the tag bench");
+		free(cards); free(latency); free(tasks);
+		if(pool) threadpool_destroy(pool);
+		return 1;
+	}
+
+	uint64_t rnd = config->seed;
+	for(i = 0 ; i < config->cards ; i++)
+	{
+		uint64_t k = splitmix64(&rnd);
+		tagCardInit(&cards[i], (uint8_t*) &k);
+	}
+
+	prnlog("[+] Answering %llu requests for %d cards (%d CCs each) on %d threads...",
+		   (unsigned long long) config->requests, config->cards, config->ccs, threads);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	for(i = 0 ; i < threads ; i++)
+	{
+		tasks[i].config = config;
+		tasks[i].cards = cards;
+		tasks[i].first = config->requests * i / threads;
+		tasks[i].count = config->requests * (i + 1) / threads - tasks[i].first;
+		tasks[i].latency = latency;
+		if(threadpool_submit(pool, tagBenchWorker, &tasks[i]))
+		{
+			logmsg(LOG_LEVEL_ERROR, "Failed to queue tag bench work");
+			break;
+		}
+	}
+	// Workers already queued use the cards, so wait for them either way
+	threadpool_wait(pool);
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	threadpool_destroy(pool);
+	if(i < threads)
+	{
+		for(i = 0 ; i < config->cards ; i++)
+			tagCardDestroy(&cards[i]);
+		free(cards); free(latency); free(tasks);
+		return 1;
+	}
+
+	for(i = 0 ; i < config->cards ; i++)
+	{
+		hits += cards[i].hits;
+		misses += cards[i].misses;
+		tagCardDestroy(&cards[i]);
+	}
+
+	qsort(latency, config->requests, sizeof(uint32_t), compareLatency);
+	r.requests = config->requests;
+	r.hit_rate = (double) hits / (hits + misses);
+	r.seconds = (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / 1e9;
+	r.p50 = percentile(latency, r.requests, 0.50);
+	r.p99 = percentile(latency, r.requests, 0.99);
+	r.p999 = percentile(latency, r.requests, 0.999);
+	r.max = latency[r.requests - 1] / 1000.0;
+
+	prnlog("Responses/s     : %.0f", r.requests / r.seconds);
+	prnlog("Cache hit rate  : %.1f%%", 100 * r.hit_rate);
+	prnlog("Latency (us)    : p50 %.2f  p99 %.2f  p99.9 %.2f  max %.2f", r.p50, r.p99, r.p999, r.max);
+	prnlog("Response window : %.1f us, p99 is %s", TAG_RESPONSE_WINDOW_US,
+		   r.p99 < TAG_RESPONSE_WINDOW_US ? "within it" : "OUTSIDE it");
+
+	free(cards);
+	free(latency);
+	free(tasks);
+	if(result) *result = r;
+	return r.p99 < TAG_RESPONSE_WINDOW_US ? 0 : 1;
+}
+
+// ----------------------------------------------------------------------------
+// TEST CODE BELOW
+// ----------------------------------------------------------------------------
+
+int testTagEngine()
+{
+	int errors = 0;
+	uint64_t rnd = 1;
+	uint8_t key[8], ccs[TAG_CACHE_WAYS + 2][8], cc_nr[12], nr[4], expected[4], mac[4];
+	tag_card card;
+	int i, n;
+
+	prnlog("[+] Testing tag response engine...");
+	for(i = 0 ; i < 8 ; i++) key[i] = splitmix64(&rnd);
+	for(i = 0 ; i < TAG_CACHE_WAYS + 2 ; i++)
+	{
+		uint64_t c = splitmix64(&rnd);
+		memcpy(ccs[i], &c, 8);
+	}
+	tagCardInit(&card, key);
+
+	// More CCs than ways, so entries get evicted and recomputed
+	for(n = 0 ; n < 300 ; n++)
+	{
+		uint64_t r = splitmix64(&rnd);
+		memcpy(nr, &r, 4);
+		i = (r >> 32) % (TAG_CACHE_WAYS + 2);
+		memcpy(cc_nr, ccs[i], 8);
+		memcpy(cc_nr + 8, nr, 4);
+		opt_doTagMAC(cc_nr, key, expected);
+		tagRespond(&card, ccs[i], nr, mac);
+		if(memcmp(mac, expected, 4) != 0)
+		{
+			logmsg(LOG_LEVEL_ERROR, "[+] FAILED: cached tag MAC differs from opt_doTagMAC");
+			printvar("cc_nr", cc_nr, 12);
+			errors++;
+			break;
+		}
+	}
+	if(card.hits == 0 || card.misses <= TAG_CACHE_WAYS + 2)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: expected both hits and evictions, got %llu hits, %llu misses",
+			   (unsigned long long) card.hits, (unsigned long long) card.misses);
+		errors++;
+	}
+
+	// Within the ways, only the first request of each CC misses
+	tagCardDestroy(&card);
+	tagCardInit(&card, key);
+	for(n = 0 ; n < 100 ; n++)
+		tagRespond(&card, ccs[n % TAG_CACHE_WAYS], nr, mac);
+	if(card.misses != TAG_CACHE_WAYS || card.hits != 100 - TAG_CACHE_WAYS)
+	{
+		logmsg(LOG_LEVEL_ERROR, "[+] FAILED: %llu misses for %d CCs", (unsigned long long) card.misses, TAG_CACHE_WAYS);
+		errors++;
+	}
+	tagCardDestroy(&card);
+
+	if(errors == 0)
+		prnlog("[+] Tag response engine ok");
+	return errors;
+}
@@ -0,0 +1,126 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#ifndef TAG_ENGINE_H
+#define TAG_ENGINE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <pthread.h>
+#include "optimized_cipher.h"
+
+/**
+ * Tag responses for card emulation. The tag MAC is MAC(key, CC * NR * 32x0), and a
+ * reader usually sends several NRs for the same CC, so the cipher state after the
+ * CC (opt_doTagMAC_1) is kept per card, for the last TAG_CACHE_WAYS CCs. A response
+ * is then only opt_doTagMAC_2 over the NR.
+ *
+ * A card may be answered from several threads at once.
+ */
+#define TAG_CACHE_WAYS 4
+/**
+ * Time a tag has to answer, ISO 15693 t1 = 4352/fc (13.56 MHz), in microseconds
+ */
+#define TAG_RESPONSE_WINDOW_US 320.9
+
+typedef struct {
+	uint8_t cc[8];
+	State state;
+	uint32_t used;				// last use, 0 = empty
+} tag_cache_entry;
+
+typedef struct {
+	uint8_t div_key[8];
+	tag_cache_entry cache[TAG_CACHE_WAYS];
+	uint32_t clock;
+	uint64_t hits;
+	uint64_t misses;
+	pthread_mutex_t lock;
+} tag_card;
+
+typedef struct {
+	int threads;				// 0 = one per core
+	int cards;
+	int ccs;					// CCs in use per card
+	uint64_t requests;
+	uint64_t seed;
+} tag_bench_config;
+
+typedef struct {
+	uint64_t requests;
+	double hit_rate;
+	double seconds;
+	double p50, p99, p999, max;	// response latency in microseconds
+} tag_bench_result;
+
+/**
+ * @brief Sets up an emulated card with an empty cache
+ * @param card
+ * @param div_key the diversified key of the card
+ */
+void tagCardInit(tag_card *card, const uint8_t div_key[8]);
+/**
+ * @brief Frees what tagCardInit set up
+ */
+void tagCardDestroy(tag_card *card);
+/**
+ * @brief The tag MAC for CC and NR, the same as opt_doTagMAC on cc * nr
+ * @param card
+ * @param cc the card challenge, 8 bytes
+ * @param nr the reader challenge, 4 bytes
+ * @param mac where to store the MAC
+ */
+void tagRespond(tag_card *card, const uint8_t cc[8], const uint8_t nr[4], uint8_t mac[4]);
+/**
+ * @brief Latency benchmark: config->threads threads answer random NRs for random
+ * cards, each card seeing config->ccs different CCs, and time every response.
+ * @param config
+ * @param result where to store the percentiles, may be NULL
+ * @return 0 if p99 is within TAG_RESPONSE_WINDOW_US, 1 otherwise
+ */
+int tagBench(const tag_bench_config *config, tag_bench_result *result);
+
+int testTagEngine();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TAG_ENGINE_H
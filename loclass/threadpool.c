@@ -0,0 +1,176 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "threadpool.h"
+
+typedef struct tp_job {
+	threadpool_task fn;
+	void *arg;
+	struct tp_job *next;
+} tp_job;
+
+struct threadpool {
+	pthread_mutex_t lock;
+	pthread_cond_t has_work;
+	pthread_cond_t all_done;
+	tp_job *head;
+	tp_job *tail;
+	int pending;	// queued + running
+	int stop;
+	int nthreads;
+	pthread_t *threads;
+};
+
+int numberOfCores(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int) n : 1;
+}
+
+static void* tp_worker(void *p)
+{
+	threadpool *pool = (threadpool*) p;
+	for(;;)
+	{
+		pthread_mutex_lock(&pool->lock);
+		while(pool->head == NULL && !pool->stop)
+			pthread_cond_wait(&pool->has_work, &pool->lock);
+		if(pool->head == NULL)
+		{
+			pthread_mutex_unlock(&pool->lock);
+			return NULL;
+		}
+		tp_job *job = pool->head;
+		pool->head = job->next;
+		if(pool->head == NULL) pool->tail = NULL;
+		pthread_mutex_unlock(&pool->lock);
+
+		job->fn(job->arg);
+		free(job);
+
+		pthread_mutex_lock(&pool->lock);
+		if(--pool->pending == 0)
+			pthread_cond_broadcast(&pool->all_done);
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+threadpool* threadpool_create(int nthreads)
+{
+	if(nthreads <= 0) nthreads = numberOfCores();
+
+	threadpool *pool = calloc(1, sizeof(threadpool));
+	if(pool == NULL) return NULL;
+	pool->threads = calloc(nthreads, sizeof(pthread_t));
+	if(pool->threads == NULL)
+	{
+		free(pool);
+		return NULL;
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->has_work, NULL);
+	pthread_cond_init(&pool->all_done, NULL);
+
+	int i;
+	for(i = 0 ; i < nthreads ; i++)
+	{
+		if(pthread_create(&pool->threads[i], NULL, tp_worker, pool) != 0)
+			break;
+	}
+	pool->nthreads = i;
+	if(i == 0)
+	{
+		threadpool_destroy(pool);
+		return NULL;
+	}
+	return pool;
+}
+
+int threadpool_submit(threadpool *pool, threadpool_task fn, void *arg)
+{
+	tp_job *job = malloc(sizeof(tp_job));
+	if(job == NULL) return 1;
+	job->fn = fn;
+	job->arg = arg;
+	job->next = NULL;
+
+	pthread_mutex_lock(&pool->lock);
+	if(pool->tail) pool->tail->next = job;
+	else pool->head = job;
+	pool->tail = job;
+	pool->pending++;
+	pthread_cond_signal(&pool->has_work);
+	pthread_mutex_unlock(&pool->lock);
+	return 0;
+}
+
+void threadpool_wait(threadpool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	while(pool->pending > 0)
+		pthread_cond_wait(&pool->all_done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void threadpool_destroy(threadpool *pool)
+{
+	if(pool == NULL) return;
+	threadpool_wait(pool);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->has_work);
+	pthread_mutex_unlock(&pool->lock);
+
+	int i;
+	for(i = 0 ; i < pool->nthreads ; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->has_work);
+	pthread_cond_destroy(&pool->all_done);
+	free(pool->threads);
+	free(pool);
+}
+
+int threadpool_size(threadpool *pool)
+{
+	return pool->nthreads;
+}
@@ -0,0 +1,86 @@
+/*****************************************************************************
+ * WARNING
+ *
+ * THIS CODE IS CREATED FOR EXPERIMENTATION AND EDUCATIONAL USE ONLY. 
+ * 
+ * USAGE OF THIS CODE IN OTHER WAYS MAY INFRINGE UPON THE INTELLECTUAL 
+ * PROPERTY OF OTHER PARTIES, SUCH AS INSIDE SECURE AND HID GLOBAL, 
+ * AND MAY EXPOSE YOU TO AN INFRINGEMENT ACTION FROM THOSE PARTIES. 
+ * 
+ * THIS CODE SHOULD NEVER BE USED TO INFRINGE PATENTS OR INTELLECTUAL PROPERTY RIGHTS. 
+ *
+ *****************************************************************************
+ *
+ * This file is part of loclass. It is a reconstructon of the cipher engine
+ * used in iClass, and RFID techology.
+ *
+ * The implementation is based on the work performed by
+ * Flavio D. Garcia, Gerhard de Koning Gans, Roel Verdult and
+ * Milosch Meriac in the paper "Dismantling IClass".
+ *
+ * Copyright (C) 2014 Martin Holst Swende
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation, or, at your option, any later version. 
+ *
+ * This file is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with loclass.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * 
+ ****************************************************************************/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A minimal fixed-size worker pool. Tasks are plain function pointers with one
+ * argument, executed in submission order by whichever worker is free. Used by the
+ * bulk paths (audit, scanners) so that they don't have to manage pthreads themselves.
+ */
+typedef void (*threadpool_task)(void *arg);
+
+typedef struct threadpool threadpool;
+
+/**
+ * @brief Creates a pool with the given number of worker threads
+ * @param nthreads number of workers, 0 means one per online core
+ * @return the pool, or NULL on failure
+ */
+threadpool* threadpool_create(int nthreads);
+/**
+ * @brief Queues a task. Never blocks.
+ * @return 0 for ok, 1 for failz
+ */
+int threadpool_submit(threadpool *pool, threadpool_task fn, void *arg);
+/**
+ * @brief Blocks until every task submitted so far has finished
+ */
+void threadpool_wait(threadpool *pool);
+/**
+ * @brief Waits for all queued tasks, then stops and frees the workers
+ */
+void threadpool_destroy(threadpool *pool);
+/**
+ * @return the number of workers in the pool
+ */
+int threadpool_size(threadpool *pool);
+/**
+ * @return the number of online cores, at least 1
+ */
+int numberOfCores(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // THREADPOOL_H